@@ -0,0 +1,219 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/http/response_parser.hh>
+#include <nil/actor/core/future.hh>
+#include <nil/actor/core/gate.hh>
+#include <nil/actor/core/iostream.hh>
+#include <nil/actor/core/semaphore.hh>
+#include <nil/actor/core/shared_ptr.hh>
+#include <nil/actor/core/sstring.hh>
+#include <nil/actor/core/timer.hh>
+#include <nil/actor/core/metrics_registration.hh>
+#include <nil/actor/network/api.hh>
+#include <nil/actor/network/socket_defs.hh>
+#include <nil/actor/network/tls.hh>
+#include <nil/actor/detail/noncopyable_function.hh>
+#include <nil/actor/detail/std-compat.hh>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace nil {
+    namespace actor {
+
+        namespace http {
+
+            class client;
+            class host_pool;
+            class client_connection;
+
+            /// Where the requests of one connection pool go.
+            struct endpoint {
+                socket_address addr;
+                /// Sent in the Host header, and used as the TLS server name
+                sstring host;
+                /// Connect with tls::connect() and the credentials of the client
+                bool tls = false;
+            };
+
+            struct request {
+                sstring method = "GET";
+                sstring url = "/";
+                std::unordered_map<sstring, sstring> headers;
+                sstring content;
+                /// Streams the body instead of sending \c content. The writer owns the
+                /// stream and must close it. The body is sent with the chunked transfer
+                /// encoding unless \c content_length is set.
+                noncopyable_function<future<>(output_stream<char> &&)> body_writer;
+                std::optional<size_t> content_length;
+
+                request() = default;
+                request(sstring method, sstring url, sstring content = {}) :
+                    method(std::move(method)), url(std::move(url)), content(std::move(content)) {
+                }
+                request &add_header(const sstring &h, const sstring &value) {
+                    headers[h] = value;
+                    return *this;
+                }
+                /// Safe to send again if the connection fails: the method is idempotent
+                /// and the body is not streamed.
+                bool retryable() const;
+            };
+
+            class response {
+                std::unique_ptr<http_response> _rsp;
+                input_stream<char> _body;
+                // a slot of client_options::max_concurrent_requests, held until the
+                // response is dropped
+                std::optional<semaphore_units<>> _permit;
+
+                friend class client;
+
+            public:
+                response(std::unique_ptr<http_response> rsp, input_stream<char> body) :
+                    _rsp(std::move(rsp)), _body(std::move(body)) {
+                }
+                int status() const {
+                    return _rsp->_status;
+                }
+                const sstring &version() const {
+                    return _rsp->_version;
+                }
+                const std::unordered_map<sstring, sstring> &headers() const {
+                    return _rsp->_headers;
+                }
+                /// Case-insensitive header lookup, empty if missing
+                sstring get_header(const sstring &name) const;
+                /// The response body, ending where the response does.
+                ///
+                /// The connection serves the next response only once the body is read to
+                /// its end; a response dropped before that closes the connection.
+                input_stream<char> &body() {
+                    return _body;
+                }
+                /// Reads the whole body
+                future<sstring> read_body();
+            };
+
+            struct client_options {
+                /// Connections opened to one endpoint at most
+                size_t max_connections_per_host = 16;
+                /// Requests written to a connection before its first response is read.
+                /// Only idempotent requests without a streamed body are pipelined.
+                size_t max_pipeline_depth = 1;
+                /// Requests in progress at most, until their response bodies are read
+                size_t max_concurrent_requests = 1024;
+                std::chrono::milliseconds connect_timeout {5000};
+                /// From sending the request until the response headers are received
+                std::chrono::milliseconds request_timeout {30000};
+                /// Idle connections are closed after that long
+                std::chrono::milliseconds idle_timeout {60000};
+                /// Times a retryable request is sent again after a connection failure
+                unsigned max_retries = 1;
+                /// For endpoints with tls set
+                shared_ptr<tls::certificate_credentials> credentials;
+                /// Label of the client metrics
+                sstring name = "http-client";
+            };
+
+            class client_error : public std::runtime_error {
+            public:
+                using std::runtime_error::runtime_error;
+            };
+
+            class request_timeout_error : public client_error {
+            public:
+                request_timeout_error() : client_error("http request timed out") {
+                }
+            };
+
+            /// Shard-local HTTP/1.1 client keeping connections alive in per-endpoint pools.
+            ///
+            /// Use case example, using actor threads for clarity:
+            ///
+            ///    http::client c;
+            ///    http::endpoint ep {ipv4_addr("10.0.0.1", 80), "backend"};
+            ///    auto rsp = c.make_request(ep, http::request("GET", "/items")).get0();
+            ///    auto body = rsp.read_body().get0();
+            ///    c.close().get();
+            class client {
+                client_options _opts;
+                std::unordered_map<sstring, std::unique_ptr<host_pool>> _pools;
+                semaphore _concurrency;
+                gate _gate;
+                timer<> _idle_timer;
+                metrics::metric_groups _metrics;
+
+                struct stats {
+                    uint64_t requests = 0;
+                    uint64_t responses = 0;
+                    uint64_t errors = 0;
+                    uint64_t retries = 0;
+                    uint64_t timeouts = 0;
+                    uint64_t connects = 0;
+                    uint64_t connect_errors = 0;
+                    uint64_t pool_hits = 0;
+                    uint64_t pool_misses = 0;
+                    uint64_t latency_us = 0;
+                    uint64_t connections = 0;
+                } _stats;
+
+                host_pool &pool_for(const endpoint &ep);
+                future<response> do_request(host_pool &pool, lw_shared_ptr<request> req, semaphore_units<> permit,
+                                            unsigned attempt);
+                void expire_idle();
+
+                friend class host_pool;
+                friend class client_connection;
+
+            public:
+                explicit client(client_options opts = client_options());
+                ~client();
+
+                /// Sends \c req and resolves once the response headers are received;
+                /// the body is streamed from response::body().
+                future<response> make_request(const endpoint &ep, request req);
+
+                /// Waits for the requests in progress and for their response bodies to be
+                /// closed or dropped, then closes every connection.
+                future<> close();
+
+                const client_options &options() const {
+                    return _opts;
+                }
+                size_t connections() const {
+                    return _stats.connections;
+                }
+            };
+
+        }    // namespace http
+
+    }    // namespace actor
+}    // namespace nil
@@ -34,6 +34,7 @@ namespace nil {
 
         struct http_response {
             sstring _version;
+            int _status = 0;
             std::unordered_map<sstring, sstring> _headers;
         };
 
@@ -276,27 +277,48 @@ namespace nil {
                         goto _test_eof10;
                 st_case_10:
                     if (48 <= ((*(p))) && ((*(p))) <= 57) {
-                        goto _st11;
+                        goto _ctr_status11;
                     }
                     { goto _st0; }
+                _ctr_status11 : {
+#line 28 "src/http/response_parser.rl"
+
+                    _rsp->_status = _rsp->_status * 10 + ((*(p)) - '0');
+                }
+
+                    goto _st11;
                 _st11:
                     p += 1;
                     if (p == pe)
                         goto _test_eof11;
                 st_case_11:
                     if (48 <= ((*(p))) && ((*(p))) <= 57) {
-                        goto _st12;
+                        goto _ctr_status12;
                     }
                     { goto _st0; }
+                _ctr_status12 : {
+#line 28 "src/http/response_parser.rl"
+
+                    _rsp->_status = _rsp->_status * 10 + ((*(p)) - '0');
+                }
+
+                    goto _st12;
                 _st12:
                     p += 1;
                     if (p == pe)
                         goto _test_eof12;
                 st_case_12:
                     if (48 <= ((*(p))) && ((*(p))) <= 57) {
-                        goto _st13;
+                        goto _ctr_status13;
                     }
                     { goto _st0; }
+                _ctr_status13 : {
+#line 28 "src/http/response_parser.rl"
+
+                    _rsp->_status = _rsp->_status * 10 + ((*(p)) - '0');
+                }
+
+                    goto _st13;
                 _st13:
                     p += 1;
                     if (p == pe)
@@ -1316,6 +1338,9 @@ namespace nil {
             bool eof() const {
                 return _state == state::eof;
             }
+            bool failed() const {
+                return _state == state::error;
+            }
         };
 
     }    // namespace actor
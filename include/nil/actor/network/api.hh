@@ -35,6 +35,7 @@
 #include <nil/actor/core/temporary_buffer.hh>
 #include <nil/actor/core/iostream.hh>
 #include <nil/actor/detail/std-compat.hh>
+#include <nil/actor/detail/noncopyable_function.hh>
 #include <nil/actor/core/detail/api-level.hh>
 #include <sys/types.h>
 
@@ -76,6 +77,7 @@ namespace nil {
 
             /// \cond internal
             class connected_socket_impl;
+            class packet_source_impl;
             class socket_impl;
 
             class server_socket_impl;
@@ -83,6 +85,8 @@ namespace nil {
             class get_impl;
             /// \endcond
 
+            class connection_balancing_policy;
+
             class udp_datagram_impl {
             public:
                 virtual ~udp_datagram_impl() {};
@@ -168,6 +172,71 @@ namespace nil {
             unsigned max_buffer_size = 128 * 1024;
         };
 
+        /// Reads the data received on a connection as it was received.
+        ///
+        /// Unlike \ref input_stream, which hands out the buffers the stack received
+        /// and copies them into new ones whenever a read spans two of them, a
+        /// \c stream_receiver lets the caller look at a header first and then
+        /// decide where the data following it goes: into memory the caller owns,
+        /// copied once out of the received packets, or into a buffer sharing them.
+        /// Obtained with connected_socket::receiver(); it must not be mixed with
+        /// the input stream of the same connection.
+        class stream_receiver {
+            std::unique_ptr<net::packet_source_impl> _src;
+            // Received and not consumed yet
+            net::packet _buf;
+            bool _eof = false;
+
+        private:
+            future<> receive();
+            future<> fill(size_t size);
+            // The first size bytes, which must be in the first fragment
+            temporary_buffer<char> front(size_t size);
+            void consume_into(char *dst, size_t size);
+
+        public:
+            /// \cond internal
+            explicit stream_receiver(std::unique_ptr<net::packet_source_impl> src) noexcept;
+            /// \endcond
+            stream_receiver(stream_receiver &&) noexcept;
+            stream_receiver &operator=(stream_receiver &&) noexcept;
+            ~stream_receiver();
+
+            /// Returns the next \c size bytes without consuming them.
+            ///
+            /// The buffer shares the received packet when the bytes are in one of its
+            /// fragments. It is shorter than \c size if the stream ends earlier.
+            future<temporary_buffer<char>> peek(size_t size);
+            /// Consumes and returns the next \c size bytes, shorter at the end of the stream.
+            ///
+            /// No copy is made when the bytes are in a single received fragment.
+            future<temporary_buffer<char>> read_exactly(size_t size);
+            /// Consumes the next \c size bytes into \c dst, copying them straight out
+            /// of the received packets.
+            ///
+            /// \return the number of bytes stored, less than \c size only at the end
+            ///         of the stream
+            future<size_t> read_into(char *dst, size_t size);
+            /// Consumes the next \c size bytes into memory obtained from \c provider,
+            /// which is only called when they are not in a single received fragment.
+            /// A buffer from \c provider shorter than requested fails the read with
+            /// \c std::invalid_argument, and nothing is consumed.
+            ///
+            /// \return the bytes, shorter than \c size only at the end of the stream
+            future<temporary_buffer<char>> read_into(size_t size,
+                                                     noncopyable_function<temporary_buffer<char>(size_t)> provider);
+            /// Consumes and returns whatever has been received, waiting for data if
+            /// nothing was. An empty buffer means the end of the stream.
+            future<temporary_buffer<char>> read();
+            /// Drops the next \c size bytes.
+            future<> skip(size_t size);
+            /// Whether the stream has ended and every byte has been consumed
+            bool eof() const noexcept {
+                return _eof && !_buf.len();
+            }
+            future<> close();
+        };
+
         /// A TCP (or other stream-based protocol) connection.
         ///
         /// A \c connected_socket represents a full-duplex stream between
@@ -194,6 +263,11 @@ namespace nil {
             ///
             /// Gets an object returning data sent from the remote endpoint.
             input_stream<char> input(connected_socket_input_stream_config csisc = {});
+            /// Gets a receiver of the incoming data, instead of the input stream.
+            ///
+            /// See \ref stream_receiver. The native stack hands it the received packets
+            /// as they are, other stacks the buffers of their input data source.
+            stream_receiver receiver();
             /// Gets the output stream.
             ///
             /// Gets an object that sends data to the remote endpoint.
@@ -205,6 +279,15 @@ namespace nil {
             ///
             /// \return whether the nodelay option is enabled or not
             bool get_nodelay() const;
+            /// Sizes the next read of the input stream after the bytes the reader knows it needs.
+            ///
+            /// A frame parser that decoded a header can ask for the rest of the frame in one
+            /// read instead of in reads sized after the previous ones. The size is kept within
+            /// the limits of the \ref connected_socket_input_stream_config of the stream, and
+            /// is only a hint: stacks that do not read into buffers of their own ignore it.
+            ///
+            /// \param size the bytes wanted, 0 to go back to the adaptive sizing
+            void set_read_size_hint(size_t size);
             /// Sets SO_KEEPALIVE option (enable keepalive timer on a socket)
             void set_keepalive(bool keepalive);
             /// Gets O_KEEPALIVE option
@@ -307,6 +390,10 @@ namespace nil {
                 port,
                 // This algorithm distributes all new connections to listen_options::fixed_cpu shard only.
                 fixed,
+                // This algorithm sends new connections to the shard picked by listen_options::balancing_policy,
+                // by default the one carrying the smallest share of connections, traffic and request rate.
+                // All connections are accepted by a single shard, so SO_REUSEPORT is not used.
+                activity,
                 default_ = connection_distribution
             };
             /// Constructs a \c server_socket not corresponding to a connection
@@ -351,6 +438,11 @@ namespace nil {
                 lba = server_socket::load_balancing_algorithm::fixed;
                 fixed_cpu = cpu;
             }
+            std::shared_ptr<net::connection_balancing_policy> balancing_policy;
+            void set_balancing_policy(std::shared_ptr<net::connection_balancing_policy> policy) {
+                lba = server_socket::load_balancing_algorithm::activity;
+                balancing_policy = std::move(policy);
+            }
         };
 
         class network_interface {
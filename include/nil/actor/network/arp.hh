@@ -26,9 +26,15 @@
 
 #include <nil/actor/network/net.hh>
 #include <nil/actor/core/byteorder.hh>
+#include <nil/actor/core/lowres_clock.hh>
+#include <nil/actor/core/metrics.hh>
+#include <nil/actor/core/timer.hh>
 #include <nil/actor/network/ethernet.hh>
 
+#include <algorithm>
+#include <chrono>
 #include <unordered_map>
+#include <vector>
 
 namespace nil {
     namespace actor {
@@ -92,14 +98,355 @@ namespace nil {
                 friend class arp_for;
             };
 
+            class arp_error : public std::runtime_error {
+            public:
+                arp_error(const std::string &msg) : std::runtime_error(msg) {
+                }
+            };
+
+            class arp_timeout_error : public arp_error {
+            public:
+                arp_timeout_error() : arp_error("ARP timeout") {
+                }
+            };
+
+            class arp_queue_full_error : public arp_error {
+            public:
+                arp_queue_full_error() : arp_error("ARP waiter's queue is full") {
+                }
+            };
+
+            /// Lookups waiting for addresses to resolve, along with the requests sent
+            /// for them, on behalf of neighbor_cache.
+            template<typename L3Addr>
+            class neighbor_resolutions {
+            public:
+                using l2addr = ethernet_address;
+                using l3addr = L3Addr;
+                using clock_type = lowres_clock;
+
+            private:
+                struct resolution {
+                    circular_buffer<promise<l2addr>> _waiters;
+                    clock_type::time_point _next_request;
+                    unsigned _requests = 0;
+                };
+
+            private:
+                std::unordered_map<l3addr, resolution> _in_progress;
+                uint64_t _failures = 0;
+                uint64_t _queue_drops = 0;
+
+            public:
+                bool empty() const noexcept {
+                    return _in_progress.empty();
+                }
+                bool contains(const l3addr &addr) const {
+                    return _in_progress.count(addr);
+                }
+                uint64_t failures() const noexcept {
+                    return _failures;
+                }
+                uint64_t queue_drops() const noexcept {
+                    return _queue_drops;
+                }
+                /// Queues a lookup of \c addr, \c send_request is called if it is the
+                /// first one. Beyond \c max_queued waiters the oldest one is failed:
+                /// newer packets are more likely to still matter.
+                template<typename SendRequest>
+                future<l2addr> wait(const l3addr &addr, unsigned max_queued, clock_type::duration retransmit_time,
+                                    SendRequest &&send_request) {
+                    auto i = _in_progress.find(addr);
+                    if (i == _in_progress.end()) {
+                        i = _in_progress.emplace(addr, resolution()).first;
+                        i->second._requests = 1;
+                        i->second._next_request = clock_type::now() + retransmit_time;
+                        send_request(addr);
+                    }
+                    auto &res = i->second;
+                    if (res._waiters.size() >= std::max(max_queued, 1u)) {
+                        res._waiters.front().set_exception(arp_queue_full_error());
+                        res._waiters.pop_front();
+                        ++_queue_drops;
+                    }
+                    res._waiters.emplace_back();
+                    return res._waiters.back().get_future();
+                }
+                /// Hands \c hwaddr to everybody waiting for \c addr.
+                void resolve(const l3addr &addr, l2addr hwaddr) {
+                    auto i = _in_progress.find(addr);
+                    if (i != _in_progress.end()) {
+                        for (auto &&pr : i->second._waiters) {
+                            pr.set_value(hwaddr);
+                        }
+                        _in_progress.erase(i);
+                    }
+                }
+                /// Sends the requests that are due again and fails the lookups of
+                /// addresses that did not answer \c max_requests of them.
+                template<typename SendRequest>
+                void retransmit(clock_type::time_point now, unsigned max_requests, clock_type::duration retransmit_time,
+                                SendRequest &&send_request) {
+                    for (auto i = _in_progress.begin(); i != _in_progress.end();) {
+                        auto &res = i->second;
+                        if (now < res._next_request) {
+                            ++i;
+                            continue;
+                        }
+                        if (res._requests >= max_requests) {
+                            ++_failures;
+                            for (auto &w : res._waiters) {
+                                w.set_exception(arp_timeout_error());
+                            }
+                            i = _in_progress.erase(i);
+                            continue;
+                        }
+                        send_request(i->first);
+                        ++res._requests;
+                        res._next_request = now + retransmit_time;
+                        ++i;
+                    }
+                }
+            };
+
+            /// Tunables of a neighbor cache, for ARP and IPv6 neighbor discovery alike.
+            struct arp_cache_config {
+                /// How long a confirmed mapping is used without questioning it
+                std::chrono::milliseconds reachable_time = std::chrono::seconds(30);
+                /// Stale mappings nobody sent to for that long are forgotten
+                std::chrono::milliseconds gc_time = std::chrono::seconds(60);
+                /// Interval between requests while resolving or probing an address
+                std::chrono::milliseconds retransmit_time = std::chrono::seconds(1);
+                /// Requests sent before giving up on an address
+                unsigned max_probes = 3;
+                /// Lookups waiting for an address to resolve, the oldest one is dropped beyond that
+                unsigned max_queued = 64;
+            };
+
+            /// Known mappings and the resolutions in progress, aged after RFC 4861: a
+            /// reachable mapping was confirmed recently, a stale one is still used but
+            /// gets probed with a unicast request as soon as we send to it. Our own
+            /// addresses and broadcast are permanent. Mappings nobody sends to age out.
+            /// Shared by arp_for and the IPv6 neighbor discovery, which only differ in
+            /// how requests are put on the wire.
+            template<typename L3Addr>
+            class neighbor_cache {
+            public:
+                using l2addr = ethernet_address;
+                using l3addr = L3Addr;
+                using clock_type = lowres_clock;
+                /// Sends a request for \c addr to whoever owns it
+                using send_request_type = std::function<void(const l3addr &addr)>;
+                /// Sends a request for \c addr to \c hwaddr only, to confirm a known mapping
+                using send_probe_type = std::function<void(const l3addr &addr, l2addr hwaddr)>;
+
+                enum class state {
+                    permanent,
+                    reachable,
+                    stale,
+                    probe,
+                };
+                struct neighbor {
+                    l2addr hwaddr;
+                    state st;
+                    clock_type::time_point confirmed;
+                    clock_type::time_point used;
+                    clock_type::time_point next_probe;
+                    unsigned probes = 0;
+                };
+                struct stats {
+                    uint64_t hits = 0;
+                    uint64_t misses = 0;
+                    uint64_t requests = 0;
+                    uint64_t probes = 0;
+                    uint64_t failures = 0;
+                    uint64_t address_changes = 0;
+                };
+
+            private:
+                arp_cache_config _config;
+                std::unordered_map<l3addr, neighbor> _table;
+                neighbor_resolutions<l3addr> _in_progress;
+                // Drives retransmissions and the aging of the table while either
+                // has anything dynamic in it
+                timer<clock_type> _timer;
+                stats _stats;
+                send_request_type _send_request;
+                send_probe_type _send_probe;
+
+            private:
+                void send_request(const l3addr &addr) {
+                    ++_stats.requests;
+                    _send_request(addr);
+                }
+                void send_probe(const l3addr &addr, neighbor &n, clock_type::time_point now) {
+                    ++n.probes;
+                    n.next_probe = now + _config.retransmit_time;
+                    ++_stats.probes;
+                    _send_probe(addr, n.hwaddr);
+                }
+                void arm_timer() {
+                    if (!_timer.armed()) {
+                        _timer.arm_periodic(_config.retransmit_time);
+                    }
+                }
+                void on_timer();
+
+            public:
+                neighbor_cache(send_request_type send_request, send_probe_type send_probe) :
+                    _send_request(std::move(send_request)), _send_probe(std::move(send_probe)) {
+                    _timer.set_callback([this] { on_timer(); });
+                }
+                future<l2addr> lookup(const l3addr &addr);
+                /// Records that \c addr is at \c hwaddr, unless it is one of the permanent entries.
+                void learn(l2addr hwaddr, const l3addr &addr);
+                void set_permanent(const l3addr &addr, l2addr hwaddr) {
+                    _table[addr] = neighbor {hwaddr, state::permanent};
+                }
+                void erase(const l3addr &addr) {
+                    _table.erase(addr);
+                }
+                const neighbor *find(const l3addr &addr) const {
+                    auto i = _table.find(addr);
+                    return i != _table.end() ? &i->second : nullptr;
+                }
+                /// Whether a lookup of \c addr waits for an answer
+                bool resolving(const l3addr &addr) const {
+                    return _in_progress.contains(addr);
+                }
+                size_t size() const noexcept {
+                    return _table.size();
+                }
+                const stats &get_stats() const noexcept {
+                    return _stats;
+                }
+                uint64_t failures() const noexcept {
+                    return _stats.failures + _in_progress.failures();
+                }
+                uint64_t queue_drops() const noexcept {
+                    return _in_progress.queue_drops();
+                }
+                void set_config(const arp_cache_config &cfg) {
+                    _config = cfg;
+                    if (_timer.armed()) {
+                        _timer.rearm_periodic(_config.retransmit_time);
+                    }
+                }
+                const arp_cache_config &config() const noexcept {
+                    return _config;
+                }
+            };
+
+            template<typename L3Addr>
+            future<ethernet_address> neighbor_cache<L3Addr>::lookup(const l3addr &addr) {
+                auto i = _table.find(addr);
+                if (i != _table.end()) {
+                    auto &n = i->second;
+                    ++_stats.hits;
+                    if (n.st != state::permanent) {
+                        auto now = clock_type::now();
+                        n.used = now;
+                        // Keep using the stale mapping while it is being confirmed
+                        if (n.st == state::stale) {
+                            n.st = state::probe;
+                            n.probes = 0;
+                            send_probe(addr, n, now);
+                        }
+                    }
+                    return make_ready_future<ethernet_address>(n.hwaddr);
+                }
+                ++_stats.misses;
+                return _in_progress.wait(addr, _config.max_queued, _config.retransmit_time, [this](const l3addr &a) {
+                    arm_timer();
+                    send_request(a);
+                });
+            }
+
+            template<typename L3Addr>
+            void neighbor_cache<L3Addr>::learn(l2addr hwaddr, const l3addr &addr) {
+                auto now = clock_type::now();
+                auto i = _table.find(addr);
+                if (i == _table.end()) {
+                    _table.emplace(addr, neighbor {hwaddr, state::reachable, now, now});
+                    arm_timer();
+                } else if (i->second.st != state::permanent) {
+                    auto &n = i->second;
+                    if (n.hwaddr != hwaddr) {
+                        ++_stats.address_changes;
+                        n.hwaddr = hwaddr;
+                    }
+                    n.st = state::reachable;
+                    n.confirmed = now;
+                    n.probes = 0;
+                } else {
+                    // Somebody else claims one of our addresses, keep ours
+                    return;
+                }
+                _in_progress.resolve(addr, hwaddr);
+            }
+
+            template<typename L3Addr>
+            void neighbor_cache<L3Addr>::on_timer() {
+                auto now = clock_type::now();
+                _in_progress.retransmit(now, _config.max_probes, _config.retransmit_time,
+                                        [this](const l3addr &a) { send_request(a); });
+
+                bool dynamic = false;
+                for (auto i = _table.begin(); i != _table.end();) {
+                    auto &n = i->second;
+                    switch (n.st) {
+                        case state::permanent:
+                            ++i;
+                            continue;
+                        case state::reachable:
+                            if (now - n.confirmed >= _config.reachable_time) {
+                                n.st = state::stale;
+                            } else if (n.used > n.confirmed &&
+                                       now - n.confirmed >= _config.reachable_time - _config.reachable_time / 4) {
+                                // Still in use: refresh it before it expires rather than
+                                // going through the stale state
+                                n.st = state::probe;
+                                n.probes = 0;
+                                send_probe(i->first, n, now);
+                            }
+                            break;
+                        case state::stale:
+                            if (now - n.used >= _config.gc_time) {
+                                i = _table.erase(i);
+                                continue;
+                            }
+                            break;
+                        case state::probe:
+                            if (now < n.next_probe) {
+                                break;
+                            }
+                            if (n.probes >= _config.max_probes) {
+                                // The next lookup resolves it again with a broadcast,
+                                // which finds the peer if it moved to another address
+                                ++_stats.failures;
+                                i = _table.erase(i);
+                                continue;
+                            }
+                            send_probe(i->first, n, now);
+                            break;
+                    }
+                    dynamic = true;
+                    ++i;
+                }
+                if (!dynamic && _in_progress.empty()) {
+                    _timer.cancel();
+                }
+            }
+
             template<typename L3>
             class arp_for : public arp_for_protocol {
             public:
                 using l2addr = ethernet_address;
                 using l3addr = typename L3::address_type;
+                using learn_hook_type = std::function<void(l2addr, l3addr)>;
+                using clock_type = lowres_clock;
 
             private:
-                static constexpr auto max_waiters = 512;
                 enum oper {
                     op_request = 1,
                     op_reply = 2,
@@ -143,43 +490,117 @@ namespace nil {
                         return 8 + 2 * (l2addr::size() + l3addr::size());
                     }
                 };
-                struct resolution {
-                    std::vector<promise<l2addr>> _waiters;
-                    timer<> _timeout_timer;
-                };
 
             private:
                 l3addr _l3self = L3::broadcast_address();
-                std::unordered_map<l3addr, l2addr> _table;
-                std::unordered_map<l3addr, resolution> _in_progress;
+                // Secondary addresses answered for in addition to _l3self
+                std::vector<l3addr> _aliases;
+                neighbor_cache<l3addr> _cache;
+                uint64_t _gratuitous = 0;
+                metrics::metric_groups _metrics;
+                // Replies may be steered to any shard, so by default the learned
+                // mapping is propagated to all of them by the native stack.
+                learn_hook_type _learn_hook = [](l2addr l2, l3addr l3) { arp_learn(l2, l3); };
 
             private:
-                packet make_query_packet(l3addr paddr);
+                packet make_query_packet(l3addr paddr, l3addr sender);
+                packet make_query_packet(l3addr paddr) {
+                    return make_query_packet(paddr, _l3self);
+                }
                 virtual future<> received(packet p) override;
                 future<> handle_request(arp_hdr *ah);
+                void handle_update(l2addr l2, l3addr l3);
+                bool is_self(l3addr addr) const {
+                    return (addr == _l3self && _l3self != L3::broadcast_address()) ||
+                           std::find(_aliases.begin(), _aliases.end(), addr) != _aliases.end();
+                }
                 l2addr l2self() {
                     return _arp.l2self();
                 }
                 void send(l2addr to, packet p);
+                void announce(l3addr addr);
 
             public:
                 future<> send_query(const l3addr &paddr);
-                explicit arp_for(arp &a) : arp_for_protocol(a, L3::arp_protocol_type()) {
-                    _table[L3::broadcast_address()] = ethernet::broadcast_address();
+                explicit arp_for(arp &a);
+                future<ethernet_address> lookup(const l3addr &addr) {
+                    return _cache.lookup(addr);
+                }
+                void learn(l2addr l2, l3addr l3) {
+                    _cache.learn(l2, l3);
                 }
-                future<ethernet_address> lookup(const l3addr &addr);
-                void learn(l2addr l2, l3addr l3);
                 void run();
                 void set_self_addr(l3addr addr) {
-                    _table.erase(_l3self);
-                    _table[addr] = l2self();
+                    if (_l3self != L3::broadcast_address() &&
+                        std::find(_aliases.begin(), _aliases.end(), _l3self) == _aliases.end()) {
+                        _cache.erase(_l3self);
+                    }
+                    _cache.set_permanent(addr, l2self());
                     _l3self = addr;
+                    announce(addr);
+                }
+                void add_self_addr(l3addr addr) {
+                    if (std::find(_aliases.begin(), _aliases.end(), addr) == _aliases.end()) {
+                        _aliases.push_back(addr);
+                    }
+                    _cache.set_permanent(addr, l2self());
+                    announce(addr);
+                }
+                void remove_self_addr(l3addr addr) {
+                    _aliases.erase(std::remove(_aliases.begin(), _aliases.end(), addr), _aliases.end());
+                    if (addr != _l3self) {
+                        _cache.erase(addr);
+                    }
+                }
+                void set_learn_hook(learn_hook_type hook) {
+                    _learn_hook = std::move(hook);
+                }
+                void set_config(const arp_cache_config &cfg) {
+                    _cache.set_config(cfg);
+                }
+                const arp_cache_config &config() const noexcept {
+                    return _cache.config();
                 }
                 friend class arp;
             };
 
             template<typename L3>
-            packet arp_for<L3>::make_query_packet(l3addr paddr) {
+            arp_for<L3>::arp_for(arp &a) :
+                arp_for_protocol(a, L3::arp_protocol_type()),
+                _cache(
+                    [this](const l3addr &paddr) {
+                        // FIXME: future is discarded
+                        (void)send_query(paddr);
+                    },
+                    [this](const l3addr &paddr, l2addr hwaddr) { send(hwaddr, make_query_packet(paddr)); }) {
+                namespace sm = metrics;
+
+                _cache.set_permanent(L3::broadcast_address(), ethernet::broadcast_address());
+                _metrics.add_group(
+                    "arp",
+                    {sm::make_derive("hits", [this] { return _cache.get_stats().hits; },
+                                     sm::description("Counts lookups answered from the neighbor cache")),
+                     sm::make_derive("misses", [this] { return _cache.get_stats().misses; },
+                                     sm::description("Counts lookups that had to wait for an address to resolve")),
+                     sm::make_derive("requests_sent", [this] { return _cache.get_stats().requests; },
+                                     sm::description("Counts broadcast requests sent to resolve an address")),
+                     sm::make_derive("probes_sent", [this] { return _cache.get_stats().probes; },
+                                     sm::description("Counts unicast requests sent to refresh a known mapping")),
+                     sm::make_derive("failures", [this] { return _cache.failures(); },
+                                     sm::description("Counts addresses that did not answer any request or probe")),
+                     sm::make_derive("queue_drops", [this] { return _cache.queue_drops(); },
+                                     sm::description("Counts lookups dropped because too many were waiting for "
+                                                     "the same address")),
+                     sm::make_derive("address_changes", [this] { return _cache.get_stats().address_changes; },
+                                     sm::description("Counts mappings updated to a different hardware address")),
+                     sm::make_derive("gratuitous_received", [this] { return _gratuitous; },
+                                     sm::description("Counts gratuitous requests and replies received")),
+                     sm::make_gauge("entries", [this] { return _cache.size(); },
+                                    sm::description("Holds the number of entries in the neighbor cache"))});
+            }
+
+            template<typename L3>
+            packet arp_for<L3>::make_query_packet(l3addr paddr, l3addr sender) {
                 arp_hdr hdr;
                 hdr.htype = ethernet::arp_hardware_type();
                 hdr.ptype = L3::arp_protocol_type();
@@ -187,7 +608,7 @@ namespace nil {
                 hdr.plen = sizeof(l3addr);
                 hdr.oper = op_request;
                 hdr.sender_hwaddr = l2self();
-                hdr.sender_paddr = _l3self;
+                hdr.sender_paddr = sender;
                 hdr.target_hwaddr = ethernet::broadcast_address();
                 hdr.target_paddr = paddr;
                 auto p = packet();
@@ -207,68 +628,13 @@ namespace nil {
                 return make_ready_future<>();
             }
 
-            class arp_error : public std::runtime_error {
-            public:
-                arp_error(const std::string &msg) : std::runtime_error(msg) {
-                }
-            };
-
-            class arp_timeout_error : public arp_error {
-            public:
-                arp_timeout_error() : arp_error("ARP timeout") {
-                }
-            };
-
-            class arp_queue_full_error : public arp_error {
-            public:
-                arp_queue_full_error() : arp_error("ARP waiter's queue is full") {
-                }
-            };
-
-            template<typename L3>
-            future<ethernet_address> arp_for<L3>::lookup(const l3addr &paddr) {
-                auto i = _table.find(paddr);
-                if (i != _table.end()) {
-                    return make_ready_future<ethernet_address>(i->second);
-                }
-                auto j = _in_progress.find(paddr);
-                auto first_request = j == _in_progress.end();
-                auto &res = first_request ? _in_progress[paddr] : j->second;
-
-                if (first_request) {
-                    res._timeout_timer.set_callback([paddr, this, &res] {
-                        // FIXME: future is discarded
-                        (void)send_query(paddr);
-                        for (auto &w : res._waiters) {
-                            w.set_exception(arp_timeout_error());
-                        }
-                        res._waiters.clear();
-                    });
-                    res._timeout_timer.arm_periodic(std::chrono::seconds(1));
-                    // FIXME: future is discarded
-                    (void)send_query(paddr);
-                }
-
-                if (res._waiters.size() >= max_waiters) {
-                    return make_exception_future<ethernet_address>(arp_queue_full_error());
-                }
-
-                res._waiters.emplace_back();
-                return res._waiters.back().get_future();
-            }
-
             template<typename L3>
-            void arp_for<L3>::learn(l2addr hwaddr, l3addr paddr) {
-                _table[paddr] = hwaddr;
-                auto i = _in_progress.find(paddr);
-                if (i != _in_progress.end()) {
-                    auto &res = i->second;
-                    res._timeout_timer.cancel();
-                    for (auto &&pr : res._waiters) {
-                        pr.set_value(hwaddr);
-                    }
-                    _in_progress.erase(i);
+            void arp_for<L3>::announce(l3addr addr) {
+                // Every shard configures the same addresses, one announcement is enough
+                if (this_shard_id() != 0 || addr == L3::broadcast_address() || addr == l3addr()) {
+                    return;
                 }
+                send(ethernet::broadcast_address(), make_query_packet(addr, addr));
             }
 
             template<typename L3>
@@ -281,25 +647,58 @@ namespace nil {
                 if (h.hlen != sizeof(l2addr) || h.plen != sizeof(l3addr)) {
                     return make_ready_future<>();
                 }
+                if (h.sender_paddr == h.target_paddr) {
+                    // Gratuitous: a host announcing its address, usually after it
+                    // moved to another interface
+                    ++_gratuitous;
+                    handle_update(h.sender_hwaddr, h.sender_paddr);
+                    return make_ready_future<>();
+                }
                 switch (h.oper) {
                     case op_request:
+                        // RFC 826: the sender of a request refreshes a mapping we already have
+                        handle_update(h.sender_hwaddr, h.sender_paddr);
                         return handle_request(&h);
                     case op_reply:
-                        arp_learn(h.sender_hwaddr, h.sender_paddr);
+                        if (!is_self(h.sender_paddr)) {
+                            _learn_hook(h.sender_hwaddr, h.sender_paddr);
+                        }
                         return make_ready_future<>();
                     default:
                         return make_ready_future<>();
                 }
             }
 
+            template<typename L3>
+            void arp_for<L3>::handle_update(l2addr l2, l3addr l3) {
+                if (is_self(l3)) {
+                    return;
+                }
+                if (auto n = _cache.find(l3)) {
+                    if (n->st == neighbor_cache<l3addr>::state::permanent) {
+                        return;
+                    }
+                    if (n->hwaddr == l2) {
+                        // Nothing other shards need to hear about
+                        learn(l2, l3);
+                        return;
+                    }
+                } else if (!_cache.resolving(l3)) {
+                    // Do not fill the table with every host on the segment
+                    return;
+                }
+                _learn_hook(l2, l3);
+            }
+
             template<typename L3>
             future<> arp_for<L3>::handle_request(arp_hdr *ah) {
-                if (ah->target_paddr == _l3self && _l3self != L3::broadcast_address()) {
+                auto self = ah->target_paddr;
+                if (is_self(self)) {
                     ah->oper = op_reply;
                     ah->target_hwaddr = ah->sender_hwaddr;
                     ah->target_paddr = ah->sender_paddr;
                     ah->sender_hwaddr = l2self();
-                    ah->sender_paddr = _l3self;
+                    ah->sender_paddr = self;
                     auto p = packet();
                     ah->write(p.prepend_uninitialized_header(ah->size()));
                     send(ah->target_hwaddr, std::move(p));
@@ -0,0 +1,132 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <nil/actor/core/timer.hh>
+#include <nil/actor/core/smp.hh>
+#include <nil/actor/network/socket_defs.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            /// Traffic carried by the posix connections of a shard, averaged over
+            /// the last few sampling periods.
+            struct shard_activity {
+                double bytes_per_second = 0;
+                /// Completed reads and writes per second, a stand-in for the request rate
+                double ops_per_second = 0;
+                /// Number of samples published so far, changes every sampling period
+                uint64_t samples = 0;
+            };
+
+            /// Accounts \c bytes read or written by a connection of the current shard.
+            void account_connection_io(size_t bytes) noexcept;
+
+            /// Returns the last activity sample published by shard \c cpu.
+            ///
+            /// Samples are published to memory shared by all shards, so this is a
+            /// couple of relaxed loads and may be called from any shard.
+            shard_activity get_shard_activity(shard_id cpu) noexcept;
+
+            /// Periodically publishes the activity of the current shard.
+            ///
+            /// Owned by the posix network stack of every shard.
+            class shard_activity_sampler {
+                timer<> _timer;
+                uint64_t _last_bytes = 0;
+                uint64_t _last_ops = 0;
+
+                void sample();
+
+            public:
+                static constexpr std::chrono::milliseconds period {100};
+
+                shard_activity_sampler();
+            };
+
+            /// Picks the shard that serves a newly accepted connection.
+            ///
+            /// Used with server_socket::load_balancing_algorithm::activity; called on
+            /// the shard owning the listening socket only.
+            class connection_balancing_policy {
+            public:
+                virtual ~connection_balancing_policy() = default;
+                /// \param connections number of connections of the listener currently open on every shard
+                /// \param peer address of the connecting client
+                virtual shard_id next_cpu(const std::vector<unsigned> &connections, const socket_address &peer) = 0;
+            };
+
+            /// Sends new connections to the shard with the lowest weighted share of
+            /// connections, traffic and request rate.
+            ///
+            /// Connections assigned since the last sample are charged the average
+            /// traffic of a connection, so that a burst of connects does not land on
+            /// the shard that was the least loaded when the burst started.
+            class activity_balancing_policy : public connection_balancing_policy {
+            public:
+                struct weights {
+                    double connections = 1;
+                    double bytes = 1;
+                    double ops = 1;
+                };
+
+            private:
+                weights _weights;
+                uint64_t _samples = 0;
+                std::vector<unsigned> _assigned;
+
+            public:
+                activity_balancing_policy();
+                explicit activity_balancing_policy(weights w);
+                shard_id next_cpu(const std::vector<unsigned> &connections, const socket_address &peer) override;
+            };
+
+            /// Suggests moving connections from a shard to another one.
+            struct migration_hint {
+                shard_id from;
+                shard_id to;
+                /// Traffic of \c from relative to the traffic of \c to
+                double ratio;
+            };
+
+            /// Compares the traffic of all shards and returns a hint when the busiest
+            /// one carries more than \c threshold times the traffic of the idlest one.
+            ///
+            /// Connections can not be moved between shards once accepted; applications
+            /// act on the hint by asking clients of the busy shard to reconnect, for
+            /// instance by closing idle keep-alive connections there.
+            std::optional<migration_hint> connection_migration_hint(double threshold = 1.5);
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -59,7 +59,7 @@ namespace nil {
             template<typename Protocol>
             native_server_socket_impl<Protocol>::native_server_socket_impl(Protocol &proto, uint16_t port,
                                                                            listen_options opt) :
-                _listener(proto.listen(port)) {
+                _listener(proto.listen(port, opt.listen_backlog)) {
             }
 
             template<typename Protocol>
@@ -68,12 +68,12 @@ namespace nil {
                     // Save "conn" contents before call below function
                     // "conn" is moved in 1st argument, and used in 2nd argument
                     // It causes trouble on Arm which passes arguments from left to right
-                    auto ip = conn.foreign_ip().ip;
+                    auto ip = conn.foreign_ip();
                     auto port = conn.foreign_port();
                     return make_ready_future<accept_result>(
                         accept_result {connected_socket(std::make_unique<native_connected_socket_impl<Protocol>>(
                                            make_lw_shared(std::move(conn)))),
-                                       make_ipv4_address(ip, port)});
+                                       socket_address(net::inet_address(ip), port)});
                 });
             }
 
@@ -92,6 +92,7 @@ namespace nil {
             class native_connected_socket_impl : public connected_socket_impl {
                 lw_shared_ptr<typename Protocol::connection> _conn;
                 class native_data_source_impl;
+                class native_packet_source_impl;
                 class native_data_sink_impl;
 
             public:
@@ -101,6 +102,7 @@ namespace nil {
                 using connected_socket_impl::source;
                 virtual data_source source() override;
                 virtual data_sink sink() override;
+                virtual std::unique_ptr<packet_source_impl> packet_source() override;
                 virtual void shutdown_input() override;
                 virtual void shutdown_output() override;
                 virtual void set_nodelay(bool nodelay) override;
@@ -128,9 +130,14 @@ namespace nil {
                     assert(proto == transport::TCP);
 
                     // FIXME: local is ignored since native stack does not support multiple IPs yet
-                    assert(sa.as_posix_sockaddr().sa_family == AF_INET);
+                    assert(sa.as_posix_sockaddr().sa_family == AF_INET ||
+                           sa.as_posix_sockaddr().sa_family == AF_INET6);
 
-                    _conn = make_lw_shared<typename Protocol::connection>(_proto.connect(sa));
+                    try {
+                        _conn = make_lw_shared<typename Protocol::connection>(_proto.connect(sa));
+                    } catch (...) {
+                        return make_exception_future<connected_socket>(std::current_exception());
+                    }
                     return _conn->connected().then([conn = _conn]() mutable {
                         auto csi = std::make_unique<native_connected_socket_impl<Protocol>>(std::move(conn));
                         return make_ready_future<connected_socket>(connected_socket(std::move(csi)));
@@ -154,6 +161,39 @@ namespace nil {
                 }
             };
 
+            // Dispatches connect() to the IPv4 or the IPv6 protocol instance depending on
+            // the family of the remote address.
+            template<typename Protocol4, typename Protocol6>
+            class native_dual_stack_socket_impl final : public socket_impl {
+                native_socket_impl<Protocol4> _v4;
+                native_socket_impl<Protocol6> _v6;
+
+            public:
+                native_dual_stack_socket_impl(Protocol4 &proto4, Protocol6 &proto6) : _v4(proto4), _v6(proto6) {
+                }
+
+                virtual future<connected_socket> connect(socket_address sa, socket_address local,
+                                                         transport proto = transport::TCP) override {
+                    if (sa.as_posix_sockaddr().sa_family == AF_INET6) {
+                        return _v6.connect(sa, local, proto);
+                    }
+                    return _v4.connect(sa, local, proto);
+                }
+
+                virtual void set_reuseaddr(bool reuseaddr) override {
+                    _v4.set_reuseaddr(reuseaddr);
+                }
+
+                virtual bool get_reuseaddr() const override {
+                    return _v4.get_reuseaddr();
+                }
+
+                virtual void shutdown() override {
+                    _v4.shutdown();
+                    _v6.shutdown();
+                }
+            };
+
             template<typename Protocol>
             class native_connected_socket_impl<Protocol>::native_data_source_impl final : public data_source_impl {
                 typedef typename Protocol::connection connection_type;
@@ -187,6 +227,34 @@ namespace nil {
                 }
             };
 
+            // Hands out the packets of the connection as they are, so that a
+            // stream_receiver can move their payload where it belongs in one copy
+            // or share it with no copy at all
+            template<typename Protocol>
+            class native_connected_socket_impl<Protocol>::native_packet_source_impl final : public packet_source_impl {
+                typedef typename Protocol::connection connection_type;
+                lw_shared_ptr<connection_type> _conn;
+                bool _eof = false;
+
+            public:
+                explicit native_packet_source_impl(lw_shared_ptr<connection_type> conn) : _conn(std::move(conn)) {
+                }
+                virtual future<packet> get() override {
+                    if (_eof) {
+                        return make_ready_future<packet>();
+                    }
+                    return _conn->wait_for_data().then([this] {
+                        auto p = _conn->read();
+                        _eof = !p.len();
+                        return p;
+                    });
+                }
+                virtual future<> close() override {
+                    _conn->close_write();
+                    return make_ready_future<>();
+                }
+            };
+
             template<typename Protocol>
             class native_connected_socket_impl<Protocol>::native_data_sink_impl final : public data_sink_impl {
                 typedef typename Protocol::connection connection_type;
@@ -215,6 +283,11 @@ namespace nil {
                 return data_sink(std::make_unique<native_data_sink_impl>(_conn));
             }
 
+            template<typename Protocol>
+            std::unique_ptr<packet_source_impl> native_connected_socket_impl<Protocol>::packet_source() {
+                return std::make_unique<native_packet_source_impl>(_conn);
+            }
+
             template<typename Protocol>
             void native_connected_socket_impl<Protocol>::shutdown_input() {
                 _conn->close_read();
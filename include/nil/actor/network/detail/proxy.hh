@@ -0,0 +1,183 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/network/net.hh>
+#include <nil/actor/network/packet.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/circular_buffer.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            // Lock-free ring with a single producer shard and a single consumer shard.
+            //
+            // Each side keeps a private copy of the other side's index and only reloads
+            // it when the ring looks full (or empty), so the shared cache lines bounce
+            // once per batch rather than once per element.
+            template<typename T, size_t Size>
+            class spsc_ring {
+                static_assert((Size & (Size - 1)) == 0, "ring size must be a power of two");
+                static constexpr size_t cache_line_size = 64;
+                using slot = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+                // producer side
+                alignas(cache_line_size) std::atomic<size_t> _head {0};
+                size_t _cached_tail = 0;
+                // consumer side
+                alignas(cache_line_size) std::atomic<size_t> _tail {0};
+                size_t _cached_head = 0;
+                alignas(cache_line_size) slot _slots[Size];
+
+                T *at(size_t idx) {
+                    return reinterpret_cast<T *>(&_slots[idx & (Size - 1)]);
+                }
+
+            public:
+                spsc_ring() = default;
+                spsc_ring(const spsc_ring &) = delete;
+                ~spsc_ring() {
+                    while (pop()) {
+                    }
+                }
+
+                // Moves up to max elements from the front of q into the ring and
+                // publishes them at once. Returns the number of elements moved.
+                size_t push(circular_buffer<T> &q, size_t max) {
+                    auto head = _head.load(std::memory_order_relaxed);
+                    if (Size - (head - _cached_tail) < max) {
+                        _cached_tail = _tail.load(std::memory_order_acquire);
+                    }
+                    auto n = std::min({max, q.size(), Size - (head - _cached_tail)});
+                    for (size_t i = 0; i < n; ++i) {
+                        new (at(head + i)) T(std::move(q.front()));
+                        q.pop_front();
+                    }
+                    _head.store(head + n, std::memory_order_release);
+                    return n;
+                }
+
+                bool push(T &&v) {
+                    auto head = _head.load(std::memory_order_relaxed);
+                    if (head - _cached_tail == Size) {
+                        _cached_tail = _tail.load(std::memory_order_acquire);
+                        if (head - _cached_tail == Size) {
+                            return false;
+                        }
+                    }
+                    new (at(head)) T(std::move(v));
+                    _head.store(head + 1, std::memory_order_release);
+                    return true;
+                }
+
+                boost::optional<T> pop() {
+                    auto tail = _tail.load(std::memory_order_relaxed);
+                    if (tail == _cached_head) {
+                        _cached_head = _head.load(std::memory_order_acquire);
+                        if (tail == _cached_head) {
+                            return {};
+                        }
+                    }
+                    auto p = at(tail);
+                    boost::optional<T> v(std::move(*p));
+                    p->~T();
+                    _tail.store(tail + 1, std::memory_order_release);
+                    return v;
+                }
+
+                // Approximate when read from a third party
+                size_t size() const {
+                    return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed);
+                }
+            };
+
+            // Forwards packets of a shard without a hardware queue to the queue of its
+            // master shard.
+            //
+            // Packets go through a ring filled here and drained by a packet provider of
+            // the master queue, and their deleters come back through a second ring,
+            // drained by a poller of this shard. Neither direction costs a message per
+            // packet: the master is only sent a doorbell to wake it up, at most one at a
+            // time. The packets of a batch share a single deleter, which returns all of
+            // their own deleters at once when the last of them is freed.
+            class proxy_net_device : public qp {
+            private:
+                // Bounds the packets not yet freed by the master, so that the rings can
+                // never overflow
+                static constexpr size_t _send_queue_length = 128;
+
+                struct channel {
+                    spsc_ring<packet, _send_queue_length> packets;                // to the master
+                    spsc_ring<std::vector<deleter>, _send_queue_length> frees;    // back from the master
+                };
+
+                size_t _send_depth = 0;
+                unsigned _cpu;
+                device *_dev;
+                // shared with the provider registered on the master, which may outlive us
+                std::shared_ptr<channel> _channel;
+                bool _attached = false;
+                bool _attaching = false;
+                bool _doorbell_pending = false;
+                reactor::poller _free_poller;
+                uint64_t _forwarded = 0;
+                uint64_t _backpressure = 0;
+                uint64_t _doorbells = 0;
+                uint64_t _free_batches = 0;
+
+                void attach();
+                void ring_doorbell();
+                bool reclaim();
+
+            public:
+                explicit proxy_net_device(unsigned cpu, device *dev);
+                virtual future<> send(packet p) override {
+                    abort();
+                }
+                virtual uint32_t send(circular_buffer<packet> &p) override;
+                // Forwarded packets the master has not freed yet
+                size_t in_flight() const noexcept {
+                    return _send_depth;
+                }
+                static constexpr size_t max_in_flight() noexcept {
+                    return _send_queue_length;
+                }
+            };
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,121 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            /// Hands out local ports for outgoing connections, such that the replies
+            /// of each connection are received by the current shard.
+            ///
+            /// The RSS hash of a flow is linear in its input, so the hash of a flow is
+            /// the hash with a zero local port, XORed with the contribution of the
+            /// port alone. Only the bits of the hash under the steering mask pick the
+            /// shard, so flows whose zero-port hashes agree on them, forming a bucket,
+            /// have the same ports steering here. That list is computed and shuffled
+            /// once per bucket. Each flow walks its bucket's list from its own position,
+            /// skipping the ports it has in use, so released ports are reused last and
+            /// the peer has the longest time to forget about the previous connection.
+            ///
+            /// Flows with no port in use are kept for a while, and evicted in least
+            /// recently used order. So are the lists of buckets no flow uses, beyond
+            /// max_buckets of them.
+            class ephemeral_port_allocator {
+            public:
+                static constexpr uint16_t first_port = 41952;
+                static constexpr uint16_t last_port = 65535;
+                static constexpr size_t max_idle_pools = 64;
+                static constexpr size_t max_buckets = 1024;
+
+                /// \param port_hash contribution of a local port to the RSS hash of a flow
+                /// \param steers_here whether a flow with the given RSS hash is received by this shard
+                /// \param steering_mask the bits of the RSS hash steers_here depends on
+                /// \param seed seed of the order ports are handed out in
+                ephemeral_port_allocator(std::function<uint32_t(uint16_t)> port_hash,
+                                         std::function<bool(uint32_t)> steers_here, uint32_t steering_mask,
+                                         uint32_t seed);
+
+                /// Returns a local port for the flow whose RSS hash, with a zero local
+                /// port, is \c flow_hash.
+                ///
+                /// Throws std::system_error with EADDRNOTAVAIL when all ports steering
+                /// to this shard are in use for this flow.
+                uint16_t allocate(uint32_t flow_hash);
+                /// Returns a port obtained from allocate() with the same \c flow_hash
+                void release(uint32_t flow_hash, uint16_t port);
+
+                size_t pools() const {
+                    return _pools.size();
+                }
+                size_t buckets() const {
+                    return _buckets.size();
+                }
+
+            private:
+                struct bucket {
+                    // The ports steering here, shuffled
+                    std::vector<uint16_t> ports;
+                    size_t pools = 0;
+                };
+
+                struct pool {
+                    bucket *b;
+                    // Position of the next port to try in the bucket's list
+                    size_t next;
+                    std::unordered_set<uint16_t> in_use;
+                    bool idle = false;
+                    std::list<uint32_t>::iterator idle_pos;
+                };
+
+                std::function<uint32_t(uint16_t)> _port_hash;
+                std::function<bool(uint32_t)> _steers_here;
+                uint32_t _steering_mask;
+                std::default_random_engine _random;
+                // Contribution of every port of the range under the steering mask, computed on first use
+                std::vector<uint32_t> _port_hashes;
+                std::unordered_map<uint32_t, bucket> _buckets;
+                std::unordered_map<uint32_t, pool> _pools;
+                // Pools with no port in use, least recently used first
+                std::list<uint32_t> _idle;
+
+                bucket &get_bucket(uint32_t flow_hash);
+                pool &get_pool(uint32_t flow_hash);
+                void evict(uint32_t flow_hash);
+            };
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
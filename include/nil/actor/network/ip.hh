@@ -39,7 +39,9 @@
 #include <nil/actor/network/arp.hh>
 #include <nil/actor/network/ip_checksum.hh>
 #include <nil/actor/network/const.hh>
+#include <nil/actor/network/offload.hh>
 #include <nil/actor/network/packet-util.hh>
+#include <nil/actor/network/route.hh>
 #include <nil/actor/core/shared_ptr.hh>
 #include <nil/actor/network/toeplitz.hh>
 #include <nil/actor/network/udp.hh>
@@ -194,6 +196,8 @@ namespace nil {
                     packet p;
                     ethernet_address e_dst;
                     ip_protocol_num proto_num;
+                    // Chosen by the route to \c to when unspecified
+                    ipv4_address from;
                 };
                 using packet_provider_type = std::function<boost::optional<l4packet>()>;
                 static void tcp_pseudo_header_checksum(checksummer &csum, ipv4_address src, ipv4_address dst,
@@ -204,6 +208,10 @@ namespace nil {
                                                        uint16_t len) {
                     csum.sum_many(src.ip.raw, dst.ip.raw, uint8_t(0), uint8_t(ip_protocol_num::udp), len);
                 }
+                static void hash_address(forward_hash &hash_data, ipv4_address a) {
+                    hash_data.push_back(hton(a.ip));
+                }
+                static constexpr const char *tcp_metrics_group = "tcp";
                 static constexpr uint8_t ip_hdr_len_min = ipv4_hdr_len_min;
             };
 
@@ -250,8 +258,8 @@ namespace nil {
 
                 uint32_t hash(rss_key_type rss_key) {
                     forward_hash hash_data;
-                    hash_data.push_back(hton(foreign_ip.ip));
-                    hash_data.push_back(hton(local_ip.ip));
+                    InetTraits::hash_address(hash_data, foreign_ip);
+                    InetTraits::hash_address(hash_data, local_ip);
                     hash_data.push_back(hton(foreign_port));
                     hash_data.push_back(hton(local_port));
                     return toeplitz_hash(rss_key, hash_data);
@@ -329,16 +337,11 @@ namespace nil {
                 static const int default_queue_size;
 
             private:
-                static const uint16_t min_anonymous_port = 32768;
                 ipv4 &_inet;
-                std::unordered_map<uint16_t, lw_shared_ptr<udp_channel_state>> _channels;
+                udp_channel_table _channels;
                 int _queue_size = default_queue_size;
-                uint16_t _next_anonymous_port = min_anonymous_port;
                 circular_buffer<ipv4_traits::l4packet> _packetq;
 
-            private:
-                uint16_t next_port(uint16_t port);
-
             public:
                 class registration {
                 private:
@@ -349,7 +352,7 @@ namespace nil {
                     registration(ipv4_udp &proto, uint16_t port) : _proto(proto), _port(port) {};
 
                     void unregister() {
-                        _proto._channels.erase(_proto._channels.find(_port));
+                        _proto._channels.unbind(_port);
                     }
 
                     uint16_t port() const {
@@ -425,6 +428,10 @@ namespace nil {
                 ipv4_address _host_address;
                 ipv4_address _gw_address;
                 ipv4_address _netmask;
+                // Secondary addresses with their prefix lengths
+                std::vector<std::pair<ipv4_address, uint8_t>> _addresses;
+                std::vector<ipv4_route> _static_routes;
+                ipv4_route_table _routes;
                 l3_protocol _l3;
                 ipv4_tcp _tcp;
                 ipv4_icmp _icmp;
@@ -452,13 +459,15 @@ namespace nil {
                 timer<lowres_clock> _frag_timer;
                 circular_buffer<l3_protocol::l3packet> _packetq;
                 unsigned _pkt_provider_idx = 0;
+                std::unique_ptr<tcp_gro> _gro;
                 metrics::metric_groups _metrics;
 
             private:
                 future<> handle_received_packet(packet p, ethernet_address from);
                 bool forward(forward_hash &out_hash_data, packet &p, size_t off);
                 boost::optional<l3_protocol::l3packet> get_packet();
-                bool in_my_netmask(ipv4_address a) const;
+                bool is_on_link(ipv4_address a) const;
+                void update_routes();
                 void frag_limit_mem();
                 void frag_timeout();
                 void frag_drop(ipv4_frag_id frag_id, uint32_t dropped_size);
@@ -479,6 +488,21 @@ namespace nil {
                 ipv4_address gw_address() const;
                 void set_netmask_address(ipv4_address ip);
                 ipv4_address netmask_address() const;
+                // Addresses besides the host address; each one adds a route to its
+                // subnet, preferring itself as the source.
+                void add_address(ipv4_address a, unsigned prefix_length);
+                bool remove_address(ipv4_address a);
+                bool is_my_address(ipv4_address a) const;
+                // Routes besides the subnets of our addresses and the default route
+                // through the gateway. An unspecified gateway makes \c prefix on-link,
+                // an unspecified source selects the host address.
+                void add_route(ipv4_address prefix, unsigned length, ipv4_address gateway,
+                               ipv4_address source = ipv4_address());
+                bool remove_route(ipv4_address prefix, unsigned length);
+                const ipv4_route_table &routes() const {
+                    return _routes;
+                }
+                ipv4_address source_address(ipv4_address to) const;
                 interface *netif() const {
                     return _netif;
                 }
@@ -487,7 +511,8 @@ namespace nil {
                 // But for now, a simple single raw pointer suffices
                 void set_packet_filter(ip_packet_filter *);
                 ip_packet_filter *packet_filter() const;
-                void send(ipv4_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst);
+                void send(ipv4_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst,
+                          ipv4_address from = ipv4_address());
                 tcp<ipv4_traits> &get_tcp() {
                     return *_tcp._tcp;
                 }
@@ -499,9 +524,18 @@ namespace nil {
                     return _netif->hw_features();
                 }
                 static bool needs_frag(packet &p, ip_protocol_num proto_num, net::hw_features hw_features);
+                // Coalesce received TCP segments in software, unless the device does LRO
+                void enable_gro();
                 void learn(ethernet_address l2, ipv4_address l3) {
                     _arp.learn(l2, l3);
                 }
+                // Stacks living outside of the native network stack learn locally instead
+                void set_arp_learn_hook(arp_for<ipv4>::learn_hook_type hook) {
+                    _arp.set_learn_hook(std::move(hook));
+                }
+                arp_for<ipv4> &neighbors() {
+                    return _arp;
+                }
                 void register_packet_provider(ipv4_traits::packet_provider_type &&func) {
                     _pkt_providers.push_back(std::move(func));
                 }
@@ -566,6 +600,13 @@ namespace nil {
 
             void arp_learn(ethernet_address l2, ipv4_address l3);
 
+            // Apply an address or route change to the native stack of every shard
+            future<> add_ipv4_address(ipv4_address a, unsigned prefix_length);
+            future<> remove_ipv4_address(ipv4_address a);
+            future<> add_ipv4_route(ipv4_address prefix, unsigned length, ipv4_address gateway,
+                                    ipv4_address source = ipv4_address());
+            future<> remove_ipv4_route(ipv4_address prefix, unsigned length);
+
         }    // namespace net
 
     }    // namespace actor
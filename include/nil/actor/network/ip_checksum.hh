@@ -27,6 +27,7 @@
 #include <nil/actor/network/packet.hh>
 #include <cstdint>
 #include <cstddef>
+#include <vector>
 #include <arpa/inet.h>
 
 namespace nil {
@@ -73,6 +74,19 @@ namespace nil {
                 }
                 uint16_t get() const;
             };
+
+            // A checksum kernel sums a buffer starting at an even offset and returns
+            // the folded 16-bit one's complement sum of its big-endian words.
+            using checksum_kernel = uint16_t (*)(const char *data, size_t len);
+
+            struct checksum_implementation {
+                const char *name;
+                checksum_kernel sum;
+            };
+
+            // Kernels usable on this CPU, from the scalar reference to the widest
+            // vector unit; checksummer uses the last one for large buffers.
+            const std::vector<checksum_implementation> &checksum_implementations();
         }    // namespace net
     }    // namespace actor
 }    // namespace nil
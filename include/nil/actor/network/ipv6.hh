@@ -0,0 +1,449 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <unordered_map>
+#include <cstdint>
+#include <vector>
+
+#include <nil/actor/core/array_map.hh>
+#include <nil/actor/network/ip.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            class ipv6;
+            template<ip_protocol_num ProtoNum>
+            class ipv6_l4;
+
+            template<typename InetTraits>
+            class tcp;
+
+            struct ipv6_traits {
+                using address_type = ipv6_address;
+                using inet_type = ipv6_l4<ip_protocol_num::tcp>;
+                struct l4packet {
+                    ipv6_address to;
+                    packet p;
+                    ethernet_address e_dst;
+                    ip_protocol_num proto_num;
+                    // Chosen by source_address() when unspecified
+                    ipv6_address from;
+                };
+                using packet_provider_type = std::function<boost::optional<l4packet>()>;
+                // RFC 8200, section 8.1: the upper-layer length and the next header
+                // value are both summed as 32-bit words.
+                static void pseudo_header_checksum(checksummer &csum, const ipv6_address &src,
+                                                   const ipv6_address &dst, uint32_t len,
+                                                   ip_protocol_num proto_num) {
+                    csum.sum(reinterpret_cast<const char *>(src.ip.data()), ipv6_address::size());
+                    csum.sum(reinterpret_cast<const char *>(dst.ip.data()), ipv6_address::size());
+                    csum.sum_many(len, uint32_t(proto_num));
+                }
+                static void tcp_pseudo_header_checksum(checksummer &csum, ipv6_address src, ipv6_address dst,
+                                                       uint16_t len) {
+                    pseudo_header_checksum(csum, src, dst, len, ip_protocol_num::tcp);
+                }
+                static void udp_pseudo_header_checksum(checksummer &csum, ipv6_address src, ipv6_address dst,
+                                                       uint16_t len) {
+                    pseudo_header_checksum(csum, src, dst, len, ip_protocol_num::udp);
+                }
+                static void hash_address(forward_hash &hash_data, const ipv6_address &a) {
+                    for (auto b : a.ip) {
+                        hash_data.push_back(b);
+                    }
+                }
+                static constexpr const char *tcp_metrics_group = "tcp6";
+                static constexpr uint8_t ip_hdr_len_min = ipv6_hdr_len_min;
+            };
+
+            template<ip_protocol_num ProtoNum>
+            class ipv6_l4 {
+            public:
+                ipv6 &_inet;
+
+            public:
+                ipv6_l4(ipv6 &inet) : _inet(inet) {
+                }
+                void register_packet_provider(ipv6_traits::packet_provider_type func);
+                future<ethernet_address> get_l2_dst_address(ipv6_address to);
+                const ipv6 &inet() const {
+                    return _inet;
+                }
+            };
+
+            class ipv6_protocol {
+            public:
+                virtual ~ipv6_protocol() {
+                }
+                virtual void received(packet p, ipv6_address from, ipv6_address to) = 0;
+                virtual bool forward(forward_hash &out_hash_data, packet &p, size_t off) {
+                    return true;
+                }
+            };
+
+            class ipv6_tcp final : public ipv6_protocol {
+                ipv6_l4<ip_protocol_num::tcp> _inet_l4;
+                std::unique_ptr<tcp<ipv6_traits>> _tcp;
+
+            public:
+                ipv6_tcp(ipv6 &inet);
+                ~ipv6_tcp();
+                virtual void received(packet p, ipv6_address from, ipv6_address to) override;
+                virtual bool forward(forward_hash &out_hash_data, packet &p, size_t off) override;
+                friend class ipv6;
+            };
+
+            struct icmpv6_hdr {
+                enum class msg_type : uint8_t {
+                    echo_request = 128,
+                    echo_reply = 129,
+                    neighbor_solicitation = 135,
+                    neighbor_advertisement = 136,
+                };
+                msg_type type;
+                uint8_t code;
+                packed<uint16_t> csum;
+                template<typename Adjuster>
+                auto adjust_endianness(Adjuster a) {
+                    return a(csum);
+                }
+            } __attribute__((packed));
+
+            class icmpv6 {
+            public:
+                using ipaddr = ipv6_address;
+                using inet_type = ipv6_l4<ip_protocol_num::icmpv6>;
+                explicit icmpv6(inet_type &inet) : _inet(inet) {
+                    _inet.register_packet_provider([this] {
+                        boost::optional<ipv6_traits::l4packet> l4p;
+                        if (!_packetq.empty()) {
+                            l4p = std::move(_packetq.front());
+                            _packetq.pop_front();
+                            _queue_space.signal(l4p.value().p.len());
+                        }
+                        return l4p;
+                    });
+                }
+                void received(packet p, ipaddr from, ipaddr to);
+
+            private:
+                inet_type &_inet;
+                circular_buffer<ipv6_traits::l4packet> _packetq;
+                semaphore _queue_space = {212992};
+            };
+
+            class ipv6_icmp final : public ipv6_protocol {
+                ipv6_l4<ip_protocol_num::icmpv6> _inet_l4;
+                icmpv6 _icmp;
+
+            public:
+                ipv6_icmp(ipv6 &inet) : _inet_l4(inet), _icmp(_inet_l4) {
+                }
+                // Neighbor discovery is validated with the hop limit of the datagram,
+                // without it neighbor discovery messages are dropped
+                void received(packet p, ipv6_address from, ipv6_address to, uint8_t hop_limit,
+                              ethernet_address l2src);
+                virtual void received(packet p, ipv6_address from, ipv6_address to) override {
+                    received(std::move(p), from, to, 0, ethernet_address());
+                }
+                friend class ipv6;
+            };
+
+            // Neighbor Discovery (RFC 4861) takes the place of ARP for IPv6: addresses
+            // are resolved by multicasting a neighbor solicitation to the target's
+            // solicited-node group and learning the link-layer address carried by the
+            // neighbor advertisement that answers it.
+            class ndp {
+            public:
+                using l2addr = ethernet_address;
+                using l3addr = ipv6_address;
+                using learn_hook_type = std::function<void(l2addr, l3addr)>;
+
+            private:
+                enum nd_flags : uint32_t {
+                    router_flag = 1u << 31,
+                    solicited_flag = 1u << 30,
+                    override_flag = 1u << 29,
+                };
+                enum option_type : uint8_t {
+                    source_link_layer_address = 1,
+                    target_link_layer_address = 2,
+                };
+                struct nd_hdr {
+                    uint8_t type;
+                    uint8_t code;
+                    uint16_t csum;
+                    uint32_t flags;
+                    l3addr target;
+
+                    static nd_hdr read(const char *p) {
+                        nd_hdr nh;
+                        nh.type = consume_be<uint8_t>(p);
+                        nh.code = consume_be<uint8_t>(p);
+                        nh.csum = consume_be<uint16_t>(p);
+                        nh.flags = consume_be<uint32_t>(p);
+                        nh.target = l3addr::consume(p);
+                        return nh;
+                    }
+                    void write(char *p) const {
+                        produce_be<uint8_t>(p, type);
+                        produce_be<uint8_t>(p, code);
+                        produce_be<uint16_t>(p, csum);
+                        produce_be<uint32_t>(p, flags);
+                        target.produce(p);
+                    }
+                    static constexpr size_t size() {
+                        return 8 + l3addr::size();
+                    }
+                };
+                // Only the link-layer address options are of interest to us; ethernet
+                // addresses fit exactly into a single 8-octet option unit.
+                static constexpr size_t lladdr_option_size = 8;
+
+            private:
+                ipv6 &_inet;
+                // RFC 4861 section 10 constants are the defaults of arp_cache_config
+                neighbor_cache<l3addr> _cache;
+                learn_hook_type _learn_hook;
+
+            private:
+                packet make_message(icmpv6_hdr::msg_type type, uint32_t flags, const l3addr &target,
+                                    option_type opt, const l3addr &src, const l3addr &dst);
+                void send_solicitation(const l3addr &target, const l3addr &dst, l2addr e_dst);
+                void send_advertisement(const l3addr &to, l2addr e_dst, const l3addr &target, bool solicited);
+                void handle_solicitation(const nd_hdr &h, boost::optional<l2addr> lladdr, const l3addr &from,
+                                         l2addr l2src);
+                void handle_advertisement(const nd_hdr &h, boost::optional<l2addr> lladdr);
+                void handle_update(l2addr l2, const l3addr &l3, bool override);
+                void propagate(l2addr l2, l3addr l3);
+
+            public:
+                explicit ndp(ipv6 &inet);
+                future<ethernet_address> lookup(const l3addr &addr) {
+                    return _cache.lookup(addr);
+                }
+                void learn(l2addr l2, l3addr l3) {
+                    _cache.learn(l2, l3);
+                }
+                // Messages with a hop limit other than 255 may come from off the link
+                // and are dropped (RFC 4861 section 7.1). \c l2src is the source of the
+                // ethernet frame that carried the message.
+                void received(packet p, l3addr from, l3addr to, uint8_t hop_limit, l2addr l2src);
+                void add_self_addr(l3addr addr);
+                void remove_self_addr(l3addr addr) {
+                    _cache.erase(addr);
+                }
+                // Advertisements may be steered to any shard, so the stack can ask for
+                // the learned mapping to be propagated (see arp_learn() for IPv4).
+                void set_learn_hook(learn_hook_type hook) {
+                    _learn_hook = std::move(hook);
+                }
+                void set_config(const arp_cache_config &cfg) {
+                    _cache.set_config(cfg);
+                }
+                const arp_cache_config &config() const noexcept {
+                    return _cache.config();
+                }
+            };
+
+            class ipv6_udp : public ipv6_protocol {
+            public:
+                static const int default_queue_size;
+
+            private:
+                ipv6 &_inet;
+                udp_channel_table _channels;
+                int _queue_size = default_queue_size;
+                circular_buffer<ipv6_traits::l4packet> _packetq;
+
+            public:
+                class registration {
+                private:
+                    ipv6_udp &_proto;
+                    uint16_t _port;
+
+                public:
+                    registration(ipv6_udp &proto, uint16_t port) : _proto(proto), _port(port) {};
+
+                    void unregister() {
+                        _proto._channels.unbind(_port);
+                    }
+
+                    uint16_t port() const {
+                        return _port;
+                    }
+                };
+
+                ipv6_udp(ipv6 &inet);
+                udp_channel make_channel(ipv6_addr addr);
+                virtual void received(packet p, ipv6_address from, ipv6_address to) override;
+                // Throws EMSGSIZE for datagrams that do not fit the link MTU
+                void send(uint16_t src_port, ipv6_addr dst, packet &&p);
+                bool forward(forward_hash &out_hash_data, packet &p, size_t off) override;
+                void set_queue_size(int size) {
+                    _queue_size = size;
+                }
+
+                const ipv6 &inet() const {
+                    return _inet;
+                }
+            };
+
+            struct ip6_hdr {
+                packed<uint32_t> ver_tc_flow;
+                packed<uint16_t> payload_len;
+                uint8_t next_header;
+                uint8_t hop_limit;
+                ipv6_address src_ip;
+                ipv6_address dst_ip;
+                // Addresses are plain byte arrays and are already in network order
+                template<typename Adjuster>
+                auto adjust_endianness(Adjuster a) {
+                    return a(ver_tc_flow, payload_len);
+                }
+                uint8_t ver() const {
+                    return uint32_t(ver_tc_flow) >> 28;
+                }
+            } __attribute__((packed));
+
+            class ipv6 {
+            public:
+                using clock_type = lowres_clock;
+                using address_type = ipv6_address;
+                using proto_type = uint16_t;
+                static constexpr uint8_t default_hop_limit = 64;
+                // Neighbor discovery messages must carry the maximum hop limit
+                static constexpr uint8_t nd_hop_limit = 255;
+                static constexpr unsigned default_prefix_length = 64;
+
+                static ipv6_address all_nodes_address();
+                static ipv6_address solicited_node_address(const ipv6_address &a);
+                static ipv6_address make_link_local_address(ethernet_address hw_address);
+                static ethernet_address multicast_ethernet_address(const ipv6_address &a);
+                static bool is_multicast(const ipv6_address &a) {
+                    return a.ip[0] == 0xff;
+                }
+                static bool is_link_local(const ipv6_address &a) {
+                    return a.ip[0] == 0xfe && (a.ip[1] & 0xc0) == 0x80;
+                }
+
+            private:
+                interface *_netif;
+                net::hw_features _hw_features;
+                std::vector<ipv6_traits::packet_provider_type> _pkt_providers;
+                ndp _ndp;
+                ipv6_address _link_local_address;
+                ipv6_address _host_address;
+                ipv6_address _gw_address;
+                unsigned _prefix_length = default_prefix_length;
+                l3_protocol _l3;
+                ipv6_tcp _tcp;
+                ipv6_icmp _icmp;
+                ipv6_udp _udp;
+                array_map<ipv6_protocol *, 256> _l4;
+                circular_buffer<l3_protocol::l3packet> _packetq;
+                unsigned _pkt_provider_idx = 0;
+
+            private:
+                future<> handle_received_packet(packet p, ethernet_address from);
+                bool forward(forward_hash &out_hash_data, packet &p, size_t off);
+                boost::optional<l3_protocol::l3packet> get_packet();
+                bool in_my_prefix(const ipv6_address &a) const;
+                bool is_my_address(const ipv6_address &a) const;
+                // Walks the extension header chain. Returns false if the datagram has to
+                // be dropped, otherwise leaves the upper layer protocol in proto_num and
+                // its offset from the start of the fixed header in l4_offset.
+                static bool skip_extension_headers(packet &p, size_t off, uint8_t &proto_num, size_t &l4_offset);
+
+            public:
+                explicit ipv6(interface *netif);
+                void set_host_address(ipv6_address ip);
+                ipv6_address host_address() const;
+                ipv6_address link_local_address() const {
+                    return _link_local_address;
+                }
+                void set_gw_address(ipv6_address ip);
+                ipv6_address gw_address() const;
+                void set_prefix_length(unsigned prefix_length);
+                unsigned prefix_length() const;
+                bool is_configured() const {
+                    return !_host_address.is_unspecified();
+                }
+                interface *netif() const {
+                    return _netif;
+                }
+                // Picks the address packets to the given destination are sent from
+                ipv6_address source_address(const ipv6_address &to) const;
+                void send(ipv6_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst,
+                          ipv6_address from = ipv6_address());
+                tcp<ipv6_traits> &get_tcp() {
+                    return *_tcp._tcp;
+                }
+                ipv6_udp &get_udp() {
+                    return _udp;
+                }
+                ndp &neighbors() {
+                    return _ndp;
+                }
+                void register_l4(proto_type id, ipv6_protocol *handler);
+                // The device offload paths only know how to describe IPv4 frames, so
+                // IPv6 checksums and segmentation are always done in software.
+                const net::hw_features &hw_features() const {
+                    return _hw_features;
+                }
+                void learn(ethernet_address l2, ipv6_address l3) {
+                    _ndp.learn(l2, l3);
+                }
+                void register_packet_provider(ipv6_traits::packet_provider_type &&func) {
+                    _pkt_providers.push_back(std::move(func));
+                }
+                future<ethernet_address> get_l2_dst_address(ipv6_address to);
+            };
+
+            template<ip_protocol_num ProtoNum>
+            inline void ipv6_l4<ProtoNum>::register_packet_provider(ipv6_traits::packet_provider_type func) {
+                _inet.register_packet_provider([func = std::move(func)] {
+                    auto l4p = func();
+                    if (l4p) {
+                        l4p.value().proto_num = ProtoNum;
+                    }
+                    return l4p;
+                });
+            }
+
+            template<ip_protocol_num ProtoNum>
+            inline future<ethernet_address> ipv6_l4<ProtoNum>::get_l2_dst_address(ipv6_address to) {
+                return _inet.get_l2_dst_address(to);
+            }
+
+            void ndp_learn(ethernet_address l2, ipv6_address l3);
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
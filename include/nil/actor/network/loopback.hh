@@ -0,0 +1,85 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <nil/actor/network/net.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            /// Software device connecting two native stacks back-to-back.
+            ///
+            /// Every hardware queue is served by the shard with the same id, and frames
+            /// are steered to the receiving queue with a Toeplitz hash of the flow, the
+            /// way a multi-queue NIC does it, so that RSS and hash2cpu() behave as they
+            /// would on real hardware.
+            struct loopback_device_config {
+                /// Number of hardware queues (capped by smp::count)
+                uint16_t queues = 1;
+                /// Delay applied to every frame before it is handed to the receiver
+                std::chrono::microseconds latency {0};
+                /// Probability of a frame being dropped
+                double loss = 0;
+                /// Probability of a frame being delivered after the one that follows it
+                double reorder = 0;
+                /// Skip checksum computation and verification: the wire never corrupts frames
+                bool csum_offload = false;
+                uint16_t mtu = 1500;
+                /// Seed of the loss and reordering decisions, combined with the queue id
+                uint32_t seed = 0;
+            };
+
+            /// Creates two devices wired to each other within this process.
+            ///
+            /// Queues of both devices are created by init_local_queue() on their shards
+            /// as usual; a frame sent on one device is received by the other one.
+            std::pair<std::shared_ptr<device>, std::shared_ptr<device>>
+                create_loopback_device_pair(const loopback_device_config &cfg = loopback_device_config());
+
+            /// Creates one end of a device pair shared by two processes.
+            ///
+            /// Both processes open the same POSIX shared memory segment \c name, one of
+            /// them with \c side 0 and the other one with \c side 1, and must use the same
+            /// number of queues. Side 0 creates the segment, side 1 removes its name once
+            /// mapped.
+            std::unique_ptr<device> create_shm_loopback_device(const std::string &name, unsigned side,
+                                                               const loopback_device_config &cfg =
+                                                                   loopback_device_config());
+
+            /// Creates the shared memory device described by the --loopback-* options.
+            std::unique_ptr<device> create_loopback_net_device(boost::program_options::variables_map opts);
+            boost::program_options::options_description get_loopback_net_options_description();
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -53,7 +53,7 @@ namespace nil {
             class l3_protocol;
 
             class forward_hash {
-                uint8_t data[64];
+                uint8_t _data[64];
                 size_t end_idx = 0;
 
             public:
@@ -61,8 +61,8 @@ namespace nil {
                     return end_idx;
                 }
                 void push_back(uint8_t b) {
-                    assert(end_idx < sizeof(data));
-                    data[end_idx++] = b;
+                    assert(end_idx < sizeof(_data));
+                    _data[end_idx++] = b;
                 }
                 void push_back(uint16_t b) {
                     push_back(uint8_t(b));
@@ -73,7 +73,10 @@ namespace nil {
                     push_back(uint16_t(b >> 16));
                 }
                 const uint8_t &operator[](size_t idx) const {
-                    return data[idx];
+                    return _data[idx];
+                }
+                const uint8_t *data() const {
+                    return _data;
                 }
             };
 
@@ -152,11 +155,18 @@ namespace nil {
                                          forward);
                 void forward(unsigned cpuid, packet p);
                 unsigned hash2cpu(uint32_t hash);
+                // Bits of the RSS hash hash2cpu() depends on
+                uint32_t hash2cpu_mask();
                 void register_packet_provider(l3_protocol::packet_provider_type func) {
                     _pkt_providers.push_back(std::move(func));
                 }
                 uint16_t hw_queues_count();
                 rss_key_type rss_key() const;
+                // Advertise TSO when the device has none, and split TCP super-segments
+                // in software on the local queue.
+                void enable_sw_gso();
+                // Account a packet software GRO made of \c segments TCP segments
+                void update_gro_stats(unsigned segments);
                 friend class l3_protocol;
             };
 
@@ -226,11 +236,16 @@ namespace nil {
                         uint64_t total;     // total number of erroneous packets
                         uint64_t csum;      // packets with bad checksum
                     } bad;
+
+                    uint64_t gro_segments;    // TCP segments that went through software GRO
+                    uint64_t gro_packets;     // packets software GRO made of them
                 } rx;
 
                 struct {
                     struct qp_stats_good good;
-                    uint64_t linearized;    // number of packets that were linearized
+                    uint64_t linearized;      // number of packets that were linearized
+                    uint64_t gso_packets;     // TCP super-segments split by software GSO
+                    uint64_t gso_segments;    // segments software GSO made of them
                 } tx;
             };
 
@@ -238,10 +253,11 @@ namespace nil {
                 using packet_provider_type = std::function<boost::optional<packet>()>;
                 std::vector<packet_provider_type> _pkt_providers;
                 boost::optional<std::array<uint8_t, 128>> _sw_reta;
-                circular_buffer<packet> _proxy_packetq;
                 stream<packet> _rx_stream;
                 std::unique_ptr<detail::poller> _tx_poller;
                 circular_buffer<packet> _tx_packetq;
+                // Features of the device, when TSO is emulated in software
+                boost::optional<hw_features> _sw_gso;
 
             protected:
                 const std::string _stats_plugin_name;
@@ -269,12 +285,17 @@ namespace nil {
                 void configure_proxies(const std::map<unsigned, float> &cpu_weights);
                 // build REdirection TAble for cpu_weights map: target cpu -> weight
                 void build_sw_reta(const std::map<unsigned, float> &cpu_weights);
-                void proxy_send(packet p) {
-                    _proxy_packetq.push_back(std::move(p));
-                }
                 void register_packet_provider(packet_provider_type func) {
                     _pkt_providers.push_back(std::move(func));
                 }
+                // Split TSO super-segments before they reach a device lacking TSO
+                void enable_sw_gso(const hw_features &hw) {
+                    _sw_gso = hw;
+                }
+                void update_gro_stats(unsigned segments) {
+                    _stats.rx.gro_segments += segments;
+                    ++_stats.rx.gro_packets;
+                }
                 bool poll_tx();
                 friend class device;
             };
@@ -316,6 +337,11 @@ namespace nil {
                 virtual unsigned hash2qid(uint32_t hash) {
                     return hash % hw_queues_count();
                 }
+                // Bits of the RSS hash hash2qid() depends on
+                virtual uint32_t hash2qid_mask() {
+                    uint32_t n = hw_queues_count();
+                    return (n & (n - 1)) == 0 ? n - 1 : ~uint32_t(0);
+                }
                 void set_local_queue(std::unique_ptr<qp> dev);
                 template<typename Func>
                 unsigned forward_dst(unsigned src_cpuid, Func &&hashfn) {
@@ -332,6 +358,9 @@ namespace nil {
                     // not necessary be true in the future
                     return forward_dst(hash2qid(hash), [hash] { return hash; });
                 }
+                // Bits of the RSS hash hash2cpu() depends on: flows whose hashes agree
+                // on them are received by the same shard
+                uint32_t hash2cpu_mask();
             };
         }    // namespace net
     }        // namespace actor
@@ -0,0 +1,109 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <nil/actor/core/circular_buffer.hh>
+#include <nil/actor/network/net.hh>
+#include <nil/actor/network/packet.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            /// Splits an Ethernet frame carrying a TCP/IPv4 super-segment, built for
+            /// TSO, into frames whose payload is at most offload_info::tso_seg_size
+            /// bytes, the way the NIC would do it. Payloads are shared, not copied.
+            ///
+            /// The IP header checksum is updated incrementally (RFC 1624) for the new
+            /// total length, unless \c hw offloads it. The TCP checksum of the
+            /// super-segment covers the pseudo header without length only: when \c hw
+            /// offloads L4 checksums the segment length is added to it, otherwise the
+            /// checksum of every segment is completed in software.
+            ///
+            /// Frames that are not TCP over IPv4 are passed unchanged.
+            ///
+            /// \return the number of frames appended to \c out
+            size_t tcp_gso_segment(packet p, const hw_features &hw, circular_buffer<packet> &out);
+
+            /// Coalesces received TCP/IPv4 segments of the same flow before TCP input.
+            ///
+            /// A segment is appended to the one held for its flow when it carries
+            /// data in sequence, the same acknowledgment, window and options, and
+            /// no flag other than ACK and PSH. Anything else flushes the flow first,
+            /// so segments of a flow never overtake each other. Held segments are
+            /// delivered at the end of every reactor poll cycle, when PSH is seen,
+            /// or when the coalesced segment could not grow any more.
+            ///
+            /// Checksums of coalesced segments are verified here, and delivered
+            /// packets are marked with offload_info::rx_csum_verified.
+            class tcp_gro {
+            public:
+                /// Called with an IP datagram and the number of segments it is made of
+                using deliver_fn = std::function<void(packet, unsigned)>;
+                static constexpr size_t max_flows = 8;
+
+            private:
+                struct flow {
+                    uint32_t src;
+                    uint32_t dst;
+                    uint32_t ports;
+                    packet p;
+                    uint32_t next_seq;
+                    uint16_t seg_size;
+                    uint16_t hdr_len;
+                    unsigned segments;
+                    // Header of the first segment, compared against the following ones
+                    std::array<char, 60> tcp_hdr;
+                };
+                bool _verify_csum;
+                deliver_fn _deliver;
+                std::vector<flow> _flows;
+                std::unique_ptr<detail::poller> _flush_poller;
+
+            private:
+                void deliver(flow &f);
+                void flush_flow(uint32_t src, uint32_t dst, uint32_t ports);
+
+            public:
+                /// \param verify_csum whether TCP checksums still need to be verified
+                tcp_gro(bool verify_csum, deliver_fn deliver);
+                ~tcp_gro();
+                /// Takes an IP datagram addressed to this host, carrying TCP.
+                void receive(packet p);
+                /// Delivers all held segments, returns whether there were any.
+                bool flush();
+            };
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -25,8 +25,11 @@
 #pragma once
 
 #include <nil/actor/network/packet.hh>
+#include <iterator>
+#include <limits>
 #include <map>
 #include <iostream>
+#include <utility>
 
 namespace nil {
     namespace actor {
@@ -158,6 +161,126 @@ namespace nil {
                 }
             };
 
+            /// Reassembly queue of a byte stream received out of order.
+            ///
+            /// Keeps disjoint, non-adjacent ranges of the stream keyed by their first
+            /// offset. A segment is coalesced with its neighbours as it is inserted,
+            /// by appending fragments rather than linearizing, so that an insertion
+            /// costs O(log n) plus the ranges it swallows, each of which is removed
+            /// once. Offsets only need to be ordered across the span of the queue,
+            /// which makes wrapping sequence numbers fine.
+            template<typename Offset>
+            class packet_reassembly_queue {
+                std::map<Offset, packet> _ranges;
+                size_t _bytes = 0;
+                // Start of the range the most recent segment ended up in
+                Offset _last {};
+
+            public:
+                /// Adds the segment starting at \c beg and returns how many bytes
+                /// were not queued yet. Whatever would take the queue beyond \c limit
+                /// bytes is dropped.
+                size_t insert(Offset beg, packet p, size_t limit = std::numeric_limits<size_t>::max()) {
+                    if (!p.len() || _bytes >= limit) {
+                        return 0;
+                    }
+                    if (p.len() > limit - _bytes) {
+                        p.trim_back(p.len() - (limit - _bytes));
+                    }
+                    auto before = _bytes;
+                    auto end = beg + p.len();
+                    auto next = _ranges.upper_bound(beg);
+                    if (next != _ranges.begin()) {
+                        auto prev = std::prev(next);
+                        auto prev_end = prev->first + prev->second.len();
+                        if (end <= prev_end) {
+                            _last = prev->first;
+                            return 0;
+                        }
+                        if (beg <= prev_end) {
+                            // Extends the previous range
+                            p.trim_front(prev_end - beg);
+                            auto merged = std::move(prev->second);
+                            merged.append(std::move(p));
+                            p = std::move(merged);
+                            beg = prev->first;
+                            _bytes -= prev_end - prev->first;
+                            _ranges.erase(prev);
+                        }
+                    }
+                    // Swallow the ranges the segment covers or reaches
+                    while (next != _ranges.end() && next->first <= end) {
+                        auto next_end = next->first + next->second.len();
+                        _bytes -= next->second.len();
+                        if (end < next_end) {
+                            next->second.trim_front(end - next->first);
+                            p.append(std::move(next->second));
+                            end = next_end;
+                        }
+                        next = _ranges.erase(next);
+                    }
+                    _bytes += p.len();
+                    _last = beg;
+                    _ranges.emplace_hint(next, beg, std::move(p));
+                    return _bytes - before;
+                }
+
+                /// Hands the data following \c next over to \c deliver, trimmed so
+                /// that it starts at \c next, and forgets about data before it.
+                /// Returns the offset following the delivered data.
+                template<typename Func>
+                Offset pop_front(Offset next, Func &&deliver) {
+                    while (!_ranges.empty()) {
+                        auto it = _ranges.begin();
+                        auto end = it->first + it->second.len();
+                        if (next < it->first) {
+                            break;
+                        }
+                        _bytes -= it->second.len();
+                        if (next < end) {
+                            it->second.trim_front(next - it->first);
+                            next = end;
+                            deliver(std::move(it->second));
+                        }
+                        _ranges.erase(it);
+                    }
+                    return next;
+                }
+
+                /// Stores up to \c max ranges as [begin, end) pairs, the one holding
+                /// the most recently inserted segment first, as SACK blocks are
+                /// reported (RFC 2018). Returns the number of ranges stored.
+                size_t ranges(std::pair<Offset, Offset> *out, size_t max) const {
+                    size_t n = 0;
+                    auto last = _ranges.find(_last);
+                    if (last != _ranges.end() && n < max) {
+                        out[n++] = {last->first, last->first + last->second.len()};
+                    }
+                    for (auto it = _ranges.begin(); it != _ranges.end() && n < max; ++it) {
+                        if (it != last) {
+                            out[n++] = {it->first, it->first + it->second.len()};
+                        }
+                    }
+                    return n;
+                }
+
+                bool empty() const noexcept {
+                    return _ranges.empty();
+                }
+                /// Number of bytes queued
+                size_t bytes() const noexcept {
+                    return _bytes;
+                }
+                /// Number of disjoint ranges queued
+                size_t size() const noexcept {
+                    return _ranges.size();
+                }
+                void clear() {
+                    _ranges.clear();
+                    _bytes = 0;
+                }
+            };
+
         }    // namespace net
 
     }    // namespace actor
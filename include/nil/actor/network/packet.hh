@@ -36,6 +36,7 @@
 #include <algorithm>
 #include <iosfwd>
 #include <functional>
+#include <utility>
 
 namespace nil {
     namespace actor {
@@ -55,6 +56,8 @@ namespace nil {
                 uint8_t udp_hdr_len = 8;
                 bool needs_ip_csum = false;
                 bool reassembled = false;
+                // L4 checksum already verified in software (GRO)
+                bool rx_csum_verified = false;
                 uint16_t tso_seg_size = 0;
                 // HW stripped VLAN header (CPU order)
                 boost::optional<uint16_t> vlan_tci;
@@ -293,6 +296,12 @@ namespace nil {
                 packet free_on_cpu(
                     unsigned cpu, std::function<void()> cb = [] {});
 
+                // replace the deleter of the packet with d; the caller becomes
+                // responsible for the one returned
+                deleter exchange_deleter(deleter d) {
+                    return std::exchange(_impl->_deleter, std::move(d));
+                }
+
                 void linearize() {
                     return linearize(0, len());
                 }
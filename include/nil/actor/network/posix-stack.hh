@@ -27,6 +27,7 @@
 #include <nil/actor/core/sharded.hh>
 #include <nil/actor/core/detail/pollable_fd.hh>
 #include <nil/actor/network/stack.hh>
+#include <nil/actor/network/connection_balancing.hh>
 #include <nil/actor/core/polymorphic_temporary_buffer.hh>
 #include <nil/actor/core/detail/buffer_allocator.hh>
 
@@ -55,9 +56,8 @@ namespace nil {
                         _cpu_load[cpu]--;
                     }
                     shard_id next_cpu() {
-                        // FIXME: The naive algorithm will just round robin the connections around the shards.
-                        // A more complex version can keep track of the amount of activity in each connection,
-                        // and use that information.
+                        // Counts connections only; see connection_balancing_policy for taking
+                        // the activity of each shard into account.
                         auto min_el = std::min_element(_cpu_load.begin(), _cpu_load.end());
                         auto cpu = shard_id(std::distance(_cpu_load.begin(), min_el));
                         _cpu_load[cpu]++;
@@ -67,6 +67,11 @@ namespace nil {
                         _cpu_load[cpu]++;
                         return cpu;
                     }
+                    shard_id next_cpu(connection_balancing_policy &policy, const socket_address &peer) {
+                        auto cpu = policy.next_cpu(_cpu_load, peer);
+                        assert(cpu < smp::count);
+                        return force_cpu(cpu);
+                    }
                 };
 
                 lw_shared_ptr<load_balancer> _lb;
@@ -111,12 +116,19 @@ namespace nil {
                 handle get_handle(shard_id cpu) {
                     return handle(_lb->force_cpu(cpu), _lb);
                 }
+                handle get_handle(connection_balancing_policy &policy, const socket_address &peer) {
+                    return handle(_lb->next_cpu(policy, peer), _lb);
+                }
             };
 
             class posix_data_source_impl final : public data_source_impl, private detail::buffer_allocator {
                 boost::container::pmr::polymorphic_allocator<char> *_buffer_allocator;
                 pollable_fd _fd;
                 connected_socket_input_stream_config _config;
+                // Set through connected_socket::set_read_size_hint(), shared with the socket
+                lw_shared_ptr<size_t> _read_size_hint;
+                // Whether the buffer being read into was sized after the hint
+                bool _hinted = false;
 
             private:
                 virtual temporary_buffer<char> allocate_buffer() override;
@@ -124,9 +136,10 @@ namespace nil {
             public:
                 explicit posix_data_source_impl(
                     pollable_fd fd, connected_socket_input_stream_config config,
-                    boost::container::pmr::polymorphic_allocator<char> *allocator = memory::malloc_allocator) :
+                    boost::container::pmr::polymorphic_allocator<char> *allocator = memory::malloc_allocator,
+                    lw_shared_ptr<size_t> read_size_hint = make_lw_shared<size_t>(0)) :
                     _buffer_allocator(allocator),
-                    _fd(std::move(fd)), _config(config) {
+                    _fd(std::move(fd)), _config(config), _read_size_hint(std::move(read_size_hint)) {
                 }
                 future<temporary_buffer<char>> get() override;
                 future<> close() override;
@@ -190,15 +203,19 @@ namespace nil {
                 conntrack _conntrack;
                 server_socket::load_balancing_algorithm _lba;
                 shard_id _fixed_cpu;
+                std::shared_ptr<connection_balancing_policy> _policy;
                 boost::container::pmr::polymorphic_allocator<char> *_allocator;
 
             public:
                 explicit posix_server_socket_impl(
-                    int protocol, socket_address sa, pollable_fd lfd, server_socket::load_balancing_algorithm lba,
-                    shard_id fixed_cpu,
+                    int protocol, socket_address sa, pollable_fd lfd, const listen_options &opts,
                     boost::container::pmr::polymorphic_allocator<char> *allocator = memory::malloc_allocator) :
                     _sa(sa),
-                    _protocol(protocol), _lfd(std::move(lfd)), _lba(lba), _fixed_cpu(fixed_cpu), _allocator(allocator) {
+                    _protocol(protocol), _lfd(std::move(lfd)), _lba(opts.lba), _fixed_cpu(opts.fixed_cpu),
+                    _policy(opts.balancing_policy), _allocator(allocator) {
+                    if (_lba == server_socket::load_balancing_algorithm::activity && !_policy) {
+                        _policy = std::make_shared<activity_balancing_policy>();
+                    }
                 }
                 virtual future<accept_result> accept() override;
                 virtual void abort_accept() override;
@@ -226,6 +243,7 @@ namespace nil {
             class posix_network_stack : public network_stack {
             private:
                 const bool _reuseport;
+                shard_activity_sampler _activity_sampler;
 
             protected:
                 boost::container::pmr::polymorphic_allocator<char> *_allocator;
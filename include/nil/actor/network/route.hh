@@ -0,0 +1,127 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            /// An IPv4 route, addresses in host byte order.
+            struct ipv4_route {
+                uint32_t prefix = 0;
+                uint8_t length = 0;
+                /// Next hop, 0 when the destination is on-link
+                uint32_t gateway = 0;
+                /// Preferred source address, 0 to use the primary one
+                uint32_t source = 0;
+            };
+
+            /// Longest prefix match table for IPv4 routes.
+            ///
+            /// A DIR-16-8-8 multibit trie: the 16 most significant bits of the
+            /// destination index a flat first level, and prefixes longer than 16 (24)
+            /// bits expand into 256-entry chunks of the second (third) level, so that a
+            /// lookup costs at most three dependent loads. Entries refer to
+            /// deduplicated next hops.
+            ///
+            /// The table is rebuilt on every change: updates are rare, lookups happen
+            /// for every packet. Recent lookups are remembered in a small direct mapped
+            /// cache, hit by destinations we keep talking to.
+            class ipv4_route_table {
+            public:
+                struct next_hop {
+                    uint32_t gateway;
+                    uint32_t source;
+                };
+
+            private:
+                // An entry is either 0 (no route), a next hop index + 1, or a chunk
+                // index tagged with chunk_bit.
+                static constexpr uint32_t chunk_bit = 1u << 31;
+                static constexpr size_t cache_size = 256;
+                struct cache_entry {
+                    uint32_t dst;
+                    uint32_t generation;
+                    uint32_t entry;
+                };
+                std::vector<ipv4_route> _routes;
+                std::vector<next_hop> _next_hops;
+                std::vector<uint32_t> _level1;
+                std::vector<std::array<uint32_t, 256>> _level2;
+                std::vector<std::array<uint32_t, 256>> _level3;
+                mutable std::array<cache_entry, cache_size> _cache {};
+                uint32_t _generation = 1;
+
+            private:
+                void rebuild();
+                uint32_t next_hop_entry(const ipv4_route &r);
+                uint32_t chunk_for(std::vector<std::array<uint32_t, 256>> &level, uint32_t &entry);
+                uint32_t walk(uint32_t dst) const noexcept {
+                    auto e = _level1[dst >> 16];
+                    if (e & chunk_bit) {
+                        e = _level2[e & ~chunk_bit][(dst >> 8) & 0xff];
+                        if (e & chunk_bit) {
+                            e = _level3[e & ~chunk_bit][dst & 0xff];
+                        }
+                    }
+                    return e;
+                }
+
+            public:
+                ipv4_route_table();
+                /// Adds a route, or replaces the one with the same prefix and length.
+                void add(ipv4_route r);
+                /// Returns whether there was such a route.
+                bool remove(uint32_t prefix, uint8_t length);
+                /// Replaces all routes at once.
+                void assign(std::vector<ipv4_route> routes);
+                const std::vector<ipv4_route> &routes() const noexcept {
+                    return _routes;
+                }
+                /// Next hop of the most specific route to \c dst, nullptr if none.
+                const next_hop *lookup(uint32_t dst) const noexcept {
+                    auto &c = _cache[(dst ^ (dst >> 8) ^ (dst >> 16)) % cache_size];
+                    if (c.dst != dst || c.generation != _generation) {
+                        c = {dst, _generation, walk(dst)};
+                    }
+                    return c.entry ? &_next_hops[c.entry - 1] : nullptr;
+                }
+                /// Same as lookup(), bypassing the cache.
+                const next_hop *lookup_uncached(uint32_t dst) const noexcept {
+                    auto e = walk(dst);
+                    return e ? &_next_hops[e - 1] : nullptr;
+                }
+            };
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,66 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <cstddef>
+
+#include <nil/actor/network/api.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            /// Shared memory transport for peers running on the same host.
+            ///
+            /// A connection is bootstrapped over a unix domain socket: the connecting
+            /// side creates a memory file holding one ring per direction and two
+            /// eventfds, and passes them to the listening side. Data is then exchanged
+            /// through the rings without entering the kernel, and eventfds are only
+            /// written while the peer is waiting. Received buffers point into the
+            /// mapping, so that reading does not copy.
+            ///
+            /// The resulting connected_socket can be used wherever a TCP one is, in
+            /// particular by rpc::client and rpc::server:
+            ///
+            ///     rpc::protocol<serializer>::server srv(proto, opts, net::shm_listen(addr));
+            ///     rpc::protocol<serializer>::client cli(proto, opts, net::shm_socket(), addr);
+            struct shm_socket_options {
+                /// Capacity of the ring of each direction, rounded up to a power of two
+                size_t ring_size = 1 << 20;
+            };
+
+            /// Creates a socket connecting to a unix domain address passed to shm_listen().
+            ::nil::actor::socket shm_socket(const shm_socket_options &opts = shm_socket_options());
+
+            /// Listens for shared memory connections on a unix domain address.
+            ///
+            /// Connections are served by the shard that accepts them.
+            server_socket shm_listen(socket_address sa, listen_options opts = listen_options());
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
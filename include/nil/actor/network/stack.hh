@@ -35,6 +35,17 @@ namespace nil {
         namespace net {
 
             /// \cond internal
+            /// Received data of a connection, for stream_receiver
+            class packet_source_impl {
+            public:
+                virtual ~packet_source_impl() {
+                }
+                /// Returns the data received since the last call, waiting for some
+                /// if there is none. An empty packet means the end of the stream.
+                virtual future<packet> get() = 0;
+                virtual future<> close() = 0;
+            };
+
             class connected_socket_impl {
             public:
                 virtual ~connected_socket_impl() {
@@ -42,6 +53,9 @@ namespace nil {
                 virtual data_source source() = 0;
                 virtual data_source source(connected_socket_input_stream_config csisc);
                 virtual data_sink sink() = 0;
+                virtual std::unique_ptr<packet_source_impl> packet_source();
+                virtual void set_read_size_hint(size_t size) {
+                }
                 virtual void shutdown_input() = 0;
                 virtual void shutdown_output() = 0;
                 virtual void set_nodelay(bool nodelay) = 0;
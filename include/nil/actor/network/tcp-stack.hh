@@ -40,6 +40,7 @@ namespace nil {
         namespace net {
 
             struct ipv4_traits;
+            struct ipv6_traits;
             template<typename InetTraits>
             class tcp;
 
@@ -47,6 +48,13 @@ namespace nil {
 
             nil::actor::socket tcpv4_socket(tcp<ipv4_traits> &tcpv4);
 
+            server_socket tcpv6_listen(tcp<ipv6_traits> &tcpv6, uint16_t port, listen_options opts);
+
+            nil::actor::socket tcpv6_socket(tcp<ipv6_traits> &tcpv6);
+
+            // connect() picks the protocol instance by the family of the remote address
+            nil::actor::socket tcp_dual_stack_socket(tcp<ipv4_traits> &tcpv4, tcp<ipv6_traits> &tcpv6);
+
         }    // namespace net
 
     }    // namespace actor
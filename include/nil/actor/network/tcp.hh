@@ -34,9 +34,13 @@
 #include <nil/actor/network/ip.hh>
 #include <nil/actor/network/const.hh>
 #include <nil/actor/network/packet-util.hh>
+#include <nil/actor/network/siphash.hh>
+#include <nil/actor/network/ephemeral_ports.hh>
+#include <nil/actor/network/timer_wheel.hh>
 #include <nil/actor/detail/std-compat.hh>
 #include <unordered_map>
 #include <map>
+#include <cstring>
 #include <functional>
 #include <deque>
 #include <chrono>
@@ -44,9 +48,6 @@
 #include <stdexcept>
 #include <system_error>
 
-#include <nil/crypto3/hash/md5.hpp>
-#include <nil/crypto3/hash/algorithm/hash.hpp>
-
 namespace nil {
     namespace actor {
 
@@ -99,7 +100,15 @@ namespace nil {
 
             struct tcp_option {
                 // The kind and len field are fixed and defined in TCP protocol
-                enum class option_kind : uint8_t { mss = 2, win_scale = 3, sack = 4, timestamps = 8, nop = 1, eol = 0 };
+                enum class option_kind : uint8_t {
+                    mss = 2,
+                    win_scale = 3,
+                    sack = 4,
+                    sack_blocks = 5,
+                    timestamps = 8,
+                    nop = 1,
+                    eol = 0
+                };
                 enum class option_len : uint8_t { mss = 4, win_scale = 3, sack = 2, timestamps = 10, nop = 1, eol = 1 };
                 static void write(char *p, option_kind kind, option_len len) {
                     p[0] = static_cast<uint8_t>(kind);
@@ -177,6 +186,11 @@ namespace nil {
                     }
                 };
                 static const uint8_t align = 4;
+                // With no timestamps, four blocks fit in the option space
+                static constexpr unsigned max_sack_blocks = 4;
+                static uint8_t sack_blocks_size(unsigned nr_blocks) {
+                    return nr_blocks ? 2 + 8 * nr_blocks : 0;
+                }
 
                 void parse(uint8_t *beg, uint8_t *end);
                 uint8_t fill(void *h, const tcp_hdr *th, uint8_t option_size);
@@ -193,6 +207,9 @@ namespace nil {
                 uint16_t _local_mss;
                 uint8_t _remote_win_scale = 0;
                 uint8_t _local_win_scale = 0;
+                // SACK blocks carried by the next segment, set up by the tcb
+                std::pair<uint32_t, uint32_t> _sack_blocks[max_sack_blocks];
+                uint8_t _nr_sack_blocks = 0;
             };
             inline char *&operator+=(char *&x, tcp_option::option_len len) {
                 x += uint8_t(len);
@@ -317,6 +334,27 @@ namespace nil {
                 }
             };
 
+            // SYN cookies (RFC 4987): when a listener has no room left, the SYN,ACK is
+            // sent without allocating a tcb, and its sequence number encodes what the
+            // tcb would have remembered about the SYN. The final ACK of the handshake
+            // is validated by recomputing the cookie, and only then the tcb is created.
+            //
+            // Cookie layout, from the most significant bit: a 3-bit counter of
+            // 64s periods, 7 bits of options (MSS index, window scale, SACK permitted)
+            // and 22 bits of keyed hash over the flow, the client ISN, the counter and
+            // the options.
+            struct syn_cookie {
+                static constexpr unsigned counter_bits = 3;
+                static constexpr unsigned option_bits = 7;
+                static constexpr unsigned hash_bits = 22;
+                static constexpr std::chrono::seconds period {64};
+
+                // Options of the SYN \c opt, rounded to what fits the cookie; none when
+                // the peer's MSS is below the smallest one a cookie can carry
+                static boost::optional<uint32_t> encode_options(const tcp_option &opt);
+                static void decode_options(uint32_t bits, tcp_option &opt);
+            };
+
             struct tcp_tag { };
             using tcp_packet_merger = packet_merger<tcp_seq, tcp_tag>;
 
@@ -412,14 +450,14 @@ namespace nil {
                         std::deque<packet> data;
                         // The total size of data stored in std::deque<packet> data
                         size_t data_size = 0;
-                        tcp_packet_merger out_of_order;
+                        packet_reassembly_queue<tcp_seq> out_of_order;
                         boost::optional<promise<>> _data_received_promise;
                         // The maximun memory buffer size allowed for receiving
                         // Currently, it is the same as default receive window size when window scaling is enabled
                         size_t max_receive_buf_size = 3737600;
                     } _rcv;
                     tcp_option _option;
-                    timer<lowres_clock> _delayed_ack;
+                    wheel_timer _delayed_ack;
                     // Retransmission timeout
                     std::chrono::milliseconds _rto {1000};
                     std::chrono::milliseconds _persist_time_out {1000};
@@ -428,23 +466,16 @@ namespace nil {
                     // Clock granularity
                     static constexpr std::chrono::milliseconds _rto_clk_granularity {1};
                     static constexpr uint16_t _max_nr_retransmit {5};
-                    timer<lowres_clock> _retransmit;
-                    timer<lowres_clock> _persist;
+                    wheel_timer _retransmit;
+                    wheel_timer _persist;
                     uint16_t _nr_full_seg_received = 0;
-                    struct isn_secret {
-                        // 512 bits secretkey for ISN generating
-                        uint32_t key[16];
-                        isn_secret() {
-                            std::random_device rd;
-                            std::default_random_engine e(rd());
-                            std::uniform_int_distribution<uint32_t> dist {};
-                            for (auto &k : key) {
-                                k = dist(e);
-                            }
-                        }
-                    };
-                    static isn_secret _isn_secret;
+                    // Secret key for ISN generating
+                    static const siphash_key _isn_secret;
                     tcp_seq get_isn();
+                    // Set while the tcb counts as pending in the listener it was created for
+                    bool _pending_in_listener = false;
+                    // Flow hash the local port was allocated for, by connect()
+                    boost::optional<uint32_t> _ephemeral_flow_hash;
                     circular_buffer<typename InetTraits::l4packet> _packetq;
                     bool _poll_active = false;
                     uint32_t get_default_receive_window_size() {
@@ -462,6 +493,7 @@ namespace nil {
                 public:
                     tcb(tcp &t, connid id);
                     void input_handle_listen_state(tcp_hdr *th, packet p);
+                    void restore_from_syn_cookie(tcp_hdr *th, const tcp_option &opt, tcp_seq iss);
                     void input_handle_syn_sent_state(tcp_hdr *th, packet p);
                     void input_handle_other_state(tcp_hdr *th, packet p);
                     void output_one(bool data_retransmit = false);
@@ -510,6 +542,7 @@ namespace nil {
                     void respond_with_reset(tcp_hdr *th);
                     bool merge_out_of_order();
                     void insert_out_of_order(tcp_seq seq, packet p);
+                    void prepare_sack_blocks(uint16_t len);
                     void trim_receive_data_after_window();
                     bool should_send_ack(uint16_t seg_len);
                     void clear_delayed_ack();
@@ -591,7 +624,9 @@ namespace nil {
                         return _tcp.hw_features().mtu - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min;
                     }
                     void queue_packet(packet p) {
-                        _packetq.emplace_back(typename InetTraits::l4packet {_foreign_ip, std::move(p)});
+                        typename InetTraits::l4packet l4p {_foreign_ip, std::move(p)};
+                        l4p.from = _local_ip;
+                        _packetq.emplace_back(std::move(l4p));
                     }
                     void signal_data_received() {
                         if (_rcv._data_received_promise) {
@@ -686,18 +721,29 @@ namespace nil {
                     uint32_t data_segment_acked(tcp_seq seg_ack);
                     bool segment_acceptable(tcp_seq seg_seq, unsigned seg_len);
                     void init_from_options(tcp_hdr *th, uint8_t *opt_start, uint8_t *opt_end);
+                    void apply_options(tcp_hdr *th);
                     friend class connection;
+                    friend class tcp;
                 };
                 inet_type &_inet;
+                // Retransmission, persist and delayed ACK timers of all connections,
+                // declared first so that it outlives them
+                timer_wheel _timers;
                 std::unordered_map<connid, lw_shared_ptr<tcb>, connid_hash> _tcbs;
                 std::unordered_map<uint16_t, listener *> _listening;
                 std::random_device _rd;
                 std::default_random_engine _e;
-                std::uniform_int_distribution<uint16_t> _port_dist {41952, 65535};
+                boost::optional<ephemeral_port_allocator> _ephemeral_ports;
                 circular_buffer<std::pair<lw_shared_ptr<tcb>, ethernet_address>> _poll_tcbs;
                 // queue for packets that do not belong to any tcb
-                circular_buffer<ipv4_traits::l4packet> _packetq;
+                circular_buffer<typename InetTraits::l4packet> _packetq;
                 semaphore _queue_space = {212992};
+                siphash_key _syn_cookie_key = siphash_key::random();
+                bool _syn_cookies = true;
+                lowres_clock::time_point _last_syn_cookie;
+                uint64_t _syn_cookies_sent = 0;
+                uint64_t _syn_cookies_accepted = 0;
+                uint64_t _syn_cookies_rejected = 0;
                 metrics::metric_groups _metrics;
 
             public:
@@ -776,6 +822,10 @@ namespace nil {
                     bool full() {
                         return _pending + _q.size() >= _q.max_size();
                     }
+                    // Established connections alone fill the queue
+                    bool accept_queue_full() {
+                        return _q.size() >= _q.max_size();
+                    }
                     void inc_pending() {
                         _pending++;
                     }
@@ -809,10 +859,27 @@ namespace nil {
                         it->second->dec_pending();
                     }
                 }
+                ephemeral_port_allocator &ephemeral_ports();
+                void remove_pending_tcb(uint16_t local_port) {
+                    auto it = _listening.find(local_port);
+                    if (it != _listening.end()) {
+                        it->second->dec_pending();
+                    }
+                }
+                // Answer SYNs with cookies when a listener is full, instead of a reset
+                void set_syn_cookies(bool enabled) {
+                    _syn_cookies = enabled;
+                }
 
             private:
                 void send_packet_without_tcb(ipaddr from, ipaddr to, packet p);
+                void send_control_packet(packet p, ipaddr local_ip, ipaddr foreign_ip, uint8_t hdr_len);
                 void respond_with_reset(tcp_hdr *rth, ipaddr local_ip, ipaddr foreign_ip);
+                static uint64_t keyed_flow_hash(const siphash_key &key, const connid &id, uint32_t a, uint32_t b);
+                uint32_t syn_cookie_counter() const;
+                tcp_seq make_syn_cookie(const connid &id, tcp_seq client_isn, uint32_t options, uint32_t counter) const;
+                void respond_with_syn_cookie(tcp_hdr *rth, packet p, const connid &id);
+                bool accept_syn_cookie(tcp_hdr *th, packet &p, const connid &id, listener &l);
                 friend class listener;
             };
 
@@ -820,12 +887,28 @@ namespace nil {
             tcp<InetTraits>::tcp(inet_type &inet) : _inet(inet), _e(_rd()) {
                 namespace sm = metrics;
 
-                _metrics.add_group("tcp", {sm::make_derive(
-                                              "linearizations", [] { return tcp_packet_merger::linearizations(); },
-                                              sm::description("Counts a number of times a buffer linearization was "
-                                                              "invoked during the buffers merge process. "
-                                                              "Divide it by a total TCP receive packet rate to get an "
-                                                              "everage number of lineraizations per TCP packet."))});
+                _metrics.add_group(
+                    InetTraits::tcp_metrics_group,
+                    {sm::make_derive("linearizations", [] { return tcp_packet_merger::linearizations(); },
+                                     sm::description("Counts a number of times a buffer linearization was "
+                                                     "invoked during the buffers merge process. "
+                                                     "Divide it by a total TCP receive packet rate to get an "
+                                                     "everage number of lineraizations per TCP packet.")),
+                     sm::make_derive("syn_cookies_sent", [this] { return _syn_cookies_sent; },
+                                     sm::description("Counts SYN,ACKs sent with a cookie because the listener was full")),
+                     sm::make_derive("syn_cookies_accepted", [this] { return _syn_cookies_accepted; },
+                                     sm::description("Counts connections established from a valid SYN cookie")),
+                     sm::make_derive("syn_cookies_rejected", [this] { return _syn_cookies_rejected; },
+                                     sm::description("Counts ACKs to a listener carrying an invalid SYN cookie")),
+                     sm::make_derive("timer_rearms", [this] { return _timers.get_stats().rearms; },
+                                     sm::description("Counts deadlines set on connection timers")),
+                     sm::make_derive("timer_rearms_deferred", [this] { return _timers.get_stats().deferred; },
+                                     sm::description("Counts connection timer deadlines moved later without "
+                                                     "touching the timer wheel")),
+                     sm::make_derive("timer_expirations", [this] { return _timers.get_stats().expired; },
+                                     sm::description("Counts connection timers that went off")),
+                     sm::make_gauge("timers", [this] { return _timers.size(); },
+                                    sm::description("Holds the number of connection timers in the timer wheel"))});
 
                 _inet.register_packet_provider([this, tcb_polled = 0u]() mutable {
                     boost::optional<typename InetTraits::l4packet> l4p;
@@ -864,22 +947,52 @@ namespace nil {
                 return listener(*this, port, queue_length);
             }
 
+            template<typename InetTraits>
+            ephemeral_port_allocator &tcp<InetTraits>::ephemeral_ports() {
+                if (!_ephemeral_ports) {
+                    auto netif = _inet._inet.netif();
+                    // With a single queue every port steers here, and no port is hashed
+                    auto single_queue = netif->hw_queues_count() <= 1;
+                    _ephemeral_ports.emplace(
+                        [netif](uint16_t port) { return connid {ipaddr(), ipaddr(), port, 0}.hash(netif->rss_key()); },
+                        [netif, single_queue](uint32_t hash) {
+                            return single_queue || netif->hash2cpu(hash) == this_shard_id();
+                        },
+                        single_queue ? 0 : netif->hash2cpu_mask(), _e());
+                }
+                return *_ephemeral_ports;
+            }
+
             template<typename InetTraits>
             auto tcp<InetTraits>::connect(socket_address sa) -> connection {
-                uint16_t src_port;
-                connid id;
-                auto src_ip = _inet._inet.host_address();
-                auto dst_ip = ipv4_address(sa);
-                auto dst_port = net::ntoh(sa.u.in.sin_port);
-
-                do {
-                    src_port = _port_dist(_e);
-                    id = connid {src_ip, dst_ip, src_port, dst_port};
-                } while (_inet._inet.netif()->hw_queues_count() > 1 &&
-                         (_inet._inet.netif()->hash2cpu(id.hash(_inet._inet.netif()->rss_key())) != this_shard_id() ||
-                          _tcbs.find(id) != _tcbs.end()));
+                auto dst_ip = ipaddr(sa);
+                auto src_ip = _inet._inet.source_address(dst_ip);
+                auto dst_port = sa.port();
+                auto flow_hash = connid {src_ip, dst_ip, 0, dst_port}.hash(_inet._inet.netif()->rss_key());
+
+                auto &ports = ephemeral_ports();
+                auto id = connid {src_ip, dst_ip, ports.allocate(flow_hash), dst_port};
+                // The port may already be the local end of a connection we accepted
+                if (_tcbs.find(id) != _tcbs.end()) {
+                    std::vector<uint16_t> taken;
+                    try {
+                        while (_tcbs.find(id) != _tcbs.end()) {
+                            taken.push_back(id.local_port);
+                            id.local_port = ports.allocate(flow_hash);
+                        }
+                    } catch (...) {
+                        for (auto port : taken) {
+                            ports.release(flow_hash, port);
+                        }
+                        throw;
+                    }
+                    for (auto port : taken) {
+                        ports.release(flow_hash, port);
+                    }
+                }
 
                 auto tcbp = make_lw_shared<tcb>(*this, id);
+                tcbp->_ephemeral_flow_hash = flow_hash;
                 _tcbs.insert({id, tcbp});
                 tcbp->connect();
                 return connection(tcbp);
@@ -910,7 +1023,7 @@ namespace nil {
                     return;
                 }
 
-                if (!hw_features().rx_csum_offload) {
+                if (!hw_features().rx_csum_offload && !p.offload_info_ref().rx_csum_verified) {
                     checksummer csum;
                     InetTraits::tcp_pseudo_header_checksum(csum, from, to, p.len());
                     csum.sum(p);
@@ -924,7 +1037,7 @@ namespace nil {
                 lw_shared_ptr<tcb> tcbp;
                 if (tcbi == _tcbs.end()) {
                     auto listener = _listening.find(id.local_port);
-                    if (listener == _listening.end() || listener->second->full()) {
+                    if (listener == _listening.end() || (listener->second->full() && !_syn_cookies)) {
                         // 1) In CLOSE state
                         // 1.1 all data in the incoming segment is discarded.  An incoming
                         // segment containing a RST is discarded. An incoming segment not
@@ -942,20 +1055,28 @@ namespace nil {
                         }
                         // 2.2 second check for an ACK
                         if (h.f_ack) {
-                            // Any acknowledgment is bad if it arrives on a connection
+                            // Unless it completes a handshake started with a SYN cookie,
+                            // any acknowledgment is bad if it arrives on a connection
                             // still in the LISTEN state.
                             // <SEQ=SEG.ACK><CTL=RST>
+                            if (!h.f_syn && accept_syn_cookie(&h, p, id, *listener->second)) {
+                                return;
+                            }
                             return respond_with_reset(&h, id.local_ip, id.foreign_ip);
                         }
                         // 2.3 third check for a SYN
                         if (h.f_syn) {
                             // check the security
                             // NOTE: Ignored for now
+                            if (listener->second->full()) {
+                                return respond_with_syn_cookie(&h, std::move(p), id);
+                            }
                             tcbp = make_lw_shared<tcb>(*this, id);
                             _tcbs.insert({id, tcbp});
-                            // TODO: we need to remove the tcb and decrease the pending if
-                            // it stays SYN_RECEIVED state forever.
+                            // Released when the connection is queued to the listener, or
+                            // when the tcb is cleaned up before that.
                             listener->second->inc_pending();
+                            tcbp->_pending_in_listener = true;
 
                             return tcbp->input_handle_listen_state(&h, std::move(p));
                         }
@@ -983,9 +1104,10 @@ namespace nil {
             void tcp<InetTraits>::send_packet_without_tcb(ipaddr from, ipaddr to, packet p) {
                 if (_queue_space.try_wait(p.len())) {    // drop packets that do not fit the queue
                     // FIXME: future is discarded
-                    (void)_inet.get_l2_dst_address(to).then([this, to,
+                    (void)_inet.get_l2_dst_address(to).then([this, from, to,
                                                              p = std::move(p)](ethernet_address e_dst) mutable {
-                        _packetq.emplace_back(ipv4_traits::l4packet {to, std::move(p), e_dst, ip_protocol_num::tcp});
+                        _packetq.emplace_back(
+                            typename InetTraits::l4packet {to, std::move(p), e_dst, ip_protocol_num::tcp, from});
                     });
                 }
             }
@@ -1002,11 +1124,13 @@ namespace nil {
             template<typename InetTraits>
             tcp<InetTraits>::tcb::tcb(tcp &t, connid id) :
                 _tcp(t), _local_ip(id.local_ip), _foreign_ip(id.foreign_ip), _local_port(id.local_port),
-                _foreign_port(id.foreign_port), _delayed_ack([this] {
-                    _nr_full_seg_received = 0;
-                    output();
-                }),
-                _retransmit([this] { retransmit(); }), _persist([this] { persist(); }) {
+                _foreign_port(id.foreign_port),
+                _delayed_ack(t._timers,
+                             [this] {
+                                 _nr_full_seg_received = 0;
+                                 output();
+                             }),
+                _retransmit(t._timers, [this] { retransmit(); }), _persist(t._timers, [this] { persist(); }) {
             }
 
             template<typename InetTraits>
@@ -1037,9 +1161,16 @@ namespace nil {
                 h.checksum = 0;
                 h.write(th);
 
+                send_control_packet(std::move(p), local_ip, foreign_ip, tcp_hdr::len);
+            }
+
+            // Checksums and sends a segment made of a header only
+            template<typename InetTraits>
+            void tcp<InetTraits>::send_control_packet(packet p, ipaddr local_ip, ipaddr foreign_ip, uint8_t hdr_len) {
+                auto th = p.get_header(0, hdr_len);
                 checksummer csum;
                 offload_info oi;
-                InetTraits::tcp_pseudo_header_checksum(csum, local_ip, foreign_ip, tcp_hdr::len);
+                InetTraits::tcp_pseudo_header_checksum(csum, local_ip, foreign_ip, hdr_len);
                 uint16_t checksum;
                 if (hw_features().tx_csum_l4_offload) {
                     checksum = ~csum.get();
@@ -1052,12 +1183,127 @@ namespace nil {
                 tcp_hdr::write_nbo_checksum(th, checksum);
 
                 oi.protocol = ip_protocol_num::tcp;
-                oi.tcp_hdr_len = tcp_hdr::len;
+                oi.tcp_hdr_len = hdr_len;
                 p.set_offload_info(oi);
 
                 send_packet_without_tcb(local_ip, foreign_ip, std::move(p));
             }
 
+            template<typename InetTraits>
+            uint64_t tcp<InetTraits>::keyed_flow_hash(const siphash_key &key, const connid &id, uint32_t a,
+                                                      uint32_t b) {
+                static_assert(std::is_trivially_copyable<ipaddr>::value, "addresses are hashed as bytes");
+                char buf[2 * sizeof(ipaddr) + 2 * sizeof(uint16_t) + 2 * sizeof(uint32_t)];
+                auto p = buf;
+                auto put = [&p](const auto &v) {
+                    std::memcpy(p, &v, sizeof(v));
+                    p += sizeof(v);
+                };
+                put(id.local_ip);
+                put(id.foreign_ip);
+                put(id.local_port);
+                put(id.foreign_port);
+                put(a);
+                put(b);
+                return siphash(key, buf, sizeof(buf));
+            }
+
+            template<typename InetTraits>
+            uint32_t tcp<InetTraits>::syn_cookie_counter() const {
+                auto now = lowres_clock::now().time_since_epoch();
+                return std::chrono::duration_cast<std::chrono::seconds>(now) / syn_cookie::period;
+            }
+
+            template<typename InetTraits>
+            tcp_seq tcp<InetTraits>::make_syn_cookie(const connid &id, tcp_seq client_isn, uint32_t options,
+                                                     uint32_t counter) const {
+                constexpr uint32_t counter_mask = (1u << syn_cookie::counter_bits) - 1;
+                constexpr uint32_t hash_mask = (1u << syn_cookie::hash_bits) - 1;
+                auto hash = keyed_flow_hash(_syn_cookie_key, id, client_isn.raw,
+                                            (counter << syn_cookie::option_bits) | options);
+                return make_seq(((counter & counter_mask) << (syn_cookie::option_bits + syn_cookie::hash_bits)) |
+                                (options << syn_cookie::hash_bits) | (uint32_t(hash) & hash_mask));
+            }
+
+            template<typename InetTraits>
+            void tcp<InetTraits>::respond_with_syn_cookie(tcp_hdr *rth, packet p, const connid &id) {
+                auto opt_start = reinterpret_cast<uint8_t *>(p.get_header(0, rth->data_offset * 4));
+                if (!opt_start) {
+                    return;
+                }
+                opt_start += tcp_hdr::len;
+                tcp_option opt;
+                opt.parse(opt_start, opt_start + rth->data_offset * 4 - tcp_hdr::len);
+                opt._local_mss = hw_features().mtu - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min;
+
+                auto options = syn_cookie::encode_options(opt);
+                if (!options) {
+                    // Rounding the MSS up would make us send segments the peer refused;
+                    // drop the SYN so that its retransmission finds room in the backlog.
+                    return;
+                }
+                _last_syn_cookie = lowres_clock::now();
+                _syn_cookies_sent++;
+
+                packet out;
+                auto options_size = opt.get_size(true, true);
+                auto th = out.prepend_uninitialized_header(tcp_hdr::len + options_size);
+                auto h = tcp_hdr {};
+                h.src_port = rth->dst_port;
+                h.dst_port = rth->src_port;
+                h.seq = make_syn_cookie(id, rth->seq, *options, syn_cookie_counter());
+                h.ack = rth->seq + 1;
+                h.f_syn = true;
+                h.f_ack = true;
+                h.data_offset = (tcp_hdr::len + options_size) / 4;
+                // The window of a SYN is never scaled: what a tcb advertises by default
+                h.window = 29200;
+                h.checksum = 0;
+                opt.fill(th, &h, options_size);
+                h.write(th);
+
+                send_control_packet(std::move(out), id.local_ip, id.foreign_ip, tcp_hdr::len + options_size);
+            }
+
+            template<typename InetTraits>
+            bool tcp<InetTraits>::accept_syn_cookie(tcp_hdr *th, packet &p, const connid &id, listener &l) {
+                // Cookies are only checked for a while after the last one was sent,
+                // so that stray ACKs do not cost a hash each.
+                if (!_syn_cookies || lowres_clock::now() - _last_syn_cookie > 2 * syn_cookie::period) {
+                    return false;
+                }
+                constexpr uint32_t option_mask = (1u << syn_cookie::option_bits) - 1;
+                constexpr uint32_t counter_mask = (1u << syn_cookie::counter_bits) - 1;
+                auto cookie = th->ack - 1;
+                auto client_isn = th->seq - 1;
+                auto options = (cookie.raw >> syn_cookie::hash_bits) & option_mask;
+                auto cookie_counter = cookie.raw >> (syn_cookie::option_bits + syn_cookie::hash_bits);
+                // A cookie is valid for the period it was sent in and the next one
+                auto now = syn_cookie_counter();
+                auto counter = (now & counter_mask) == cookie_counter ? now : now - 1;
+                if ((counter & counter_mask) != cookie_counter || make_syn_cookie(id, client_isn, options, counter) != cookie) {
+                    _syn_cookies_rejected++;
+                    return false;
+                }
+                // The handshake is complete but there is no room for the connection:
+                // drop the ACK, the client retransmits it along with its data.
+                // Half-open connections do not count, they may well be the flood
+                // that made us send cookies.
+                if (l.accept_queue_full()) {
+                    return true;
+                }
+                _syn_cookies_accepted++;
+                tcp_option opt;
+                syn_cookie::decode_options(options, opt);
+                auto tcbp = make_lw_shared<tcb>(*this, id);
+                _tcbs.insert({id, tcbp});
+                l.inc_pending();
+                tcbp->_pending_in_listener = true;
+                tcbp->restore_from_syn_cookie(th, opt, cookie);
+                tcbp->input_handle_other_state(th, std::move(p));
+                return true;
+            }
+
             template<typename InetTraits>
             uint32_t tcp<InetTraits>::tcb::data_segment_acked(tcp_seq seg_ack) {
                 uint32_t total_acked_bytes = 0;
@@ -1114,7 +1360,11 @@ namespace nil {
             void tcp<InetTraits>::tcb::init_from_options(tcp_hdr *th, uint8_t *opt_start, uint8_t *opt_end) {
                 // Handle tcp options
                 _option.parse(opt_start, opt_end);
+                apply_options(th);
+            }
 
+            template<typename InetTraits>
+            void tcp<InetTraits>::tcb::apply_options(tcp_hdr *th) {
                 // Remote receive window scale factor
                 _snd.window_scale = _option._remote_win_scale;
                 // Local receive window scale factor
@@ -1175,6 +1425,26 @@ namespace nil {
                 do_syn_received();
             }
 
+            // Rebuilds the SYN_RECEIVED state the SYN would have left, from the options
+            // carried by the cookie \c iss and the ACK completing the handshake.
+            template<typename InetTraits>
+            void tcp<InetTraits>::tcb::restore_from_syn_cookie(tcp_hdr *th, const tcp_option &opt, tcp_seq iss) {
+                _rcv.initial = th->seq - 1;
+                _rcv.next = th->seq;
+                _rcv.urgent = _rcv.next;
+
+                _snd.initial = iss;
+                _snd.unacknowledged = iss;
+                _snd.next = iss + 1;
+                _snd.recover = iss;
+
+                tcp_debug("syn cookie: LISTEN -> SYN_RECEIVED\n");
+                _option = opt;
+                apply_options(th);
+                _state = SYN_RECEIVED;
+                _snd.syn_tx_time = clock_type::now();
+            }
+
             template<typename InetTraits>
             void tcp<InetTraits>::tcb::input_handle_syn_sent_state(tcp_hdr *th, packet p) {
                 auto opt_len = th->data_offset * 4 - tcp_hdr::len;
@@ -1203,6 +1473,7 @@ namespace nil {
                     // reset", drop the segment, enter CLOSED state, delete TCB, and
                     // return.  Otherwise (no ACK) drop the segment and return.
                     if (acceptable) {
+                        _connect_done.set_exception(tcp_refused_error());
                         return do_reset();
                     } else {
                         return;
@@ -1341,6 +1612,7 @@ namespace nil {
                         if (_snd.unacknowledged <= seg_ack && seg_ack <= _snd.next) {
                             tcp_debug("SYN_RECEIVED -> ESTABLISHED\n");
                             do_established();
+                            _pending_in_listener = false;
                             _tcp.add_connected_tcb(this->shared_from_this(), _local_port);
                         } else {
                             // <SEQ=SEG.ACK><CTL=RST>
@@ -1665,6 +1937,7 @@ namespace nil {
                 bool syn_on = syn_needs_on();
                 bool ack_on = ack_needs_on();
 
+                prepare_sack_blocks(len);
                 auto options_size = _option.get_size(syn_on, ack_on);
                 auto th = p.prepend_uninitialized_header(tcp_hdr::len + options_size);
                 auto h = tcp_hdr {};
@@ -1707,7 +1980,10 @@ namespace nil {
 
                 oi.tcp_hdr_len = tcp_hdr::len + options_size;
 
-                if (_tcp.hw_features().tx_csum_l4_offload) {
+                // TSO emulated in software completes the checksum of every segment
+                // itself, whether the device offloads L4 checksums or not.
+                bool tso = _tcp.hw_features().tx_tso && len > _snd.mss;
+                if (_tcp.hw_features().tx_csum_l4_offload || tso) {
                     oi.needs_csum = true;
 
                     //
@@ -1719,7 +1995,7 @@ namespace nil {
                     // segment length set to 0. All the rest is the same as for a TCP Tx
                     // CSUM offload case.
                     //
-                    if (_tcp.hw_features().tx_tso && len > _snd.mss) {
+                    if (tso) {
                         oi.tso_seg_size = _snd.mss;
                     } else {
                         pseudo_hdr_seg_len = tcp_hdr::len + options_size + len;
@@ -1732,7 +2008,7 @@ namespace nil {
                 InetTraits::tcp_pseudo_header_checksum(csum, _local_ip, _foreign_ip, pseudo_hdr_seg_len);
 
                 uint16_t checksum;
-                if (_tcp.hw_features().tx_csum_l4_offload) {
+                if (oi.needs_csum) {
                     checksum = ~csum.get();
                 } else {
                     csum.sum(p);
@@ -1907,45 +2183,43 @@ namespace nil {
 
             template<typename InetTraits>
             bool tcp<InetTraits>::tcb::merge_out_of_order() {
-                bool merged = false;
-                if (_rcv.out_of_order.map.empty()) {
-                    return merged;
-                }
-                for (auto it = _rcv.out_of_order.map.begin(); it != _rcv.out_of_order.map.end();) {
-                    auto &p = it->second;
-                    auto seg_beg = it->first;
-                    auto seg_len = p.len();
-                    auto seg_end = seg_beg + seg_len;
-                    if (seg_beg <= _rcv.next && _rcv.next < seg_end) {
-                        // This segment has been received out of order and its previous
-                        // segment has been received now
-                        auto trim = _rcv.next - seg_beg;
-                        if (trim) {
-                            p.trim_front(trim);
-                            seg_len -= trim;
-                        }
-                        _rcv.next += seg_len;
-                        _rcv.data_size += p.len();
-                        _rcv.data.push_back(std::move(p));
-                        // Since c++11, erase() always returns the value of the following element
-                        it = _rcv.out_of_order.map.erase(it);
-                        merged = true;
-                    } else if (_rcv.next >= seg_end) {
-                        // This segment has been receive already, drop it
-                        it = _rcv.out_of_order.map.erase(it);
-                    } else {
-                        // seg_beg > _rcv.need, can not merge. Note, seg_beg can grow only,
-                        // so we can stop looking here.
-                        it++;
-                        break;
-                    }
+                if (_rcv.out_of_order.empty()) {
+                    return false;
                 }
+                // Ranges are coalesced as they are queued, so at most one of them
+                // continues the in-order data
+                auto next = _rcv.out_of_order.pop_front(_rcv.next, [this](packet p) {
+                    _rcv.data_size += p.len();
+                    _rcv.data.push_back(std::move(p));
+                });
+                auto merged = next != _rcv.next;
+                _rcv.next = next;
                 return merged;
             }
 
             template<typename InetTraits>
             void tcp<InetTraits>::tcb::insert_out_of_order(tcp_seq seg, packet p) {
-                _rcv.out_of_order.merge(seg, std::move(p));
+                // Out of order data takes receive buffer space just like in-order data
+                auto limit = _rcv.max_receive_buf_size - std::min(_rcv.data_size, _rcv.max_receive_buf_size);
+                _rcv.out_of_order.insert(seg, std::move(p), limit);
+            }
+
+            template<typename InetTraits>
+            void tcp<InetTraits>::tcb::prepare_sack_blocks(uint16_t len) {
+                _option._nr_sack_blocks = 0;
+                if (!_option._sack_received || _rcv.out_of_order.empty()) {
+                    return;
+                }
+                std::pair<tcp_seq, tcp_seq> blocks[tcp_option::max_sack_blocks];
+                auto n = _rcv.out_of_order.ranges(blocks, tcp_option::max_sack_blocks);
+                // The options must not push a full segment beyond the MSS
+                while (n && len + tcp_option::sack_blocks_size(n) > _snd.mss) {
+                    --n;
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    _option._sack_blocks[i] = {blocks[i].first.raw, blocks[i].second.raw};
+                }
+                _option._nr_sack_blocks = n;
             }
 
             template<typename InetTraits>
@@ -2084,12 +2358,20 @@ namespace nil {
             void tcp<InetTraits>::tcb::cleanup() {
                 _snd.unsent.clear();
                 _snd.data.clear();
-                _rcv.out_of_order.map.clear();
+                _rcv.out_of_order.clear();
                 _rcv.data_size = 0;
                 _rcv.data.clear();
                 stop_retransmit_timer();
                 clear_delayed_ack();
                 remove_from_tcbs();
+                if (_pending_in_listener) {
+                    _pending_in_listener = false;
+                    _tcp.remove_pending_tcb(_local_port);
+                }
+                if (_ephemeral_flow_hash) {
+                    _tcp.ephemeral_ports().release(*_ephemeral_flow_hash, _local_port);
+                    _ephemeral_flow_hash = boost::none;
+                }
             }
 
             template<typename InetTraits>
@@ -2098,15 +2380,10 @@ namespace nil {
                 // with the expression:
                 //   ISN = M + F(localip, localport, remoteip, remoteport, secretkey)
                 //   M is the 4 microsecond timer
+                // F is SipHash keyed with a per-process secret.
                 using namespace std::chrono;
-                crypto3::hashes::md5::digest_type hash;
-                hash[0] = _local_ip.ip;
-                hash[1] = _foreign_ip.ip;
-                hash[2] = (_local_port << 16) + _foreign_port;
-                hash[3] = _isn_secret.key[15];
-                crypto3::hash<crypto3::hashes::md5>(std::begin(_isn_secret.key), std::end(_isn_secret.key), &hash[4]);
-                //                CryptoPP::Weak::MD5::Transform(hash, _isn_secret.key);
-                auto seq = hash[0];
+                auto id = connid {_local_ip, _foreign_ip, _local_port, _foreign_port};
+                uint32_t seq = _tcp.keyed_flow_hash(_isn_secret, id, 0, 0);
                 auto m = duration_cast<microseconds>(clock_type::now().time_since_epoch());
                 seq += m.count() / 4;
                 return make_seq(seq);
@@ -2171,7 +2448,7 @@ namespace nil {
             constexpr std::chrono::milliseconds tcp<InetTraits>::tcb::_rto_clk_granularity;
 
             template<typename InetTraits>
-            typename tcp<InetTraits>::tcb::isn_secret tcp<InetTraits>::tcb::_isn_secret;
+            const siphash_key tcp<InetTraits>::tcb::_isn_secret = siphash_key::random();
 
         }    // namespace net
 
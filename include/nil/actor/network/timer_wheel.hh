@@ -0,0 +1,178 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/core/lowres_clock.hh>
+#include <nil/actor/core/timer.hh>
+#include <nil/actor/detail/noncopyable_function.hh>
+
+#include <boost/intrusive/list.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            class timer_wheel;
+
+            /// A timer driven by a timer_wheel instead of the reactor.
+            ///
+            /// Meant for timers that are re-armed far more often than they expire, like
+            /// the retransmission timer of a TCP connection. Moving the deadline later
+            /// only records it, and the wheel checks it again when the old deadline
+            /// comes. Cancelling is just as lazy.
+            ///
+            /// A timer may outlive its wheel, as a tcb kept alive by a continuation
+            /// outlives the stack. The wheel detaches it when destroyed: the timer
+            /// can still be armed and destroyed, but never fires again.
+            class wheel_timer {
+            public:
+                using clock_type = lowres_clock;
+
+            private:
+                using hook_type =
+                    boost::intrusive::list_member_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>>;
+                // Links the timer into a slot while scheduled
+                hook_type _hook;
+                // Links the timer into the wheel for as long as both live
+                hook_type _wheel_hook;
+                // Null once the wheel is gone
+                timer_wheel *_wheel;
+                noncopyable_function<void()> _callback;
+                clock_type::time_point _deadline;
+                // Tick of the slot the timer is linked into, at or before the deadline
+                uint64_t _tick = 0;
+                bool _armed = false;
+                friend class timer_wheel;
+
+            public:
+                explicit wheel_timer(timer_wheel &wheel) noexcept;
+                wheel_timer(timer_wheel &wheel, noncopyable_function<void()> callback) noexcept;
+                wheel_timer(const wheel_timer &) = delete;
+                ~wheel_timer();
+                void set_callback(noncopyable_function<void()> callback) noexcept {
+                    _callback = std::move(callback);
+                }
+                void arm(clock_type::time_point until) {
+                    rearm(until);
+                }
+                void arm(clock_type::duration delta) {
+                    rearm(clock_type::now() + delta);
+                }
+                void rearm(clock_type::time_point until);
+                bool armed() const noexcept {
+                    return _armed;
+                }
+                /// Returns whether the timer was armed.
+                bool cancel() noexcept {
+                    auto was_armed = _armed;
+                    _armed = false;
+                    return was_armed;
+                }
+                clock_type::time_point get_timeout() const noexcept {
+                    return _deadline;
+                }
+            };
+
+            /// Hierarchical timing wheel (Varghese and Lauck) for the timers of one shard.
+            ///
+            /// Four levels of 256 slots, the first one a tick wide, cover 2^32 ticks.
+            /// Arming a timer links it into a slot in O(1). A slot of a higher level is
+            /// spread over the lower ones when the wheel gets to it. The wheel advances
+            /// on a single reactor timer, one tick at a time, and runs the timers that
+            /// are due in one batch.
+            class timer_wheel {
+            public:
+                using clock_type = lowres_clock;
+                static constexpr std::chrono::milliseconds tick {10};
+
+                struct stats {
+                    /// Deadlines set on timers
+                    uint64_t rearms = 0;
+                    /// Deadlines recorded without touching the wheel
+                    uint64_t deferred = 0;
+                    /// Timers that reached a slot before their deadline and were put back
+                    uint64_t reinserted = 0;
+                    /// Timers moved down a level
+                    uint64_t cascaded = 0;
+                    /// Callbacks run
+                    uint64_t expired = 0;
+                };
+
+            private:
+                static constexpr unsigned level_bits = 8;
+                static constexpr unsigned slots_per_level = 1 << level_bits;
+                static constexpr unsigned levels = 4;
+                using list_type = boost::intrusive::list<
+                    wheel_timer,
+                    boost::intrusive::member_hook<wheel_timer, wheel_timer::hook_type, &wheel_timer::_hook>,
+                    boost::intrusive::constant_time_size<false>>;
+                using timer_list_type = boost::intrusive::list<
+                    wheel_timer,
+                    boost::intrusive::member_hook<wheel_timer, wheel_timer::hook_type, &wheel_timer::_wheel_hook>,
+                    boost::intrusive::constant_time_size<false>>;
+
+                std::array<list_type, levels * slots_per_level> _slots;
+                // Every timer attached to the wheel, scheduled or not
+                timer_list_type _timers;
+                clock_type::time_point _start;
+                // Last tick processed
+                uint64_t _now = 0;
+                // Timers linked into a slot, or due and about to run
+                size_t _linked = 0;
+                timer<clock_type> _driver;
+                stats _stats;
+
+            private:
+                uint64_t current_tick() const noexcept;
+                uint64_t tick_of(clock_type::time_point tp) const noexcept;
+                void schedule(wheel_timer &t);
+                void link(wheel_timer &t, uint64_t when);
+                void place(wheel_timer &t, uint64_t when) noexcept;
+                void advance();
+                friend class wheel_timer;
+
+            public:
+                timer_wheel();
+                timer_wheel(const timer_wheel &) = delete;
+                /// Detaches the timers that outlive the wheel.
+                ~timer_wheel();
+                /// Number of timers in the wheel, including cancelled ones not reached yet
+                size_t size() const noexcept {
+                    return _linked;
+                }
+                const stats &get_stats() const noexcept {
+                    return _stats;
+                }
+            };
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
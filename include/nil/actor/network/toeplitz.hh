@@ -24,6 +24,9 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
 #include <vector>
 
 namespace nil {
@@ -49,25 +52,26 @@ namespace nil {
         static constexpr rss_key_type default_rsskey_52bytes {default_rsskey_52bytes_v,
                                                               sizeof(default_rsskey_52bytes_v)};
 
+        // Computes the Toeplitz hash of len bytes, as RSS capable NICs do.
+        //
+        // The key is expanded once into lookup tables, which are cached per
+        // thread by key address: keys handed out by devices must not be modified
+        // while in use.
+        uint32_t toeplitz_hash(rss_key_type key, const uint8_t *data, size_t len);
+
         template<typename T>
-        static inline uint32_t toeplitz_hash(rss_key_type key, const T &data) {
-            uint32_t hash = 0, v;
-            u_int i, b;
+        inline uint32_t toeplitz_hash(rss_key_type key, const T &data) {
+            return toeplitz_hash(key, reinterpret_cast<const uint8_t *>(data.data()), data.size());
+        }
 
-            /* XXXRW: Perhaps an assertion about key length vs. data length? */
+        struct toeplitz_implementation {
+            const char *name;
+            uint32_t (*hash)(rss_key_type key, const uint8_t *data, size_t len);
+        };
 
-            v = (key[0] << 24) + (key[1] << 16) + (key[2] << 8) + key[3];
-            for (i = 0; i < data.size(); i++) {
-                for (b = 0; b < 8; b++) {
-                    if (data[i] & (1 << (7 - b)))
-                        hash ^= v;
-                    v <<= 1;
-                    if ((i + 4) < key.size() && (key[i + 4] & (1 << (7 - b))))
-                        v |= 1;
-                }
-            }
-            return (hash);
-        }
+        // Implementations usable on this CPU, the bit-by-bit reference first;
+        // toeplitz_hash() uses the last one.
+        const std::vector<toeplitz_implementation> &toeplitz_implementations();
 
     }    // namespace actor
 }    // namespace nil
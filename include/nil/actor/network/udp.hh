@@ -62,6 +62,25 @@ namespace nil {
                 }
             };
 
+            // The channels of a UDP protocol, by local port, for IPv4 and IPv6 alike
+            class udp_channel_table {
+                static constexpr uint16_t min_anonymous_port = 32768;
+                std::unordered_map<uint16_t, lw_shared_ptr<udp_channel_state>> _channels;
+                uint16_t _next_anonymous_port = min_anonymous_port;
+
+            public:
+                // Registers a channel on port, or on a free anonymous port when it is zero, and returns
+                // the port. Throws when the port is taken or none is free.
+                uint16_t bind(uint16_t port, lw_shared_ptr<udp_channel_state> state);
+                void unbind(uint16_t port) {
+                    _channels.erase(port);
+                }
+                udp_channel_state *find(uint16_t port) {
+                    auto it = _channels.find(port);
+                    return it != _channels.end() ? it->second.get() : nullptr;
+                }
+            };
+
         }    // namespace net
 
     }    // namespace actor
@@ -0,0 +1,248 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/rpc/rpc.hh>
+#include <nil/actor/core/future.hh>
+#include <nil/actor/core/gate.hh>
+#include <nil/actor/core/timer.hh>
+#include <nil/actor/core/shared_ptr.hh>
+#include <nil/actor/core/metrics_registration.hh>
+
+#include <chrono>
+#include <functional>
+#include <random>
+#include <tuple>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            struct hedging_options {
+                /// Percentile of the recent call latencies after which a call is sent again to another replica
+                double percentile = 0.95;
+                /// Hedging delay used until enough latencies are known
+                std::chrono::microseconds initial_delay {10000};
+                /// The hedging delay is never shorter than that
+                std::chrono::microseconds min_delay {100};
+                /// Fraction of the calls that may be hedged at most, so that a group that is slow
+                /// because it is overloaded does not get even more load
+                double max_hedge_ratio = 0.1;
+                /// Label of the group metrics, next to an \c id label unique to each group of a shard
+                sstring name = "rpc-client-group";
+            };
+
+            /// Sends each call to one of several clients connected to replicas serving the same verbs.
+            ///
+            /// A replica is picked by the power of two choices: of two random replicas, the one with the
+            /// lower average latency times outstanding calls goes. A call not answered within a percentile
+            /// of the recent latencies is sent again to another replica; the first reply wins and the
+            /// other attempt is cancelled. A failed attempt is ignored while the other one may still
+            /// succeed. Only idempotent verbs should be called through a group.
+            ///
+            /// The group does not own the clients, which have to outlive it.
+            ///
+            /// Use case example, using actor threads for clarity:
+            ///
+            ///    rpc::client_group g({c1, c2, c3});
+            ///    auto get = proto.make_client<sstring(sstring)>(GET);
+            ///    auto value = g.call(get, key).get0();
+            ///    g.close().get();
+            class client_group {
+            public:
+                struct stats {
+                    uint64_t calls = 0;
+                    uint64_t hedged = 0;
+                    uint64_t hedge_wins = 0;
+                    uint64_t errors = 0;
+                };
+
+            private:
+                using clock_type = steady_clock_type;
+
+                struct replica {
+                    client *c;
+                    // Moving average of the replica latency
+                    clock_type::duration latency {0};
+                    bool sampled = false;
+                    unsigned outstanding = 0;
+                };
+
+                template<typename Func, typename Future, typename... Args>
+                struct hedged_call : public enable_lw_shared_from_this<hedged_call<Func, Future, Args...>> {
+                    struct attempt {
+                        unsigned replica = 0;
+                        clock_type::time_point start;
+                        cancellable cancel;
+                        bool running = false;
+                    };
+                    Func func;
+                    std::tuple<Args...> args;
+                    typename Future::promise_type pr;
+                    // The first one is the original call, the second one its hedge
+                    attempt attempts[2];
+                    unsigned running = 0;
+                    bool done = false;
+                    timer<> hedge;
+
+                    hedged_call(Func f, const Args &...a) : func(std::move(f)), args(a...) {
+                    }
+                };
+
+                static constexpr size_t max_samples = 512;
+                static constexpr size_t min_samples = 32;
+                static constexpr size_t update_interval = 32;
+
+                hedging_options _opts;
+                std::vector<replica> _replicas;
+                // Ring of the latest call latencies of the whole group
+                std::vector<clock_type::duration> _samples;
+                size_t _next_sample = 0;
+                size_t _samples_since_update = 0;
+                clock_type::duration _hedge_delay;
+                std::default_random_engine _rng;
+                gate _gate;
+                stats _stats;
+                metrics::metric_groups _metrics;
+
+            public:
+                client_group(std::vector<std::reference_wrapper<client>> replicas,
+                             hedging_options opts = hedging_options());
+                client_group(client_group &&) = delete;
+
+                /// Calls a verb made by protocol::make_client, as func(client, cancellable, args...)
+                template<typename Func, typename... Args>
+                auto call(Func &func, const Args &...args);
+
+                /// Time after which a call is hedged
+                clock_type::duration hedge_delay() const {
+                    return _hedge_delay;
+                }
+                size_t size() const {
+                    return _replicas.size();
+                }
+                /// Replica calls go to; for tests
+                client &replica_client(unsigned i) {
+                    return *_replicas[i].c;
+                }
+                const stats &get_stats() const {
+                    return _stats;
+                }
+                /// Waits for calls in progress; calls made afterwards fail with gate_closed_exception
+                future<> close();
+
+            private:
+                unsigned pick(int exclude = -1);
+                double load(unsigned i) const;
+                bool may_hedge() const;
+                void update_latency(unsigned r, clock_type::duration latency);
+                void add_sample(unsigned r, clock_type::duration latency);
+
+                template<typename Call>
+                void launch(lw_shared_ptr<Call> call, unsigned i, unsigned r);
+                template<typename Call, typename Future>
+                void complete(lw_shared_ptr<Call> call, unsigned i, Future f);
+            };
+
+            template<typename Func, typename... Args>
+            auto client_group::call(Func &func, const Args &...args) {
+                using future_type = futurize_t<std::invoke_result_t<Func &, client &, cancellable &, const Args &...>>;
+                using call_type = hedged_call<Func, future_type, Args...>;
+                try {
+                    _gate.enter();
+                } catch (...) {
+                    return futurize<future_type>::make_exception_future(std::current_exception());
+                }
+                ++_stats.calls;
+                auto c = make_lw_shared<call_type>(func, args...);
+                auto f = c->pr.get_future();
+                c->hedge.set_callback([this, c = c.get()] {
+                    if (!may_hedge()) {
+                        return;
+                    }
+                    ++_stats.hedged;
+                    launch(c->shared_from_this(), 1, pick(c->attempts[0].replica));
+                });
+                launch(c, 0, pick());
+                if (!c->done && _replicas.size() > 1) {
+                    c->hedge.arm(_hedge_delay);
+                }
+                return f;
+            }
+
+            template<typename Call>
+            void client_group::launch(lw_shared_ptr<Call> c, unsigned i, unsigned r) {
+                auto &a = c->attempts[i];
+                a.replica = r;
+                a.start = clock_type::now();
+                a.running = true;
+                ++c->running;
+                ++_replicas[r].outstanding;
+                auto f = futurize_invoke([this, &a, &c, r] {
+                    return std::apply([&](const auto &...args) { return c->func(*_replicas[r].c, a.cancel, args...); },
+                                      c->args);
+                });
+                (void)f.then_wrapped([this, c, i](auto f) { complete(c, i, std::move(f)); });
+            }
+
+            template<typename Call, typename Future>
+            void client_group::complete(lw_shared_ptr<Call> c, unsigned i, Future f) {
+                auto &a = c->attempts[i];
+                auto &other = c->attempts[1 - i];
+                a.running = false;
+                --c->running;
+                --_replicas[a.replica].outstanding;
+                if (c->done || (f.failed() && other.running)) {
+                    // Lost the race, or the other attempt may still succeed
+                    f.ignore_ready_future();
+                } else {
+                    c->done = true;
+                    c->hedge.cancel();
+                    if (f.failed()) {
+                        ++_stats.errors;
+                    } else {
+                        add_sample(a.replica, clock_type::now() - a.start);
+                        if (i == 1) {
+                            ++_stats.hedge_wins;
+                        }
+                    }
+                    if (other.running) {
+                        // It took at least that long, which keeps a stalled replica from looking idle
+                        update_latency(other.replica, clock_type::now() - other.start);
+                        other.cancel.cancel();
+                    }
+                    f.forward_to(std::move(c->pr));
+                }
+                if (c->done && !c->running) {
+                    _gate.leave();
+                }
+            }
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
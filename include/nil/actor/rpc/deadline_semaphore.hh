@@ -0,0 +1,144 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/core/future.hh>
+#include <nil/actor/core/semaphore.hh>
+#include <nil/actor/core/timer.hh>
+#include <nil/actor/core/lowres_clock.hh>
+
+#include <boost/optional.hpp>
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <map>
+#include <tuple>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            /// Counting semaphore that admits waiters by priority class and deadline.
+            ///
+            /// Waiters of a lower priority class go first; within a class the one with
+            /// the earliest deadline does, and those without a deadline come last, in
+            /// arrival order. Like basic_semaphore, a waiter that does not fit holds
+            /// back the ones behind it, so that large requests are not starved. Waiters
+            /// still queued at their deadline fail with semaphore_timed_out.
+            class deadline_semaphore {
+            public:
+                using clock_type = lowres_clock;
+                using time_point = clock_type::time_point;
+
+                /// Units taken from the semaphore, given back on destruction
+                class units {
+                    deadline_semaphore *_sem = nullptr;
+                    size_t _n = 0;
+
+                public:
+                    units() noexcept = default;
+                    units(deadline_semaphore &sem, size_t n) noexcept : _sem(&sem), _n(n) {
+                    }
+                    units(units &&o) noexcept : _sem(o._sem), _n(o._n) {
+                        o._n = 0;
+                    }
+                    units &operator=(units &&o) noexcept {
+                        if (this != &o) {
+                            return_all();
+                            _sem = o._sem;
+                            _n = o._n;
+                            o._n = 0;
+                        }
+                        return *this;
+                    }
+                    units(const units &) = delete;
+                    ~units() {
+                        return_all();
+                    }
+                    size_t count() const noexcept {
+                        return _n;
+                    }
+                    /// Gives the units back before destruction
+                    void return_all() noexcept {
+                        if (_n) {
+                            _sem->signal(_n);
+                            _n = 0;
+                        }
+                    }
+                };
+
+            private:
+                // (priority class, deadline, arrival)
+                using key_type = std::tuple<unsigned, time_point, uint64_t>;
+                struct waiter {
+                    promise<units> pr;
+                    size_t n;
+                };
+
+                size_t _count;
+                uint64_t _arrivals = 0;
+                std::map<key_type, waiter> _waiters;
+                // Armed for the earliest deadline among the first waiters of each class
+                timer<clock_type> _expiry;
+                std::exception_ptr _ex;
+
+            private:
+                void wake() noexcept;
+                void expire() noexcept;
+
+            public:
+                explicit deadline_semaphore(size_t count);
+                deadline_semaphore(const deadline_semaphore &) = delete;
+
+                static constexpr size_t max_counter() noexcept {
+                    return std::numeric_limits<ssize_t>::max();
+                }
+
+                /// Waits until \c n units are available and takes them.
+                ///
+                /// \param deadline the time at which the wait fails with semaphore_timed_out,
+                ///        and the order of the waiter within its class
+                /// \param priority_class waiters of lower classes are served first
+                future<units> get_units(size_t n, boost::optional<time_point> deadline = {},
+                                        unsigned priority_class = 0);
+                void signal(size_t n) noexcept;
+                /// Fails current and future waits with broken_semaphore
+                void broken() noexcept;
+                size_t available_units() const noexcept {
+                    return _count;
+                }
+                size_t waiters() const noexcept {
+                    return _waiters.size();
+                }
+            };
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,163 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/rpc/rpc_types.hh>
+#include <nil/actor/core/lowres_clock.hh>
+#include <nil/actor/core/metrics_registration.hh>
+#include <nil/actor/core/sstring.hh>
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            /// \addtogroup rpc
+            /// @{
+
+            struct response_cache_options {
+                /// Replies are dropped that long after they were cached
+                std::chrono::milliseconds ttl {1000};
+                /// Bytes of arguments and replies held at most, the least recently used going first
+                size_t memory_budget = 1 << 20;
+                /// Label of the cache metrics, along with the verb
+                sstring name = "rpc";
+            };
+
+            /// Marshalled replies of a verb, keyed by the marshalled arguments of their requests.
+            ///
+            /// Replies smaller than a page are copied into buffers of their own, larger ones keep
+            /// sharing the fragments they were marshalled into. Only successful replies are cached.
+            class response_cache {
+            public:
+                struct stats {
+                    uint64_t hits = 0;
+                    uint64_t misses = 0;
+                    uint64_t evictions = 0;
+                    uint64_t invalidations = 0;
+                };
+
+            private:
+                using clock_type = lowres_clock;
+
+            public:
+                /// A request the cache had no reply for, whose reply may be cached
+                struct miss {
+                    sstring key;
+                    /// Generation of the cache when the request missed
+                    uint64_t generation = 0;
+                };
+
+            private:
+                struct entry {
+                    sstring key;
+                    std::vector<temporary_buffer<char>> reply;
+                    size_t size;
+                    clock_type::time_point expiry;
+                };
+
+                response_cache_options _opts;
+                // Most recently used first
+                std::list<entry> _lru;
+                std::unordered_map<std::string_view, std::list<entry>::iterator> _index;
+                size_t _memory = 0;
+                // Bumped by every invalidation, so that replies computed before it are not cached after it
+                uint64_t _generation = 0;
+                stats _stats;
+                metrics::metric_groups _metrics;
+
+            public:
+                response_cache(response_cache_options opts, uint64_t verb);
+                response_cache(response_cache &&) = delete;
+
+                /// The key of the arguments of a request, or of arguments marshalled locally
+                template<typename Buf>    // Buf is either rcv_buf or snd_buf
+                static sstring key_of(const Buf &args, size_t head_space = 0);
+
+                /// A copy of the cached reply for the key, with head_space bytes left in front
+                boost::optional<snd_buf> lookup(const sstring &key, size_t head_space);
+                /// The miss to pass to insert() once the reply for key is computed
+                miss make_miss(sstring key) const {
+                    return miss {std::move(key), _generation};
+                }
+                /// Caches a reply marshalled after head_space bytes, unless the cache was
+                /// invalidated since the request missed
+                void insert(miss m, snd_buf &reply, size_t head_space);
+                void invalidate(const sstring &key);
+                void clear();
+
+                const stats &get_stats() const {
+                    return _stats;
+                }
+                size_t memory_used() const {
+                    return _memory;
+                }
+                size_t size() const {
+                    return _lru.size();
+                }
+
+            private:
+                void erase(std::list<entry>::iterator it);
+            };
+
+            template<typename Buf>
+            sstring response_cache::key_of(const Buf &args, size_t head_space) {
+                sstring key = uninitialized_string(args.size - head_space);
+                auto out = key.data();
+                auto skip = head_space;
+                auto left = key.size();
+                auto append = [&](const temporary_buffer<char> &b) {
+                    auto from = std::min(skip, b.size());
+                    skip -= from;
+                    auto n = std::min(b.size() - from, left);
+                    std::copy_n(b.get() + from, n, out);
+                    out += n;
+                    left -= n;
+                };
+                if (auto *one = std::get_if<temporary_buffer<char>>(&args.bufs)) {
+                    append(*one);
+                } else {
+                    for (auto &b : std::get<std::vector<temporary_buffer<char>>>(args.bufs)) {
+                        append(b);
+                    }
+                }
+                return key;
+            }
+
+            /// @}
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
@@ -26,21 +26,27 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <limits>
 #include <list>
 
 #include <nil/actor/core/future.hh>
 #include <nil/actor/core/core.hh>
 #include <nil/actor/network/api.hh>
+#include <nil/actor/network/packet.hh>
 #include <nil/actor/core/iostream.hh>
 #include <nil/actor/core/shared_ptr.hh>
 #include <nil/actor/core/condition_variable.hh>
 #include <nil/actor/core/gate.hh>
 #include <nil/actor/rpc/rpc_types.hh>
+#include <nil/actor/rpc/deadline_semaphore.hh>
+#include <nil/actor/rpc/response_cache.hh>
+#include <nil/actor/rpc/rpc_tracing.hh>
 #include <nil/actor/core/byteorder.hh>
 #include <nil/actor/core/shared_future.hh>
 #include <nil/actor/core/queue.hh>
 #include <nil/actor/core/weak_ptr.hh>
 #include <nil/actor/core/scheduling.hh>
+#include <nil/actor/detail/noncopyable_function.hh>
 #include <nil/actor/detail/backtrace.hh>
 #include <nil/actor/detail/log.hh>
 
@@ -64,11 +70,15 @@ namespace nil {
 
             using id_type = int64_t;
 
-            using rpc_semaphore = basic_semaphore<semaphore_default_exception_factory, rpc_clock_type>;
-            using resource_permit = semaphore_units<semaphore_default_exception_factory, rpc_clock_type>;
+            using rpc_semaphore = deadline_semaphore;
+            using resource_permit = deadline_semaphore::units;
 
             static constexpr char rpc_magic[] = "SSTARRPC";
 
+            /// Bytes an outgoing queue of weight 1 sends per round, and the size of the
+            /// chunks large messages are split into. See client_options::send_weights.
+            static constexpr size_t send_quantum = 64 * 1024;
+
             /// \addtogroup rpc
             /// @{
 
@@ -94,6 +104,9 @@ namespace nil {
             ///
             ///     sum(req_mem) <= max_memory
             ///
+            /// Requests waiting for memory are admitted by the priority class of their
+            /// verb, then earliest deadline first.
+            ///
             /// \see server
             struct resource_limits {
                 size_t basic_request_size = 0;    ///< Minimum request footprint in memory
@@ -117,6 +130,30 @@ namespace nil {
                 ///
                 /// \see resource_limits::isolate_connection
                 sstring isolation_cookie;
+                /// Sends the trace context of calls along with them, if the server supports it.
+                ///
+                /// \see trace_context
+                bool send_trace_context = false;
+                /// Weights of the outgoing queues of the connection, by the scheduling group
+                /// messages are sent from.
+                ///
+                /// Messages are queued by the scheduling group they are sent from: calls by
+                /// that of their caller, replies by that of their handler. Queues take turns
+                /// by deficit round robin, each sending about weight times send_quantum bytes
+                /// per round, so that bulk transfers in one group do not hold back the
+                /// messages of another. Groups not listed have weight 1.
+                std::unordered_map<scheduling_group, unsigned> send_weights;
+                /// Sends messages larger than send_quantum in chunks interleaved with the
+                /// messages of other queues, in both directions, if the server supports it.
+                bool send_in_chunks = false;
+                /// Buffer sizes of the reads from the connection.
+                ///
+                /// Frames are read in buffers of adaptive size, within these limits, but
+                /// once a header says how much of its frame is missing the rest is read in
+                /// one buffer of that size, up to max_buffer_size. Raising min_buffer_size
+                /// lets batches of small frames arrive in one buffer, raising
+                /// max_buffer_size lets large frames be read in one go.
+                connected_socket_input_stream_config input_stream_config;
             };
 
             /// @}
@@ -153,6 +190,15 @@ namespace nil {
                 boost::optional<streaming_domain_type> streaming_domain;
                 server_socket::load_balancing_algorithm load_balancing_algorithm =
                     server_socket::load_balancing_algorithm::default_;
+                /// Weights of the outgoing queues of the connections, by the scheduling group
+                /// replies are sent from.
+                ///
+                /// \see client_options::send_weights
+                std::unordered_map<scheduling_group, unsigned> send_weights;
+                /// Buffer sizes of the reads from the connections.
+                ///
+                /// \see client_options::input_stream_config
+                connected_socket_input_stream_config input_stream_config;
             };
 
             /// @}
@@ -173,6 +219,8 @@ namespace nil {
                 CONNECTION_ID = 2,
                 STREAM_PARENT = 3,
                 ISOLATION = 4,
+                TRACING = 5,
+                FRAME_CONTINUATION = 6,
             };
 
             // internal representation of feature data
@@ -246,10 +294,16 @@ namespace nil {
                     snd_buf buf;
                     boost::optional<promise<>> p = promise<>();
                     cancellable *pcancel = nullptr;
+                    // Set once the headers are filled in and the buffer compressed
+                    bool prepared = false;
+                    // Bytes of buf already sent in chunks, under chunk_tag
+                    size_t sent = 0;
+                    uint32_t chunk_tag = 0;
                     outgoing_entry(snd_buf b) : buf(std::move(b)) {
                     }
                     outgoing_entry(outgoing_entry &&o) noexcept :
-                        t(std::move(o.t)), buf(std::move(o.buf)), p(std::move(o.p)), pcancel(o.pcancel) {
+                        t(std::move(o.t)), buf(std::move(o.buf)), p(std::move(o.p)), pcancel(o.pcancel),
+                        prepared(o.prepared), sent(o.sent), chunk_tag(o.chunk_tag) {
                         o.p = boost::none;
                     }
                     ~outgoing_entry() {
@@ -263,11 +317,29 @@ namespace nil {
                     }
                 };
                 friend outgoing_entry;
-                std::list<outgoing_entry> _outgoing_queue;
+                // The messages sent from a scheduling group
+                struct outgoing_class {
+                    std::list<outgoing_entry> entries;
+                    unsigned weight = 1;
+                    // Bytes the class may still send before the next one takes its turn
+                    size_t deficit = 0;
+                    bool active = false;
+                    bool has_turn = false;
+                };
+                std::unordered_map<scheduling_group, outgoing_class> _outgoing_classes;
+                // Classes with queued messages, the one taking its turn first
+                circular_buffer<outgoing_class *> _active_classes;
                 condition_variable _outgoing_queue_cond;
                 future<> _send_loop_stopped = make_ready_future<>();
                 std::unique_ptr<compressor> _compressor;
                 bool _timeout_negotiated = false;
+                bool _tracing_negotiated = false;
+                bool _continuation_negotiated = false;
+                uint32_t _next_chunk_tag = 0;
+                // Messages of the peer some chunks of which were received, by chunk tag
+                std::unordered_map<uint32_t, net::packet> _partial_frames;
+                // Bytes held in _partial_frames
+                size_t _partial_frames_size = 0;
                 // stream related fields
                 bool _is_stream = false;
                 connection_id _id = invalid_connection_id;
@@ -287,9 +359,27 @@ namespace nil {
 
                 snd_buf compress(snd_buf buf);
                 future<> send_buffer(snd_buf buf);
+                // The weight of the outgoing queue of messages sent from the scheduling group
+                virtual unsigned send_weight(scheduling_group sg) const {
+                    return 1;
+                }
+                // Messages of the peer reassembled at once at most. The peer sends one at a time per
+                // scheduling group.
+                static constexpr size_t max_partial_frames = 64;
+                // Bytes of messages of the peer reassembled at once at most
+                virtual size_t max_partial_frames_size() const {
+                    return std::numeric_limits<size_t>::max();
+                }
+                void drop_partial_frames();
+                size_t pending_messages() const;
+                outgoing_class *next_outgoing_class();
+                size_t next_write_size(const outgoing_entry &d) const;
+                snd_buf next_chunk(outgoing_entry &d, size_t size);
 
                 enum class outgoing_queue_type { request, response, stream = response };
 
+                template<outgoing_queue_type QueueType>
+                void prepare_outgoing(outgoing_entry &d);
                 template<outgoing_queue_type QueueType>
                 void send_loop();
                 future<> stop_send_loop();
@@ -302,16 +392,17 @@ namespace nil {
                 future<> handle_stream_frame();
 
             public:
-                connection(connected_socket &&fd, const logger &l, void *s, connection_id id = invalid_connection_id) :
+                connection(connected_socket &&fd, const logger &l, void *s, connection_id id = invalid_connection_id,
+                           connected_socket_input_stream_config input_config = {}) :
                     connection(l, s, id) {
-                    set_socket(std::move(fd));
+                    set_socket(std::move(fd), input_config);
                 }
                 connection(const logger &l, void *s, connection_id id = invalid_connection_id) :
                     _logger(l), _serializer(s), _id(id) {
                 }
                 virtual ~connection() {
                 }
-                void set_socket(connected_socket &&fd);
+                void set_socket(connected_socket &&fd, connected_socket_input_stream_config input_config = {});
                 future<> send_negotiation_frame(feature_map features);
                 // functions below are public because they are used by external heavily templated functions
                 // and I am not smart enough to know how to define them as friends
@@ -344,6 +435,9 @@ namespace nil {
                     return _id;
                 }
                 xshard_connection_ptr get_stream(connection_id id) const;
+                bool has_stream(connection_id id) const {
+                    return _streams.count(id);
+                }
                 void register_stream(connection_id id, xshard_connection_ptr c);
                 virtual socket_address peer_address() const = 0;
 
@@ -356,6 +450,11 @@ namespace nil {
                     return *static_cast<Serializer *>(_serializer);
                 }
 
+                // The socket in reads from, null for frames parsed out of memory
+                connected_socket *socket_of(input_stream<char> &in) {
+                    return &in == &_read_buf ? &_fd : nullptr;
+                }
+
                 template<typename FrameType>
                 typename FrameType::return_type read_frame(socket_address info, input_stream<char> &in);
 
@@ -363,6 +462,11 @@ namespace nil {
                 typename FrameType::return_type read_frame_compressed(socket_address info,
                                                                       std::unique_ptr<compressor> &compressor,
                                                                       input_stream<char> &in);
+                // Reassembles the next message received in chunks, if FRAME_CONTINUATION was negotiated
+                template<typename FrameType>
+                typename FrameType::return_type read_frame_chunked(socket_address info,
+                                                                   std::unique_ptr<compressor> &compressor,
+                                                                   input_stream<char> &in);
                 friend class client;
                 template<typename Serializer, typename... Out>
                 friend class sink_impl;
@@ -396,6 +500,8 @@ namespace nil {
             class client : public rpc::connection, public weakly_referencable<client> {
                 socket _socket;
                 id_type _message_id = 1;
+                // Stripes of a striped_client draw ids from interleaved sequences
+                id_type _message_id_step = 1;
                 struct reply_handler_base {
                     timer<rpc_clock_type> t;
                     cancellable *pcancel = nullptr;
@@ -444,6 +550,7 @@ namespace nil {
             private:
                 future<> negotiate_protocol(input_stream<char> &in);
                 void negotiate(feature_map server_features);
+                unsigned send_weight(scheduling_group sg) const override;
                 future<std::tuple<int64_t, boost::optional<rcv_buf>>> read_response_frame(input_stream<char> &in);
                 future<std::tuple<int64_t, boost::optional<rcv_buf>>>
                     read_response_frame_compressed(input_stream<char> &in);
@@ -488,7 +595,9 @@ namespace nil {
                     return _stats;
                 }
                 auto next_message_id() {
-                    return _message_id++;
+                    auto id = _message_id;
+                    _message_id += _message_id_step;
+                    return id;
                 }
                 void wait_for_reply(id_type id, std::unique_ptr<reply_handler_base> &&h,
                                     boost::optional<rpc_clock_type::time_point> timeout, cancellable *cancel);
@@ -531,6 +640,65 @@ namespace nil {
                 future<sink<Out...>> make_stream_sink() {
                     return make_stream_sink<Serializer, Out...>(make_socket());
                 }
+
+                friend class striped_client;
+            };
+
+            /// How a striped_client spreads calls over its connections.
+            struct striping_options {
+                /// Number of connections to the server
+                unsigned stripes = 4;
+                /// Requests of at least this many bytes are sent over a connection of their
+                /// own, so that they do not delay the smaller ones queued behind them. With
+                /// 0 all requests are spread round-robin.
+                size_t bulk_threshold = 0;
+            };
+
+            /// Spreads the calls to a server over several connections.
+            ///
+            /// A connection is served by one send loop and one read loop, which may not
+            /// keep a fast link busy, and a large message delays every message behind it.
+            /// A striped client keeps several connections to the same server and picks
+            /// one of them per call. Message ids are unique across the connections,
+            /// timeouts and cancellation work as they do with a single client, and a call
+            /// passing a stream sink is sent over the connection that opened the stream.
+            class striped_client {
+                std::vector<std::unique_ptr<client>> _stripes;
+                striping_options _options;
+                unsigned _next = 0;
+
+            protected:
+                striped_client(striping_options options, noncopyable_function<std::unique_ptr<client>()> connect);
+
+            public:
+                unsigned stripes() const {
+                    return _stripes.size();
+                }
+                client &stripe(unsigned i) {
+                    return *_stripes[i];
+                }
+                /// Connection to send a request of \c size bytes over
+                client &pick(size_t size);
+                /// Connection that opened the stream \c id, null if none did
+                client *stripe_of_stream(connection_id id) noexcept;
+                template<typename Serializer>
+                Serializer &serializer() {
+                    return _stripes.front()->template serializer<Serializer>();
+                }
+                /// Statistics summed over all connections
+                stats get_stats() const;
+                future<> stop();
+                socket_address peer_address() const {
+                    return _stripes.front()->peer_address();
+                }
+                template<typename Serializer, typename... Out>
+                future<sink<Out...>> make_stream_sink(socket socket) {
+                    return pick(0).template make_stream_sink<Serializer, Out...>(std::move(socket));
+                }
+                template<typename Serializer, typename... Out>
+                future<sink<Out...>> make_stream_sink() {
+                    return make_stream_sink<Serializer, Out...>(make_socket());
+                }
             };
 
             class protocol_base;
@@ -540,6 +708,16 @@ namespace nil {
                 static thread_local std::unordered_map<streaming_domain_type, server *> _servers;
 
             public:
+                /// Fate of the requests that reached a handler
+                struct admission_stats {
+                    /// Requests whose handler was run
+                    uint64_t served = 0;
+                    /// Requests dropped because their deadline was too close to be met
+                    uint64_t shed = 0;
+                    /// Requests whose deadline passed while waiting for resources
+                    uint64_t expired = 0;
+                };
+
                 class connection : public rpc::connection, public enable_shared_from_this<connection> {
                     server &_server;
                     client_info _info;
@@ -560,6 +738,9 @@ namespace nil {
                     }
                     future<> send_unknown_verb_reply(boost::optional<rpc_clock_type::time_point> timeout, int64_t msg_id,
                                                      uint64_t type);
+                    unsigned send_weight(scheduling_group sg) const override;
+                    // The memory limit of the server
+                    size_t max_partial_frames_size() const override;
 
                 public:
                     connection(server &s, connected_socket &&fd, socket_address &&addr, const logger &l,
@@ -574,7 +755,7 @@ namespace nil {
                     }
                     stats get_stats() const {
                         stats res = _stats;
-                        res.pending = _outgoing_queue.size();
+                        res.pending = pending_messages();
                         return res;
                     }
 
@@ -586,12 +767,13 @@ namespace nil {
                     }
                     // Resources will be released when this goes out of scope
                     future<resource_permit> wait_for_resources(size_t memory_consumed,
-                                                               boost::optional<rpc_clock_type::time_point> timeout) {
-                        if (timeout) {
-                            return get_units(_server._resources_available, memory_consumed, *timeout);
-                        } else {
-                            return get_units(_server._resources_available, memory_consumed);
-                        }
+                                                               boost::optional<rpc_clock_type::time_point> timeout,
+                                                               unsigned priority_class = 0) {
+                        return _server._resources_available.get_units(memory_consumed, timeout, priority_class);
+                    }
+                    // Whether requests are waiting for resources
+                    bool resources_contended() const noexcept {
+                        return _server._resources_available.waiters() > 0;
                     }
                     size_t estimate_request_size(size_t serialized_size) {
                         return rpc::estimate_request_size(_server._limits, serialized_size);
@@ -615,6 +797,7 @@ namespace nil {
                 gate _reply_gate;
                 server_options _options;
                 uint64_t _next_client_id = 1;
+                admission_stats _admission_stats;
 
             public:
                 server(protocol_base *proto, const socket_address &addr,
@@ -636,17 +819,77 @@ namespace nil {
                 gate &reply_gate() {
                     return _reply_gate;
                 }
+                const admission_stats &get_admission_stats() const {
+                    return _admission_stats;
+                }
+                admission_stats &get_admission_stats_internal() {
+                    return _admission_stats;
+                }
                 friend connection;
                 friend client;
             };
 
             using rpc_handler_func =
                 std::function<future<>(shared_ptr<server::connection>,
-                                       boost::optional<rpc_clock_type::time_point> timeout, int64_t msgid, rcv_buf data)>;
+                                       boost::optional<rpc_clock_type::time_point> timeout, int64_t msgid, rcv_buf data,
+                                       span_ptr trace)>;
+
+            /// Admission state of a verb.
+            ///
+            /// A request carrying a deadline is dropped, without running its handler,
+            /// when the time left is below the service time of the verb, on arrival
+            /// and again once it gets its resources.
+            struct verb_admission {
+                /// Samples averaged into the first estimate of the service time
+                static constexpr unsigned seed_samples = 4;
+                /// A request the estimate would shed is admitted at most this often anyway,
+                /// so that an estimate gone stale under constant contention gets samples
+                static constexpr rpc_clock_type::duration probe_interval = std::chrono::seconds(1);
+
+                /// Class of the verb's requests when waiting for resources, lower ones
+                /// are admitted first
+                unsigned priority_class = 0;
+                /// Moving average of the time the handler takes
+                rpc_clock_type::duration service_time {0};
+                unsigned samples = 0;
+                rpc_clock_type::time_point last_admitted;
+
+                /// Tells whether a request may still make its deadline. Requests are shed
+                /// only when they compete for resources, and only once the estimate is
+                /// seeded: shed requests yield no samples, so an idle server is where the
+                /// estimate of a verb that got faster catches up.
+                bool can_meet(boost::optional<rpc_clock_type::time_point> deadline, bool contended) noexcept {
+                    if (!deadline) {
+                        return true;
+                    }
+                    auto now = rpc_clock_type::now();
+                    if (*deadline <= now) {
+                        return false;
+                    }
+                    if (!contended || samples < seed_samples || *deadline - now >= service_time ||
+                        now - last_admitted >= probe_interval) {
+                        last_admitted = now;
+                        return true;
+                    }
+                    return false;
+                }
+                void add_service_time_sample(rpc_clock_type::duration sample) noexcept {
+                    // Same gain as the smoothed round trip time of TCP, seeded with the mean
+                    // of the first samples
+                    if (samples < seed_samples) {
+                        service_time += (sample - service_time) / ++samples;
+                    } else {
+                        service_time += (sample - service_time) / 8;
+                    }
+                }
+            };
 
             struct rpc_handler {
                 scheduling_group sg;
                 rpc_handler_func func;
+                lw_shared_ptr<verb_admission> admission;
+                // Set for verbs registered with register_cacheable_handler()
+                lw_shared_ptr<response_cache> cache;
                 gate use_gate;
             };
 
@@ -812,6 +1055,40 @@ namespace nil {
                         rpc::client(p.get_logger(), &p._serializer, options, std::move(socket), addr, local) {
                     }
                 };
+                /// Represents several client side connections to the same server.
+                class striped_client : public rpc::striped_client {
+                public:
+                    /*
+                     * Create client objects which will attempt to connect to the remote address.
+                     *
+                     * @param addr the remote address identifying this client
+                     * @param local the local address of this client, with no port
+                     */
+                    striped_client(protocol &p, striping_options so, client_options options,
+                                   const socket_address &addr, const socket_address &local = {}) :
+                        rpc::striped_client(so, [&p, options, addr, local] {
+                            return std::make_unique<rpc::client>(p.get_logger(), &p._serializer, options, addr, local);
+                        }) {
+                    }
+
+                    /**
+                     * Create client objects which will attempt to connect to the remote address using
+                     * sockets returned by \c make_socket.
+                     *
+                     * @param addr the remote address identifying this client
+                     * @param local the local address of this client, with no port
+                     * @param make_socket returns a socket object to use for each connection
+                     */
+                    striped_client(protocol &p, striping_options so, client_options options,
+                                   noncopyable_function<socket()> make_socket, const socket_address &addr,
+                                   const socket_address &local = {}) :
+                        rpc::striped_client(
+                            so, [&p, options, make_socket = std::move(make_socket), addr, local]() mutable {
+                                return std::make_unique<rpc::client>(p.get_logger(), &p._serializer, options,
+                                                                     make_socket(), addr, local);
+                            }) {
+                    }
+                };
 
                 friend server;
 
@@ -823,6 +1100,7 @@ namespace nil {
             public:
                 protocol(Serializer &&serializer) : _serializer(std::forward<Serializer>(serializer)) {
                 }
+                ~protocol();
 
                 /// Creates a callable that can be used to invoke the verb on the remote.
                 ///
@@ -871,6 +1149,98 @@ namespace nil {
                 template<typename Func>
                 auto register_handler(MsgType t, scheduling_group sg, Func &&func);
 
+                /// Register a handler to be run on a shard picked from each request.
+                ///
+                /// Requests are received on the shard of their connection, where
+                /// shard_of is called with the first argument of the handler; the
+                /// handler runs on the shard it returns, modulo smp::count. The request
+                /// buffer is handed over without its data being copied, the handler and
+                /// serializer registered on that shard unmarshall it, run it and marshall
+                /// its reply there, and the reply is sent back from the shard of the
+                /// connection. Requests and replies going to the same shard are batched.
+                /// The handler must be registered on every shard, and so may use the
+                /// state of its own shard. Only one protocol of a serializer and verb
+                /// type per shard can register a given verb this way.
+                ///
+                /// The handler may take a time point, but neither client_info nor
+                /// streams.
+                ///
+                /// \param t the verb to register the handler for.
+                /// \param sg the scheduling group the handler is invoked in, on either
+                ///     shard. See register_handler().
+                /// \param shard_of the callable picking the shard from the first argument
+                ///     of the handler, for example a hash of a key.
+                /// \param func the callable to be called when the verb is invoked by the
+                ///     remote.
+                ///
+                /// \returns a client, a callable that can be used to invoke the verb. See
+                ///     make_client().
+                template<typename ShardOf, typename Func>
+                auto register_sharded_handler(MsgType t, scheduling_group sg, ShardOf &&shard_of, Func &&func);
+
+                /// Register a handler to be run on a shard picked from each request.
+                ///
+                /// See the overload taking a scheduling group.
+                template<typename ShardOf, typename Func>
+                auto register_sharded_handler(MsgType t, ShardOf &&shard_of, Func &&func);
+
+                /// Register a handler whose replies are cached.
+                ///
+                /// Each shard keeps the marshalled replies of the verb keyed by the raw
+                /// bytes of the arguments of their requests, and answers requests it has a
+                /// reply for without running the handler, sharing the cached buffers
+                /// rather than copying them. Replies expire after opts.ttl and the least
+                /// recently used ones are dropped to stay within opts.memory_budget.
+                /// Exceptions are not cached.
+                ///
+                /// The verb must be idempotent: its reply may only depend on its arguments,
+                /// neither on the client nor on the time it is called at, unless the cached
+                /// replies are invalidated whenever what they were computed from changes.
+                /// The handler cannot be of a no_wait verb nor take streams.
+                ///
+                /// \param t the verb to register the handler for.
+                /// \param sg the scheduling group the handler is invoked in. See
+                ///     register_handler().
+                /// \param opts the time to live and the memory budget of the cache of each
+                ///     shard.
+                /// \param func the callable to be called when the verb is invoked by the
+                ///     remote and no cached reply is found.
+                ///
+                /// \returns a client, a callable that can be used to invoke the verb. See
+                ///     make_client().
+                template<typename Func>
+                auto register_cacheable_handler(MsgType t, scheduling_group sg, response_cache_options opts,
+                                                Func &&func);
+
+                /// Register a handler whose replies are cached.
+                ///
+                /// See the overload taking a scheduling group.
+                template<typename Func>
+                auto register_cacheable_handler(MsgType t, response_cache_options opts, Func &&func);
+
+                /// Drops the replies cached on this shard for a verb.
+                ///
+                /// \param t the verb, which must have been registered with
+                ///     register_cacheable_handler()
+                void invalidate_cached(MsgType t);
+
+                /// Drops the reply cached on this shard for a verb called with the arguments.
+                ///
+                /// The arguments are marshalled to find the reply, so they must be of the
+                /// types the handler takes, or at least be marshalled the same way.
+                ///
+                /// \param t the verb, which must have been registered with
+                ///     register_cacheable_handler()
+                /// \param args the arguments of the request the reply was cached for
+                template<typename... Args>
+                void invalidate_cached(MsgType t, const Args &...args);
+
+                /// The cache of a verb on this shard, to look at its statistics.
+                ///
+                /// \param t the verb, which must have been registered with
+                ///     register_cacheable_handler()
+                response_cache &cache_of(MsgType t);
+
                 /// Unregister the handler for the verb.
                 ///
                 /// Waits for all currently running handlers, then unregisters the handler.
@@ -883,6 +1253,16 @@ namespace nil {
                 ///     handlers finished.
                 future<> unregister_handler(MsgType t);
 
+                /// Sets the priority class of the requests of a verb.
+                ///
+                /// Requests waiting for resources (see resource_limits) are admitted by
+                /// class, lower first, and by deadline within a class. All verbs start
+                /// in class 0.
+                ///
+                /// \param t the verb, which must have a handler registered
+                /// \param priority_class the class of its requests
+                void set_priority_class(MsgType t, unsigned priority_class);
+
                 /// Set a logger function to be used to log messages.
                 ///
                 /// \deprecated use the logger overload set_logger(::nil::actor::logger*)
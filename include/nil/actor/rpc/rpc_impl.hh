@@ -58,6 +58,23 @@ namespace nil {
 
             struct wait_type { };    // opposite of no_wait_type
 
+            // Bytes of the trace context in front of a request header, when tracing is negotiated
+            constexpr size_t trace_context_size = 20;
+            // Room left in front of a marshalled request for the trace context, the expiration time
+            // and the request header
+            constexpr size_t request_frame_headroom = trace_context_size + 28;
+
+            inline void write_trace_context(char *p, const trace_context &ctx) {
+                write_le<uint64_t>(p, ctx.trace_id);
+                write_le<uint64_t>(p + 8, ctx.span_id);
+                write_le<uint32_t>(p + 16, ctx.sampled ? 1 : 0);
+            }
+
+            inline trace_context read_trace_context(const char *p) {
+                auto sampled = read_le<uint32_t>(p + 16) & 1;
+                return trace_context {read_le<uint64_t>(p), read_le<uint64_t>(p + 8), bool(sampled)};
+            }
+
             // tags to tell whether we want a const client_info& parameter
             struct do_want_client_info { };
             struct dont_want_client_info { };
@@ -273,19 +290,52 @@ namespace nil {
                 }
             }
 
+            // A serializer whose write() functions need a memory_output_stream, for
+            // instance to reserve room and fill it in later, asks for the size of the
+            // message to be measured first by declaring
+            //
+            //     static constexpr bool measure_before_marshalling = true;
+            template<typename Serializer, typename = void>
+            struct measures_before_marshalling : std::false_type { };
+
+            template<typename Serializer>
+            struct measures_before_marshalling<Serializer,
+                                               std::void_t<decltype(Serializer::measure_before_marshalling)>>
+                : std::bool_constant<Serializer::measure_before_marshalling> { };
+
             template<typename Serializer, typename... T>
             inline snd_buf marshall(Serializer &serializer, size_t head_space, const T &...args) {
-                measuring_output_stream measure;
-                do_marshall(serializer, measure, args...);
-                snd_buf ret(measure.size() + head_space);
-                auto out = make_serializer_stream(ret);
-                out.skip(head_space);
-                do_marshall(serializer, out, args...);
-                return ret;
+                if constexpr (measures_before_marshalling<Serializer>::value) {
+                    measuring_output_stream measure;
+                    do_marshall(serializer, measure, args...);
+                    snd_buf ret(measure.size() + head_space);
+                    auto out = make_serializer_stream(ret);
+                    out.skip(head_space);
+                    do_marshall(serializer, out, args...);
+                    return ret;
+                } else {
+                    // Messages of the same signature tend to be of similar size
+                    static thread_local size_t size_hint = 0;
+                    snd_buf_output_stream out(head_space, size_hint);
+                    do_marshall(serializer, out, args...);
+                    size_hint = out.size();
+                    return std::move(out).release();
+                }
             }
 
-            template<typename Serializer, typename Input>
-            inline std::tuple<> do_unmarshall(connection &c, Input &in) {
+            // Unmarshalling needs the serializer of a connection, and the connection itself only for streams. This
+            // stands for a connection where none is at hand, like on the shard a sharded handler runs on.
+            template<typename Serializer>
+            struct serializer_context {
+                Serializer &s;
+                template<typename T>
+                T &serializer() {
+                    return s;
+                }
+            };
+
+            template<typename Serializer, typename Input, typename Context>
+            inline std::tuple<> do_unmarshall(Context &c, Input &in) {
                 return std::make_tuple();
             }
 
@@ -293,16 +343,18 @@ namespace nil {
             struct unmarshal_one {
                 template<typename T>
                 struct helper {
-                    static T doit(connection &c, Input &in) {
-                        return read(c.serializer<Serializer>(), in, type<T>());
+                    template<typename Context>
+                    static T doit(Context &c, Input &in) {
+                        return read(c.template serializer<Serializer>(), in, type<T>());
                     }
                 };
                 template<typename T>
                 struct helper<optional<T>> {
-                    static optional<T> doit(connection &c, Input &in) {
+                    template<typename Context>
+                    static optional<T> doit(Context &c, Input &in) {
                         if (in.size()) {
-                            return optional<T>(
-                                read(c.serializer<Serializer>(), in, type<typename remove_optional<T>::type>()));
+                            return optional<T>(read(c.template serializer<Serializer>(), in,
+                                                    type<typename remove_optional<T>::type>()));
                         } else {
                             return optional<T>();
                         }
@@ -310,7 +362,8 @@ namespace nil {
                 };
                 template<typename T>
                 struct helper<std::reference_wrapper<const T>> {
-                    static T doit(connection &c, Input &in) {
+                    template<typename Context>
+                    static T doit(Context &c, Input &in) {
                         return helper<T>::doit(c, in);
                     }
                 };
@@ -335,24 +388,31 @@ namespace nil {
                 };
                 template<typename... T>
                 struct helper<tuple<T...>> {
-                    static tuple<T...> doit(connection &c, Input &in) {
-                        return do_unmarshall<Serializer, Input, T...>(c, in);
+                    template<typename Context>
+                    static tuple<T...> doit(Context &c, Input &in) {
+                        return do_unmarshall<Serializer, Input, Context, T...>(c, in);
                     }
                 };
             };
 
-            template<typename Serializer, typename Input, typename T0, typename... Trest>
-            inline std::tuple<T0, Trest...> do_unmarshall(connection &c, Input &in) {
+            template<typename Serializer, typename Input, typename Context, typename T0, typename... Trest>
+            inline std::tuple<T0, Trest...> do_unmarshall(Context &c, Input &in) {
                 // FIXME: something less recursive
                 auto first = std::make_tuple(unmarshal_one<Serializer, Input>::template helper<T0>::doit(c, in));
-                auto rest = do_unmarshall<Serializer, Input, Trest...>(c, in);
+                auto rest = do_unmarshall<Serializer, Input, Context, Trest...>(c, in);
                 return std::tuple_cat(std::move(first), std::move(rest));
             }
 
             template<typename Serializer, typename... T>
             inline std::tuple<T...> unmarshall(connection &c, rcv_buf input) {
                 auto in = make_deserializer_stream(input);
-                return do_unmarshall<Serializer, decltype(in), T...>(c, in);
+                return do_unmarshall<Serializer, decltype(in), connection, T...>(c, in);
+            }
+
+            template<typename Serializer, typename... T>
+            inline std::tuple<T...> unmarshall(serializer_context<Serializer> c, rcv_buf input) {
+                auto in = make_deserializer_stream(input);
+                return do_unmarshall<Serializer, decltype(in), serializer_context<Serializer>, T...>(c, in);
             }
 
             inline std::exception_ptr unmarshal_exception(rcv_buf &d) {
@@ -469,6 +529,32 @@ namespace nil {
                 return now + std::min(relative, rpc_clock_type::time_point::max() - now);
             }
 
+            template<typename T>
+            struct is_sink : std::false_type { };
+
+            template<typename... T>
+            struct is_sink<sink<T...>> : std::true_type { };
+
+            template<typename T>
+            struct is_stream : is_sink<T> { };
+
+            template<typename... T>
+            struct is_stream<source<T...>> : std::true_type { };
+
+            // Stream opened by the sink passed along with a request, if any
+            template<typename... T>
+            boost::optional<connection_id> stream_of(const T &...args) {
+                boost::optional<connection_id> id;
+                (
+                    [&id](const auto &arg) {
+                        if constexpr (is_sink<std::decay_t<decltype(arg)>>::value) {
+                            id = arg.get_id();
+                        }
+                    }(args),
+                    ...);
+                return id;
+            }
+
             // Returns lambda that can be used to send rpc messages.
             // The lambda gets client connection and rpc parameters as arguments, marshalls them sends
             // to a server and waits for a reply. After receiving reply it unmarshalls it and signal completion
@@ -478,21 +564,18 @@ namespace nil {
                 struct shelper {
                     MsgType t;
                     signature<Ret(InArgs...)> sig;
-                    auto send(rpc::client &dst, boost::optional<rpc_clock_type::time_point> timeout, cancellable *cancel,
-                              const InArgs &...args) {
-                        if (dst.error()) {
-                            using cleaned_ret_type = typename wait_signature<Ret>::cleaned_type;
-                            return futurize<cleaned_ret_type>::make_exception_future(closed_error());
-                        }
-
+                    auto send_marshalled(rpc::client &dst, snd_buf data,
+                                         boost::optional<rpc_clock_type::time_point> timeout, cancellable *cancel) {
                         // send message
                         auto msg_id = dst.next_message_id();
-                        snd_buf data = marshall(dst.template serializer<Serializer>(), 28, args...);
-                        static_assert(snd_buf::chunk_size >= 28, "send buffer chunk size is too small");
-                        auto p = data.front().get_write() + 8;    // 8 extra bytes for expiration timer
+                        static_assert(snd_buf::chunk_size >= request_frame_headroom,
+                                      "send buffer chunk size is too small");
+                        auto p = data.front().get_write();
+                        write_trace_context(p, current_trace_context());
+                        p += trace_context_size + 8;    // 8 extra bytes for expiration timer
                         write_le<uint64_t>(p, uint64_t(t));
                         write_le<int64_t>(p + 8, msg_id);
-                        write_le<uint32_t>(p + 16, data.size - 28);
+                        write_le<uint32_t>(p + 16, data.size - request_frame_headroom);
 
                         // prepare reply handler, if return type is now_wait_type this does nothing, since no reply will
                         // be sent
@@ -503,6 +586,31 @@ namespace nil {
                                 return std::move(std::get<1>(r));    // return future of wait_for_reply
                             });
                     }
+                    auto send(rpc::client &dst, boost::optional<rpc_clock_type::time_point> timeout, cancellable *cancel,
+                              const InArgs &...args) {
+                        if (dst.error()) {
+                            using cleaned_ret_type = typename wait_signature<Ret>::cleaned_type;
+                            return futurize<cleaned_ret_type>::make_exception_future(closed_error());
+                        }
+                        snd_buf data = marshall(dst.template serializer<Serializer>(), request_frame_headroom, args...);
+                        return send_marshalled(dst, std::move(data), timeout, cancel);
+                    }
+                    auto send(rpc::striped_client &dst, boost::optional<rpc_clock_type::time_point> timeout,
+                              cancellable *cancel, const InArgs &...args) {
+                        // The connection is chosen after the size of the request is known
+                        snd_buf data = marshall(dst.template serializer<Serializer>(), request_frame_headroom, args...);
+                        using cleaned_ret_type = typename wait_signature<Ret>::cleaned_type;
+                        auto stream = stream_of(args...);
+                        auto stripe = stream ? dst.stripe_of_stream(*stream) : &dst.pick(data.size);
+                        if (!stripe) {
+                            return futurize<cleaned_ret_type>::make_exception_future(
+                                std::logic_error(format("rpc stream id {:d} not found", *stream).c_str()));
+                        }
+                        if (stripe->error()) {
+                            return futurize<cleaned_ret_type>::make_exception_future(closed_error());
+                        }
+                        return send_marshalled(*stripe, std::move(data), timeout, cancel);
+                    }
                     auto operator()(rpc::client &dst, const InArgs &...args) {
                         return send(dst, {}, nullptr, args...);
                     }
@@ -515,43 +623,74 @@ namespace nil {
                     auto operator()(rpc::client &dst, cancellable &cancel, const InArgs &...args) {
                         return send(dst, {}, &cancel, args...);
                     }
+                    auto operator()(rpc::striped_client &dst, const InArgs &...args) {
+                        return send(dst, {}, nullptr, args...);
+                    }
+                    auto operator()(rpc::striped_client &dst, rpc_clock_type::time_point timeout,
+                                    const InArgs &...args) {
+                        return send(dst, timeout, nullptr, args...);
+                    }
+                    auto operator()(rpc::striped_client &dst, rpc_clock_type::duration timeout,
+                                    const InArgs &...args) {
+                        return send(dst, relative_timeout_to_absolute(timeout), nullptr, args...);
+                    }
+                    auto operator()(rpc::striped_client &dst, cancellable &cancel, const InArgs &...args) {
+                        return send(dst, {}, &cancel, args...);
+                    }
                 };
                 return shelper {xt, xsig};
             }
 
-            template<typename Serializer, typename ACTOR_ELLIPSIS RetTypes>
-            inline future<> reply(wait_type, future<RetTypes ACTOR_ELLIPSIS> &&ret, int64_t msg_id,
-                                  shared_ptr<server::connection> client,
-                                  boost::optional<rpc_clock_type::time_point> timeout) {
-                if (!client->error()) {
-                    snd_buf data;
-                    try {
+            // Marshalls an exception into an error reply, negating msg_id
+            inline snd_buf make_error_reply(const std::exception &ex, int64_t &msg_id) {
+                uint32_t len = std::strlen(ex.what());
+                snd_buf data(20 + len);
+                auto os = make_serializer_stream(data);
+                os.skip(12);
+                uint32_t v32 = boost::endian::native_to_little(uint32_t(exception_type::USER));
+                os.write(reinterpret_cast<char *>(&v32), sizeof(v32));
+                v32 = boost::endian::native_to_little(len);
+                os.write(reinterpret_cast<char *>(&v32), sizeof(v32));
+                os.write(ex.what(), len);
+                msg_id = -msg_id;
+                return data;
+            }
+
+            // Marshalls the result of a handler into a reply, or its exception into an error reply, in which
+            // case msg_id is negated. The context is the connection or a serializer_context.
+            template<typename Serializer, typename Context, typename ACTOR_ELLIPSIS RetTypes>
+            inline snd_buf make_reply(Context &c, future<RetTypes ACTOR_ELLIPSIS> &&ret, int64_t &msg_id) {
+                snd_buf data;
+                try {
 #if ACTOR_API_LEVEL < 6
-                        if constexpr (sizeof...(RetTypes) == 0) {
+                    if constexpr (sizeof...(RetTypes) == 0) {
 #else
-                        if constexpr (std::is_void_v<RetTypes>) {
+                    if constexpr (std::is_void_v<RetTypes>) {
 #endif
-                            ret.get();
-                            data = std::invoke(marshall<Serializer>,
-                                               std::ref(client->template serializer<Serializer>()), 12);
-                        } else {
-                            data = std::invoke(marshall<Serializer, const RetTypes & ACTOR_ELLIPSIS>,
-                                               std::ref(client->template serializer<Serializer>()), 12,
-                                               std::move(ret.get0()));
-                        }
-                    } catch (std::exception &ex) {
-                        uint32_t len = std::strlen(ex.what());
-                        data = snd_buf(20 + len);
-                        auto os = make_serializer_stream(data);
-                        os.skip(12);
-                        uint32_t v32 = boost::endian::native_to_little(uint32_t(exception_type::USER));
-                        os.write(reinterpret_cast<char *>(&v32), sizeof(v32));
-                        v32 = boost::endian::native_to_little(len);
-                        os.write(reinterpret_cast<char *>(&v32), sizeof(v32));
-                        os.write(ex.what(), len);
-                        msg_id = -msg_id;
+                        ret.get();
+                        data = std::invoke(marshall<Serializer>, std::ref(c.template serializer<Serializer>()), 12);
+                    } else {
+                        data = std::invoke(marshall<Serializer, const RetTypes & ACTOR_ELLIPSIS>,
+                                           std::ref(c.template serializer<Serializer>()), 12,
+                                           std::move(ret.get0()));
                     }
+                } catch (std::exception &ex) {
+                    data = make_error_reply(ex, msg_id);
+                }
+                return data;
+            }
 
+            // Successful replies are cached when a cache is given
+            template<typename Serializer, typename ACTOR_ELLIPSIS RetTypes>
+            inline future<> reply(wait_type, future<RetTypes ACTOR_ELLIPSIS> &&ret, int64_t msg_id,
+                                  shared_ptr<server::connection> client,
+                                  boost::optional<rpc_clock_type::time_point> timeout,
+                                  response_cache *cache = nullptr, response_cache::miss miss = {}) {
+                if (!client->error()) {
+                    auto data = make_reply<Serializer>(*client, std::move(ret), msg_id);
+                    if (cache && msg_id > 0) {
+                        cache->insert(std::move(miss), data, 12);
+                    }
                     return client->respond(msg_id, std::move(data), timeout);
                 } else {
                     ret.ignore_ready_future();
@@ -563,7 +702,8 @@ namespace nil {
             template<typename Serializer>
             inline future<> reply(no_wait_type, future<no_wait_type> &&r, int64_t msgid,
                                   shared_ptr<server::connection> client,
-                                  boost::optional<rpc_clock_type::time_point> timeout) {
+                                  boost::optional<rpc_clock_type::time_point> timeout,
+                                  response_cache *cache = nullptr, response_cache::miss miss = {}) {
                 try {
                     r.get();
                 } catch (std::exception &ex) {
@@ -598,19 +738,53 @@ namespace nil {
                 return std::ref(x);
             }
 
-            // Creates lambda to handle RPC message on a server.
-            // The lambda unmarshalls all parameters, calls a handler, marshall return values and sends them back to a
-            // client
+            // Runs a request on the shard of its connection: unmarshalls all parameters, calls a handler, marshall
+            // return values and sends them back to a client. The reply of a miss is cached if a cache is given
             template<typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo,
                      typename WantTimePoint>
-            auto recv_helper(signature<Ret(InArgs...)> sig, Func &&func, WantClientInfo wci, WantTimePoint wtp) {
-                using signature = decltype(sig);
+            future<> handle_locally(Func &func, signature<Ret(InArgs...)> sig, WantClientInfo wci, WantTimePoint wtp,
+                                    lw_shared_ptr<verb_admission> admission, shared_ptr<server::connection> client,
+                                    boost::optional<rpc_clock_type::time_point> timeout, int64_t msg_id, rcv_buf data,
+                                    span_ptr trace, lw_shared_ptr<response_cache> cache = {},
+                                    response_cache::miss miss = {}) {
                 using wait_style = wait_signature_t<Ret>;
-                return [func = lref_to_cref(std::forward<Func>(func))](shared_ptr<server::connection> client,
-                                                                       boost::optional<rpc_clock_type::time_point>
-                                                                           timeout,
-                                                                       int64_t msg_id,
-                                                                       rcv_buf data) mutable {
+                auto start = std::chrono::steady_clock::now();
+                auto args = unmarshall<Serializer, InArgs...>(*client, std::move(data));
+                // Calls the handler makes right away belong to the trace of the request
+                boost::optional<trace_scope> scope;
+                if (trace) {
+                    trace->handler_started = start;
+                    scope.emplace(trace->context());
+                }
+                return apply(func, client->info(), timeout, wci, wtp, sig, std::move(args))
+                    .then_wrapped([client, timeout, msg_id, admission = std::move(admission), start,
+                                   trace = std::move(trace), cache = std::move(cache),
+                                   miss = std::move(miss)](futurize_t<Ret> ret) mutable {
+                        auto now = std::chrono::steady_clock::now();
+                        admission->add_service_time_sample(
+                            std::chrono::duration_cast<rpc_clock_type::duration>(now - start));
+                        auto f = reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout, cache.get(),
+                                                   std::move(miss));
+                        if (trace) {
+                            trace->handler_finished = now;
+                            return f.finally([trace = std::move(trace)] { finish_span(trace); });
+                        }
+                        return f;
+                    });
+            }
+
+            // Creates lambda to handle RPC message on a server.
+            // The lambda checks the message against the memory limit and the admission of the verb, waits for
+            // resources and passes the message to handle, which runs it and sends the reply
+            template<typename Serializer, typename Ret, typename Handle>
+            auto make_receiver(lw_shared_ptr<verb_admission> admission, Handle &&handle) {
+                using wait_style = wait_signature_t<Ret>;
+                return [handle = std::forward<Handle>(handle),
+                        admission = std::move(admission)](shared_ptr<server::connection> client,
+                                                          boost::optional<rpc_clock_type::time_point> timeout,
+                                                          int64_t msg_id,
+                                                          rcv_buf data,
+                                                          span_ptr trace) mutable {
                     auto memory_consumed = client->estimate_request_size(data.size);
                     if (memory_consumed > client->max_request_size()) {
                         auto err = format("request size {:d} large than memory limit {:d}", memory_consumed,
@@ -631,30 +805,42 @@ namespace nil {
                         }).handle_exception_type([](gate_closed_exception &) { /* ignore */ });
                         return make_ready_future();
                     }
+                    // Nobody will be waiting for the reply by the time the handler is done
+                    if (!admission->can_meet(timeout, client->resources_contended())) {
+                        client->get_server().get_admission_stats_internal().shed++;
+                        return make_ready_future();
+                    }
                     // note: apply is executed asynchronously with regards to networking so we cannot chain futures here
                     // by doing "return apply()"
-                    auto f = client->wait_for_resources(memory_consumed, timeout)
-                                 .then([client, timeout, msg_id, data = std::move(data), &func](auto permit) mutable {
+                    auto units = client->wait_for_resources(memory_consumed, timeout, admission->priority_class);
+                    bool waited = !units.available();
+                    auto f = std::move(units)
+                                 .then([client, timeout, msg_id, data = std::move(data), &handle,
+                                        admission = admission, waited, trace = std::move(trace)](auto permit) mutable {
+                                     auto &stats = client->get_server().get_admission_stats_internal();
+                                     // Waiting may have eaten the time the handler needs
+                                     if (!admission->can_meet(timeout, waited)) {
+                                         stats.shed++;
+                                         return;
+                                     }
+                                     stats.served++;
+                                     if (trace) {
+                                         trace->admitted = std::chrono::steady_clock::now();
+                                     }
                                      // FIXME: future is discarded
                                      (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id,
                                                                                              data = std::move(data),
                                                                                              permit = std::move(permit),
-                                                                                             &func]() mutable {
+                                                                                             &handle,
+                                                                                             trace = std::move(
+                                                                                                 trace)]() mutable {
                                          try {
-                                             auto args = unmarshall<Serializer, InArgs...>(*client, std::move(data));
-                                             return apply(func, client->info(), timeout, WantClientInfo(),
-                                                          WantTimePoint(), signature(), std::move(args))
-                                                 .then_wrapped([client, timeout, msg_id, permit = std::move(permit)](
-                                                                   futurize_t<Ret> ret) mutable {
-                                                     return reply<Serializer>(wait_style(), std::move(ret), msg_id,
-                                                                              client, timeout)
-                                                         .handle_exception([permit = std::move(permit), client,
-                                                                            msg_id](std::exception_ptr eptr) {
-                                                             client->get_logger()(
-                                                                 client->info(), msg_id,
-                                                                 format("got exception while processing a message: {}",
-                                                                        eptr));
-                                                         });
+                                             return handle(client, timeout, msg_id, std::move(data), std::move(trace))
+                                                 .handle_exception([permit = std::move(permit), client,
+                                                                    msg_id](std::exception_ptr eptr) {
+                                                     client->get_logger()(
+                                                         client->info(), msg_id,
+                                                         format("got exception while processing a message: {}", eptr));
                                                  });
                                          } catch (...) {
                                              client->get_logger()(client->info(), msg_id,
@@ -666,13 +852,252 @@ namespace nil {
                                  });
 
                     if (timeout) {
-                        f = f.handle_exception_type([](semaphore_timed_out &) { /* ignore */ });
+                        f = f.handle_exception_type([client](semaphore_timed_out &) {
+                            client->get_server().get_admission_stats_internal().expired++;
+                        });
                     }
 
                     return f;
                 };
             }
 
+            template<typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo,
+                     typename WantTimePoint>
+            auto recv_helper(signature<Ret(InArgs...)> sig, Func &&func, WantClientInfo wci, WantTimePoint wtp,
+                             lw_shared_ptr<verb_admission> admission) {
+                return make_receiver<Serializer, Ret>(
+                    admission, [func = lref_to_cref(std::forward<Func>(func)),
+                                admission](shared_ptr<server::connection> client,
+                                           boost::optional<rpc_clock_type::time_point> timeout, int64_t msg_id,
+                                           rcv_buf data, span_ptr trace) mutable {
+                        return handle_locally<Serializer>(func, signature<Ret(InArgs...)>(), WantClientInfo(),
+                                                          WantTimePoint(), admission, std::move(client), timeout,
+                                                          msg_id, std::move(data), std::move(trace));
+                    });
+            }
+
+            // Creates lambda to handle RPC message of a verb whose replies are cached by the raw bytes of
+            // its arguments. Hits are answered without running the handler
+            template<typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo,
+                     typename WantTimePoint>
+            auto cached_recv_helper(signature<Ret(InArgs...)> sig, Func &&func, WantClientInfo wci, WantTimePoint wtp,
+                                    lw_shared_ptr<verb_admission> admission, lw_shared_ptr<response_cache> cache) {
+                static_assert(std::is_same_v<wait_signature_t<Ret>, wait_type>, "only replies can be cached");
+                static_assert((!is_stream<std::decay_t<InArgs>>::value && ...), "streams cannot be cached");
+                return make_receiver<Serializer, Ret>(
+                    admission, [func = lref_to_cref(std::forward<Func>(func)), admission,
+                                cache = std::move(cache)](shared_ptr<server::connection> client,
+                                                          boost::optional<rpc_clock_type::time_point> timeout,
+                                                          int64_t msg_id, rcv_buf data, span_ptr trace) mutable {
+                        auto key = response_cache::key_of(data);
+                        if (auto hit = cache->lookup(key, 12)) {
+                            if (trace) {
+                                trace->handler_started = trace->handler_finished = std::chrono::steady_clock::now();
+                            }
+                            auto f = client->error() ? make_ready_future<>()
+                                                     : client->respond(msg_id, std::move(*hit), timeout);
+                            if (trace) {
+                                return f.finally([trace = std::move(trace)] { finish_span(trace); });
+                            }
+                            return f;
+                        }
+                        return handle_locally<Serializer>(func, signature<Ret(InArgs...)>(), WantClientInfo(),
+                                                          WantTimePoint(), admission, std::move(client), timeout,
+                                                          msg_id, std::move(data), std::move(trace), cache,
+                                                          cache->make_miss(std::move(key)));
+                    });
+            }
+
+            // Unmarshalls the first argument of a message, leaving the message as it is
+            template<typename Serializer, typename T>
+            inline T peek_first_argument(connection &c, rcv_buf &data) {
+                auto in = make_deserializer_stream(data);
+                return unmarshal_one<Serializer, decltype(in)>::template helper<T>::doit(c, in);
+            }
+
+            template<typename T>
+            T make_shard_local_buffer_copy(foreign_ptr<std::unique_ptr<T>> org);
+
+            // Runs a task on another shard. Tasks for a shard queued while a batch is on its way
+            // there go together in the next one.
+            void submit_batched(unsigned shard, noncopyable_function<void()> task);
+
+            // The outcome of a message handled on another shard
+            struct remote_reply {
+                int64_t msg_id = 0;
+                // Marshalled there, null for no_wait verbs
+                foreign_ptr<std::unique_ptr<snd_buf>> reply;
+                // Failure of a no_wait handler
+                std::exception_ptr ex;
+            };
+
+            // A verb registered with register_sharded_handler() on this shard, run here for the messages of any
+            // shard picking this one
+            struct sharded_verb {
+                // The protocol that registered it
+                const void *owner = nullptr;
+                // Unmarshalls a message with the serializer of that protocol and runs the handler registered here
+                noncopyable_function<future<remote_reply>(rcv_buf, boost::optional<rpc_clock_type::time_point>,
+                                                          int64_t)>
+                    run;
+                gate use_gate;
+            };
+
+            // The sharded verbs of the protocols of a serializer and verb type on this shard
+            template<typename Serializer, typename MsgType>
+            std::unordered_map<MsgType, sharded_verb> &sharded_verbs() {
+                static thread_local std::unordered_map<MsgType, sharded_verb> verbs;
+                return verbs;
+            }
+
+            template<typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantTimePoint>
+            auto make_sharded_verb_runner(signature<Ret(InArgs...)> sig, lw_shared_ptr<Func> func,
+                                          Serializer &serializer, WantTimePoint wtp) {
+                using wait_style = wait_signature_t<Ret>;
+                return [func = std::move(func), &serializer](rcv_buf data,
+                                                             boost::optional<rpc_clock_type::time_point> timeout,
+                                                             int64_t msg_id) {
+                    return futurize_invoke([&] {
+                               serializer_context<Serializer> c {serializer};
+                               auto args = unmarshall<Serializer, InArgs...>(c, std::move(data));
+                               opt_time_point time_point(timeout);
+                               auto all_args = maybe_add_time_point(WantTimePoint(), time_point, std::move(args));
+                               return futurize<Ret>::apply(*func, std::move(all_args));
+                           })
+                        .then_wrapped([&serializer, msg_id](futurize_t<Ret> ret) {
+                            remote_reply r;
+                            r.msg_id = msg_id;
+                            if constexpr (std::is_same_v<wait_style, no_wait_type>) {
+                                if (ret.failed()) {
+                                    r.ex = ret.get_exception();
+                                }
+                            } else {
+                                r.reply = make_foreign(std::make_unique<snd_buf>(make_reply<Serializer>(
+                                    serializer_context<Serializer> {serializer}, std::move(ret), r.msg_id)));
+                            }
+                            return r;
+                        });
+                };
+            }
+
+            // The reply of a message of a verb returning Ret that failed with ex on another shard
+            template<typename Ret>
+            remote_reply make_remote_error_reply(std::exception_ptr ex, int64_t msg_id) {
+                remote_reply r;
+                r.msg_id = msg_id;
+                if constexpr (std::is_same_v<wait_signature_t<Ret>, no_wait_type>) {
+                    r.ex = std::move(ex);
+                } else {
+                    snd_buf data;
+                    try {
+                        std::rethrow_exception(std::move(ex));
+                    } catch (std::exception &e) {
+                        data = make_error_reply(e, r.msg_id);
+                    } catch (...) {
+                        data = make_error_reply(std::runtime_error("unknown exception"), r.msg_id);
+                    }
+                    r.reply = make_foreign(std::make_unique<snd_buf>(std::move(data)));
+                }
+                return r;
+            }
+
+            // Runs a message of verb t on this shard, with the sharded verb registered here
+            template<typename Serializer, typename MsgType, typename Ret>
+            future<remote_reply> run_sharded_verb(MsgType t, rcv_buf data,
+                                                  boost::optional<rpc_clock_type::time_point> timeout,
+                                                  int64_t msg_id) {
+                auto &verbs = sharded_verbs<Serializer, MsgType>();
+                auto it = verbs.find(t);
+                if (it == verbs.end() || it->second.use_gate.is_closed()) {
+                    auto ex = std::runtime_error(format("no handler of the verb on shard {}", this_shard_id()));
+                    return make_ready_future<remote_reply>(
+                        make_remote_error_reply<Ret>(std::make_exception_ptr(ex), msg_id));
+                }
+                auto &verb = it->second;
+                return with_gate(verb.use_gate, [&verb, data = std::move(data), timeout, msg_id]() mutable {
+                    return verb.run(std::move(data), timeout, msg_id);
+                });
+            }
+
+            // Creates lambda to handle RPC message of a verb served on the shard shard_of picks from its first
+            // argument. The message buffer moves there without its data being copied, the handler and serializer
+            // registered there unmarshall it, run it and marshall its reply, and the reply is sent from the shard
+            // of the connection
+            template<typename Serializer, typename MsgType, typename ShardOf, typename Func, typename Ret,
+                     typename... InArgs, typename WantTimePoint>
+            auto sharded_recv_helper(signature<Ret(InArgs...)> sig, MsgType t, ShardOf &&shard_of,
+                                     lw_shared_ptr<Func> func, WantTimePoint wtp,
+                                     lw_shared_ptr<verb_admission> admission) {
+                static_assert(sizeof...(InArgs) > 0, "the shard is picked from the first argument of the handler");
+                static_assert((!is_stream<std::decay_t<InArgs>>::value && ...),
+                              "streams cannot be handed to another shard");
+                using first_type = std::tuple_element_t<0, std::tuple<InArgs...>>;
+                using wait_style = wait_signature_t<Ret>;
+                return make_receiver<Serializer, Ret>(admission, [t, shard_of = std::forward<ShardOf>(shard_of),
+                                                                  func = std::move(func), admission](
+                                                                     shared_ptr<server::connection> client,
+                                                                     boost::optional<rpc_clock_type::time_point>
+                                                                         timeout,
+                                                                     int64_t msg_id, rcv_buf data,
+                                                                     span_ptr trace) mutable {
+                    unsigned shard = shard_of(peek_first_argument<Serializer, first_type>(*client, data)) % smp::count;
+                    if (shard == this_shard_id()) {
+                        return handle_locally<Serializer>(*func, signature<Ret(InArgs...)>(), dont_want_client_info(),
+                                                          WantTimePoint(), admission, std::move(client), timeout,
+                                                          msg_id, std::move(data), std::move(trace));
+                    }
+                    auto start = std::chrono::steady_clock::now();
+                    // The span stays here, the handler times are those of the trip to the other shard
+                    auto ctx = trace ? trace->context() : trace_context();
+                    if (trace) {
+                        trace->handler_started = start;
+                    }
+                    auto call = std::make_unique<promise<remote_reply>>();
+                    auto done = call->get_future();
+                    submit_batched(shard, [t, call = call.get(), src = this_shard_id(), sg = current_scheduling_group(),
+                                           timeout, msg_id, ctx,
+                                           buf = make_foreign(std::make_unique<rcv_buf>(std::move(data)))]() mutable {
+                        // Never fails: whatever goes wrong here becomes the reply, so that the call is
+                        // always resolved
+                        (void)with_scheduling_group(sg, [t, timeout, msg_id, ctx, buf = std::move(buf)]() mutable {
+                            boost::optional<trace_scope> scope;
+                            if (ctx.sampled) {
+                                scope.emplace(ctx);
+                            }
+                            return run_sharded_verb<Serializer, MsgType, Ret>(
+                                t, make_shard_local_buffer_copy(std::move(buf)), timeout, msg_id);
+                        }).then_wrapped([call, src, msg_id](future<remote_reply> f) mutable {
+                            auto r = f.failed() ? make_remote_error_reply<Ret>(f.get_exception(), msg_id) : f.get0();
+                            submit_batched(src, [call, r = std::move(r)]() mutable { call->set_value(std::move(r)); });
+                        });
+                    });
+                    auto f = done.then([client, timeout, admission, start, call = std::move(call),
+                                        trace](remote_reply r) {
+                        auto now = std::chrono::steady_clock::now();
+                        admission->add_service_time_sample(
+                            std::chrono::duration_cast<rpc_clock_type::duration>(now - start));
+                        if (trace) {
+                            trace->handler_finished = now;
+                        }
+                        if constexpr (std::is_same_v<wait_style, no_wait_type>) {
+                            auto ret = r.ex ? make_exception_future<no_wait_type>(r.ex)
+                                            : make_ready_future<no_wait_type>(no_wait);
+                            return reply<Serializer>(no_wait_type(), std::move(ret), r.msg_id, client, timeout);
+                        } else {
+                            if (client->error()) {
+                                return make_ready_future<>();
+                            }
+                            return client->respond(r.msg_id, make_shard_local_buffer_copy(std::move(r.reply)),
+                                                   timeout);
+                        }
+                    });
+                    if (trace) {
+                        return f.finally([trace = std::move(trace)] { finish_span(trace); });
+                    }
+                    return f;
+                });
+            }
+
             // helper to create copy constructible lambda from non copy constructible one. std::function<> works only
             // with former kind.
             template<typename Func>
@@ -739,9 +1164,10 @@ namespace nil {
                 using clean_sig_type = typename sig_type::clean;
                 using want_client_info = typename sig_type::want_client_info;
                 using want_time_point = typename sig_type::want_time_point;
+                auto admission = make_lw_shared<verb_admission>();
                 auto recv = recv_helper<Serializer>(clean_sig_type(), std::forward<Func>(func), want_client_info(),
-                                                    want_time_point());
-                register_receiver(t, rpc_handler {sg, make_copyable_function(std::move(recv))});
+                                                    want_time_point(), admission);
+                register_receiver(t, rpc_handler {sg, make_copyable_function(std::move(recv)), std::move(admission)});
                 return make_client(clean_sig_type(), t);
             }
 
@@ -751,13 +1177,116 @@ namespace nil {
                 return register_handler(t, scheduling_group(), std::forward<Func>(func));
             }
 
+            template<typename Serializer, typename MsgType>
+            template<typename ShardOf, typename Func>
+            auto protocol<Serializer, MsgType>::register_sharded_handler(MsgType t, scheduling_group sg,
+                                                                         ShardOf &&shard_of, Func &&func) {
+                using sig_type = signature<typename function_traits<Func>::signature>;
+                using clean_sig_type = typename sig_type::clean;
+                using want_time_point = typename sig_type::want_time_point;
+                static_assert(std::is_same_v<typename sig_type::want_client_info, dont_want_client_info>,
+                              "client_info belongs to the shard of the connection");
+                auto &verbs = sharded_verbs<Serializer, MsgType>();
+                if (verbs.count(t)) {
+                    throw_with_backtrace<std::runtime_error>("sharded handler already registered on this shard");
+                }
+                auto shared_func = make_lw_shared<std::decay_t<Func>>(std::forward<Func>(func));
+                auto admission = make_lw_shared<verb_admission>();
+                auto recv = sharded_recv_helper<Serializer>(clean_sig_type(), t, std::forward<ShardOf>(shard_of),
+                                                            shared_func, want_time_point(), admission);
+                register_receiver(t, rpc_handler {sg, make_copyable_function(std::move(recv)), std::move(admission)});
+                auto &verb = verbs[t];
+                verb.owner = this;
+                verb.run = make_sharded_verb_runner(clean_sig_type(), std::move(shared_func), _serializer,
+                                                    want_time_point());
+                return make_client(clean_sig_type(), t);
+            }
+
+            template<typename Serializer, typename MsgType>
+            template<typename ShardOf, typename Func>
+            auto protocol<Serializer, MsgType>::register_sharded_handler(MsgType t, ShardOf &&shard_of, Func &&func) {
+                return register_sharded_handler(t, scheduling_group(), std::forward<ShardOf>(shard_of),
+                                                std::forward<Func>(func));
+            }
+
+            template<typename Serializer, typename MsgType>
+            template<typename Func>
+            auto protocol<Serializer, MsgType>::register_cacheable_handler(MsgType t, scheduling_group sg,
+                                                                           response_cache_options opts, Func &&func) {
+                using sig_type = signature<typename function_traits<Func>::signature>;
+                using clean_sig_type = typename sig_type::clean;
+                using want_client_info = typename sig_type::want_client_info;
+                using want_time_point = typename sig_type::want_time_point;
+                auto admission = make_lw_shared<verb_admission>();
+                auto cache = make_lw_shared<response_cache>(std::move(opts), uint64_t(t));
+                auto recv = cached_recv_helper<Serializer>(clean_sig_type(), std::forward<Func>(func),
+                                                           want_client_info(), want_time_point(), admission, cache);
+                register_receiver(t, rpc_handler {sg, make_copyable_function(std::move(recv)), std::move(admission),
+                                                  std::move(cache)});
+                return make_client(clean_sig_type(), t);
+            }
+
+            template<typename Serializer, typename MsgType>
+            template<typename Func>
+            auto protocol<Serializer, MsgType>::register_cacheable_handler(MsgType t, response_cache_options opts,
+                                                                           Func &&func) {
+                return register_cacheable_handler(t, scheduling_group(), std::move(opts), std::forward<Func>(func));
+            }
+
+            template<typename Serializer, typename MsgType>
+            response_cache &protocol<Serializer, MsgType>::cache_of(MsgType t) {
+                auto it = _handlers.find(t);
+                if (it == _handlers.end() || !it->second.cache) {
+                    throw_with_backtrace<std::runtime_error>("no cacheable handler registered for the verb");
+                }
+                return *it->second.cache;
+            }
+
+            template<typename Serializer, typename MsgType>
+            void protocol<Serializer, MsgType>::invalidate_cached(MsgType t) {
+                cache_of(t).clear();
+            }
+
+            template<typename Serializer, typename MsgType>
+            template<typename... Args>
+            void protocol<Serializer, MsgType>::invalidate_cached(MsgType t, const Args &...args) {
+                auto &cache = cache_of(t);
+                auto marshalled = marshall<Serializer, const Args &...>(_serializer, 0, args...);
+                cache.invalidate(response_cache::key_of(marshalled));
+            }
+
+            template<typename Serializer, typename MsgType>
+            void protocol<Serializer, MsgType>::set_priority_class(MsgType t, unsigned priority_class) {
+                auto it = _handlers.find(t);
+                if (it == _handlers.end()) {
+                    throw_with_backtrace<std::runtime_error>("no handler registered for the verb");
+                }
+                it->second.admission->priority_class = priority_class;
+            }
+
             template<typename Serializer, typename MsgType>
             future<> protocol<Serializer, MsgType>::unregister_handler(MsgType t) {
+                auto &verbs = sharded_verbs<Serializer, MsgType>();
+                auto verb = verbs.find(t);
+                auto closed = make_ready_future<>();
+                if (verb != verbs.end() && verb->second.owner == this) {
+                    closed = verb->second.use_gate.close().finally([&verbs, t] { verbs.erase(t); });
+                }
                 auto it = _handlers.find(t);
                 if (it != _handlers.end()) {
-                    return it->second.use_gate.close().finally([this, t] { _handlers.erase(t); });
+                    closed = when_all_succeed(std::move(closed), it->second.use_gate.close())
+                                 .discard_result()
+                                 .finally([this, t] { _handlers.erase(t); });
+                }
+                return closed;
+            }
+
+            template<typename Serializer, typename MsgType>
+            protocol<Serializer, MsgType>::~protocol() {
+                auto &verbs = sharded_verbs<Serializer, MsgType>();
+                for (auto it = verbs.begin(); it != verbs.end();) {
+                    it = it->second.owner == this ? verbs.erase(it) : std::next(it);
                 }
-                return make_ready_future<>();
             }
 
             template<typename Serializer, typename MsgType>
@@ -789,9 +1318,6 @@ namespace nil {
                 h->use_gate.leave();
             }
 
-            template<typename T>
-            T make_shard_local_buffer_copy(foreign_ptr<std::unique_ptr<T>> org);
-
             template<typename Serializer, typename... Out>
             future<> sink_impl<Serializer, Out...>::operator()(const Out &...args) {
                 // note that we use remote serializer pointer, so if serailizer needs a state
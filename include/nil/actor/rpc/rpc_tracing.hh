@@ -0,0 +1,151 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/core/future.hh>
+#include <nil/actor/core/shared_ptr.hh>
+#include <nil/actor/core/sstring.hh>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+            class routes;
+        }
+
+        namespace rpc {
+
+            /// \addtogroup rpc
+            /// @{
+
+            /// Trace context sent along with requests when both sides negotiated tracing.
+            ///
+            /// Calls take the context current when they are made, see trace_scope. Servers
+            /// record a span for each request carrying a sampled context, and make it current
+            /// while the handler is called, so that calls the handler makes right away belong
+            /// to the same trace.
+            struct trace_context {
+                uint64_t trace_id = 0;
+                /// Span of the caller
+                uint64_t span_id = 0;
+                bool sampled = false;
+
+                /// A new trace, with random ids
+                static trace_context start(bool sampled = true);
+            };
+
+            /// Makes a trace context current until destroyed.
+            ///
+            /// Only calls made before the task yields are covered, as is the case for other
+            /// thread-local state.
+            class trace_scope {
+                trace_context _saved;
+
+            public:
+                explicit trace_scope(const trace_context &ctx) noexcept;
+                trace_scope(const trace_scope &) = delete;
+                trace_scope &operator=(const trace_scope &) = delete;
+                ~trace_scope();
+            };
+
+            /// Trace context calls are made with; not sampled if none was set
+            const trace_context &current_trace_context() noexcept;
+
+            /// A request served, with the steady clock times it went through the server
+            struct span {
+                using time_point = std::chrono::steady_clock::time_point;
+
+                uint64_t trace_id = 0;
+                uint64_t span_id = 0;
+                uint64_t parent_span_id = 0;
+                uint64_t verb = 0;
+                int64_t msg_id = 0;
+                /// Header read
+                time_point received;
+                /// Memory for the request reserved
+                time_point admitted;
+                time_point handler_started;
+                time_point handler_finished;
+                /// Reply written to the connection
+                time_point replied;
+
+                trace_context context() const noexcept {
+                    return trace_context {trace_id, span_id, true};
+                }
+            };
+
+            using span_ptr = lw_shared_ptr<span>;
+
+            // Server side of spans, for requests carrying a sampled context
+            span_ptr start_span(const trace_context &ctx, uint64_t verb, int64_t msg_id);
+            void finish_span(const span_ptr &s);
+
+            /// Latest spans recorded on a shard, overwriting the oldest ones.
+            ///
+            /// Only its own shard touches a ring, so it takes no lock.
+            class span_ring {
+                std::vector<span> _spans;
+                size_t _capacity;
+                size_t _next = 0;
+                uint64_t _recorded = 0;
+
+            public:
+                explicit span_ring(size_t capacity) : _capacity(capacity) {
+                }
+                void push(const span &s);
+                /// Spans held, oldest first
+                std::vector<span> snapshot() const;
+                /// Spans pushed since the ring was created, including overwritten ones
+                uint64_t recorded() const noexcept {
+                    return _recorded;
+                }
+                size_t capacity() const noexcept {
+                    return _capacity;
+                }
+            };
+
+            /// Ring the spans of requests served on this shard go to
+            span_ring &local_spans();
+
+            /// Spans held by the rings of all shards
+            future<std::vector<span>> collect_spans();
+
+            /// Formats spans as a JSON array of objects, with ids as hex strings and times in
+            /// microseconds of the steady clock
+            sstring spans_to_json(const std::vector<span> &spans);
+
+            /// Serves the spans of all shards as JSON on GET path
+            void add_tracing_routes(httpd::routes &r, const sstring &path = "/rpc/spans");
+
+            /// @}
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
@@ -25,8 +25,10 @@
 #pragma once
 
 #include <nil/actor/network/api.hh>
+#include <algorithm>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <boost/any.hpp>
 #include <boost/type.hpp>
 #include <nil/actor/detail/std-compat.hh>
@@ -222,6 +224,41 @@ namespace nil {
                 temporary_buffer<char> &front();
             };
 
+            /// Serializer output that grows a snd_buf as it is written.
+            ///
+            /// Lets arguments be serialized in a single pass, without measuring them
+            /// first. The first chunk is sized after the expected size of the message,
+            /// the following ones double up to snd_buf::chunk_size, and chunks of that
+            /// size are recycled through a per-shard pool. The head space is left for
+            /// the caller to fill in once the size of the payload is known.
+            class snd_buf_output_stream {
+                std::vector<temporary_buffer<char>> _chunks;
+                char *_pos = nullptr;
+                char *_end = nullptr;
+                // Bytes in the chunks before the last one
+                size_t _done = 0;
+
+            private:
+                void next_chunk(size_t min_size);
+                void write_slow(const char *p, size_t size);
+
+            public:
+                snd_buf_output_stream(size_t head_space, size_t size_hint);
+                void write(const char *p, size_t size) {
+                    if (size <= size_t(_end - _pos)) {
+                        _pos = std::copy_n(p, size, _pos);
+                    } else {
+                        write_slow(p, size);
+                    }
+                }
+                void skip(size_t size);
+                /// Bytes written so far, head space included
+                size_t size() const noexcept {
+                    return _done + (_pos - _chunks.back().get());
+                }
+                snd_buf release() &&;
+            };
+
             static inline memory_input_stream<rcv_buf::iterator> make_deserializer_stream(rcv_buf &input) {
                 auto *b = std::get_if<temporary_buffer<char>>(&input.bufs);
                 if (b) {
@@ -0,0 +1,122 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+// Compares the scalar checksum kernel with the widest one this CPU supports,
+// over buffer sizes from a bare TCP/IP header up to a full TSO segment. The
+// checksummer cases go through the dispatch used by the stack, inline sum for
+// short buffers included.
+
+#include <nil/actor/network/ip_checksum.hh>
+
+#include <nil/actor/testing/perf_tests.hh>
+
+#include <random>
+#include <vector>
+
+using namespace nil::actor;
+
+class checksum {
+    // One spare byte, to measure unaligned starts as well
+    std::vector<char> _buf = std::vector<char>(65536 + 1);
+
+protected:
+    const net::checksum_kernel _scalar = net::checksum_implementations().front().sum;
+    const net::checksum_kernel _widest = net::checksum_implementations().back().sum;
+
+    const char *aligned() const {
+        return _buf.data();
+    }
+    const char *unaligned() const {
+        return _buf.data() + 1;
+    }
+    uint16_t checksummer(const char *data, size_t len) const {
+        net::checksummer csum;
+        csum.sum(data, len);
+        return csum.get();
+    }
+
+public:
+    checksum() {
+        std::mt19937 rng(0);
+        for (auto &c : _buf) {
+            c = char(rng());
+        }
+    }
+};
+
+PERF_TEST_F(checksum, scalar_40) {
+    perf_tests::do_not_optimize(_scalar(aligned(), 40));
+}
+
+PERF_TEST_F(checksum, scalar_1460) {
+    perf_tests::do_not_optimize(_scalar(aligned(), 1460));
+}
+
+PERF_TEST_F(checksum, scalar_9000) {
+    perf_tests::do_not_optimize(_scalar(aligned(), 9000));
+}
+
+PERF_TEST_F(checksum, scalar_65536) {
+    perf_tests::do_not_optimize(_scalar(aligned(), 65536));
+}
+
+PERF_TEST_F(checksum, widest_40) {
+    perf_tests::do_not_optimize(_widest(aligned(), 40));
+}
+
+PERF_TEST_F(checksum, widest_1460) {
+    perf_tests::do_not_optimize(_widest(aligned(), 1460));
+}
+
+PERF_TEST_F(checksum, widest_1460_unaligned) {
+    perf_tests::do_not_optimize(_widest(unaligned(), 1460));
+}
+
+PERF_TEST_F(checksum, widest_9000) {
+    perf_tests::do_not_optimize(_widest(aligned(), 9000));
+}
+
+PERF_TEST_F(checksum, widest_65536) {
+    perf_tests::do_not_optimize(_widest(aligned(), 65536));
+}
+
+PERF_TEST_F(checksum, checksummer_40) {
+    perf_tests::do_not_optimize(checksummer(aligned(), 40));
+}
+
+PERF_TEST_F(checksum, checksummer_576) {
+    perf_tests::do_not_optimize(checksummer(aligned(), 576));
+}
+
+PERF_TEST_F(checksum, checksummer_1460) {
+    perf_tests::do_not_optimize(checksummer(aligned(), 1460));
+}
+
+PERF_TEST_F(checksum, checksummer_1460_unaligned) {
+    perf_tests::do_not_optimize(checksummer(unaligned(), 1460));
+}
+
+PERF_TEST_F(checksum, checksummer_65536) {
+    perf_tests::do_not_optimize(checksummer(aligned(), 65536));
+}
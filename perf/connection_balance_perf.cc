@@ -0,0 +1,193 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+// Exchanges messages over the busy connections of a mix of idle and busy echo
+// connections, against a listener balanced across all shards. The busy
+// connections are served in parallel only as long as they ended up on
+// different shards, so an iteration takes longer the worse they are spread.
+//
+// Busy connections are opened at a fixed stride, the pattern that sends all of
+// them to the same shard when only connection counts are balanced.
+
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/thread.hh>
+#include <nil/actor/core/sleep.hh>
+#include <nil/actor/core/gate.hh>
+#include <nil/actor/core/loop.hh>
+#include <nil/actor/network/api.hh>
+#include <nil/actor/network/connection_balancing.hh>
+
+#include <nil/actor/testing/perf_tests.hh>
+
+#include <algorithm>
+#include <vector>
+
+using namespace nil::actor;
+
+namespace {
+
+    struct shard_state {
+        server_socket listener;
+        future<> accepting = make_ready_future<>();
+        gate connections;
+    };
+
+    thread_local std::unique_ptr<shard_state> state;
+
+    future<> echo(connected_socket s) {
+        return do_with(std::move(s), [](connected_socket &s) {
+            return do_with(s.input(), s.output(), [](input_stream<char> &in, output_stream<char> &out) {
+                return repeat([&in, &out] {
+                           return in.read().then([&out](temporary_buffer<char> buf) {
+                               if (buf.empty()) {
+                                   return make_ready_future<stop_iteration>(stop_iteration::yes);
+                               }
+                               return out.write(std::move(buf)).then([&out] { return out.flush(); }).then([] {
+                                   return stop_iteration::no;
+                               });
+                           });
+                       })
+                    .finally([&out] { return out.close(); });
+            });
+        });
+    }
+
+    void start_server(socket_address addr, listen_options opts) {
+        state = std::make_unique<shard_state>();
+        state->listener = engine().listen(addr, opts);
+        state->accepting = keep_doing([] {
+                               return state->listener.accept().then([](accept_result ar) {
+                                   // FIXME: future is discarded
+                                   (void)with_gate(state->connections, [s = std::move(ar.connection)]() mutable {
+                                       return echo(std::move(s)).handle_exception([](auto) {});
+                                   });
+                               });
+                           }).handle_exception([](auto) {});
+    }
+
+    future<> stop_server() {
+        state->listener.abort_accept();
+        return std::move(state->accepting).then([] { return state->connections.close(); }).then([] {
+            state.reset();
+        });
+    }
+
+    struct client_connection {
+        connected_socket s;
+        input_stream<char> in;
+        output_stream<char> out;
+
+        explicit client_connection(connected_socket cs) : s(std::move(cs)), in(s.input()), out(s.output()) {
+        }
+        // Sends \c msg and waits for it to come back
+        future<> exchange(const sstring &msg) {
+            return out.write(msg).then([this] { return out.flush(); }).then([this, size = msg.size()] {
+                return do_with(size_t(0), [this, size](size_t &received) {
+                    return do_until([&received, size] { return received >= size; }, [this, &received] {
+                        return in.read().then([&received](temporary_buffer<char> buf) {
+                            if (buf.empty()) {
+                                throw std::runtime_error("echo connection closed");
+                            }
+                            received += buf.size();
+                        });
+                    });
+                });
+            });
+        }
+        void close() {
+            out.close().get();
+            in.close().get();
+        }
+    };
+
+}    // namespace
+
+class balanced_echo {
+    static constexpr unsigned nr_connections = 64;
+    static constexpr unsigned nr_busy = 4;
+
+    socket_address _addr;
+    std::vector<std::unique_ptr<client_connection>> _idle;
+    std::vector<std::unique_ptr<client_connection>> _busy;
+
+protected:
+    const sstring _msg = sstring(16384, 'x');
+
+    future<> busy_round() {
+        return parallel_for_each(_busy, [this](auto &c) { return c->exchange(_msg); });
+    }
+
+public:
+    balanced_echo(server_socket::load_balancing_algorithm lba, uint16_t port) :
+        _addr(ipv4_addr("127.0.0.1", port)) {
+        listen_options opts;
+        opts.reuse_address = true;
+        opts.lba = lba;
+        smp::invoke_on_all([addr = _addr, opts] { start_server(addr, opts); }).get();
+
+        // Every smp::count-th connection is busy, as long as there are busy ones
+        // left. Busy ones get traffic for a few sampling periods before the next
+        // connection is opened, so that the sampled activity can catch up.
+        for (unsigned i = 0; i < nr_connections; ++i) {
+            auto c = std::make_unique<client_connection>(engine().net().connect(_addr).get0());
+            if (i % smp::count == 0 && _busy.size() < nr_busy) {
+                auto until = lowres_clock::now() + net::shard_activity_sampler::period * 3;
+                while (lowres_clock::now() < until) {
+                    c->exchange(_msg).get();
+                }
+                _busy.push_back(std::move(c));
+            } else {
+                _idle.push_back(std::move(c));
+            }
+        }
+    }
+    ~balanced_echo() {
+        for (auto &&c : _busy) {
+            c->close();
+        }
+        for (auto &&c : _idle) {
+            c->close();
+        }
+        smp::invoke_on_all([] { return stop_server(); }).get();
+    }
+};
+
+struct activity_balancing : balanced_echo {
+    activity_balancing() : balanced_echo(server_socket::load_balancing_algorithm::activity, 10200) {
+    }
+};
+
+struct connection_distribution : balanced_echo {
+    connection_distribution() :
+        balanced_echo(server_socket::load_balancing_algorithm::connection_distribution, 10201) {
+    }
+};
+
+PERF_TEST_F(activity_balancing, busy_round) {
+    return busy_round();
+}
+
+PERF_TEST_F(connection_distribution, busy_round) {
+    return busy_round();
+}
@@ -0,0 +1,132 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+// Measures the IPv4 route table: build time, and the cost of a lookup with and
+// without the next hop cache, over tables of random prefixes.
+
+#include <nil/actor/network/route.hh>
+
+#include <nil/actor/testing/perf_tests.hh>
+
+#include <random>
+#include <vector>
+
+using namespace nil::actor;
+using namespace net;
+
+namespace {
+
+    std::vector<ipv4_route> random_routes(std::mt19937 &rng, size_t count) {
+        // Prefix lengths roughly distributed the way they are in a full table:
+        // mostly /24, then /16 to /23, and a few longer ones
+        std::discrete_distribution<unsigned> lengths({1, 2, 6, 60, 1, 1});
+        const uint8_t length_of[] = {8, 16, 20, 24, 28, 32};
+        std::vector<ipv4_route> routes(count);
+        for (auto &r : routes) {
+            r.length = length_of[lengths(rng)];
+            r.prefix = rng() & (~0u << (32 - r.length));
+            r.gateway = rng() % 16 + 1;
+        }
+        return routes;
+    }
+
+}    // namespace
+
+template<size_t Count>
+class route_table {
+    std::mt19937 _rng {0};
+    std::vector<uint32_t> _many;
+    std::vector<uint32_t> _few;
+    size_t _next = 0;
+
+    // Destinations are drawn from the routes, to reach the deeper levels
+    std::vector<uint32_t> destinations(size_t n) {
+        std::vector<uint32_t> dsts(n);
+        for (auto &d : dsts) {
+            auto &r = _routes[_rng() % _routes.size()];
+            d = r.prefix | (_rng() & ~(~0u << (32 - r.length)));
+        }
+        return dsts;
+    }
+
+protected:
+    std::vector<ipv4_route> _routes = random_routes(_rng, Count);
+    ipv4_route_table _table;
+
+    uint32_t many() {
+        return _many[_next++ % _many.size()];
+    }
+    // A working set small enough to live in the cache
+    uint32_t few() {
+        return _few[_next++ % _few.size()];
+    }
+
+public:
+    route_table() {
+        _table.assign(_routes);
+        _many = destinations(1 << 16);
+        _few = destinations(64);
+    }
+};
+
+using small_table = route_table<1024>;
+using full_table = route_table<524288>;
+
+PERF_TEST_F(small_table, build) {
+    auto routes = _routes;
+    perf_tests::start_measuring_time();
+    _table.assign(std::move(routes));
+    perf_tests::stop_measuring_time();
+}
+
+PERF_TEST_F(small_table, lookup_uncached) {
+    perf_tests::do_not_optimize(_table.lookup_uncached(many()));
+}
+
+PERF_TEST_F(small_table, lookup_hot) {
+    perf_tests::do_not_optimize(_table.lookup(few()));
+}
+
+PERF_TEST_F(small_table, lookup_cold) {
+    perf_tests::do_not_optimize(_table.lookup(many()));
+}
+
+PERF_TEST_F(full_table, build) {
+    auto routes = _routes;
+    perf_tests::start_measuring_time();
+    _table.assign(std::move(routes));
+    perf_tests::stop_measuring_time();
+}
+
+PERF_TEST_F(full_table, lookup_uncached) {
+    perf_tests::do_not_optimize(_table.lookup_uncached(many()));
+}
+
+PERF_TEST_F(full_table, lookup_hot) {
+    perf_tests::do_not_optimize(_table.lookup(few()));
+}
+
+PERF_TEST_F(full_table, lookup_cold) {
+    perf_tests::do_not_optimize(_table.lookup(many()));
+}
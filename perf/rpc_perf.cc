@@ -24,6 +24,13 @@
 
 #include <random>
 
+#include <boost/range/irange.hpp>
+
+#include <nil/actor/rpc/rpc.hh>
+#include <nil/actor/network/api.hh>
+#include <nil/actor/network/shm_socket.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/loop.hh>
 #include <nil/actor/rpc/lz4_compressor.hh>
 #include <nil/actor/rpc/lz4_fragmented_compressor.hh>
 
@@ -234,3 +241,353 @@ PERF_TEST_F(lz4_fragmented, large_random_buffer_decompress) {
 PERF_TEST_F(lz4_fragmented, large_zeroed_buffer_decompress) {
     perf_tests::do_not_optimize(compressor().decompress(large_compressed_buffer_zeroes()));
 }
+
+struct single_pass_serializer { };
+
+struct two_pass_serializer {
+    static constexpr bool measure_before_marshalling = true;
+};
+
+template<typename Serializer, typename Output>
+inline void write(Serializer, Output &out, uint64_t v) {
+    out.write(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+template<typename Serializer, typename Output>
+inline void write(Serializer s, Output &out, const nil::actor::sstring &v) {
+    write(s, out, uint64_t(v.size()));
+    out.write(v.c_str(), v.size());
+}
+
+template<typename Serializer, typename Output>
+inline void write(Serializer s, Output &out, const std::vector<nil::actor::sstring> &v) {
+    write(s, out, uint64_t(v.size()));
+    for (auto &&e : v) {
+        write(s, out, e);
+    }
+}
+
+template<typename Serializer>
+struct marshalling {
+    // Head space reserved by the client for the request header
+    static constexpr size_t head_space = 28;
+
+private:
+    Serializer _serializer;
+    nil::actor::sstring _medium_string;
+    nil::actor::sstring _large_string;
+    std::vector<nil::actor::sstring> _many_strings;
+
+public:
+    marshalling() :
+        _medium_string(nil::actor::sstring::initialized_later(), 4 * 1024),
+        _large_string(nil::actor::sstring::initialized_later(), 1024 * 1024) {
+        auto &eng = testing::local_random_engine;
+        auto dist = std::uniform_int_distribution<char>();
+
+        std::generate_n(_medium_string.begin(), _medium_string.size(), [&] { return dist(eng); });
+        std::generate_n(_large_string.begin(), _large_string.size(), [&] { return dist(eng); });
+        for (auto i = 0; i < 1000; i++) {
+            _many_strings.emplace_back(nil::actor::sstring::initialized_later(), 100);
+            std::generate_n(_many_strings.back().begin(), 100, [&] { return dist(eng); });
+        }
+    }
+
+    template<typename... T>
+    nil::actor::rpc::snd_buf marshall(const T &...args) {
+        return nil::actor::rpc::marshall(_serializer, head_space, args...);
+    }
+
+    nil::actor::rpc::snd_buf scalars() {
+        return marshall(uint64_t(1), uint64_t(2), uint64_t(3));
+    }
+    nil::actor::rpc::snd_buf medium_string() {
+        return marshall(uint64_t(1), _medium_string);
+    }
+    nil::actor::rpc::snd_buf large_string() {
+        return marshall(uint64_t(1), _large_string);
+    }
+    nil::actor::rpc::snd_buf many_strings() {
+        return marshall(uint64_t(1), _many_strings);
+    }
+};
+
+using single_pass = marshalling<single_pass_serializer>;
+
+PERF_TEST_F(single_pass, scalars) {
+    perf_tests::do_not_optimize(scalars());
+}
+
+PERF_TEST_F(single_pass, medium_string) {
+    perf_tests::do_not_optimize(medium_string());
+}
+
+PERF_TEST_F(single_pass, large_string) {
+    perf_tests::do_not_optimize(large_string());
+}
+
+PERF_TEST_F(single_pass, many_strings) {
+    perf_tests::do_not_optimize(many_strings());
+}
+
+using two_pass = marshalling<two_pass_serializer>;
+
+PERF_TEST_F(two_pass, scalars) {
+    perf_tests::do_not_optimize(scalars());
+}
+
+PERF_TEST_F(two_pass, medium_string) {
+    perf_tests::do_not_optimize(medium_string());
+}
+
+PERF_TEST_F(two_pass, large_string) {
+    perf_tests::do_not_optimize(large_string());
+}
+
+PERF_TEST_F(two_pass, many_strings) {
+    perf_tests::do_not_optimize(many_strings());
+}
+
+template<typename Serializer, typename Input>
+inline uint64_t read(Serializer, Input &in, nil::actor::rpc::type<uint64_t>) {
+    uint64_t v;
+    in.read(reinterpret_cast<char *>(&v), sizeof(v));
+    return v;
+}
+
+template<typename Serializer, typename Input>
+inline nil::actor::sstring read(Serializer s, Input &in, nil::actor::rpc::type<nil::actor::sstring>) {
+    auto size = read(s, in, nil::actor::rpc::type<uint64_t>());
+    nil::actor::sstring ret(nil::actor::sstring::initialized_later(), size);
+    in.read(ret.data(), size);
+    return ret;
+}
+
+struct transport_serializer { };
+
+struct tcp_transport {
+    static nil::actor::socket_address address() {
+        return nil::actor::ipv4_addr("127.0.0.1", 10100);
+    }
+    static nil::actor::server_socket listen(nil::actor::socket_address sa = address()) {
+        nil::actor::listen_options lo;
+        lo.reuse_address = true;
+        return nil::actor::engine().net().listen(sa, lo);
+    }
+    static nil::actor::socket socket() {
+        return nil::actor::engine().net().socket();
+    }
+};
+
+struct unix_transport {
+    static nil::actor::socket_address address() {
+        return nil::actor::socket_address(
+            nil::actor::unix_domain_addr(std::string("\0actor-rpc-perf-unix", 20)));
+    }
+    static nil::actor::server_socket listen() {
+        return nil::actor::engine().net().listen(address(), nil::actor::listen_options());
+    }
+    static nil::actor::socket socket() {
+        return nil::actor::engine().net().socket();
+    }
+};
+
+struct shm_transport {
+    static nil::actor::socket_address address() {
+        return nil::actor::socket_address(
+            nil::actor::unix_domain_addr(std::string("\0actor-rpc-perf-shm", 19)));
+    }
+    static nil::actor::server_socket listen() {
+        return nil::actor::net::shm_listen(address());
+    }
+    static nil::actor::socket socket() {
+        return nil::actor::net::shm_socket();
+    }
+};
+
+template<typename Transport>
+struct transport {
+    static constexpr size_t small_payload_size = 16;
+    static constexpr size_t large_payload_size = 64 * 1024;
+    static constexpr unsigned concurrency = 16;
+
+private:
+    using protocol = nil::actor::rpc::protocol<transport_serializer>;
+
+    struct connection {
+        protocol proto {transport_serializer {}};
+        protocol::server server;
+        protocol::client client;
+
+        connection() :
+            server(proto, nil::actor::rpc::server_options(), Transport::listen()),
+            client(proto, nil::actor::rpc::client_options(), Transport::socket(), Transport::address()) {
+            proto.register_handler(1, [](nil::actor::sstring payload) { return payload; });
+        }
+    };
+
+    // Shared by all test cases of a transport, and never stopped
+    static connection &local_connection() {
+        static thread_local connection *c = new connection();
+        return *c;
+    }
+
+    connection &_connection;
+    nil::actor::sstring _small_payload;
+    nil::actor::sstring _large_payload;
+
+    nil::actor::future<> echo(const nil::actor::sstring &payload) {
+        auto echo = _connection.proto.template make_client<nil::actor::sstring(nil::actor::sstring)>(1);
+        return echo(_connection.client, payload).discard_result();
+    }
+
+public:
+    transport() :
+        _connection(local_connection()),
+        _small_payload(nil::actor::sstring::initialized_later(), small_payload_size),
+        _large_payload(nil::actor::sstring::initialized_later(), large_payload_size) {
+        std::fill(_small_payload.begin(), _small_payload.end(), 's');
+        std::fill(_large_payload.begin(), _large_payload.end(), 'l');
+    }
+
+    // One call at a time: round trip latency
+    nil::actor::future<> small_round_trip() {
+        return echo(_small_payload);
+    }
+    nil::actor::future<> large_round_trip() {
+        return echo(_large_payload);
+    }
+    // Many calls in flight: throughput
+    nil::actor::future<> small_pipelined() {
+        return nil::actor::parallel_for_each(boost::irange(0u, concurrency),
+                                             [this](unsigned) { return echo(_small_payload); });
+    }
+};
+
+using tcp = transport<tcp_transport>;
+
+PERF_TEST_F(tcp, small_round_trip) {
+    return small_round_trip();
+}
+
+PERF_TEST_F(tcp, large_round_trip) {
+    return large_round_trip();
+}
+
+PERF_TEST_F(tcp, small_pipelined) {
+    return small_pipelined();
+}
+
+using unix_socket = transport<unix_transport>;
+
+PERF_TEST_F(unix_socket, small_round_trip) {
+    return small_round_trip();
+}
+
+PERF_TEST_F(unix_socket, large_round_trip) {
+    return large_round_trip();
+}
+
+PERF_TEST_F(unix_socket, small_pipelined) {
+    return small_pipelined();
+}
+
+using shm = transport<shm_transport>;
+
+PERF_TEST_F(shm, small_round_trip) {
+    return small_round_trip();
+}
+
+PERF_TEST_F(shm, large_round_trip) {
+    return large_round_trip();
+}
+
+PERF_TEST_F(shm, small_pipelined) {
+    return small_pipelined();
+}
+
+template<unsigned Stripes>
+struct striping {
+    static constexpr size_t small_payload_size = 16;
+    static constexpr size_t large_payload_size = 1024 * 1024;
+    static constexpr unsigned concurrency = 64;
+
+private:
+    using protocol = nil::actor::rpc::protocol<transport_serializer>;
+
+    static nil::actor::socket_address address() {
+        return nil::actor::ipv4_addr("127.0.0.1", 10200 + Stripes);
+    }
+
+    static nil::actor::rpc::striping_options options() {
+        nil::actor::rpc::striping_options so;
+        so.stripes = Stripes;
+        so.bulk_threshold = Stripes > 1 ? 64 * 1024 : 0;
+        return so;
+    }
+
+    struct connection {
+        protocol proto {transport_serializer {}};
+        protocol::server server;
+        protocol::striped_client client;
+
+        connection() :
+            server(proto, nil::actor::rpc::server_options(), tcp_transport::listen(address())),
+            client(proto, options(), nil::actor::rpc::client_options(), address()) {
+            proto.register_handler(1, [](nil::actor::sstring payload) { return payload; });
+        }
+    };
+
+    // Shared by all test cases with the same number of stripes, and never stopped
+    static connection &local_connection() {
+        static thread_local connection *c = new connection();
+        return *c;
+    }
+
+    connection &_connection;
+    nil::actor::sstring _small_payload;
+    nil::actor::sstring _large_payload;
+
+    nil::actor::future<> echo(const nil::actor::sstring &payload) {
+        auto echo = _connection.proto.template make_client<nil::actor::sstring(nil::actor::sstring)>(1);
+        return echo(_connection.client, payload).discard_result();
+    }
+
+public:
+    striping() :
+        _connection(local_connection()),
+        _small_payload(nil::actor::sstring::initialized_later(), small_payload_size),
+        _large_payload(nil::actor::sstring::initialized_later(), large_payload_size) {
+        std::fill(_small_payload.begin(), _small_payload.end(), 's');
+        std::fill(_large_payload.begin(), _large_payload.end(), 'l');
+    }
+
+    nil::actor::future<> small_pipelined() {
+        return nil::actor::parallel_for_each(boost::irange(0u, concurrency),
+                                             [this](unsigned) { return echo(_small_payload); });
+    }
+    // Small calls issued along with a large one, which they may get queued behind
+    nil::actor::future<> mixed() {
+        return nil::actor::when_all_succeed(echo(_large_payload), small_pipelined()).discard_result();
+    }
+};
+
+using one_stripe = striping<1>;
+
+PERF_TEST_F(one_stripe, small_pipelined) {
+    return small_pipelined();
+}
+
+PERF_TEST_F(one_stripe, mixed) {
+    return mixed();
+}
+
+using four_stripes = striping<4>;
+
+PERF_TEST_F(four_stripes, small_pipelined) {
+    return small_pipelined();
+}
+
+PERF_TEST_F(four_stripes, mixed) {
+    return mixed();
+}
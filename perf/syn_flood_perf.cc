@@ -0,0 +1,209 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+// Opens connections to a native stack listener over a loopback device pair,
+// with and without a SYN flood from spoofed addresses hitting the same
+// listener. With SYN cookies the legitimate connections should keep going
+// through at a similar pace while the backlog is full of spoofed entries.
+//
+// Runs on a single shard: start it with --smp 1.
+
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/thread.hh>
+#include <nil/actor/core/sleep.hh>
+#include <nil/actor/core/loop.hh>
+#include <nil/actor/network/loopback.hh>
+#include <nil/actor/network/ethernet.hh>
+#include <nil/actor/network/ip.hh>
+#include <nil/actor/network/tcp.hh>
+#include <nil/actor/network/tcp-stack.hh>
+
+#include <nil/actor/testing/perf_tests.hh>
+
+#include <random>
+
+using namespace nil::actor;
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+    const uint16_t server_port = 80;
+    // Spoofed sources are 10.0.0.100 to 10.0.0.199
+    const unsigned nr_spoofed = 100;
+
+    struct ipv4_node {
+        interface netif;
+        ipv4 inet;
+
+        static std::shared_ptr<device> start(std::shared_ptr<device> dev) {
+            dev->set_local_queue(dev->init_local_queue({}, this_shard_id()));
+            return dev;
+        }
+
+        ipv4_node(std::shared_ptr<device> dev, const char *addr) : netif(start(std::move(dev))), inet(&netif) {
+            inet.set_host_address(ipv4_address(addr));
+            inet.set_netmask_address(ipv4_address("255.255.255.0"));
+            inet.set_arp_learn_hook([this](ethernet_address l2, ipv4_address l3) { inet.learn(l2, l3); });
+        }
+    };
+
+    ipv4_address spoofed_address(unsigned i) {
+        return ipv4_address(ipv4_address("10.0.0.100").ip + i % nr_spoofed);
+    }
+
+    // A SYN carrying an MSS option; checksums are left out, the device is
+    // configured to skip their verification.
+    packet make_syn(ethernet_address src_mac, ethernet_address dst_mac, ipv4_address src, uint16_t src_port,
+                    uint32_t isn) {
+        packet p;
+        auto th = p.prepend_uninitialized_header(tcp_hdr::len + uint8_t(tcp_option::option_len::mss));
+        auto h = tcp_hdr {};
+        h.src_port = src_port;
+        h.dst_port = server_port;
+        h.seq = make_seq(isn);
+        h.f_syn = true;
+        h.data_offset = (tcp_hdr::len + uint8_t(tcp_option::option_len::mss)) / 4;
+        h.window = 29200;
+        h.write(th);
+        tcp_option::mss mss;
+        mss.mss = 1460;
+        mss.write(th + tcp_hdr::len);
+
+        auto iph = p.prepend_header<ip_hdr>();
+        iph->ihl = sizeof(ip_hdr) / 4;
+        iph->ver = 4;
+        iph->dscp = 0;
+        iph->ecn = 0;
+        iph->len = p.len();
+        iph->id = 0;
+        iph->frag = 0;
+        iph->ttl = 64;
+        iph->ip_proto = uint8_t(ip_protocol_num::tcp);
+        iph->csum = 0;
+        iph->src_ip = src;
+        iph->dst_ip = ipv4_address("10.0.0.2");
+        *iph = hton(*iph);
+        auto eh = p.prepend_header<eth_hdr>();
+        eh->dst_mac = dst_mac;
+        eh->src_mac = src_mac;
+        eh->eth_proto = uint16_t(eth_protocol_num::ipv4);
+        *eh = hton(*eh);
+        return p;
+    }
+
+}    // namespace
+
+class syn_flood_base {
+    static constexpr unsigned flood_rate = 200000;    // spoofed SYNs per second
+    static constexpr int backlog = 128;
+
+    std::pair<std::shared_ptr<device>, std::shared_ptr<device>> _devs;
+    std::shared_ptr<device> &_attacker;
+    ipv4_node &_client;
+    ipv4_node &_server;
+    server_socket _listener;
+    future<> _accepting = make_ready_future<>();
+    bool _stop = false;
+    future<> _flood = make_ready_future<>();
+
+protected:
+    const socket_address _addr = socket_address(ipv4_addr("10.0.0.2", server_port));
+
+    future<> connect() {
+        return do_with(tcpv4_socket(_client.inet.get_tcp()),
+                       [this](nil::actor::socket &s) { return s.connect(_addr).discard_result(); });
+    }
+
+public:
+    explicit syn_flood_base(bool flood) :
+        _devs(create_loopback_device_pair([] {
+            loopback_device_config cfg;
+            cfg.csum_offload = true;
+            return cfg;
+        }())),
+        // Device queues keep polling the stacks until the reactor exits
+        _attacker(*new std::shared_ptr<device>(_devs.first)), _client(*new ipv4_node(_devs.first, "10.0.0.1")),
+        _server(*new ipv4_node(_devs.second, "10.0.0.2")) {
+        // Answers to spoofed addresses reach the attacker, which drops them
+        for (unsigned i = 0; i < nr_spoofed; ++i) {
+            _server.inet.learn(_attacker->hw_address(), spoofed_address(i));
+        }
+        _server.inet.get_tcp().set_syn_cookies(true);
+
+        listen_options lo;
+        lo.listen_backlog = backlog;
+        _listener = tcpv4_listen(_server.inet.get_tcp(), server_port, lo);
+        _accepting = keep_doing([this] {
+                         return _listener.accept().discard_result();
+                     }).handle_exception([](auto) {});
+        if (!flood) {
+            return;
+        }
+        _flood = async([this] {
+            std::mt19937 rng(0);
+            const auto tick = 1ms;
+            const unsigned per_tick = flood_rate / 1000;
+            unsigned sent = 0;
+            while (!_stop) {
+                circular_buffer<packet> frames;
+                for (unsigned i = 0; i < per_tick; ++i, ++sent) {
+                    frames.push_back(make_syn(_attacker->hw_address(), _devs.second->hw_address(),
+                                              spoofed_address(sent), 1024 + rng() % 60000, rng()));
+                }
+                while (!frames.empty()) {
+                    _attacker->local_queue().send(frames);
+                    thread::yield();
+                }
+                sleep(tick).get();
+            }
+        });
+        // Let the spoofed entries fill the backlog first
+        sleep(100ms).get();
+    }
+    ~syn_flood_base() {
+        _stop = true;
+        _flood.get();
+        _listener.abort_accept();
+        _accepting.get();
+    }
+};
+
+struct syn_flood : syn_flood_base {
+    syn_flood() : syn_flood_base(true) {
+    }
+};
+
+struct no_flood : syn_flood_base {
+    no_flood() : syn_flood_base(false) {
+    }
+};
+
+PERF_TEST_F(no_flood, connect) {
+    return connect();
+}
+
+PERF_TEST_F(syn_flood, connect) {
+    return connect();
+}
@@ -0,0 +1,175 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+// Feeds a stream of full sized segments, reordered to a given depth, through
+// the receive side of the native TCP stack: the packet_merger based queue it
+// used to have and the coalescing reassembly queue it has now. An iteration
+// is a whole stream of 16k segments.
+
+#include <nil/actor/network/packet-util.hh>
+#include <nil/actor/network/tcp.hh>
+
+#include <nil/actor/testing/perf_tests.hh>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace nil::actor;
+using namespace net;
+
+namespace {
+
+    constexpr size_t mss = 1460;
+
+    struct bench_tag { };
+
+    // The tcb receive path before the reassembly queue
+    struct merger_receiver {
+        packet_merger<tcp_seq, bench_tag> out_of_order;
+        tcp_seq next;
+        size_t delivered = 0;
+
+        void receive(tcp_seq seq, packet p) {
+            if (seq != next) {
+                out_of_order.merge(seq, std::move(p));
+                return;
+            }
+            next += p.len();
+            delivered += p.len();
+            for (auto it = out_of_order.map.begin(); it != out_of_order.map.end();) {
+                auto &q = it->second;
+                auto seg_beg = it->first;
+                auto seg_end = seg_beg + q.len();
+                if (seg_beg <= next && next < seg_end) {
+                    q.trim_front(next - seg_beg);
+                    next += q.len();
+                    delivered += q.len();
+                    it = out_of_order.map.erase(it);
+                } else if (next >= seg_end) {
+                    it = out_of_order.map.erase(it);
+                } else {
+                    break;
+                }
+            }
+        }
+    };
+
+    struct queue_receiver {
+        packet_reassembly_queue<tcp_seq> out_of_order;
+        tcp_seq next;
+        size_t delivered = 0;
+
+        void receive(tcp_seq seq, packet p) {
+            if (seq != next) {
+                out_of_order.insert(seq, std::move(p));
+                return;
+            }
+            next += p.len();
+            delivered += p.len();
+            next = out_of_order.pop_front(next, [this](packet q) { delivered += q.len(); });
+        }
+    };
+
+    // Segment i arrives at i + jitter, jitter drawn from [0, depth)
+    std::vector<size_t> arrival_order(std::mt19937 &rng, size_t count, size_t depth) {
+        std::vector<std::pair<size_t, size_t>> arrivals(count);
+        for (size_t i = 0; i < count; ++i) {
+            arrivals[i] = {i + rng() % depth, i};
+        }
+        std::sort(arrivals.begin(), arrivals.end());
+        std::vector<size_t> order(count);
+        for (size_t i = 0; i < count; ++i) {
+            order[i] = arrivals[i].second;
+        }
+        return order;
+    }
+
+}    // namespace
+
+template<size_t Depth>
+class reordered_stream {
+    static constexpr size_t count = 1 << 14;
+
+    std::vector<char> _payload = std::vector<char>(mss, 'x');
+    std::vector<size_t> _order;
+
+protected:
+    template<typename Receiver>
+    void feed() {
+        Receiver r;
+        auto base = make_seq(uint32_t(-1) - 100 * mss);
+        r.next = base;
+        for (auto i : _order) {
+            r.receive(base + int32_t(i * mss), packet(_payload.data(), mss));
+        }
+        if (r.delivered != _order.size() * mss) {
+            throw std::runtime_error("the stream was not delivered in full");
+        }
+    }
+
+public:
+    reordered_stream() {
+        std::mt19937 rng(0);
+        _order = arrival_order(rng, count, Depth);
+    }
+};
+
+using in_order = reordered_stream<1>;
+using reordered_16 = reordered_stream<16>;
+using reordered_256 = reordered_stream<256>;
+using reordered_1024 = reordered_stream<1024>;
+
+PERF_TEST_F(in_order, packet_merger) {
+    feed<merger_receiver>();
+}
+
+PERF_TEST_F(in_order, reassembly_queue) {
+    feed<queue_receiver>();
+}
+
+PERF_TEST_F(reordered_16, packet_merger) {
+    feed<merger_receiver>();
+}
+
+PERF_TEST_F(reordered_16, reassembly_queue) {
+    feed<queue_receiver>();
+}
+
+PERF_TEST_F(reordered_256, packet_merger) {
+    feed<merger_receiver>();
+}
+
+PERF_TEST_F(reordered_256, reassembly_queue) {
+    feed<queue_receiver>();
+}
+
+PERF_TEST_F(reordered_1024, packet_merger) {
+    feed<merger_receiver>();
+}
+
+PERF_TEST_F(reordered_1024, reassembly_queue) {
+    feed<queue_receiver>();
+}
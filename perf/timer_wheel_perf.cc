@@ -0,0 +1,136 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+// Compares reactor timers with timing wheel timers the way native TCP uses
+// them: every connection pushes its retransmission timeout back on each ACK,
+// and stops and restarts it when it goes idle. An iteration is one such round
+// over 64k connections.
+//
+// Runs on a single shard: start it with --smp 1.
+
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/timer.hh>
+#include <nil/actor/core/lowres_clock.hh>
+#include <nil/actor/network/timer_wheel.hh>
+
+#include <nil/actor/testing/perf_tests.hh>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace nil::actor;
+using namespace std::chrono_literals;
+
+namespace {
+
+    using reactor_timer = timer<lowres_clock>;
+    using wheel_timer = net::wheel_timer;
+
+    constexpr auto rto = 1s;
+
+    template<typename Timer>
+    struct timer_factory;
+
+    template<>
+    struct timer_factory<reactor_timer> {
+        std::unique_ptr<reactor_timer> make() {
+            return std::make_unique<reactor_timer>([] {});
+        }
+    };
+
+    template<>
+    struct timer_factory<wheel_timer> {
+        net::timer_wheel wheel;
+
+        std::unique_ptr<wheel_timer> make() {
+            return std::make_unique<wheel_timer>(wheel, [] {});
+        }
+    };
+
+}    // namespace
+
+template<typename Timer>
+class connection_timers {
+    static constexpr size_t count = 1 << 16;
+
+    timer_factory<Timer> _factory;
+    std::vector<std::unique_ptr<Timer>> _timers;
+    std::vector<lowres_clock::duration> _jitter;
+    unsigned _round = 0;
+
+protected:
+    // Successive rounds move the deadlines later, as time passing would
+    lowres_clock::time_point deadline(size_t i) {
+        return lowres_clock::now() + rto + _jitter[i] + std::chrono::milliseconds(_round % 64);
+    }
+    // An ACK for every connection
+    void rearm_all() {
+        ++_round;
+        for (size_t i = 0; i < count; ++i) {
+            _timers[i]->rearm(deadline(i));
+        }
+    }
+    // Everything acknowledged, then new data sent
+    void restart_all() {
+        ++_round;
+        for (size_t i = 0; i < count; ++i) {
+            _timers[i]->cancel();
+            _timers[i]->arm(deadline(i));
+        }
+    }
+
+public:
+    connection_timers() : _jitter(count) {
+        std::mt19937 rng(0);
+        for (auto &j : _jitter) {
+            j = std::chrono::milliseconds(rng() % 200);
+        }
+        _timers.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            _timers.push_back(_factory.make());
+            _timers.back()->arm(deadline(i));
+        }
+    }
+};
+
+using reactor_timers = connection_timers<reactor_timer>;
+using wheel_timers = connection_timers<wheel_timer>;
+
+PERF_TEST_F(reactor_timers, rearm) {
+    rearm_all();
+}
+
+PERF_TEST_F(reactor_timers, restart) {
+    restart_all();
+}
+
+PERF_TEST_F(wheel_timers, rearm) {
+    rearm_all();
+}
+
+PERF_TEST_F(wheel_timers, restart) {
+    restart_all();
+}
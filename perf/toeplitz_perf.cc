@@ -0,0 +1,89 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+// Compares the reference Toeplitz hash with the one dispatched to on this CPU,
+// over the inputs the stack hashes: IPv4 and IPv6 addresses, with and without
+// ports.
+
+#include <nil/actor/network/toeplitz.hh>
+
+#include <nil/actor/testing/perf_tests.hh>
+
+#include <random>
+
+using namespace nil::actor;
+
+class toeplitz {
+    uint8_t _data[64];
+    uint8_t _next = 0;
+
+protected:
+    decltype(toeplitz_implementation::hash) _reference = toeplitz_implementations().front().hash;
+
+    // Varies the input so that the work can not be hoisted out of the loop
+    const uint8_t *input() {
+        _data[0] = _next++;
+        return _data;
+    }
+
+public:
+    toeplitz() {
+        std::mt19937 rng(0);
+        for (auto &b : _data) {
+            b = rng();
+        }
+    }
+};
+
+PERF_TEST_F(toeplitz, reference_ipv4) {
+    perf_tests::do_not_optimize(_reference(default_rsskey_40bytes, input(), 8));
+}
+
+PERF_TEST_F(toeplitz, reference_ipv4_ports) {
+    perf_tests::do_not_optimize(_reference(default_rsskey_40bytes, input(), 12));
+}
+
+PERF_TEST_F(toeplitz, reference_ipv6_ports) {
+    perf_tests::do_not_optimize(_reference(default_rsskey_40bytes, input(), 36));
+}
+
+PERF_TEST_F(toeplitz, dispatched_ipv4) {
+    perf_tests::do_not_optimize(toeplitz_hash(default_rsskey_40bytes, input(), 8));
+}
+
+PERF_TEST_F(toeplitz, dispatched_ipv4_ports) {
+    perf_tests::do_not_optimize(toeplitz_hash(default_rsskey_40bytes, input(), 12));
+}
+
+PERF_TEST_F(toeplitz, dispatched_ipv6) {
+    perf_tests::do_not_optimize(toeplitz_hash(default_rsskey_40bytes, input(), 32));
+}
+
+PERF_TEST_F(toeplitz, dispatched_ipv6_ports) {
+    perf_tests::do_not_optimize(toeplitz_hash(default_rsskey_40bytes, input(), 36));
+}
+
+PERF_TEST_F(toeplitz, dispatched_ipv6_ports_52_bytes_key) {
+    perf_tests::do_not_optimize(toeplitz_hash(default_rsskey_52bytes, input(), 36));
+}
@@ -0,0 +1,825 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/http/client.hh>
+#include <nil/actor/core/loop.hh>
+#include <nil/actor/core/metrics.hh>
+#include <nil/actor/core/print.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/with_timeout.hh>
+#include <nil/actor/detail/log.hh>
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <list>
+#include <optional>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        namespace http {
+
+            static logger clogger("http_client");
+
+            using clock_type = timer<>::clock;
+
+            static bool case_insensitive_equal(const sstring &a, const sstring &b) {
+                return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+                           return ::tolower(x) == ::tolower(y);
+                       });
+            }
+
+            static sstring trim(const sstring &s) {
+                size_t b = 0;
+                size_t e = s.size();
+                while (b < e && (s[b] == ' ' || s[b] == '\t')) {
+                    b++;
+                }
+                while (e > b && (s[e - 1] == ' ' || s[e - 1] == '\t')) {
+                    e--;
+                }
+                return s.substr(b, e - b);
+            }
+
+            static sstring find_header(const std::unordered_map<sstring, sstring> &headers, const sstring &name) {
+                for (auto &&h : headers) {
+                    if (case_insensitive_equal(h.first, name)) {
+                        return h.second;
+                    }
+                }
+                return "";
+            }
+
+            // Content-Length is digits only: anything else leaves the end of the
+            // body, and so the start of the next response, unknown
+            static std::optional<size_t> parse_content_length(const sstring &s) {
+                if (s.empty() || s.size() > std::numeric_limits<size_t>::digits10) {
+                    return std::nullopt;
+                }
+                size_t length = 0;
+                for (auto c : s) {
+                    if (c < '0' || c > '9') {
+                        return std::nullopt;
+                    }
+                    length = length * 10 + (c - '0');
+                }
+                return length;
+            }
+
+            bool request::retryable() const {
+                if (body_writer) {
+                    return false;
+                }
+                for (auto m : {"GET", "HEAD", "PUT", "DELETE", "OPTIONS", "TRACE"}) {
+                    if (method == m) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            sstring response::get_header(const sstring &name) const {
+                return find_header(_rsp->_headers, name);
+            }
+
+            future<sstring> response::read_body() {
+                return do_with(sstring(), [this](sstring &body) {
+                    return repeat([this, &body] {
+                        return _body.read().then([&body](temporary_buffer<char> buf) {
+                            if (buf.empty()) {
+                                return stop_iteration::yes;
+                            }
+                            body.append(buf.get(), buf.size());
+                            return stop_iteration::no;
+                        });
+                    }).then([&body] { return std::move(body); });
+                });
+            }
+
+            // Writes a request body through to the connection, either as is or split
+            // into chunks
+            class body_sink_impl : public data_sink_impl {
+                output_stream<char> &_out;
+                bool _chunked;
+
+            public:
+                body_sink_impl(output_stream<char> &out, bool chunked) : _out(out), _chunked(chunked) {
+                }
+                virtual future<> put(net::packet data) override {
+                    abort();
+                }
+                using data_sink_impl::put;
+                virtual future<> put(temporary_buffer<char> buf) override {
+                    if (buf.size() == 0) {
+                        // an empty chunk would end the body
+                        return make_ready_future<>();
+                    }
+                    if (!_chunked) {
+                        return _out.write(buf.get(), buf.size());
+                    }
+                    return _out.write(format("{:x}\r\n", buf.size()))
+                        .then([this, buf = std::move(buf)] { return _out.write(buf.get(), buf.size()); })
+                        .then([this] { return _out.write("\r\n", 2); });
+                }
+                virtual future<> close() override {
+                    return _chunked ? _out.write("0\r\n\r\n", 5) : make_ready_future<>();
+                }
+            };
+
+            class client_connection : public enable_lw_shared_from_this<client_connection> {
+            public:
+                host_pool &_pool;
+                connected_socket _fd;
+                input_stream<char> _in;
+                output_stream<char> _out;
+                http_response_parser _parser;
+                // Requests are written one at a time, and their responses read in the
+                // same order: each one waits for the body of the previous one to be
+                // consumed.
+                semaphore _write_sem {1};
+                future<> _reader_free = make_ready_future<>();
+                size_t _in_flight = 0;
+                bool _broken = false;
+                bool _keep_alive = true;
+                // a response was read already, so the server does keep it alive
+                bool _reused = false;
+                clock_type::time_point _idle_since = clock_type::now();
+
+                client_connection(host_pool &pool, connected_socket fd) :
+                    _pool(pool), _fd(std::move(fd)), _in(_fd.input()), _out(_fd.output()) {
+                }
+
+                bool usable() const {
+                    return !_broken && _keep_alive;
+                }
+                void abort() {
+                    if (!_broken) {
+                        _broken = true;
+                        _fd.shutdown_input();
+                        _fd.shutdown_output();
+                    }
+                }
+                future<response> send(request &req, const endpoint &ep);
+                future<> write(request &req, const endpoint &ep);
+                future<std::unique_ptr<http_response>> read_headers();
+                input_stream<char> make_body(const request &req, const http_response &rsp, promise<> done);
+                void response_done(bool reusable, promise<> &done);
+                // The client is not closed while response bodies are open
+                void enter_client() {
+                    _pool._client._gate.enter();
+                }
+                void leave_client() {
+                    _pool._client._gate.leave();
+                }
+                future<> close();
+            };
+
+            // Streams a response body, and hands the connection over to the next
+            // response once it is read to its end. Holds the client gate, entered by
+            // make_body(), until it is closed.
+            class body_source_impl : public data_source_impl {
+            protected:
+                lw_shared_ptr<client_connection> _conn;
+                promise<> _done;
+                bool _finished = false;
+                bool _closed = false;
+
+                void finish(bool reusable) {
+                    if (!_finished) {
+                        _finished = true;
+                        _conn->response_done(reusable, _done);
+                    }
+                }
+                future<temporary_buffer<char>> eof() {
+                    finish(true);
+                    return make_ready_future<temporary_buffer<char>>();
+                }
+                template<typename Msg>
+                future<temporary_buffer<char>> fail(Msg msg) {
+                    finish(false);
+                    return make_exception_future<temporary_buffer<char>>(client_error(msg));
+                }
+
+            public:
+                // without a connection, the body is empty
+                body_source_impl(lw_shared_ptr<client_connection> conn, promise<> done) :
+                    _conn(std::move(conn)), _done(std::move(done)), _finished(!_conn) {
+                }
+                virtual ~body_source_impl() {
+                    body_source_impl::close();
+                }
+                virtual future<temporary_buffer<char>> get() override {
+                    return eof();
+                }
+                virtual future<> close() override {
+                    finish(false);
+                    if (_conn && !_closed) {
+                        _closed = true;
+                        _conn->leave_client();
+                    }
+                    return make_ready_future<>();
+                }
+            };
+
+            class content_length_source_impl : public body_source_impl {
+                size_t _remaining;
+
+            public:
+                content_length_source_impl(lw_shared_ptr<client_connection> conn, promise<> done, size_t length) :
+                    body_source_impl(std::move(conn), std::move(done)), _remaining(length) {
+                }
+                virtual future<temporary_buffer<char>> get() override {
+                    if (!_remaining) {
+                        return eof();
+                    }
+                    return _conn->_in.read_up_to(_remaining).then([this](temporary_buffer<char> buf) {
+                        if (buf.empty()) {
+                            return fail("connection closed before the end of the response body");
+                        }
+                        _remaining -= buf.size();
+                        if (!_remaining) {
+                            // the next response can be read right away
+                            finish(true);
+                        }
+                        return make_ready_future<temporary_buffer<char>>(std::move(buf));
+                    });
+                }
+            };
+
+            class chunked_source_impl : public body_source_impl {
+                static constexpr size_t max_line_length = 4096;
+                size_t _remaining = 0;
+                bool _need_crlf = false;
+                sstring _line;
+
+                // Chunk headers and trailers are short, and the input stream is buffered
+                future<sstring> read_line() {
+                    _line = {};
+                    return repeat([this] {
+                        return _conn->_in.read_exactly(1).then([this](temporary_buffer<char> b) {
+                            if (b.empty()) {
+                                throw client_error("connection closed inside a chunked response body");
+                            }
+                            if (b[0] == '\n') {
+                                return stop_iteration::yes;
+                            }
+                            if (b[0] != '\r') {
+                                if (_line.size() == max_line_length) {
+                                    throw client_error("chunk header too long");
+                                }
+                                _line.append(b.get(), 1);
+                            }
+                            return stop_iteration::no;
+                        });
+                    }).then([this] { return std::move(_line); });
+                }
+                future<> read_trailer() {
+                    return repeat([this] {
+                        return read_line().then(
+                            [](sstring line) { return line.empty() ? stop_iteration::yes : stop_iteration::no; });
+                    });
+                }
+
+            public:
+                using body_source_impl::body_source_impl;
+
+                virtual future<temporary_buffer<char>> get() override {
+                    if (_finished) {
+                        return make_ready_future<temporary_buffer<char>>();
+                    }
+                    if (_remaining) {
+                        return _conn->_in.read_up_to(_remaining).then([this](temporary_buffer<char> buf) {
+                            if (buf.empty()) {
+                                return fail("connection closed before the end of the response body");
+                            }
+                            _remaining -= buf.size();
+                            return make_ready_future<temporary_buffer<char>>(std::move(buf));
+                        });
+                    }
+                    auto crlf = _need_crlf ? read_line().discard_result() : make_ready_future<>();
+                    return crlf.then([this] { return read_line(); })
+                        .then([this](sstring line) {
+                            _need_crlf = false;
+                            if (line.empty() || !::isxdigit(line[0])) {
+                                return fail("malformed chunk header");
+                            }
+                            // chunk extensions after ';' are ignored
+                            auto size = strtoull(line.c_str(), nullptr, 16);
+                            if (!size) {
+                                return read_trailer().then([this] { return eof(); });
+                            }
+                            _remaining = size;
+                            _need_crlf = true;
+                            return get();
+                        })
+                        .handle_exception([this](std::exception_ptr ep) {
+                            finish(false);
+                            return make_exception_future<temporary_buffer<char>>(ep);
+                        });
+                }
+            };
+
+            // Bodies without a length end with the connection
+            class until_eof_source_impl : public body_source_impl {
+            public:
+                using body_source_impl::body_source_impl;
+
+                virtual future<temporary_buffer<char>> get() override {
+                    if (_finished) {
+                        return make_ready_future<temporary_buffer<char>>();
+                    }
+                    return _conn->_in.read().then([this](temporary_buffer<char> buf) {
+                        if (buf.empty()) {
+                            finish(false);
+                        }
+                        return buf;
+                    });
+                }
+            };
+
+            class host_pool {
+                struct waiter {
+                    promise<lw_shared_ptr<client_connection>> pr;
+                    timer<> expiry;
+                    // failed already, dropped once it reaches the front
+                    bool expired = false;
+                };
+
+            public:
+                client &_client;
+                endpoint _ep;
+                std::vector<lw_shared_ptr<client_connection>> _connections;
+                std::list<waiter> _waiters;
+                size_t _connecting = 0;
+
+                host_pool(client &c, endpoint ep) : _client(c), _ep(std::move(ep)) {
+                }
+
+                bool has_capacity() const {
+                    return _connections.size() + _connecting < _client._opts.max_connections_per_host;
+                }
+                lw_shared_ptr<client_connection> find_idle() {
+                    // the most recently used one, the least likely to have been closed
+                    for (auto it = _connections.rbegin(); it != _connections.rend(); ++it) {
+                        if ((*it)->usable() && !(*it)->_in_flight) {
+                            return *it;
+                        }
+                    }
+                    return nullptr;
+                }
+                lw_shared_ptr<client_connection> find_pipelined() {
+                    lw_shared_ptr<client_connection> best;
+                    for (auto &&c : _connections) {
+                        if (c->usable() && c->_reused && c->_in_flight < _client._opts.max_pipeline_depth &&
+                            (!best || c->_in_flight < best->_in_flight)) {
+                            best = c;
+                        }
+                    }
+                    return best;
+                }
+
+                future<lw_shared_ptr<client_connection>> get_connection(bool pipelined, clock_type::time_point deadline);
+                future<lw_shared_ptr<client_connection>> connect();
+                void release(lw_shared_ptr<client_connection> c);
+                void remove(lw_shared_ptr<client_connection> c);
+                void serve_waiters();
+                void expire_idle(clock_type::time_point now);
+                future<> close();
+            };
+
+            future<lw_shared_ptr<client_connection>> host_pool::get_connection(bool pipelined,
+                                                                               clock_type::time_point deadline) {
+                auto c = find_idle();
+                if (!c && pipelined) {
+                    c = find_pipelined();
+                }
+                if (c) {
+                    _client._stats.pool_hits++;
+                    c->_in_flight++;
+                    return make_ready_future<lw_shared_ptr<client_connection>>(std::move(c));
+                }
+                _client._stats.pool_misses++;
+                if (has_capacity()) {
+                    return connect();
+                }
+                _waiters.emplace_back();
+                auto it = std::prev(_waiters.end());
+                it->expiry.set_callback([it] {
+                    it->expired = true;
+                    it->pr.set_exception(request_timeout_error());
+                });
+                it->expiry.arm(deadline);
+                return it->pr.get_future();
+            }
+
+            future<lw_shared_ptr<client_connection>> host_pool::connect() {
+                _connecting++;
+                auto deadline = clock_type::now() + _client._opts.connect_timeout;
+                auto f = futurize_invoke([this] {
+                    if (!_ep.tls) {
+                        return engine().net().connect(_ep.addr);
+                    }
+                    if (!_client._opts.credentials) {
+                        throw client_error("no TLS credentials to connect with");
+                    }
+                    return tls::connect(_client._opts.credentials, _ep.addr, _ep.host);
+                });
+                return with_timeout(deadline, std::move(f)).then_wrapped([this](future<connected_socket> f) {
+                    _connecting--;
+                    if (f.failed()) {
+                        _client._stats.connect_errors++;
+                        // someone else may succeed in the slot we leave
+                        serve_waiters();
+                        return make_exception_future<lw_shared_ptr<client_connection>>(f.get_exception());
+                    }
+                    _client._stats.connects++;
+                    _client._stats.connections++;
+                    auto c = make_lw_shared<client_connection>(*this, f.get0());
+                    c->_in_flight = 1;
+                    _connections.push_back(c);
+                    return make_ready_future<lw_shared_ptr<client_connection>>(std::move(c));
+                });
+            }
+
+            void host_pool::release(lw_shared_ptr<client_connection> c) {
+                if (!c->usable()) {
+                    if (!c->_in_flight) {
+                        remove(std::move(c));
+                        serve_waiters();
+                    }
+                    return;
+                }
+                if (!c->_in_flight) {
+                    c->_idle_since = clock_type::now();
+                    serve_waiters();
+                }
+            }
+
+            void host_pool::remove(lw_shared_ptr<client_connection> c) {
+                auto it = std::find(_connections.begin(), _connections.end(), c);
+                if (it == _connections.end()) {
+                    return;
+                }
+                _connections.erase(it);
+                _client._stats.connections--;
+                c->abort();
+                // FIXME: future is discarded
+                (void)c->close().finally([c] {});
+            }
+
+            void host_pool::serve_waiters() {
+                while (!_waiters.empty()) {
+                    if (_waiters.front().expired) {
+                        _waiters.pop_front();
+                        continue;
+                    }
+                    auto c = find_idle();
+                    if (!c && !has_capacity()) {
+                        return;
+                    }
+                    auto pr = std::move(_waiters.front().pr);
+                    _waiters.pop_front();
+                    if (c) {
+                        _client._stats.pool_hits++;
+                        c->_in_flight++;
+                        pr.set_value(std::move(c));
+                    } else {
+                        connect().forward_to(std::move(pr));
+                    }
+                }
+            }
+
+            void host_pool::expire_idle(clock_type::time_point now) {
+                std::vector<lw_shared_ptr<client_connection>> expired;
+                for (auto &&c : _connections) {
+                    if (!c->_in_flight && c->_idle_since + _client._opts.idle_timeout <= now) {
+                        expired.push_back(c);
+                    }
+                }
+                for (auto &&c : expired) {
+                    remove(c);
+                }
+            }
+
+            future<> host_pool::close() {
+                for (auto &&w : _waiters) {
+                    if (!w.expired) {
+                        w.pr.set_exception(client_error("http client closed"));
+                    }
+                }
+                _waiters.clear();
+                auto connections = std::move(_connections);
+                return parallel_for_each(connections, [](lw_shared_ptr<client_connection> c) {
+                    c->abort();
+                    return c->close().finally([c] {});
+                });
+            }
+
+            future<> client_connection::write(request &req, const endpoint &ep) {
+                sstring head = req.method + " " + req.url + " HTTP/1.1\r\n";
+                bool has_host = false;
+                for (auto &&h : req.headers) {
+                    // the framing of the body is ours to decide
+                    if (case_insensitive_equal(h.first, "Content-Length") ||
+                        case_insensitive_equal(h.first, "Transfer-Encoding")) {
+                        continue;
+                    }
+                    has_host |= case_insensitive_equal(h.first, "Host");
+                    head += h.first + ": " + h.second + "\r\n";
+                }
+                if (!has_host) {
+                    head += "Host: " + (ep.host.empty() ? format("{}", ep.addr) : ep.host) + "\r\n";
+                }
+                if (req.body_writer) {
+                    if (req.content_length) {
+                        head += "Content-Length: " + to_sstring(*req.content_length) + "\r\n";
+                    } else {
+                        head += "Transfer-Encoding: chunked\r\n";
+                    }
+                } else if (!req.content.empty() || req.method == "POST" || req.method == "PUT") {
+                    head += "Content-Length: " + to_sstring(req.content.size()) + "\r\n";
+                }
+                head += "\r\n";
+                return _out.write(head)
+                    .then([this, &req] {
+                        if (req.body_writer) {
+                            auto sink = data_sink(std::make_unique<body_sink_impl>(_out, !req.content_length));
+                            return req.body_writer(output_stream<char>(std::move(sink), 32000, true));
+                        }
+                        return _out.write(req.content);
+                    })
+                    .then([this] { return _out.flush(); });
+            }
+
+            future<std::unique_ptr<http_response>> client_connection::read_headers() {
+                _parser.init();
+                return _in.consume(_parser).then([this]() -> future<std::unique_ptr<http_response>> {
+                    if (_parser.eof()) {
+                        return make_exception_future<std::unique_ptr<http_response>>(
+                            client_error("connection closed before a response was received"));
+                    }
+                    if (_parser.failed()) {
+                        return make_exception_future<std::unique_ptr<http_response>>(
+                            client_error("malformed http response"));
+                    }
+                    auto rsp = _parser.get_parsed_response();
+                    for (auto &&h : rsp->_headers) {
+                        h.second = trim(h.second);
+                    }
+                    if (rsp->_status >= 100 && rsp->_status < 200) {
+                        // interim responses, such as 100 Continue, precede the final one
+                        return read_headers();
+                    }
+                    return make_ready_future<std::unique_ptr<http_response>>(std::move(rsp));
+                });
+            }
+
+            input_stream<char> client_connection::make_body(const request &req, const http_response &rsp,
+                                                            promise<> done) {
+                auto connection = find_header(rsp._headers, "Connection");
+                if (rsp._version == "1.0") {
+                    _keep_alive &= case_insensitive_equal(connection, "keep-alive");
+                } else if (case_insensitive_equal(connection, "close")) {
+                    _keep_alive = false;
+                }
+                auto self = shared_from_this();
+                std::unique_ptr<data_source_impl> src;
+                auto chunked = find_header(rsp._headers, "Transfer-Encoding").find("chunked") != sstring::npos;
+                auto length_header = find_header(rsp._headers, "Content-Length");
+                // Transfer-Encoding takes precedence over Content-Length (RFC 7230, 3.3.3)
+                auto length = chunked || length_header.empty() ? std::nullopt : parse_content_length(length_header);
+                if (!chunked && !length_header.empty() && !length) {
+                    response_done(false, done);
+                    throw client_error(format("malformed Content-Length in http response: {}", length_header));
+                }
+                if (req.method == "HEAD" || rsp._status == 204 || rsp._status == 304 || length == size_t(0)) {
+                    // nothing to wait for, the connection is free already
+                    response_done(true, done);
+                    return input_stream<char>(data_source(std::make_unique<body_source_impl>(nullptr, promise<>())));
+                }
+                try {
+                    enter_client();
+                } catch (...) {
+                    response_done(false, done);
+                    throw;
+                }
+                if (chunked) {
+                    src = std::make_unique<chunked_source_impl>(std::move(self), std::move(done));
+                } else if (length) {
+                    src = std::make_unique<content_length_source_impl>(std::move(self), std::move(done), *length);
+                } else {
+                    _keep_alive = false;
+                    src = std::make_unique<until_eof_source_impl>(std::move(self), std::move(done));
+                }
+                return input_stream<char>(data_source(std::move(src)));
+            }
+
+            future<response> client_connection::send(request &req, const endpoint &ep) {
+                promise<> done;
+                auto turn = std::exchange(_reader_free, done.get_future());
+                auto written = with_semaphore(_write_sem, 1, [this, &req, &ep] {
+                    if (_broken) {
+                        throw client_error("connection broken");
+                    }
+                    return write(req, ep);
+                });
+                return when_all_succeed(std::move(written), std::move(turn))
+                    .then([this] {
+                        if (_broken) {
+                            // a previous response on the connection failed
+                            throw client_error("connection broken");
+                        }
+                        return read_headers();
+                    })
+                    .then_wrapped([this, &req, done = std::move(done)](
+                                      future<std::unique_ptr<http_response>> f) mutable {
+                        if (f.failed()) {
+                            auto ex = f.get_exception();
+                            response_done(false, done);
+                            return make_exception_future<response>(ex);
+                        }
+                        auto rsp = f.get0();
+                        // fails the response if its framing is broken, the connection with it
+                        auto body = make_body(req, *rsp, std::move(done));
+                        return make_ready_future<response>(response(std::move(rsp), std::move(body)));
+                    });
+            }
+
+            void client_connection::response_done(bool reusable, promise<> &done) {
+                if (!reusable) {
+                    abort();
+                }
+                _reused = true;
+                _in_flight--;
+                done.set_value();
+                _pool.release(shared_from_this());
+            }
+
+            future<> client_connection::close() {
+                return _out.close()
+                    .handle_exception([](std::exception_ptr) {})
+                    .then([this] { return _in.close(); })
+                    .handle_exception([](std::exception_ptr) {});
+            }
+
+            client::client(client_options opts) :
+                _opts(std::move(opts)), _concurrency(_opts.max_concurrent_requests),
+                _idle_timer([this] { expire_idle(); }) {
+                _idle_timer.arm_periodic(std::max(_opts.idle_timeout / 2, std::chrono::milliseconds(1)));
+
+                namespace sm = metrics;
+                std::vector<sm::label_instance> labels {sm::label_instance("client", _opts.name)};
+                _metrics.add_group(
+                    "httpclient",
+                    {
+                        sm::make_derive("requests", _stats.requests, sm::description("Counts requests made"), labels),
+                        sm::make_derive("responses", _stats.responses,
+                                        sm::description("Counts responses received"), labels),
+                        sm::make_derive("request_errors", _stats.errors,
+                                        sm::description("Counts requests failed after their retries"), labels),
+                        sm::make_derive("retries", _stats.retries,
+                                        sm::description("Counts requests sent again after a connection failure"),
+                                        labels),
+                        sm::make_derive("timeouts", _stats.timeouts,
+                                        sm::description("Counts requests not answered within the request timeout"),
+                                        labels),
+                        sm::make_derive("connects", _stats.connects,
+                                        sm::description("Counts connections opened"), labels),
+                        sm::make_derive("connect_errors", _stats.connect_errors,
+                                        sm::description("Counts connections that failed or timed out"), labels),
+                        sm::make_gauge("connections", _stats.connections,
+                                       sm::description("Holds the number of open connections"), labels),
+                        sm::make_derive("pool_hits", _stats.pool_hits,
+                                        sm::description("Counts requests sent over an already open connection"),
+                                        labels),
+                        sm::make_derive("pool_misses", _stats.pool_misses,
+                                        sm::description("Counts requests that had to wait for a new connection"),
+                                        labels),
+                        sm::make_derive("request_latency_us", _stats.latency_us,
+                                        sm::description("Counts microseconds spent waiting for response headers. "
+                                                        "Divide by responses to get the average latency."),
+                                        labels),
+                        sm::make_gauge(
+                            "requests_in_progress",
+                            [this] { return _opts.max_concurrent_requests - _concurrency.available_units(); },
+                            sm::description("Holds the number of requests whose responses are not dropped yet"),
+                            labels),
+                    });
+            }
+
+            client::~client() {
+            }
+
+            host_pool &client::pool_for(const endpoint &ep) {
+                auto key = format("{}://{}/{}", ep.tls ? "https" : "http", ep.host, ep.addr);
+                auto it = _pools.find(key);
+                if (it == _pools.end()) {
+                    it = _pools.emplace(key, std::make_unique<host_pool>(*this, ep)).first;
+                }
+                return *it->second;
+            }
+
+            future<response> client::make_request(const endpoint &ep, request req) {
+                _stats.requests++;
+                auto &pool = pool_for(ep);
+                auto r = make_lw_shared<request>(std::move(req));
+                return with_gate(_gate, [this, &pool, r] {
+                    return get_units(_concurrency, 1).then([this, &pool, r](semaphore_units<> permit) {
+                        return do_request(pool, r, std::move(permit), 0);
+                    });
+                });
+            }
+
+            future<response> client::do_request(host_pool &pool, lw_shared_ptr<request> req, semaphore_units<> permit,
+                                                 unsigned attempt) {
+                auto start = clock_type::now();
+                auto deadline = start + _opts.request_timeout;
+                bool pipelined = _opts.max_pipeline_depth > 1 && req->retryable();
+                auto timed_out = make_lw_shared<bool>(false);
+                return pool.get_connection(pipelined, deadline)
+                    .then([&pool, req, deadline, timed_out](lw_shared_ptr<client_connection> conn) {
+                        // aborting the connection fails whatever is pending on it
+                        auto expiry = make_lw_shared<timer<>>([conn, timed_out] {
+                            *timed_out = true;
+                            conn->abort();
+                        });
+                        expiry->arm(deadline);
+                        return conn->send(*req, pool._ep).finally([conn, expiry] { expiry->cancel(); });
+                    })
+                    .then_wrapped([this, &pool, req, permit = std::move(permit), attempt, start,
+                                   timed_out](future<response> f) mutable {
+                        if (!f.failed()) {
+                            _stats.responses++;
+                            _stats.latency_us +=
+                                std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start)
+                                    .count();
+                            auto rsp = f.get0();
+                            rsp._permit = std::move(permit);
+                            return make_ready_future<response>(std::move(rsp));
+                        }
+                        auto ex = f.get_exception();
+                        bool timeout = *timed_out;
+                        try {
+                            std::rethrow_exception(ex);
+                        } catch (request_timeout_error &) {
+                            timeout = true;
+                        } catch (timed_out_error &) {
+                            // the connect timeout, worth another try
+                        } catch (...) {
+                        }
+                        if (timeout) {
+                            _stats.timeouts++;
+                            _stats.errors++;
+                            return make_exception_future<response>(request_timeout_error());
+                        }
+                        if (req->retryable() && attempt < _opts.max_retries) {
+                            clogger.debug("retrying {} {}: {}", req->method, req->url, ex);
+                            _stats.retries++;
+                            return do_request(pool, req, std::move(permit), attempt + 1);
+                        }
+                        _stats.errors++;
+                        return make_exception_future<response>(ex);
+                    });
+            }
+
+            void client::expire_idle() {
+                auto now = clock_type::now();
+                for (auto &&p : _pools) {
+                    p.second->expire_idle(now);
+                }
+            }
+
+            future<> client::close() {
+                _idle_timer.cancel();
+                return _gate.close().then([this] {
+                    return parallel_for_each(_pools, [](auto &p) { return p.second->close(); });
+                });
+            }
+
+        }    // namespace http
+
+    }    // namespace actor
+}    // namespace nil
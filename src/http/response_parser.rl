@@ -6,6 +6,7 @@ namespace nil::actor {
 
 struct http_response {
     sstring _version;
+    int _status = 0;
     std::unordered_map<sstring, sstring> _headers;
 };
 
@@ -23,6 +24,10 @@ action store_version {
     _rsp->_version = str();
 }
 
+action status_digit {
+    _rsp->_status = _rsp->_status * 10 + (fc - '0');
+}
+
 action store_field_name {
     _field_name = str();
 }
@@ -59,7 +64,7 @@ http_version = 'HTTP/' (digit '.' digit) >mark %store_version;
 
 field = tchar+ >mark %store_field_name;
 value = any* >mark %store_value;
-start_line = http_version space digit digit digit space (any - cr - lf)* crlf;
+start_line = http_version space (digit $status_digit){3} space (any - cr - lf)* crlf;
 header_1st = (field sp_ht* ':' value :> crlf) %assign_field;
 header_cont = (sp_ht+ value sp_ht* crlf) %extend_field;
 header = header_1st header_cont*;
@@ -114,6 +119,9 @@ public:
     bool eof() const {
         return _state == state::eof;
     }
+    bool failed() const {
+        return _state == state::error;
+    }
 };
 
 }
@@ -0,0 +1,189 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/network/connection_balancing.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            namespace {
+
+                struct io_counters {
+                    uint64_t bytes = 0;
+                    uint64_t ops = 0;
+                };
+
+                thread_local io_counters local_io;
+
+                // Written by its own shard only, read by the listening shards
+                struct alignas(64) activity_slot {
+                    std::atomic<double> bytes_per_second {0};
+                    std::atomic<double> ops_per_second {0};
+                    std::atomic<uint64_t> samples {0};
+                };
+
+                // Shared by all shards and never freed: shards may keep sampling
+                // while others are already shutting down.
+                activity_slot *activity_board() {
+                    static activity_slot *board = new activity_slot[smp::count];
+                    return board;
+                }
+
+                // Weight of the newest sample in the moving average
+                constexpr double sample_weight = 0.3;
+
+                double moving_average(double prev, double sample) {
+                    return prev + sample_weight * (sample - prev);
+                }
+
+                double share(double value, double total) {
+                    return total > 0 ? value / total : 0;
+                }
+
+                double traffic(const shard_activity &a, double total_bytes, double total_ops) {
+                    return share(a.bytes_per_second, total_bytes) + share(a.ops_per_second, total_ops);
+                }
+
+            }    // namespace
+
+            void account_connection_io(size_t bytes) noexcept {
+                local_io.bytes += bytes;
+                local_io.ops++;
+            }
+
+            shard_activity get_shard_activity(shard_id cpu) noexcept {
+                auto &slot = activity_board()[cpu];
+                shard_activity a;
+                a.bytes_per_second = slot.bytes_per_second.load(std::memory_order_relaxed);
+                a.ops_per_second = slot.ops_per_second.load(std::memory_order_relaxed);
+                a.samples = slot.samples.load(std::memory_order_relaxed);
+                return a;
+            }
+
+            constexpr std::chrono::milliseconds shard_activity_sampler::period;
+
+            shard_activity_sampler::shard_activity_sampler() : _timer([this] { sample(); }) {
+                _timer.arm_periodic(period);
+            }
+
+            void shard_activity_sampler::sample() {
+                auto &slot = activity_board()[this_shard_id()];
+                auto seconds = std::chrono::duration<double>(period).count();
+                auto bytes = (local_io.bytes - _last_bytes) / seconds;
+                auto ops = (local_io.ops - _last_ops) / seconds;
+                _last_bytes = local_io.bytes;
+                _last_ops = local_io.ops;
+                slot.bytes_per_second.store(moving_average(slot.bytes_per_second.load(std::memory_order_relaxed), bytes),
+                                            std::memory_order_relaxed);
+                slot.ops_per_second.store(moving_average(slot.ops_per_second.load(std::memory_order_relaxed), ops),
+                                          std::memory_order_relaxed);
+                slot.samples.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            activity_balancing_policy::activity_balancing_policy() : activity_balancing_policy(weights()) {
+            }
+
+            activity_balancing_policy::activity_balancing_policy(weights w) :
+                _weights(w), _assigned(size_t(smp::count), 0) {
+            }
+
+            shard_id activity_balancing_policy::next_cpu(const std::vector<unsigned> &connections,
+                                                         const socket_address &peer) {
+                // A new sample of our own shard means the others published theirs
+                // within the same period: forget what was assigned before.
+                auto samples = get_shard_activity(this_shard_id()).samples;
+                if (samples != _samples) {
+                    _samples = samples;
+                    std::fill(_assigned.begin(), _assigned.end(), 0);
+                }
+
+                std::vector<shard_activity> activity(smp::count);
+                double total_connections = 0;
+                double total_bytes = 0;
+                double total_ops = 0;
+                for (shard_id cpu = 0; cpu < smp::count; ++cpu) {
+                    activity[cpu] = get_shard_activity(cpu);
+                    total_connections += connections[cpu];
+                    total_bytes += activity[cpu].bytes_per_second;
+                    total_ops += activity[cpu].ops_per_second;
+                }
+                auto bytes_per_connection = share(total_bytes, total_connections);
+                auto ops_per_connection = share(total_ops, total_connections);
+
+                shard_id best = 0;
+                auto best_score = std::numeric_limits<double>::max();
+                for (shard_id cpu = 0; cpu < smp::count; ++cpu) {
+                    auto bytes = activity[cpu].bytes_per_second + _assigned[cpu] * bytes_per_connection;
+                    auto ops = activity[cpu].ops_per_second + _assigned[cpu] * ops_per_connection;
+                    auto score = _weights.connections * share(connections[cpu], total_connections) +
+                                 _weights.bytes * share(bytes, total_bytes) + _weights.ops * share(ops, total_ops);
+                    if (score < best_score || (score == best_score && connections[cpu] < connections[best])) {
+                        best = cpu;
+                        best_score = score;
+                    }
+                }
+                _assigned[best]++;
+                return best;
+            }
+
+            std::optional<migration_hint> connection_migration_hint(double threshold) {
+                std::vector<shard_activity> activity(smp::count);
+                double total_bytes = 0;
+                double total_ops = 0;
+                for (shard_id cpu = 0; cpu < smp::count; ++cpu) {
+                    activity[cpu] = get_shard_activity(cpu);
+                    total_bytes += activity[cpu].bytes_per_second;
+                    total_ops += activity[cpu].ops_per_second;
+                }
+                if (smp::count < 2 || (total_bytes == 0 && total_ops == 0)) {
+                    return std::nullopt;
+                }
+                auto load = [&](shard_id cpu) { return traffic(activity[cpu], total_bytes, total_ops); };
+                shard_id busiest = 0;
+                shard_id idlest = 0;
+                for (shard_id cpu = 1; cpu < smp::count; ++cpu) {
+                    if (load(cpu) > load(busiest)) {
+                        busiest = cpu;
+                    }
+                    if (load(cpu) < load(idlest)) {
+                        idlest = cpu;
+                    }
+                }
+                auto ratio = load(idlest) > 0 ? load(busiest) / load(idlest) : std::numeric_limits<double>::infinity();
+                if (ratio <= threshold) {
+                    return std::nullopt;
+                }
+                return migration_hint {busiest, idlest, ratio};
+            }
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -515,6 +515,9 @@ namespace nil {
                     assert(_redir_table.size());
                     return _redir_table[hash & (_redir_table.size() - 1)];
                 }
+                virtual uint32_t hash2qid_mask() override {
+                    return _redir_table.size() - 1;
+                }
                 uint16_t port_idx() {
                     return _port_idx;
                 }
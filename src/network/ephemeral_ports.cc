@@ -0,0 +1,143 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/network/ephemeral_ports.hh>
+
+#include <algorithm>
+#include <system_error>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            constexpr uint16_t ephemeral_port_allocator::first_port;
+            constexpr uint16_t ephemeral_port_allocator::last_port;
+            constexpr size_t ephemeral_port_allocator::max_idle_pools;
+            constexpr size_t ephemeral_port_allocator::max_buckets;
+
+            ephemeral_port_allocator::ephemeral_port_allocator(std::function<uint32_t(uint16_t)> port_hash,
+                                                               std::function<bool(uint32_t)> steers_here,
+                                                               uint32_t steering_mask, uint32_t seed) :
+                _port_hash(std::move(port_hash)),
+                _steers_here(std::move(steers_here)), _steering_mask(steering_mask), _random(seed) {
+            }
+
+            auto ephemeral_port_allocator::get_bucket(uint32_t flow_hash) -> bucket & {
+                auto key = flow_hash & _steering_mask;
+                auto i = _buckets.find(key);
+                if (i != _buckets.end()) {
+                    return i->second;
+                }
+
+                std::vector<uint16_t> ports;
+                if (!_steering_mask) {
+                    // The port makes no difference
+                    if (_steers_here(key)) {
+                        ports.reserve(last_port - first_port + 1);
+                        for (uint32_t port = first_port; port <= last_port; ++port) {
+                            ports.push_back(port);
+                        }
+                    }
+                } else {
+                    if (_port_hashes.empty()) {
+                        _port_hashes.reserve(last_port - first_port + 1);
+                        for (uint32_t port = first_port; port <= last_port; ++port) {
+                            _port_hashes.push_back(_port_hash(port) & _steering_mask);
+                        }
+                    }
+                    for (uint32_t port = first_port; port <= last_port; ++port) {
+                        if (_steers_here(key ^ _port_hashes[port - first_port])) {
+                            ports.push_back(port);
+                        }
+                    }
+                }
+                std::shuffle(ports.begin(), ports.end(), _random);
+                return _buckets.emplace(key, bucket {std::move(ports)}).first->second;
+            }
+
+            auto ephemeral_port_allocator::get_pool(uint32_t flow_hash) -> pool & {
+                auto i = _pools.find(flow_hash);
+                if (i != _pools.end()) {
+                    return i->second;
+                }
+                auto &b = get_bucket(flow_hash);
+                b.pools++;
+                auto &p = _pools[flow_hash];
+                p.b = &b;
+                // Flows of a bucket start at different places in its list
+                p.next = b.ports.empty() ? 0 : _random() % b.ports.size();
+                return p;
+            }
+
+            void ephemeral_port_allocator::evict(uint32_t flow_hash) {
+                auto i = _pools.find(flow_hash);
+                auto *b = i->second.b;
+                _pools.erase(i);
+                if (!--b->pools && _buckets.size() > max_buckets) {
+                    _buckets.erase(flow_hash & _steering_mask);
+                }
+            }
+
+            uint16_t ephemeral_port_allocator::allocate(uint32_t flow_hash) {
+                auto &p = get_pool(flow_hash);
+                auto &ports = p.b->ports;
+                if (p.in_use.size() == ports.size()) {
+                    throw std::system_error(EADDRNOTAVAIL, std::system_category(), "no ephemeral port left");
+                }
+                if (p.idle) {
+                    _idle.erase(p.idle_pos);
+                    p.idle = false;
+                }
+                while (p.in_use.count(ports[p.next])) {
+                    p.next = (p.next + 1) % ports.size();
+                }
+                auto port = ports[p.next];
+                p.next = (p.next + 1) % ports.size();
+                p.in_use.insert(port);
+                return port;
+            }
+
+            void ephemeral_port_allocator::release(uint32_t flow_hash, uint16_t port) {
+                auto i = _pools.find(flow_hash);
+                if (i == _pools.end()) {
+                    return;
+                }
+                auto &p = i->second;
+                if (!p.in_use.erase(port) || !p.in_use.empty()) {
+                    return;
+                }
+                p.idle = true;
+                p.idle_pos = _idle.insert(_idle.end(), flow_hash);
+                if (_idle.size() > max_idle_pools) {
+                    auto evicted = _idle.front();
+                    _idle.pop_front();
+                    evict(evicted);
+                }
+            }
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -22,6 +22,8 @@
 // SOFTWARE.
 //---------------------------------------------------------------------------//
 
+#include <algorithm>
+
 #include <nil/actor/network/ip.hh>
 #include <nil/actor/core/print.hh>
 #include <nil/actor/core/shared_ptr.hh>
@@ -91,8 +93,76 @@ namespace nil {
                 return true;
             }
 
-            bool ipv4::in_my_netmask(ipv4_address a) const {
-                return !((a.ip ^ _host_address.ip) & _netmask.ip);
+            bool ipv4::is_on_link(ipv4_address a) const {
+                // Without any route, e.g. while DHCP runs, everything is on-link
+                auto nh = _routes.lookup(a.ip);
+                return !nh || !nh->gateway;
+            }
+
+            bool ipv4::is_my_address(ipv4_address a) const {
+                return a == _host_address ||
+                       std::any_of(_addresses.begin(), _addresses.end(), [a](auto &&x) { return x.first == a; });
+            }
+
+            ipv4_address ipv4::source_address(ipv4_address to) const {
+                auto nh = _routes.lookup(to.ip);
+                return nh && nh->source ? ipv4_address(nh->source) : _host_address;
+            }
+
+            void ipv4::update_routes() {
+                std::vector<ipv4_route> routes;
+                if (!is_unspecified(_gw_address)) {
+                    routes.push_back(ipv4_route {0, 0, _gw_address.ip, 0});
+                }
+                // Listed after the default route: a zero netmask makes everything on-link
+                if (!is_unspecified(_host_address)) {
+                    auto length = uint8_t(__builtin_popcount(_netmask.ip));
+                    routes.push_back(ipv4_route {_host_address.ip, length, 0, _host_address.ip});
+                }
+                for (auto &&a : _addresses) {
+                    routes.push_back(ipv4_route {a.first.ip, a.second, 0, a.first.ip});
+                }
+                routes.insert(routes.end(), _static_routes.begin(), _static_routes.end());
+                _routes.assign(std::move(routes));
+            }
+
+            void ipv4::add_address(ipv4_address a, unsigned prefix_length) {
+                assert(prefix_length <= 32);
+                remove_address(a);
+                _addresses.emplace_back(a, prefix_length);
+                _arp.add_self_addr(a);
+                update_routes();
+            }
+
+            bool ipv4::remove_address(ipv4_address a) {
+                auto i = std::find_if(_addresses.begin(), _addresses.end(), [a](auto &&x) { return x.first == a; });
+                if (i == _addresses.end()) {
+                    return false;
+                }
+                _addresses.erase(i);
+                _arp.remove_self_addr(a);
+                update_routes();
+                return true;
+            }
+
+            void ipv4::add_route(ipv4_address prefix, unsigned length, ipv4_address gateway, ipv4_address source) {
+                assert(length <= 32);
+                remove_route(prefix, length);
+                _static_routes.push_back(ipv4_route {prefix.ip, uint8_t(length), gateway.ip, source.ip});
+                update_routes();
+            }
+
+            bool ipv4::remove_route(ipv4_address prefix, unsigned length) {
+                auto mask = length ? ~uint32_t(0) << (32 - length) : 0;
+                auto i = std::find_if(_static_routes.begin(), _static_routes.end(), [&](const ipv4_route &r) {
+                    return r.length == length && !((r.prefix ^ prefix.ip) & mask);
+                });
+                if (i == _static_routes.end()) {
+                    return false;
+                }
+                _static_routes.erase(i);
+                update_routes();
+                return true;
             }
 
             bool ipv4::needs_frag(packet &p, ip_protocol_num prot_num, net::hw_features hw_features) {
@@ -108,6 +178,18 @@ namespace nil {
                 return true;
             }
 
+            void ipv4::enable_gro() {
+                if (_gro || hw_features().rx_lro) {
+                    return;
+                }
+                _gro = std::make_unique<tcp_gro>(!hw_features().rx_csum_offload, [this](packet p, unsigned segments) {
+                    _netif->update_gro_stats(segments);
+                    auto h = ntoh(*p.get_header<ip_hdr>(0));
+                    p.trim_front(h.ihl * 4);
+                    _l4[uint8_t(ip_protocol_num::tcp)]->received(std::move(p), h.src_ip, h.dst_ip);
+                });
+            }
+
             future<> ipv4::handle_received_packet(packet p, ethernet_address from) {
                 auto iph = p.get_header<ip_hdr>(0);
                 if (!iph) {
@@ -141,7 +223,7 @@ namespace nil {
                 }
 
                 // FIXME: process options
-                if (in_my_netmask(h.src_ip) && h.src_ip != _host_address) {
+                if (is_on_link(h.src_ip) && !is_my_address(h.src_ip)) {
                     _arp.learn(from, h.src_ip);
                 }
 
@@ -153,7 +235,7 @@ namespace nil {
                     }
                 }
 
-                if (h.dst_ip != _host_address) {
+                if (!is_my_address(h.dst_ip)) {
                     // FIXME: forward
                     return make_ready_future<>();
                 }
@@ -214,6 +296,10 @@ namespace nil {
 
                 auto l4 = _l4[h.ip_proto];
                 if (l4) {
+                    if (_gro && h.ip_proto == uint8_t(ip_protocol_num::tcp)) {
+                        _gro->receive(std::move(p));
+                        return make_ready_future<>();
+                    }
                     // Trim IP header and pass to upper layer
                     p.trim_front(ip_hdr_len);
                     l4->received(std::move(p), h.src_ip, h.dst_ip);
@@ -223,22 +309,21 @@ namespace nil {
 
             future<ethernet_address> ipv4::get_l2_dst_address(ipv4_address to) {
                 // Figure out where to send the packet to. If it is a directly connected
-                // host, send to it directly, otherwise send to the default gateway.
-                ipv4_address dst;
-                if (in_my_netmask(to)) {
-                    dst = to;
-                } else {
-                    dst = _gw_address;
-                }
-
+                // host, send to it directly, otherwise send to the gateway of its route.
+                auto nh = _routes.lookup(to.ip);
+                auto dst = nh && nh->gateway ? ipv4_address(nh->gateway) : to;
                 return _arp.lookup(dst);
             }
 
-            void ipv4::send(ipv4_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst) {
+            void ipv4::send(ipv4_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst,
+                            ipv4_address from) {
                 auto needs_frag = this->needs_frag(p, proto_num, hw_features());
+                if (is_unspecified(from)) {
+                    from = source_address(to);
+                }
 
-                auto send_pkt = [this, to, proto_num, needs_frag, e_dst](packet &pkt, uint16_t remaining,
-                                                                         uint16_t offset) mutable {
+                auto send_pkt = [this, to, from, proto_num, needs_frag, e_dst](packet &pkt, uint16_t remaining,
+                                                                               uint16_t offset) mutable {
                     auto iph = pkt.prepend_header<ip_hdr>();
                     iph->ihl = sizeof(*iph) / 4;
                     iph->ver = 4;
@@ -258,7 +343,7 @@ namespace nil {
                     iph->ttl = 64;
                     iph->ip_proto = (uint8_t)proto_num;
                     iph->csum = 0;
-                    iph->src_ip = _host_address;
+                    iph->src_ip = from;
                     iph->dst_ip = to;
                     *iph = hton(*iph);
 
@@ -303,7 +388,7 @@ namespace nil {
                         }
                         if (l4p) {
                             auto l4pv = std::move(l4p.value());
-                            send(l4pv.to, l4pv.proto_num, std::move(l4pv.p), l4pv.e_dst);
+                            send(l4pv.to, l4pv.proto_num, std::move(l4pv.p), l4pv.e_dst, l4pv.from);
                             break;
                         }
                     }
@@ -320,6 +405,7 @@ namespace nil {
             void ipv4::set_host_address(ipv4_address ip) {
                 _host_address = ip;
                 _arp.set_self_addr(ip);
+                update_routes();
             }
 
             ipv4_address ipv4::host_address() const {
@@ -328,6 +414,7 @@ namespace nil {
 
             void ipv4::set_gw_address(ipv4_address ip) {
                 _gw_address = ip;
+                update_routes();
             }
 
             ipv4_address ipv4::gw_address() const {
@@ -336,6 +423,7 @@ namespace nil {
 
             void ipv4::set_netmask_address(ipv4_address ip) {
                 _netmask = ip;
+                update_routes();
             }
 
             ipv4_address ipv4::netmask_address() const {
@@ -469,9 +557,10 @@ namespace nil {
 
                 if (_queue_space.try_wait(p.len())) {    // drop packets that do not fit the queue
                     // FIXME: future is discarded
-                    (void)_inet.get_l2_dst_address(from).then([this, from,
+                    (void)_inet.get_l2_dst_address(from).then([this, from, to,
                                                                p = std::move(p)](ethernet_address e_dst) mutable {
-                        _packetq.emplace_back(ipv4_traits::l4packet {from, std::move(p), e_dst, ip_protocol_num::icmp});
+                        _packetq.emplace_back(
+                            ipv4_traits::l4packet {from, std::move(p), e_dst, ip_protocol_num::icmp, to});
                     });
                 }
             }
@@ -27,15 +27,31 @@
 
 #include <arpa/inet.h>
 
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 namespace nil {
     namespace actor {
         namespace net {
-            void checksummer::sum(const char *data, size_t len) {
-                auto orig_len = len;
-                if (odd) {
-                    csum += uint8_t(*data++);
-                    --len;
-                }
+
+            // Buffers shorter than this are summed inline, a kernel call does not pay off
+            static constexpr size_t checksum_kernel_min_len = 64;
+
+            static uint16_t fold(unsigned __int128 csum) {
+                unsigned __int128 csum1 = (csum & 0xffff'ffff'ffff'ffff) + (csum >> 64);
+                uint64_t csum2 = (csum1 & 0xffff'ffff'ffff'ffff) + (csum1 >> 64);
+                csum2 = (csum2 & 0xffff) + ((csum2 >> 16) & 0xffff) + ((csum2 >> 32) & 0xffff) + (csum2 >> 48);
+                csum2 = (csum2 & 0xffff) + (csum2 >> 16);
+                csum2 = (csum2 & 0xffff) + (csum2 >> 16);
+                return csum2;
+            }
+
+            // Sums big-endian words; the buffer is assumed to start at an even offset
+            static unsigned __int128 sum_be_words(const char *data, size_t len) {
+                unsigned __int128 csum = 0;
                 auto p64 = reinterpret_cast<const packed<uint64_t> *>(data);
                 while (len >= 8) {
                     csum += ntoh(*p64++);
@@ -48,19 +64,155 @@ namespace nil {
                 }
                 auto p8 = reinterpret_cast<const uint8_t *>(p16);
                 if (len) {
-                    csum += *p8++ << 8;
-                    len -= 1;
+                    csum += *p8 << 8;
+                }
+                return csum;
+            }
+
+            static uint16_t sum_scalar(const char *data, size_t len) {
+                return fold(sum_be_words(data, len));
+            }
+
+#if defined(__x86_64__)
+            // The vector kernels add little-endian 32-bit words into 64-bit lanes, no
+            // byte swapping in the loop: one's complement sums are byte order
+            // independent, so swapping the folded result yields the big-endian sum.
+            static uint16_t finish_le(unsigned __int128 csum, const char *data, size_t len) {
+                while (len >= 8) {
+                    uint64_t v;
+                    std::memcpy(&v, data, sizeof(v));
+                    csum += v;
+                    data += 8;
+                    len -= 8;
+                }
+                while (len >= 2) {
+                    uint16_t v;
+                    std::memcpy(&v, data, sizeof(v));
+                    csum += v;
+                    data += 2;
+                    len -= 2;
+                }
+                if (len) {
+                    csum += uint8_t(*data);
+                }
+                return __builtin_bswap16(fold(csum));
+            }
+
+            static uint16_t sum_sse2(const char *data, size_t len) {
+                auto zero = _mm_setzero_si128();
+                auto acc0 = zero, acc1 = zero;
+                while (len >= 32) {
+                    auto v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+                    auto v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16));
+                    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+                    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+                    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+                    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+                    data += 32;
+                    len -= 32;
+                }
+                uint64_t lanes[4];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc0);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes + 2), acc1);
+                unsigned __int128 csum = 0;
+                for (auto l : lanes) {
+                    csum += l;
+                }
+                return finish_le(csum, data, len);
+            }
+
+            __attribute__((target("avx2"))) static uint16_t sum_avx2(const char *data, size_t len) {
+                auto zero = _mm256_setzero_si256();
+                auto acc0 = zero, acc1 = zero;
+                while (len >= 64) {
+                    auto v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+                    auto v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32));
+                    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+                    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+                    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+                    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+                    data += 64;
+                    len -= 64;
+                }
+                uint64_t lanes[8];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc0);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes + 4), acc1);
+                unsigned __int128 csum = 0;
+                for (auto l : lanes) {
+                    csum += l;
+                }
+                return finish_le(csum, data, len);
+            }
+
+            __attribute__((target("avx512f"))) static uint16_t sum_avx512(const char *data, size_t len) {
+                // Spilling sixteen lanes costs more than it saves on short buffers
+                if (len < 256) {
+                    return sum_avx2(data, len);
+                }
+                auto zero = _mm512_setzero_si512();
+                auto acc0 = zero, acc1 = zero;
+                while (len >= 128) {
+                    auto v0 = _mm512_loadu_si512(data);
+                    auto v1 = _mm512_loadu_si512(data + 64);
+                    acc0 = _mm512_add_epi64(acc0, _mm512_unpacklo_epi32(v0, zero));
+                    acc1 = _mm512_add_epi64(acc1, _mm512_unpackhi_epi32(v0, zero));
+                    acc0 = _mm512_add_epi64(acc0, _mm512_unpacklo_epi32(v1, zero));
+                    acc1 = _mm512_add_epi64(acc1, _mm512_unpackhi_epi32(v1, zero));
+                    data += 128;
+                    len -= 128;
+                }
+                if (len >= 64) {
+                    auto v = _mm512_loadu_si512(data);
+                    acc0 = _mm512_add_epi64(acc0, _mm512_unpacklo_epi32(v, zero));
+                    acc1 = _mm512_add_epi64(acc1, _mm512_unpackhi_epi32(v, zero));
+                    data += 64;
+                    len -= 64;
+                }
+                uint64_t lanes[16];
+                _mm512_storeu_si512(lanes, acc0);
+                _mm512_storeu_si512(lanes + 8, acc1);
+                unsigned __int128 csum = 0;
+                for (auto l : lanes) {
+                    csum += l;
+                }
+                return finish_le(csum, data, len);
+            }
+#endif
+
+            const std::vector<checksum_implementation> &checksum_implementations() {
+                static const std::vector<checksum_implementation> impls = [] {
+                    std::vector<checksum_implementation> v {{"scalar", sum_scalar}};
+#if defined(__x86_64__)
+                    v.push_back({"sse2", sum_sse2});
+                    if (__builtin_cpu_supports("avx2")) {
+                        v.push_back({"avx2", sum_avx2});
+                    }
+                    if (__builtin_cpu_supports("avx512f")) {
+                        v.push_back({"avx512", sum_avx512});
+                    }
+#endif
+                    return v;
+                }();
+                return impls;
+            }
+
+            void checksummer::sum(const char *data, size_t len) {
+                static const checksum_kernel kernel = checksum_implementations().back().sum;
+                auto orig_len = len;
+                if (odd && len) {
+                    csum += uint8_t(*data++);
+                    --len;
+                }
+                if (len >= checksum_kernel_min_len) {
+                    csum += kernel(data, len);
+                } else {
+                    csum += sum_be_words(data, len);
                 }
                 odd ^= orig_len & 1;
             }
 
             uint16_t checksummer::get() const {
-                __int128 csum1 = (csum & 0xffff'ffff'ffff'ffff) + (csum >> 64);
-                uint64_t csum = (csum1 & 0xffff'ffff'ffff'ffff) + (csum1 >> 64);
-                csum = (csum & 0xffff) + ((csum >> 16) & 0xffff) + ((csum >> 32) & 0xffff) + (csum >> 48);
-                csum = (csum & 0xffff) + (csum >> 16);
-                csum = (csum & 0xffff) + (csum >> 16);
-                return hton(~csum);
+                return hton(uint16_t(~fold(csum)));
             }
 
             void checksummer::sum(const packet &p) {
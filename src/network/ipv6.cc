@@ -0,0 +1,538 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <cstring>
+
+#include <nil/actor/network/ipv6.hh>
+#include <nil/actor/network/tcp.hh>
+#include <nil/actor/core/print.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            // IPv6 extension headers which may precede the upper layer header (RFC 8200, section 4)
+            enum class ipv6_ext_hdr : uint8_t {
+                hop_by_hop = 0,
+                routing = 43,
+                fragment = 44,
+                no_next_header = 59,
+                destination = 60,
+            };
+
+            ipv6_address ipv6::all_nodes_address() {
+                ipv6_address::ipv6_bytes b {};
+                b[0] = 0xff;
+                b[1] = 0x02;
+                b[15] = 0x01;
+                return ipv6_address(b);
+            }
+
+            ipv6_address ipv6::solicited_node_address(const ipv6_address &a) {
+                // ff02::1:ffXX:XXXX, with the low-order 24 bits of the unicast address
+                ipv6_address::ipv6_bytes b {};
+                b[0] = 0xff;
+                b[1] = 0x02;
+                b[11] = 0x01;
+                b[12] = 0xff;
+                std::copy(a.ip.begin() + 13, a.ip.end(), b.begin() + 13);
+                return ipv6_address(b);
+            }
+
+            ipv6_address ipv6::make_link_local_address(ethernet_address hw_address) {
+                // fe80::/64 with a modified EUI-64 interface identifier (RFC 4291, appendix A)
+                auto &mac = hw_address.mac;
+                ipv6_address::ipv6_bytes b {};
+                b[0] = 0xfe;
+                b[1] = 0x80;
+                b[8] = mac[0] ^ 0x02;
+                b[9] = mac[1];
+                b[10] = mac[2];
+                b[11] = 0xff;
+                b[12] = 0xfe;
+                b[13] = mac[3];
+                b[14] = mac[4];
+                b[15] = mac[5];
+                return ipv6_address(b);
+            }
+
+            ethernet_address ipv6::multicast_ethernet_address(const ipv6_address &a) {
+                // 33:33 followed by the low-order 32 bits of the group address (RFC 2464, section 7)
+                return {0x33, 0x33, a.ip[12], a.ip[13], a.ip[14], a.ip[15]};
+            }
+
+            ipv6::ipv6(interface *netif) :
+                _netif(netif), _hw_features(netif->hw_features()), _ndp(*this),
+                _link_local_address(make_link_local_address(netif->hw_address())),
+                _l3(netif, eth_protocol_num::ipv6, [this] { return get_packet(); }), _tcp(*this), _icmp(*this),
+                _udp(*this), _l4({{uint8_t(ip_protocol_num::tcp), &_tcp},
+                                  {uint8_t(ip_protocol_num::icmpv6), &_icmp},
+                                  {uint8_t(ip_protocol_num::udp), &_udp}}) {
+                _hw_features.tx_csum_ip_offload = false;
+                _hw_features.tx_csum_l4_offload = false;
+                _hw_features.rx_csum_offload = false;
+                _hw_features.tx_tso = false;
+                _hw_features.tx_ufo = false;
+                _ndp.add_self_addr(_link_local_address);
+                // FIXME: ignored future
+                (void)_l3.receive(
+                    [this](packet p, ethernet_address ea) { return handle_received_packet(std::move(p), ea); },
+                    [this](forward_hash &out_hash_data, packet &p, size_t off) {
+                        return forward(out_hash_data, p, off);
+                    });
+            }
+
+            bool ipv6::skip_extension_headers(packet &p, size_t off, uint8_t &proto_num, size_t &l4_offset) {
+                l4_offset = sizeof(ip6_hdr);
+                for (;;) {
+                    switch (ipv6_ext_hdr(proto_num)) {
+                        case ipv6_ext_hdr::hop_by_hop:
+                        case ipv6_ext_hdr::routing:
+                        case ipv6_ext_hdr::destination: {
+                            // Next header and length in 8-octet units, not including the first 8 octets
+                            auto eh = p.get_header(off + l4_offset, 2);
+                            if (!eh) {
+                                return false;
+                            }
+                            proto_num = uint8_t(eh[0]);
+                            l4_offset += (size_t(uint8_t(eh[1])) + 1) * 8;
+                            break;
+                        }
+                        case ipv6_ext_hdr::fragment:
+                            // Fragments are not reassembled: we never send datagrams
+                            // larger than the link MTU, and TCP peers size their segments
+                            // by our MSS, so they are only expected from UDP peers
+                            // ignoring it.
+                        case ipv6_ext_hdr::no_next_header:
+                            return false;
+                        default:
+                            return true;
+                    }
+                }
+            }
+
+            bool ipv6::forward(forward_hash &out_hash_data, packet &p, size_t off) {
+                auto iph = p.get_header<ip6_hdr>(off);
+                if (!iph) {
+                    return true;
+                }
+
+                ipv6_traits::hash_address(out_hash_data, iph->src_ip);
+                ipv6_traits::hash_address(out_hash_data, iph->dst_ip);
+
+                uint8_t proto_num = iph->next_header;
+                size_t l4_offset;
+                if (skip_extension_headers(p, off, proto_num, l4_offset)) {
+                    auto l4 = _l4[proto_num];
+                    if (l4) {
+                        l4->forward(out_hash_data, p, off + l4_offset);
+                    }
+                }
+                return true;
+            }
+
+            bool ipv6::in_my_prefix(const ipv6_address &a) const {
+                if (!is_configured()) {
+                    return false;
+                }
+                auto bits = _prefix_length;
+                for (unsigned i = 0; bits && i < a.ip.size(); ++i) {
+                    uint8_t mask = bits >= 8 ? 0xff : uint8_t(0xff << (8 - bits));
+                    if ((a.ip[i] ^ _host_address.ip[i]) & mask) {
+                        return false;
+                    }
+                    bits -= std::min(bits, 8u);
+                }
+                return true;
+            }
+
+            bool ipv6::is_my_address(const ipv6_address &a) const {
+                if (is_multicast(a)) {
+                    return a == all_nodes_address() || a == solicited_node_address(_link_local_address) ||
+                           (is_configured() && a == solicited_node_address(_host_address));
+                }
+                return a == _link_local_address || (is_configured() && a == _host_address);
+            }
+
+            future<> ipv6::handle_received_packet(packet p, ethernet_address from) {
+                auto iph = p.get_header<ip6_hdr>(0);
+                if (!iph) {
+                    return make_ready_future<>();
+                }
+
+                auto h = ntoh(*iph);
+                if (h.ver() != 6) {
+                    return make_ready_future<>();
+                }
+                unsigned ip_len = sizeof(ip6_hdr) + h.payload_len;
+                unsigned pkt_len = p.len();
+                if (pkt_len > ip_len) {
+                    // Trim extra data in the packet beyond IP payload length
+                    p.trim_back(pkt_len - ip_len);
+                } else if (pkt_len < ip_len) {
+                    // Drop if it contains less than IP payload length
+                    return make_ready_future<>();
+                }
+
+                if (!is_my_address(h.dst_ip)) {
+                    // FIXME: forward
+                    return make_ready_future<>();
+                }
+
+                uint8_t proto_num = h.next_header;
+                size_t l4_offset;
+                if (!skip_extension_headers(p, 0, proto_num, l4_offset)) {
+                    return make_ready_future<>();
+                }
+
+                // Trim IP and extension headers and pass to upper layer
+                if (proto_num == uint8_t(ip_protocol_num::icmpv6)) {
+                    p.trim_front(l4_offset);
+                    _icmp.received(std::move(p), h.src_ip, h.dst_ip, h.hop_limit, from);
+                    return make_ready_future<>();
+                }
+                auto l4 = _l4[proto_num];
+                if (l4) {
+                    p.trim_front(l4_offset);
+                    l4->received(std::move(p), h.src_ip, h.dst_ip);
+                }
+                return make_ready_future<>();
+            }
+
+            future<ethernet_address> ipv6::get_l2_dst_address(ipv6_address to) {
+                if (is_multicast(to)) {
+                    return make_ready_future<ethernet_address>(multicast_ethernet_address(to));
+                }
+                // Figure out where to send the packet to. If it is an on-link
+                // host, send to it directly, otherwise send to the default gateway.
+                ipv6_address dst;
+                if (is_link_local(to) || in_my_prefix(to) || _gw_address.is_unspecified()) {
+                    dst = to;
+                } else {
+                    dst = _gw_address;
+                }
+
+                return _ndp.lookup(dst);
+            }
+
+            ipv6_address ipv6::source_address(const ipv6_address &to) const {
+                // Link-local destinations and link-scope groups (ff02::/16) are
+                // only reachable from the link-local address.
+                bool link_scope = is_link_local(to) || (is_multicast(to) && (to.ip[1] & 0x0f) == 0x02);
+                if (link_scope || !is_configured()) {
+                    return _link_local_address;
+                }
+                return _host_address;
+            }
+
+            void ipv6::send(ipv6_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst,
+                            ipv6_address from) {
+                // Routers never fragment IPv6 and we do not emit fragment headers: TCP
+                // segments are sized by the MSS and ipv6_udp fails oversized datagrams
+                // with EMSGSIZE, so nothing should get here that does not fit.
+                if (p.len() + sizeof(ip6_hdr) > hw_features().mtu) {
+                    return;
+                }
+
+                auto iph = p.prepend_header<ip6_hdr>();
+                iph->ver_tc_flow = uint32_t(6) << 28;
+                iph->payload_len = p.len() - sizeof(ip6_hdr);
+                iph->next_header = uint8_t(proto_num);
+                iph->hop_limit = proto_num == ip_protocol_num::icmpv6 ? nd_hop_limit : default_hop_limit;
+                iph->src_ip = from.is_unspecified() ? source_address(to) : from;
+                iph->dst_ip = to;
+                *iph = hton(*iph);
+
+                p.offload_info_ref().ip_hdr_len = sizeof(ip6_hdr);
+                _packetq.push_back(l3_protocol::l3packet {eth_protocol_num::ipv6, e_dst, std::move(p)});
+            }
+
+            boost::optional<l3_protocol::l3packet> ipv6::get_packet() {
+                // _packetq will be mostly empty here unless neighbor discovery queued
+                // a message directly
+                if (_packetq.empty()) {
+                    for (size_t i = 0; i < _pkt_providers.size(); i++) {
+                        auto l4p = _pkt_providers[_pkt_provider_idx++]();
+                        if (_pkt_provider_idx == _pkt_providers.size()) {
+                            _pkt_provider_idx = 0;
+                        }
+                        if (l4p) {
+                            auto l4pv = std::move(l4p.value());
+                            send(l4pv.to, l4pv.proto_num, std::move(l4pv.p), l4pv.e_dst, l4pv.from);
+                            break;
+                        }
+                    }
+                }
+
+                boost::optional<l3_protocol::l3packet> p;
+                if (!_packetq.empty()) {
+                    p = std::move(_packetq.front());
+                    _packetq.pop_front();
+                }
+                return p;
+            }
+
+            void ipv6::set_host_address(ipv6_address ip) {
+                if (is_configured()) {
+                    _ndp.remove_self_addr(_host_address);
+                }
+                _host_address = ip;
+                if (is_configured()) {
+                    _ndp.add_self_addr(_host_address);
+                }
+            }
+
+            ipv6_address ipv6::host_address() const {
+                return _host_address;
+            }
+
+            void ipv6::set_gw_address(ipv6_address ip) {
+                _gw_address = ip;
+            }
+
+            ipv6_address ipv6::gw_address() const {
+                return _gw_address;
+            }
+
+            void ipv6::set_prefix_length(unsigned prefix_length) {
+                _prefix_length = std::min(prefix_length, 128u);
+            }
+
+            unsigned ipv6::prefix_length() const {
+                return _prefix_length;
+            }
+
+            void ipv6::register_l4(proto_type id, ipv6_protocol *handler) {
+                _l4[id] = handler;
+            }
+
+            void ipv6_icmp::received(packet p, ipv6_address from, ipv6_address to, uint8_t hop_limit,
+                                     ethernet_address l2src) {
+                auto hdr = p.get_header<icmpv6_hdr>(0);
+                if (!hdr) {
+                    return;
+                }
+                // ICMPv6 checksums cover the pseudo header and are always verified in software
+                checksummer csum;
+                ipv6_traits::pseudo_header_checksum(csum, from, to, p.len(), ip_protocol_num::icmpv6);
+                csum.sum(p);
+                if (csum.get() != 0) {
+                    return;
+                }
+                switch (hdr->type) {
+                    case icmpv6_hdr::msg_type::neighbor_solicitation:
+                    case icmpv6_hdr::msg_type::neighbor_advertisement:
+                        _inet_l4._inet.neighbors().received(std::move(p), from, to, hop_limit, l2src);
+                        break;
+                    default:
+                        _icmp.received(std::move(p), from, to);
+                        break;
+                }
+            }
+
+            void icmpv6::received(packet p, ipaddr from, ipaddr to) {
+                auto hdr = p.get_header<icmpv6_hdr>(0);
+                if (!hdr || hdr->type != icmpv6_hdr::msg_type::echo_request || ipv6::is_multicast(from)) {
+                    return;
+                }
+                hdr->type = icmpv6_hdr::msg_type::echo_reply;
+                hdr->code = 0;
+                hdr->csum = 0;
+                checksummer csum;
+                ipv6_traits::pseudo_header_checksum(csum, _inet.inet().source_address(from), from, p.len(),
+                                                    ip_protocol_num::icmpv6);
+                csum.sum(p);
+                hdr->csum = csum.get();
+
+                if (_queue_space.try_wait(p.len())) {    // drop packets that do not fit the queue
+                    // FIXME: future is discarded
+                    (void)_inet.get_l2_dst_address(from).then([this, from,
+                                                               p = std::move(p)](ethernet_address e_dst) mutable {
+                        _packetq.emplace_back(
+                            ipv6_traits::l4packet {from, std::move(p), e_dst, ip_protocol_num::icmpv6});
+                    });
+                }
+            }
+
+            ndp::ndp(ipv6 &inet) :
+                _inet(inet),
+                _cache([this](const l3addr &a) {
+                    auto dst = ipv6::solicited_node_address(a);
+                    send_solicitation(a, dst, ipv6::multicast_ethernet_address(dst));
+                }, [this](const l3addr &a, l2addr hwaddr) { send_solicitation(a, a, hwaddr); }) {
+            }
+
+            void ndp::add_self_addr(l3addr addr) {
+                _cache.set_permanent(addr, _inet.netif()->hw_address());
+            }
+
+            packet ndp::make_message(icmpv6_hdr::msg_type type, uint32_t flags, const l3addr &target,
+                                     option_type opt, const l3addr &src, const l3addr &dst) {
+                nd_hdr h;
+                h.type = uint8_t(type);
+                h.code = 0;
+                h.csum = 0;
+                h.flags = flags;
+                h.target = target;
+                auto p = packet();
+                auto buf = p.prepend_uninitialized_header(h.size() + lladdr_option_size);
+                h.write(buf);
+                auto o = buf + h.size();
+                produce_be<uint8_t>(o, opt);
+                produce_be<uint8_t>(o, lladdr_option_size / 8);
+                _inet.netif()->hw_address().produce(o);
+
+                checksummer csum;
+                ipv6_traits::pseudo_header_checksum(csum, src, dst, p.len(), ip_protocol_num::icmpv6);
+                csum.sum(p);
+                auto c = csum.get();
+                // The checksum follows the one-byte type and code fields
+                std::memcpy(buf + 2, &c, sizeof(c));
+                return p;
+            }
+
+            void ndp::send_solicitation(const l3addr &target, const l3addr &dst, l2addr e_dst) {
+                auto p = make_message(icmpv6_hdr::msg_type::neighbor_solicitation, 0, target,
+                                      source_link_layer_address, _inet.source_address(dst), dst);
+                _inet.send(dst, ip_protocol_num::icmpv6, std::move(p), e_dst);
+            }
+
+            void ndp::send_advertisement(const l3addr &to, l2addr e_dst, const l3addr &target, bool solicited) {
+                uint32_t flags = override_flag | (solicited ? solicited_flag : 0);
+                auto p = make_message(icmpv6_hdr::msg_type::neighbor_advertisement, flags, target,
+                                      target_link_layer_address, _inet.source_address(to), to);
+                _inet.send(to, ip_protocol_num::icmpv6, std::move(p), e_dst);
+            }
+
+            void ndp::propagate(l2addr l2, l3addr l3) {
+                if (_learn_hook) {
+                    _learn_hook(l2, l3);
+                } else {
+                    learn(l2, l3);
+                }
+            }
+
+            void ndp::received(packet p, l3addr from, l3addr to, uint8_t hop_limit, l2addr l2src) {
+                if (hop_limit != ipv6::nd_hop_limit) {
+                    return;
+                }
+                auto nh = p.get_header(0, nd_hdr::size());
+                if (!nh) {
+                    return;
+                }
+                auto h = nd_hdr::read(nh);
+                if (h.code != 0 || ipv6::is_multicast(h.target)) {
+                    return;
+                }
+
+                auto type = icmpv6_hdr::msg_type(h.type);
+                auto wanted = type == icmpv6_hdr::msg_type::neighbor_solicitation ? source_link_layer_address :
+                                                                                     target_link_layer_address;
+                boost::optional<l2addr> lladdr;
+                for (size_t off = nd_hdr::size(); off + 2 <= p.len();) {
+                    auto oh = p.get_header(off, 2);
+                    auto len = size_t(uint8_t(oh[1])) * 8;
+                    if (len == 0 || off + len > p.len()) {
+                        // Malformed options invalidate the whole message
+                        return;
+                    }
+                    if (uint8_t(oh[0]) == wanted && len == lladdr_option_size) {
+                        lladdr = l2addr::read(p.get_header(off + 2, l2addr::size()));
+                    }
+                    off += len;
+                }
+
+                if (type == icmpv6_hdr::msg_type::neighbor_solicitation) {
+                    handle_solicitation(h, lladdr, from, l2src);
+                } else {
+                    handle_advertisement(h, lladdr);
+                }
+            }
+
+            void ndp::handle_solicitation(const nd_hdr &h, boost::optional<l2addr> lladdr, const l3addr &from,
+                                          l2addr l2src) {
+                if (h.target != _inet.link_local_address() &&
+                    (!_inet.is_configured() || h.target != _inet.host_address())) {
+                    return;
+                }
+                if (from.is_unspecified()) {
+                    // Duplicate address detection probe, defend the address to all nodes
+                    auto all_nodes = ipv6::all_nodes_address();
+                    send_advertisement(all_nodes, ipv6::multicast_ethernet_address(all_nodes), h.target, false);
+                    return;
+                }
+                if (lladdr) {
+                    handle_update(*lladdr, from, true);
+                }
+                // Unicast probes may omit the option: they come from a neighbor that
+                // knows us already, and the frame tells where it is.
+                send_advertisement(from, lladdr ? *lladdr : l2src, h.target, true);
+            }
+
+            void ndp::handle_advertisement(const nd_hdr &h, boost::optional<l2addr> lladdr) {
+                if (!lladdr) {
+                    return;
+                }
+                bool override = h.flags & override_flag;
+                if (!(h.flags & solicited_flag)) {
+                    handle_update(*lladdr, h.target, override);
+                    return;
+                }
+                // Answers may be steered to a shard other than the one that asked, so
+                // like ARP replies they are propagated even if we are not resolving
+                // the address here. Without the override flag a known address stays.
+                auto n = _cache.find(h.target);
+                if (n && (n->st == neighbor_cache<l3addr>::state::permanent || (!override && n->hwaddr != *lladdr))) {
+                    return;
+                }
+                propagate(*lladdr, h.target);
+            }
+
+            void ndp::handle_update(l2addr l2, const l3addr &l3, bool override) {
+                // RFC 4861 section 7.2.5: unsolicited messages never create entries,
+                // they only complete the resolutions in progress and refresh or,
+                // when overriding, correct the mappings we have.
+                if (auto n = _cache.find(l3)) {
+                    if (n->st == neighbor_cache<l3addr>::state::permanent) {
+                        return;
+                    }
+                    if (n->hwaddr == l2) {
+                        // Nothing other shards need to hear about
+                        learn(l2, l3);
+                        return;
+                    }
+                    if (!override) {
+                        return;
+                    }
+                } else if (!_cache.resolving(l3)) {
+                    return;
+                }
+                propagate(l2, l3);
+            }
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,586 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/network/loopback.hh>
+#include <nil/actor/network/ethernet.hh>
+#include <nil/actor/network/ip.hh>
+#include <nil/actor/network/ipv6.hh>
+#include <nil/actor/network/toeplitz.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/metrics.hh>
+#include <nil/actor/core/circular_buffer.hh>
+#include <nil/actor/core/loop.hh>
+
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            namespace loopback {
+
+                using clock_type = std::chrono::steady_clock;
+
+                static void hash_ports(forward_hash &data, packet &p, size_t off) {
+                    // src_port, dst_port in network byte order, for both TCP and UDP
+                    auto ports = p.get_header(off, 4);
+                    if (ports) {
+                        for (unsigned i = 0; i < 4; ++i) {
+                            data.push_back(uint8_t(ports[i]));
+                        }
+                    }
+                }
+
+                static bool is_l4_hashed(uint8_t proto) {
+                    return proto == uint8_t(ip_protocol_num::tcp) || proto == uint8_t(ip_protocol_num::udp);
+                }
+
+                // Hashes the same fields, in the same order, as the forward() callbacks
+                // of the ip layers, so that the hash matches what the stack expects
+                // from a NIC when it picks ports with hash2cpu().
+                static uint32_t flow_hash(rss_key_type key, packet &p) {
+                    auto eh = p.get_header<eth_hdr>();
+                    if (!eh) {
+                        return 0;
+                    }
+                    forward_hash data;
+                    size_t off = sizeof(eth_hdr);
+                    auto proto = ntoh(eh->eth_proto);
+                    if (proto == uint16_t(eth_protocol_num::ipv4)) {
+                        auto iph = p.get_header<ip_hdr>(off);
+                        if (!iph) {
+                            return 0;
+                        }
+                        data.push_back(iph->src_ip.ip);
+                        data.push_back(iph->dst_ip.ip);
+                        auto h = ntoh(*iph);
+                        if (is_l4_hashed(h.ip_proto) && !h.mf() && h.offset() == 0) {
+                            hash_ports(data, p, off + h.ihl * 4);
+                        }
+                    } else if (proto == uint16_t(eth_protocol_num::ipv6)) {
+                        auto iph = p.get_header<ip6_hdr>(off);
+                        if (!iph) {
+                            return 0;
+                        }
+                        ipv6_traits::hash_address(data, iph->src_ip);
+                        ipv6_traits::hash_address(data, iph->dst_ip);
+                        if (is_l4_hashed(iph->next_header)) {
+                            hash_ports(data, p, off + sizeof(ip6_hdr));
+                        }
+                    } else {
+                        // ARP and friends land on the first queue, as with RSS hardware
+                        return 0;
+                    }
+                    return toeplitz_hash(key, data);
+                }
+
+                static net::hw_features make_hw_features(const loopback_device_config &cfg) {
+                    net::hw_features hw;
+                    hw.mtu = cfg.mtu;
+                    hw.tx_csum_ip_offload = cfg.csum_offload;
+                    hw.tx_csum_l4_offload = cfg.csum_offload;
+                    hw.rx_csum_offload = cfg.csum_offload;
+                    return hw;
+                }
+
+                static ethernet_address make_hw_address(unsigned index) {
+                    return {0x02, 0x00, 0x00, 0x00, uint8_t((index + 1) >> 8), uint8_t(index + 1)};
+                }
+
+                // Receive side shared by both flavours of the device: frames are queued
+                // with their delivery time, and the impairments are applied on enqueue.
+                class qp_base : public qp {
+                    struct frame {
+                        clock_type::time_point when;
+                        packet p;
+                    };
+
+                    device *_dev;
+                    std::chrono::microseconds _latency;
+                    double _loss;
+                    double _reorder;
+                    std::default_random_engine _rng;
+                    std::uniform_real_distribution<double> _dist {0, 1};
+                    circular_buffer<frame> _rx;
+                    uint64_t _dropped = 0;
+                    uint64_t _reordered = 0;
+                    reactor::poller _rx_poller;
+
+                protected:
+                    static constexpr size_t rx_batch = 128;
+
+                    // index tells the devices of a process apart, in metrics and MAC addresses
+                    qp_base(device *dev, const loopback_device_config &cfg, unsigned index, uint16_t qid) :
+                        qp(false, "loopback" + std::to_string(index), qid), _dev(dev), _latency(cfg.latency),
+                        _loss(cfg.loss), _reorder(cfg.reorder), _rng(cfg.seed * 65537 + index * 257 + qid),
+                        _rx_poller(reactor::poller::simple([this] { return poll_rx(); })) {
+                        namespace sm = metrics;
+                        _metrics.add_group(
+                            _stats_plugin_name,
+                            {
+                                sm::make_derive(_queue_name + "_rx_dropped", _dropped,
+                                                sm::description("Counts frames dropped by the loss emulation.")),
+                                sm::make_derive(_queue_name + "_rx_reordered", _reordered,
+                                                sm::description("Counts frames delivered out of order by the reordering "
+                                                                "emulation.")),
+                            });
+                    }
+
+                    // Pulls frames from the wire into enqueue(); returns true if there were any
+                    virtual bool pull() {
+                        return false;
+                    }
+
+                public:
+                    void enqueue(packet p) {
+                        if (_loss > 0 && _dist(_rng) < _loss) {
+                            ++_dropped;
+                            return;
+                        }
+                        auto when = clock_type::now() + _latency;
+                        _rx.push_back(frame {when, std::move(p)});
+                        if (_reorder > 0 && _rx.size() > 1 && _dist(_rng) < _reorder) {
+                            // Swap the payloads only, so that delivery times stay monotonic
+                            std::swap(_rx[_rx.size() - 1].p, _rx[_rx.size() - 2].p);
+                            ++_reordered;
+                        }
+                    }
+
+                private:
+                    bool poll_rx() {
+                        bool work = pull();
+                        if (_rx.empty()) {
+                            return work;
+                        }
+                        auto now = _latency.count() ? clock_type::now() : clock_type::time_point::max();
+                        size_t n = 0;
+                        while (!_rx.empty() && _rx.front().when <= now && n < rx_batch) {
+                            auto p = std::move(_rx.front().p);
+                            _rx.pop_front();
+                            _stats.rx.good.update_frags_stats(p.nr_frags(), p.len());
+                            _dev->l2receive(std::move(p));
+                            ++n;
+                        }
+                        if (n) {
+                            _stats.rx.good.update_pkts_bunch(n);
+                        }
+                        return work || n;
+                    }
+                };
+
+                class pair_qp;
+
+                class pair_device : public device {
+                    loopback_device_config _cfg;
+                    unsigned _index;
+                    pair_device *_peer = nullptr;
+
+                public:
+                    pair_device(const loopback_device_config &cfg, unsigned index) : _cfg(cfg), _index(index) {
+                    }
+                    void connect(pair_device *peer) {
+                        _peer = peer;
+                    }
+                    ethernet_address hw_address() override {
+                        return make_hw_address(_index);
+                    }
+                    net::hw_features hw_features() override {
+                        return make_hw_features(_cfg);
+                    }
+                    uint16_t hw_queues_count() override {
+                        return std::min<unsigned>(std::max<uint16_t>(_cfg.queues, 1), smp::count);
+                    }
+                    std::unique_ptr<qp> init_local_queue(boost::program_options::variables_map opts,
+                                                         uint16_t qid) override;
+                    pair_qp &peer_queue(unsigned qid);
+                    pair_device &peer() {
+                        return *_peer;
+                    }
+                    unsigned index() const {
+                        return _index;
+                    }
+                    const loopback_device_config &config() const {
+                        return _cfg;
+                    }
+                };
+
+                // Frames for the local shard are handed over directly, the rest are
+                // batched per destination shard. Each destination has at most one
+                // message in flight, and the frames queued meanwhile make up the next
+                // batch. The frames of a batch share a single deleter, so that they are
+                // returned to this shard in one message too, once the peer freed them all.
+                class pair_qp : public qp_base {
+                    static constexpr size_t max_queued = 1024;
+                    pair_device *_dev;
+                    std::vector<std::vector<packet>> _outgoing;
+                    // the hand-off loop of each destination, ready when it has nothing left
+                    std::vector<future<>> _handoffs;
+
+                    future<> hand_off(unsigned dst);
+
+                public:
+                    pair_qp(pair_device *dev, uint16_t qid) :
+                        qp_base(dev, dev->config(), dev->index(), qid), _dev(dev), _outgoing(smp::count) {
+                        _handoffs.reserve(smp::count);
+                        for (unsigned i = 0; i < smp::count; ++i) {
+                            _handoffs.push_back(make_ready_future<>());
+                        }
+                    }
+                    virtual future<> send(packet p) override {
+                        abort();
+                    }
+                    virtual uint32_t send(circular_buffer<packet> &pkts) override;
+                };
+
+                std::unique_ptr<qp> pair_device::init_local_queue(boost::program_options::variables_map opts,
+                                                                  uint16_t qid) {
+                    return std::make_unique<pair_qp>(this, qid);
+                }
+
+                pair_qp &pair_device::peer_queue(unsigned qid) {
+                    return static_cast<pair_qp &>(_peer->queue_for_cpu(qid));
+                }
+
+                uint32_t pair_qp::send(circular_buffer<packet> &pkts) {
+                    auto &peer = _dev->peer();
+                    auto src = this_shard_id();
+                    uint32_t sent = 0;
+                    while (!pkts.empty()) {
+                        auto &p = pkts.front();
+                        auto hash = flow_hash(peer.rss_key(), p);
+                        auto dst = peer.hash2qid(hash);
+                        if (dst != src && _outgoing[dst].size() >= max_queued) {
+                            // The peer shard is behind; keep the rest queued and retry on the next poll
+                            break;
+                        }
+                        p.set_rss_hash(hash);
+                        _stats.tx.good.update_frags_stats(p.nr_frags(), p.len());
+                        if (dst == src) {
+                            _dev->peer_queue(dst).enqueue(std::move(p));
+                        } else {
+                            _outgoing[dst].push_back(std::move(p));
+                        }
+                        pkts.pop_front();
+                        ++sent;
+                    }
+                    for (unsigned dst = 0; dst < _outgoing.size(); ++dst) {
+                        if (!_outgoing[dst].empty() && _handoffs[dst].available()) {
+                            _handoffs[dst] = do_until([this, dst] { return _outgoing[dst].empty(); },
+                                                      [this, dst] { return hand_off(dst); });
+                        }
+                    }
+                    return sent;
+                }
+
+                future<> pair_qp::hand_off(unsigned dst) {
+                    auto batch = std::exchange(_outgoing[dst], {});
+                    auto src = this_shard_id();
+                    // The frames keep their data here until the peer is done with the
+                    // last of them, then all of their deleters run here at once
+                    std::vector<deleter> held;
+                    held.reserve(batch.size());
+                    for (auto &&p : batch) {
+                        held.push_back(p.exchange_deleter(deleter()));
+                    }
+                    auto d = make_deleter(deleter(), [src, held = std::move(held)]() mutable {
+                        // FIXME: future is discarded
+                        (void)smp::submit_to(src, [held = std::move(held)]() mutable {
+                            // moved out so that the deleters run here, rather than where
+                            // the message is destroyed
+                            auto local = std::move(held);
+                        });
+                    });
+                    // No reference may stay here: the peer shard is the one dropping them
+                    for (size_t i = 0; i < batch.size(); ++i) {
+                        batch[i].exchange_deleter(i + 1 < batch.size() ? d.share() : std::move(d));
+                    }
+                    auto q = &_dev->peer_queue(dst);
+                    return smp::submit_to(dst, [q, batch = std::move(batch)]() mutable {
+                        for (auto &&p : batch) {
+                            q->enqueue(std::move(p));
+                        }
+                    });
+                }
+
+                // Shared memory layout: a header followed by one single-producer
+                // single-consumer ring per (sending side, source queue, destination queue).
+                struct shm_ring {
+                    static constexpr uint32_t size = 512;
+                    static constexpr size_t slot_size = 2048;
+                    struct slot {
+                        uint32_t len;
+                        uint32_t rss_hash;
+                        char data[slot_size - 2 * sizeof(uint32_t)];
+                    };
+                    alignas(64) std::atomic<uint32_t> head;    // written by the producer only
+                    alignas(64) std::atomic<uint32_t> tail;    // written by the consumer only
+                    slot slots[size];
+                };
+
+                struct shm_header {
+                    static constexpr uint32_t magic_value = 0x6c6f6f70;    // "loop"
+                    alignas(64) std::atomic<uint32_t> magic;
+                    uint32_t queues;
+                };
+
+                class shm_device : public device {
+                    loopback_device_config _cfg;
+                    unsigned _side;
+                    void *_area = MAP_FAILED;
+                    size_t _size = 0;
+
+                public:
+                    shm_device(const std::string &name, unsigned side, const loopback_device_config &cfg);
+                    ~shm_device();
+                    ethernet_address hw_address() override {
+                        return make_hw_address(_side);
+                    }
+                    net::hw_features hw_features() override {
+                        return make_hw_features(_cfg);
+                    }
+                    uint16_t hw_queues_count() override {
+                        return _cfg.queues;
+                    }
+                    std::unique_ptr<qp> init_local_queue(boost::program_options::variables_map opts,
+                                                         uint16_t qid) override;
+                    shm_ring &ring(unsigned side, unsigned src, unsigned dst) {
+                        auto rings = reinterpret_cast<shm_ring *>(static_cast<char *>(_area) + sizeof(shm_header));
+                        return rings[(side * _cfg.queues + src) * _cfg.queues + dst];
+                    }
+                    unsigned side() const {
+                        return _side;
+                    }
+                    const loopback_device_config &config() const {
+                        return _cfg;
+                    }
+                };
+
+                class shm_qp : public qp_base {
+                    shm_device *_dev;
+                    uint16_t _qid;
+                    uint64_t _oversized = 0;
+
+                public:
+                    shm_qp(shm_device *dev, uint16_t qid) :
+                        qp_base(dev, dev->config(), dev->side(), qid), _dev(dev), _qid(qid) {
+                        namespace sm = metrics;
+                        _metrics.add_group(
+                            _stats_plugin_name,
+                            {
+                                sm::make_derive(_queue_name + "_tx_oversized", _oversized,
+                                                sm::description("Counts frames dropped for not fitting a ring "
+                                                                "slot.")),
+                            });
+                    }
+                    virtual future<> send(packet p) override {
+                        abort();
+                    }
+                    virtual uint32_t send(circular_buffer<packet> &pkts) override;
+
+                protected:
+                    virtual bool pull() override;
+                };
+
+                shm_device::shm_device(const std::string &name, unsigned side, const loopback_device_config &cfg) :
+                    _cfg(cfg), _side(side) {
+                    if (side > 1) {
+                        throw std::invalid_argument("loopback device side must be 0 or 1");
+                    }
+                    _cfg.queues = std::min<unsigned>(std::max<uint16_t>(_cfg.queues, 1), smp::count);
+                    _cfg.mtu = std::min<size_t>(_cfg.mtu, sizeof(shm_ring::slot::data) - sizeof(eth_hdr));
+                    _size = sizeof(shm_header) + 2 * _cfg.queues * _cfg.queues * sizeof(shm_ring);
+
+                    int fd = ::shm_open(name.c_str(), side == 0 ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600);
+                    if (fd < 0) {
+                        throw std::system_error(errno, std::system_category(), "shm_open " + name);
+                    }
+                    if (side == 0 && ::ftruncate(fd, _size) < 0) {
+                        auto err = errno;
+                        ::close(fd);
+                        throw std::system_error(err, std::system_category(), "ftruncate " + name);
+                    }
+                    _area = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                    auto err = errno;
+                    ::close(fd);
+                    if (_area == MAP_FAILED) {
+                        throw std::system_error(err, std::system_category(), "mmap " + name);
+                    }
+
+                    // The segment starts zeroed, so all rings are empty; side 0 publishes the
+                    // geometry and side 1 checks that it agrees with it.
+                    auto hdr = static_cast<shm_header *>(_area);
+                    if (side == 0) {
+                        hdr->queues = _cfg.queues;
+                        hdr->magic.store(shm_header::magic_value, std::memory_order_release);
+                    } else {
+                        ::shm_unlink(name.c_str());
+                        if (hdr->magic.load(std::memory_order_acquire) != shm_header::magic_value ||
+                            hdr->queues != _cfg.queues) {
+                            ::munmap(_area, _size);
+                            throw std::runtime_error("loopback device " + name +
+                                                     " was created with a different number of queues");
+                        }
+                    }
+                }
+
+                shm_device::~shm_device() {
+                    if (_area != MAP_FAILED) {
+                        ::munmap(_area, _size);
+                    }
+                }
+
+                std::unique_ptr<qp> shm_device::init_local_queue(boost::program_options::variables_map opts,
+                                                                 uint16_t qid) {
+                    return std::make_unique<shm_qp>(this, qid);
+                }
+
+                uint32_t shm_qp::send(circular_buffer<packet> &pkts) {
+                    uint32_t sent = 0;
+                    while (!pkts.empty()) {
+                        auto &p = pkts.front();
+                        if (p.len() > sizeof(shm_ring::slot::data)) {
+                            // Larger than the MTU we advertise, the stack should not have sent it
+                            ++_oversized;
+                            pkts.pop_front();
+                            continue;
+                        }
+                        auto hash = flow_hash(_dev->rss_key(), p);
+                        auto &r = _dev->ring(_dev->side(), _qid, _dev->hash2qid(hash));
+                        auto head = r.head.load(std::memory_order_relaxed);
+                        if (head - r.tail.load(std::memory_order_acquire) == shm_ring::size) {
+                            // The receiver is behind; keep the rest queued and retry on the next poll
+                            break;
+                        }
+                        auto &s = r.slots[head % shm_ring::size];
+                        s.len = p.len();
+                        s.rss_hash = hash;
+                        auto dst = s.data;
+                        for (auto &&f : p.fragments()) {
+                            std::copy_n(f.base, f.size, dst);
+                            dst += f.size;
+                        }
+                        r.head.store(head + 1, std::memory_order_release);
+                        _stats.tx.good.update_frags_stats(p.nr_frags(), p.len());
+                        _stats.tx.good.update_copy_stats(p.nr_frags(), p.len());
+                        pkts.pop_front();
+                        ++sent;
+                    }
+                    return sent;
+                }
+
+                bool shm_qp::pull() {
+                    bool work = false;
+                    auto peer = 1 - _dev->side();
+                    for (unsigned src = 0; src < _dev->hw_queues_count(); ++src) {
+                        auto &r = _dev->ring(peer, src, _qid);
+                        auto tail = r.tail.load(std::memory_order_relaxed);
+                        auto head = r.head.load(std::memory_order_acquire);
+                        if (tail == head) {
+                            continue;
+                        }
+                        for (size_t n = 0; tail != head && n < rx_batch; ++tail, ++n) {
+                            auto &s = r.slots[tail % shm_ring::size];
+                            temporary_buffer<char> buf(s.len);
+                            std::copy_n(s.data, s.len, buf.get_write());
+                            _stats.rx.good.update_copy_stats(1, s.len);
+                            packet p(std::move(buf));
+                            p.set_rss_hash(s.rss_hash);
+                            enqueue(std::move(p));
+                        }
+                        r.tail.store(tail, std::memory_order_release);
+                        work = true;
+                    }
+                    return work;
+                }
+
+            }    // namespace loopback
+
+            std::pair<std::shared_ptr<device>, std::shared_ptr<device>>
+                create_loopback_device_pair(const loopback_device_config &cfg) {
+                static std::atomic<unsigned> next_index {0};
+                auto index = next_index.fetch_add(2);
+                auto a = std::make_shared<loopback::pair_device>(cfg, index);
+                auto b = std::make_shared<loopback::pair_device>(cfg, index + 1);
+                a->connect(b.get());
+                b->connect(a.get());
+                return {std::move(a), std::move(b)};
+            }
+
+            std::unique_ptr<device> create_shm_loopback_device(const std::string &name, unsigned side,
+                                                               const loopback_device_config &cfg) {
+                return std::make_unique<loopback::shm_device>(name, side, cfg);
+            }
+
+            std::unique_ptr<device> create_loopback_net_device(boost::program_options::variables_map opts) {
+                loopback_device_config cfg;
+                cfg.queues = opts["loopback-queues"].as<unsigned>();
+                cfg.latency = std::chrono::microseconds(opts["loopback-latency-us"].as<unsigned>());
+                cfg.loss = opts["loopback-loss"].as<double>();
+                cfg.reorder = opts["loopback-reorder"].as<double>();
+                cfg.csum_offload = opts["loopback-csum-offload"].as<std::string>() == "on";
+                return create_shm_loopback_device(opts["loopback-shm"].as<std::string>(),
+                                                  opts["loopback-side"].as<unsigned>(), cfg);
+            }
+
+            boost::program_options::options_description get_loopback_net_options_description() {
+                boost::program_options::options_description opts("Loopback net options");
+                opts.add_options()("loopback-shm", boost::program_options::value<std::string>(),
+                                   "Use a shared memory loopback device with the given segment name instead of a "
+                                   "hardware device")(
+                    "loopback-side",
+                    boost::program_options::value<unsigned>()->default_value(0),
+                    "End of the loopback device to use (0 creates the segment, 1 attaches to it)")(
+                    "loopback-queues",
+                    boost::program_options::value<unsigned>()->default_value(1),
+                    "Number of loopback device queues (must match on both ends)")(
+                    "loopback-latency-us",
+                    boost::program_options::value<unsigned>()->default_value(0),
+                    "Delay added to every received frame, in microseconds")(
+                    "loopback-loss",
+                    boost::program_options::value<double>()->default_value(0),
+                    "Probability of dropping a received frame")(
+                    "loopback-reorder",
+                    boost::program_options::value<double>()->default_value(0),
+                    "Probability of delivering a received frame after the next one")(
+                    "loopback-csum-offload",
+                    boost::program_options::value<std::string>()->default_value("off"),
+                    "Skip checksum computation and verification (on / off)");
+                return opts;
+            }
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -26,11 +26,13 @@
 #include <nil/actor/network/detail/native-stack-impl.hh>
 #include <nil/actor/network/net.hh>
 #include <nil/actor/network/ip.hh>
+#include <nil/actor/network/ipv6.hh>
 #include <nil/actor/network/tcp-stack.hh>
 #include <nil/actor/network/tcp.hh>
 #include <nil/actor/network/udp.hh>
 #include <nil/actor/network/virtio.hh>
 #include <nil/actor/network/dpdk.hh>
+#include <nil/actor/network/loopback.hh>
 #include <nil/actor/network/proxy.hh>
 #include <nil/actor/network/dhcp.hh>
 #include <nil/actor/network/config.hh>
@@ -73,6 +75,9 @@ namespace nil {
                 std::unique_ptr<device> dev;
 
                 if (deprecated_config_used) {
+                    if (opts.count("loopback-shm")) {
+                        dev = create_loopback_net_device(opts);
+                    } else
 #ifdef ACTOR_HAVE_DPDK
                     if (opts.count("dpdk-pmd")) {
                         dev =
@@ -149,6 +154,7 @@ namespace nil {
             private:
                 interface _netif;
                 ipv4 _inet;
+                ipv6 _inet6;
                 bool _dhcp = false;
                 promise<> _config;
                 timer<> _timer;
@@ -159,6 +165,7 @@ namespace nil {
                     _inet.set_packet_filter(filter);
                 }
                 using tcp4 = tcp<ipv4_traits>;
+                using tcp6 = tcp<ipv6_traits>;
 
             public:
                 explicit native_network_stack(boost::program_options::variables_map opts, std::shared_ptr<device> dev);
@@ -175,10 +182,20 @@ namespace nil {
                 virtual bool has_per_core_namespace() override {
                     return true;
                 };
+                virtual bool supports_ipv6() const override {
+                    return _inet6.is_configured();
+                }
                 void arp_learn(ethernet_address l2, ipv4_address l3) {
                     _inet.learn(l2, l3);
                 }
+                void ndp_learn(ethernet_address l2, ipv6_address l3) {
+                    _inet6.learn(l2, l3);
+                }
+                ipv4 &inet() {
+                    return _inet;
+                }
                 friend class native_server_socket_impl<tcp4>;
+                friend class native_server_socket_impl<tcp6>;
 
                 class native_network_interface;
                 friend class native_network_interface;
@@ -189,11 +206,15 @@ namespace nil {
             thread_local promise<std::unique_ptr<network_stack>> native_network_stack::ready_promise;
 
             udp_channel native_network_stack::make_udp_channel(const socket_address &addr) {
+                if (addr.family() == AF_INET6) {
+                    return _inet6.get_udp().make_channel(addr);
+                }
                 return _inet.get_udp().make_channel(addr);
             }
 
             void add_native_net_options_description(boost::program_options::options_description &opts) {
                 opts.add(get_virtio_net_options_description());
+                opts.add(get_loopback_net_options_description());
 #ifdef ACTOR_HAVE_DPDK
                 opts.add(get_dpdk_net_options_description());
 #endif
@@ -203,8 +224,25 @@ namespace nil {
                                                        std::shared_ptr<device>
                                                            dev) :
                 _netif(std::move(dev)),
-                _inet(&_netif) {
+                _inet(&_netif), _inet6(&_netif) {
                 _inet.get_udp().set_queue_size(opts["udpv4-queue-size"].as<int>());
+                _inet6.get_udp().set_queue_size(opts["udpv6-queue-size"].as<int>());
+                if (opts["gso"].as<std::string>() == "on") {
+                    _netif.enable_sw_gso();
+                }
+                if (opts["gro"].as<std::string>() == "on") {
+                    _inet.enable_gro();
+                }
+                // Neighbor advertisements are steered by the address pair only, so the
+                // answer may land on a different shard than the one that asked.
+                _inet6.neighbors().set_learn_hook([](ethernet_address l2, ipv6_address l3) { net::ndp_learn(l2, l3); });
+                if (!opts["host-ipv6-addr"].as<std::string>().empty()) {
+                    _inet6.set_host_address(ipv6_address(opts["host-ipv6-addr"].as<std::string>()));
+                    _inet6.set_prefix_length(opts["ipv6-prefix-length"].as<unsigned>());
+                }
+                if (!opts["gw-ipv6-addr"].as<std::string>().empty()) {
+                    _inet6.set_gw_address(ipv6_address(opts["gw-ipv6-addr"].as<std::string>()));
+                }
                 _dhcp = opts["host-ipv4-addr"].defaulted() && opts["gw-ipv4-addr"].defaulted() &&
                         opts["netmask-ipv4-addr"].defaulted() && opts["dhcp"].as<bool>();
                 if (!_dhcp) {
@@ -215,12 +253,15 @@ namespace nil {
             }
 
             server_socket native_network_stack::listen(socket_address sa, listen_options opts) {
+                if (sa.family() == AF_INET6) {
+                    return tcpv6_listen(_inet6.get_tcp(), sa.port(), opts);
+                }
                 assert(sa.family() == AF_INET || sa.is_unspecified());
                 return tcpv4_listen(_inet.get_tcp(), ntohs(sa.as_posix_sockaddr_in().sin_port), opts);
             }
 
             nil::actor::socket native_network_stack::socket() {
-                return tcpv4_socket(_inet.get_tcp());
+                return tcp_dual_stack_socket(_inet.get_tcp(), _inet6.get_tcp());
             }
 
             using namespace std::chrono_literals;
@@ -305,6 +346,38 @@ namespace nil {
                 });
             }
 
+            void ndp_learn(ethernet_address l2, ipv6_address l3) {
+                // Run ndp_learn on all shard in the background
+                (void)smp::invoke_on_all([l2, l3] {
+                    auto &ns = static_cast<native_network_stack &>(engine().net());
+                    ns.ndp_learn(l2, l3);
+                });
+            }
+
+            future<> add_ipv4_address(ipv4_address a, unsigned prefix_length) {
+                return smp::invoke_on_all([a, prefix_length] {
+                    static_cast<native_network_stack &>(engine().net()).inet().add_address(a, prefix_length);
+                });
+            }
+
+            future<> remove_ipv4_address(ipv4_address a) {
+                return smp::invoke_on_all(
+                    [a] { static_cast<native_network_stack &>(engine().net()).inet().remove_address(a); });
+            }
+
+            future<> add_ipv4_route(ipv4_address prefix, unsigned length, ipv4_address gateway, ipv4_address source) {
+                return smp::invoke_on_all([prefix, length, gateway, source] {
+                    auto &ns = static_cast<native_network_stack &>(engine().net());
+                    ns.inet().add_route(prefix, length, gateway, source);
+                });
+            }
+
+            future<> remove_ipv4_route(ipv4_address prefix, unsigned length) {
+                return smp::invoke_on_all([prefix, length] {
+                    static_cast<native_network_stack &>(engine().net()).inet().remove_route(prefix, length);
+                });
+            }
+
             void create_native_stack(boost::program_options::variables_map opts, std::shared_ptr<device> dev) {
                 native_network_stack::ready_promise.set_value(
                     std::unique_ptr<network_stack>(std::make_unique<native_network_stack>(opts, std::move(dev))));
@@ -327,6 +400,18 @@ namespace nil {
                     "udpv4-queue-size",
                     boost::program_options::value<int>()->default_value(ipv4_udp::default_queue_size),
                     "Default size of the UDPv4 per-channel packet queue")(
+                    "host-ipv6-addr",
+                    boost::program_options::value<std::string>()->default_value(""),
+                    "static IPv6 address to use (only the link-local address is used if empty)")(
+                    "gw-ipv6-addr",
+                    boost::program_options::value<std::string>()->default_value(""),
+                    "static IPv6 gateway to use")(
+                    "ipv6-prefix-length",
+                    boost::program_options::value<unsigned>()->default_value(ipv6::default_prefix_length),
+                    "on-link prefix length of the static IPv6 address")(
+                    "udpv6-queue-size",
+                    boost::program_options::value<int>()->default_value(ipv6_udp::default_queue_size),
+                    "Default size of the UDPv6 per-channel packet queue")(
                     "dhcp", boost::program_options::value<bool>()->default_value(true), "Use DHCP discovery")(
                     "hw-queue-weight",
                     boost::program_options::value<float>()->default_value(1.0f),
@@ -334,7 +419,11 @@ namespace nil {
 #ifdef ACTOR_HAVE_DPDK
                     ("dpdk-pmd", "Use DPDK PMD drivers")
 #endif
-                        ("lro", boost::program_options::value<std::string>()->default_value("on"), "Enable LRO");
+                        ("lro", boost::program_options::value<std::string>()->default_value("on"), "Enable LRO")(
+                            "gso", boost::program_options::value<std::string>()->default_value("off"),
+                            "Segment TCP sends in software when the device has no TSO")(
+                            "gro", boost::program_options::value<std::string>()->default_value("off"),
+                            "Coalesce received TCP segments in software when the device has no LRO");
 
                 add_native_net_options_description(opts);
                 return opts;
@@ -354,6 +443,9 @@ namespace nil {
                     _stack(stack), _addresses(1, _stack._inet.host_address()),
                     _hardware_address(_stack._inet.netif()->hw_address().mac.begin(),
                                       _stack._inet.netif()->hw_address().mac.end()) {
+                    if (_stack._inet6.is_configured()) {
+                        _addresses.emplace_back(_stack._inet6.host_address());
+                    }
                 }
                 native_network_interface(const native_network_interface &) = default;
 
@@ -386,7 +478,7 @@ namespace nil {
                     return true;
                 }
                 bool supports_ipv6() const override {
-                    return false;
+                    return _stack._inet6.is_configured();
                 }
             };
 
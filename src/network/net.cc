@@ -26,6 +26,7 @@
 #include <boost/algorithm/string.hpp>
 
 #include <nil/actor/network/net.hh>
+#include <nil/actor/network/offload.hh>
 #include <nil/actor/network/toeplitz.hh>
 #include <nil/actor/core/reactor.hh>
 #include <nil/actor/core/metrics.hh>
@@ -93,8 +94,14 @@ namespace nil {
                             auto p = pr();
                             if (p) {
                                 work++;
-                                _tx_packetq.push_back(std::move(p.value()));
-                                if (_tx_packetq.size() == 128) {
+                                if (_sw_gso && p->offload_info_ref().tso_seg_size) {
+                                    _stats.tx.gso_packets++;
+                                    _stats.tx.gso_segments +=
+                                        tcp_gso_segment(std::move(p.value()), *_sw_gso, _tx_packetq);
+                                } else {
+                                    _tx_packetq.push_back(std::move(p.value()));
+                                }
+                                if (_tx_packetq.size() >= 128) {
                                     break;
                                 }
                             }
@@ -150,6 +157,20 @@ namespace nil {
                                         sm::description("Counts a number of linearized Tx packets. High value "
                                                         "indicates that we send too fragmented packets.")),
 
+                        //
+                        // Software segmentation and receive offloads: DERIVE:0:U
+                        //
+                        sm::make_derive(_queue_name + "_tx_gso_packets", _stats.tx.gso_packets,
+                                        sm::description("Counts TCP super-segments split in software.")),
+                        sm::make_derive(_queue_name + "_tx_gso_segments", _stats.tx.gso_segments,
+                                        sm::description("Counts segments produced by software GSO. The ratio to "
+                                                        "tx_gso_packets is the average number of segments per send.")),
+                        sm::make_derive(_queue_name + "_rx_gro_segments", _stats.rx.gro_segments,
+                                        sm::description("Counts TCP segments received through software GRO.")),
+                        sm::make_derive(_queue_name + "_rx_gro_packets", _stats.rx.gro_packets,
+                                        sm::description("Counts packets software GRO handed to TCP. The ratio of "
+                                                        "rx_gro_segments to it is the GRO merge ratio.")),
+
                         //
                         // Number of packets in last bunch: GAUGE:0:U
                         //
@@ -234,14 +255,8 @@ namespace nil {
                     // special case queue sending to self only, to avoid requiring a hash value
                     return;
                 }
-                register_packet_provider([this] {
-                    boost::optional<packet> p;
-                    if (!_proxy_packetq.empty()) {
-                        p = std::move(_proxy_packetq.front());
-                        _proxy_packetq.pop_front();
-                    }
-                    return p;
-                });
+                // packets of the proxies are pulled from their rings by providers the
+                // proxies register themselves, see proxy.cc
                 build_sw_reta(cpu_weights);
             }
 
@@ -264,6 +279,18 @@ namespace nil {
                 _sw_reta = reta;
             }
 
+            uint32_t device::hash2cpu_mask() {
+                auto mask = hash2qid_mask();
+                for (unsigned cpu = 0; cpu < smp::count; ++cpu) {
+                    auto *q = _queues[cpu];
+                    // forward_dst() indexes the software table, a power of two long, above the hardware bits
+                    if (q && q->_sw_reta) {
+                        mask |= uint32_t(q->_sw_reta->size() - 1) << _rss_table_bits;
+                    }
+                }
+                return mask;
+            }
+
             future<> device::receive(std::function<future<>(packet)> next_packet) {
                 auto sub = _queues[this_shard_id()]->_rx_stream.listen(std::move(next_packet));
                 _queues[this_shard_id()]->rx_start();
@@ -328,6 +355,10 @@ namespace nil {
                 return _dev->hash2cpu(hash);
             }
 
+            uint32_t interface::hash2cpu_mask() {
+                return _dev->hash2cpu_mask();
+            }
+
             uint16_t interface::hw_queues_count() {
                 return _dev->hw_queues_count();
             }
@@ -336,6 +367,19 @@ namespace nil {
                 return _dev->rss_key();
             }
 
+            void interface::enable_sw_gso() {
+                auto hw = _dev->hw_features();
+                if (hw.tx_tso) {
+                    return;
+                }
+                _dev->local_queue().enable_sw_gso(hw);
+                _hw_features.tx_tso = true;
+            }
+
+            void interface::update_gro_stats(unsigned segments) {
+                _dev->local_queue().update_gro_stats(segments);
+            }
+
             void interface::forward(unsigned cpuid, packet p) {
                 static __thread unsigned queue_depth;
 
@@ -0,0 +1,287 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <algorithm>
+#include <cstring>
+
+#include <nil/actor/network/offload.hh>
+#include <nil/actor/network/ethernet.hh>
+#include <nil/actor/network/ip.hh>
+#include <nil/actor/network/tcp.hh>
+#include <nil/actor/core/reactor.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            namespace {
+
+                // Byte offsets in the IPv4 header
+                constexpr size_t ip_len_off = 2;
+                constexpr size_t ip_proto_off = 9;
+                constexpr size_t ip_csum_off = 10;
+                constexpr size_t ip_src_off = 12;
+                constexpr size_t ip_dst_off = 16;
+
+                // Byte offsets in the TCP header
+                constexpr size_t tcp_seq_off = 4;
+                constexpr size_t tcp_flags_off = 13;
+                constexpr uint8_t tcp_flag_psh = 0x08;
+                constexpr uint8_t tcp_flag_ack = 0x10;
+
+                void sum_from(checksummer &csum, const packet &p, size_t offset) {
+                    for (auto &&f : p.fragments()) {
+                        if (offset >= f.size) {
+                            offset -= f.size;
+                            continue;
+                        }
+                        csum.sum(f.base + offset, f.size - offset);
+                        offset = 0;
+                    }
+                }
+
+            }    // namespace
+
+            size_t tcp_gso_segment(packet p, const hw_features &hw, circular_buffer<packet> &out) {
+                auto oi = p.offload_info();
+                auto seg_size = oi.tso_seg_size;
+                auto eh = p.get_header<eth_hdr>();
+                if (!seg_size || !eh || ntoh(eh->eth_proto) != uint16_t(eth_protocol_num::ipv4)) {
+                    out.push_back(std::move(p));
+                    return 1;
+                }
+                auto ip = p.get_header(sizeof(eth_hdr), ipv4_hdr_len_min);
+                if (!ip || uint8_t(ip[ip_proto_off]) != uint8_t(ip_protocol_num::tcp)) {
+                    out.push_back(std::move(p));
+                    return 1;
+                }
+                size_t tcp_off = sizeof(eth_hdr) + (ip[0] & 15) * 4;
+                auto th = p.get_header(tcp_off, tcp_hdr::len);
+                if (!th) {
+                    out.push_back(std::move(p));
+                    return 1;
+                }
+                size_t tcp_hdr_len = (uint8_t(th[12]) >> 4) * 4;
+                size_t hdr_len = tcp_off + tcp_hdr_len;
+                std::array<char, sizeof(eth_hdr) + 60 + 60> hdr;
+                auto h = p.get_header(0, hdr_len);
+                if (!h || hdr_len > hdr.size()) {
+                    out.push_back(std::move(p));
+                    return 1;
+                }
+                std::copy_n(h, hdr_len, hdr.begin());
+
+                auto tcp = tcp_hdr::read(hdr.data() + tcp_off);
+                auto ip_len = read_be<uint16_t>(hdr.data() + sizeof(eth_hdr) + ip_len_off);
+                auto ip_csum = read_be<uint16_t>(hdr.data() + sizeof(eth_hdr) + ip_csum_off);
+                // Ones' complement sum of the pseudo header without the segment length
+                auto pseudo_sum = tcp.checksum;
+                oi.tso_seg_size = 0;
+                oi.needs_csum = hw.tx_csum_l4_offload;
+
+                size_t payload_len = p.len() - hdr_len;
+                size_t nr_segments = 0;
+                size_t off = 0;
+                do {
+                    size_t len = std::min(payload_len - off, size_t(seg_size));
+                    bool last = off + len == payload_len;
+                    auto s = p.share(hdr_len + off, len);
+                    auto sh = s.prepend_uninitialized_header(hdr_len);
+                    std::copy_n(hdr.data(), hdr_len, sh);
+
+                    uint16_t seg_ip_len = hdr_len - sizeof(eth_hdr) + len;
+                    write_be<uint16_t>(sh + sizeof(eth_hdr) + ip_len_off, seg_ip_len);
+                    if (!hw.tx_csum_ip_offload) {
+                        // HC' = ~(~HC + ~m + m')
+                        checksummer csum;
+                        csum.sum_many(uint16_t(~ip_csum), uint16_t(~ip_len), seg_ip_len);
+                        write_be<uint16_t>(sh + sizeof(eth_hdr) + ip_csum_off, ntoh(csum.get()));
+                    }
+
+                    auto seg = tcp;
+                    seg.seq += int32_t(off);
+                    if (!last) {
+                        seg.f_fin = false;
+                        seg.f_psh = false;
+                    }
+                    seg.checksum = 0;
+                    seg.write(sh + tcp_off);
+                    checksummer csum;
+                    csum.sum_many(pseudo_sum, uint16_t(tcp_hdr_len + len));
+                    if (hw.tx_csum_l4_offload) {
+                        tcp_hdr::write_nbo_checksum(sh + tcp_off, uint16_t(~csum.get()));
+                    } else {
+                        sum_from(csum, s, tcp_off);
+                        tcp_hdr::write_nbo_checksum(sh + tcp_off, csum.get());
+                    }
+                    s.set_offload_info(oi);
+                    out.push_back(std::move(s));
+                    ++nr_segments;
+                    off += len;
+                } while (off < payload_len);
+                return nr_segments;
+            }
+
+            tcp_gro::tcp_gro(bool verify_csum, deliver_fn deliver) :
+                _verify_csum(verify_csum), _deliver(std::move(deliver)),
+                _flush_poller(std::make_unique<detail::poller>(reactor::poller::simple([this] { return flush(); }))) {
+                _flows.reserve(max_flows);
+            }
+
+            tcp_gro::~tcp_gro() {
+            }
+
+            void tcp_gro::deliver(flow &f) {
+                auto p = std::move(f.p);
+                if (f.segments > 1) {
+                    // Keep the IP total length consistent with the coalesced payload
+                    write_be<uint16_t>(p.get_header(ip_len_off, 2), uint16_t(p.len()));
+                }
+                _deliver(std::move(p), f.segments);
+            }
+
+            void tcp_gro::flush_flow(uint32_t src, uint32_t dst, uint32_t ports) {
+                auto i = std::find_if(_flows.begin(), _flows.end(), [&](const flow &f) {
+                    return f.src == src && f.dst == dst && f.ports == ports;
+                });
+                if (i != _flows.end()) {
+                    deliver(*i);
+                    _flows.erase(i);
+                }
+            }
+
+            bool tcp_gro::flush() {
+                if (_flows.empty()) {
+                    return false;
+                }
+                for (auto &&f : _flows) {
+                    deliver(f);
+                }
+                _flows.clear();
+                return true;
+            }
+
+            void tcp_gro::receive(packet p) {
+                auto ip = p.get_header(0, ipv4_hdr_len_min);
+                if (!ip) {
+                    _deliver(std::move(p), 1);
+                    return;
+                }
+                size_t ip_hdr_len = (ip[0] & 15) * 4;
+                auto src = read_be<uint32_t>(ip + ip_src_off);
+                auto dst = read_be<uint32_t>(ip + ip_dst_off);
+                auto th = p.get_header(ip_hdr_len, tcp_hdr::len);
+                if (!th) {
+                    _deliver(std::move(p), 1);
+                    return;
+                }
+                size_t tcp_hdr_len = (uint8_t(th[12]) >> 4) * 4;
+                size_t hdr_len = ip_hdr_len + tcp_hdr_len;
+                auto ports = read_be<uint32_t>(th);
+                if (tcp_hdr_len < tcp_hdr::len || p.len() < hdr_len) {
+                    _deliver(std::move(p), 1);
+                    return;
+                }
+
+                if (_verify_csum) {
+                    checksummer csum;
+                    csum.sum_many(src, dst, uint8_t(0), uint8_t(ip_protocol_num::tcp), uint16_t(p.len() - ip_hdr_len));
+                    sum_from(csum, p, ip_hdr_len);
+                    if (csum.get() != 0) {
+                        // Let TCP drop it
+                        _deliver(std::move(p), 1);
+                        return;
+                    }
+                }
+                p.offload_info_ref().rx_csum_verified = true;
+
+                th = p.get_header(ip_hdr_len, tcp_hdr_len);
+                auto flags = uint8_t(th[tcp_flags_off]);
+                size_t len = p.len() - hdr_len;
+                // Pure ACKs and control segments are not held, they are rarely
+                // followed by something they could be coalesced with.
+                if (!len || (flags & ~tcp_flag_psh) != tcp_flag_ack || ip_hdr_len != ipv4_hdr_len_min) {
+                    flush_flow(src, dst, ports);
+                    _deliver(std::move(p), 1);
+                    return;
+                }
+
+                auto seq = read_be<uint32_t>(th + tcp_seq_off);
+                auto i = std::find_if(_flows.begin(), _flows.end(), [&](const flow &f) {
+                    return f.src == src && f.dst == dst && f.ports == ports;
+                });
+                if (i != _flows.end()) {
+                    auto &f = *i;
+                    // Acknowledgment, data offset, window and options must match;
+                    // the flags differ in PSH at most.
+                    bool same_hdr = f.hdr_len == hdr_len && std::equal(th + 8, th + 13, f.tcp_hdr.data() + 8) &&
+                                    std::equal(th + 14, th + 16, f.tcp_hdr.data() + 14) &&
+                                    std::equal(th + tcp_hdr::len, th + tcp_hdr_len, f.tcp_hdr.data() + tcp_hdr::len);
+                    if (same_hdr && seq == f.next_seq && len <= f.seg_size &&
+                        f.p.len() + len <= ip_packet_len_max) {
+                        p.trim_front(hdr_len);
+                        f.p.append(std::move(p));
+                        f.next_seq += len;
+                        ++f.segments;
+                        if (flags & tcp_flag_psh) {
+                            auto fth = f.p.get_header(ip_hdr_len, tcp_hdr::len);
+                            fth[tcp_flags_off] |= tcp_flag_psh;
+                        }
+                        // A short segment ends the burst
+                        if ((flags & tcp_flag_psh) || len < f.seg_size ||
+                            f.p.len() + f.seg_size > ip_packet_len_max) {
+                            deliver(f);
+                            _flows.erase(i);
+                        }
+                        return;
+                    }
+                    deliver(f);
+                    _flows.erase(i);
+                }
+                if (flags & tcp_flag_psh) {
+                    _deliver(std::move(p), 1);
+                    return;
+                }
+                if (_flows.size() == max_flows) {
+                    deliver(_flows.front());
+                    _flows.erase(_flows.begin());
+                }
+                flow f;
+                f.src = src;
+                f.dst = dst;
+                f.ports = ports;
+                f.next_seq = seq + len;
+                f.seg_size = len;
+                f.hdr_len = hdr_len;
+                f.segments = 1;
+                std::copy_n(th, tcp_hdr_len, f.tcp_hdr.begin());
+                f.p = std::move(p);
+                _flows.push_back(std::move(f));
+            }
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
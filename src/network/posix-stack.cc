@@ -22,6 +22,7 @@
 // SOFTWARE.
 //---------------------------------------------------------------------------//
 
+#include <algorithm>
 #include <random>
 
 #include <sys/socket.h>
@@ -255,6 +256,7 @@ namespace nil {
                 const posix_connected_socket_operations *_ops;
                 conntrack::handle _handle;
                 boost::container::pmr::polymorphic_allocator<char> *_allocator;
+                lw_shared_ptr<size_t> _read_size_hint = make_lw_shared<size_t>(0);
 
             private:
                 explicit posix_connected_socket_impl(
@@ -276,7 +278,11 @@ namespace nil {
                     return source(connected_socket_input_stream_config());
                 }
                 virtual data_source source(connected_socket_input_stream_config csisc) override {
-                    return data_source(std::make_unique<posix_data_source_impl>(_fd, csisc, _allocator));
+                    return data_source(
+                        std::make_unique<posix_data_source_impl>(_fd, csisc, _allocator, _read_size_hint));
+                }
+                virtual void set_read_size_hint(size_t size) override {
+                    *_read_size_hint = size;
                 }
                 virtual data_sink sink() override {
                     return data_sink(std::make_unique<posix_data_sink_impl>(_fd));
@@ -543,6 +549,8 @@ namespace nil {
                                 return _conntrack.get_handle(ntoh(sa.as_posix_sockaddr_in().sin_port) % smp::count);
                             case server_socket::load_balancing_algorithm::fixed:
                                 return _conntrack.get_handle(_fixed_cpu);
+                            case server_socket::load_balancing_algorithm::activity:
+                                return _conntrack.get_handle(*_policy, sa);
                             default:
                                 abort();
                         }
@@ -650,6 +658,11 @@ namespace nil {
             future<temporary_buffer<char>> posix_data_source_impl::get() {
                 return _fd.read_some(static_cast<detail::buffer_allocator *>(this))
                     .then([this](temporary_buffer<char> b) {
+                        account_connection_io(b.size());
+                        // A read sized after the hint says nothing about the next ones
+                        if (std::exchange(_hinted, false)) {
+                            return b;
+                        }
                         if (b.size() >= _config.buffer_size) {
                             _config.buffer_size *= 2;
                             _config.buffer_size = std::min(_config.buffer_size, _config.max_buffer_size);
@@ -662,6 +675,12 @@ namespace nil {
             }
 
             temporary_buffer<char> posix_data_source_impl::allocate_buffer() {
+                if (*_read_size_hint) {
+                    auto size = std::clamp<size_t>(*_read_size_hint, _config.min_buffer_size, _config.max_buffer_size);
+                    *_read_size_hint = 0;
+                    _hinted = true;
+                    return make_temporary_buffer<char>(_buffer_allocator, size);
+                }
                 return make_temporary_buffer<char>(_buffer_allocator, _config.buffer_size);
             }
 
@@ -689,10 +708,12 @@ namespace nil {
             }
 
             future<> posix_data_sink_impl::put(temporary_buffer<char> buf) {
+                account_connection_io(buf.size());
                 return _fd.write_all(buf.get(), buf.size()).then([d = buf.release()] {});
             }
 
             future<> posix_data_sink_impl::put(packet p) {
+                account_connection_io(p.len());
                 _p = std::move(p);
                 return _fd.write_all(_p).then([this] { _p.reset(); });
             }
@@ -702,6 +723,11 @@ namespace nil {
                 return make_ready_future<>();
             }
 
+            // Activity balancing needs all connections to be accepted by one shard
+            static bool use_reuseport(bool available, const listen_options &opt) {
+                return available && opt.lba != server_socket::load_balancing_algorithm::activity;
+            }
+
             posix_network_stack::posix_network_stack(boost::program_options::variables_map opts,
                                                      boost::container::pmr::polymorphic_allocator<char> *allocator) :
                 _reuseport(engine().posix_reuseport_available()),
@@ -716,14 +742,14 @@ namespace nil {
                 }
                 if (sa.is_af_unix()) {
                     return server_socket(std::make_unique<posix_server_socket_impl>(
-                        0, sa, engine().posix_listen(sa, opt), opt.lba, opt.fixed_cpu, _allocator));
+                        0, sa, engine().posix_listen(sa, opt), opt, _allocator));
                 }
                 auto protocol = static_cast<int>(opt.proto);
-                return _reuseport ?
+                return use_reuseport(_reuseport, opt) ?
                            server_socket(std::make_unique<posix_reuseport_server_socket_impl>(
                                protocol, sa, engine().posix_listen(sa, opt), _allocator)) :
                            server_socket(std::make_unique<posix_server_socket_impl>(
-                               protocol, sa, engine().posix_listen(sa, opt), opt.lba, opt.fixed_cpu, _allocator));
+                               protocol, sa, engine().posix_listen(sa, opt), opt, _allocator));
             }
 
             ::nil::actor::socket posix_network_stack::socket() {
@@ -747,7 +773,7 @@ namespace nil {
                     return server_socket(std::make_unique<posix_ap_server_socket_impl>(0, sa, _allocator));
                 }
                 auto protocol = static_cast<int>(opt.proto);
-                return _reuseport ?
+                return use_reuseport(_reuseport, opt) ?
                            server_socket(std::make_unique<posix_reuseport_server_socket_impl>(
                                protocol, sa, engine().posix_listen(sa, opt), _allocator)) :
                            server_socket(std::make_unique<posix_ap_server_socket_impl>(protocol, sa, _allocator));
@@ -21,57 +21,134 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 //---------------------------------------------------------------------------//
-
 #include <nil/actor/network/proxy.hh>
+#include <nil/actor/network/detail/proxy.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/metrics.hh>
+
+#include <cassert>
 #include <utility>
+#include <vector>
 
 namespace nil {
     namespace actor {
 
         namespace net {
 
-            class proxy_net_device : public qp {
-            private:
-                static constexpr size_t _send_queue_length = 128;
-                size_t _send_depth = 0;
-                unsigned _cpu;
-                device *_dev;
-                std::vector<packet> _moving;
+            proxy_net_device::proxy_net_device(unsigned cpu, device *dev) :
+                _cpu(cpu), _dev(dev), _channel(std::make_shared<channel>()),
+                _free_poller(reactor::poller::simple([this] { return reclaim(); })) {
+                namespace sm = metrics;
+                _metrics.add_group(
+                    _stats_plugin_name,
+                    {
+                        sm::make_gauge(_queue_name + "_proxy_ring_occupancy", [this] { return _channel->packets.size(); },
+                                       sm::description("Holds a number of packets waiting in the ring for the master "
+                                                       "shard to pick them up.")),
+                        sm::make_gauge(_queue_name + "_proxy_in_flight", _send_depth,
+                                       sm::description(format("Holds a number of forwarded packets not freed yet. "
+                                                              "Forwarding stops once it reaches {}.",
+                                                              _send_queue_length))),
+                        sm::make_derive(_queue_name + "_proxy_forwarded", _forwarded,
+                                        sm::description("Counts packets handed to the master shard.")),
+                        sm::make_derive(_queue_name + "_proxy_backpressure", _backpressure,
+                                        sm::description("Counts Tx attempts that left packets queued because too "
+                                                        "many forwarded packets were in flight. Packets are never "
+                                                        "dropped by the proxy.")),
+                        sm::make_derive(_queue_name + "_proxy_doorbells", _doorbells,
+                                        sm::description("Counts wake-up messages sent to the master shard.")),
+                        sm::make_derive(_queue_name + "_proxy_free_batches", _free_batches,
+                                        sm::description("Counts polls that found deleters returned by the master "
+                                                        "shard.")),
+                    });
+            }
 
-            public:
-                explicit proxy_net_device(unsigned cpu, device *dev);
-                virtual future<> send(packet p) override {
-                    abort();
+            void proxy_net_device::attach() {
+                // The master queue may not exist yet while the proxies are being created,
+                // so its provider is registered on the first send
+                _attaching = true;
+                // FIXME: future is discarded
+                (void)smp::submit_to(_cpu, [dev = _dev, ch = _channel] {
+                    dev->local_queue().register_packet_provider([ch] { return ch->packets.pop(); });
+                }).then([this] {
+                    _attaching = false;
+                    _attached = true;
+                });
+            }
+
+            void proxy_net_device::ring_doorbell() {
+                if (_doorbell_pending) {
+                    return;
                 }
-                virtual uint32_t send(circular_buffer<packet> &p) override;
-            };
+                _doorbell_pending = true;
+                _doorbells++;
+                // Delivering the message is enough to have the master poll its queue.
+                // Packets pushed after it was handled could be missed if the master went
+                // idle meanwhile, so ring again if the ring is still not empty.
+                // FIXME: future is discarded
+                (void)smp::submit_to(_cpu, [] {}).then([this] {
+                    _doorbell_pending = false;
+                    if (_channel->packets.size()) {
+                        ring_doorbell();
+                    }
+                });
+            }
 
-            proxy_net_device::proxy_net_device(unsigned cpu, device *dev) : _cpu(cpu), _dev(dev) {
-                _moving.reserve(_send_queue_length);
+            bool proxy_net_device::reclaim() {
+                size_t n = 0;
+                while (auto held = _channel->frees.pop()) {
+                    // running the deleters here, on the shard that created the packets
+                    n += held->size();
+                    held->clear();
+                }
+                if (n) {
+                    _send_depth -= n;
+                    _free_batches++;
+                }
+                return n;
             }
 
             uint32_t proxy_net_device::send(circular_buffer<packet> &p) {
-                if (!_moving.empty() || _send_depth == _send_queue_length) {
+                if (!_attached) {
+                    if (!_attaching) {
+                        attach();
+                    }
                     return 0;
                 }
-
-                for (; !p.empty() && _send_depth < _send_queue_length; _send_depth++) {
-                    _moving.push_back(std::move(p.front()));
-                    p.pop_front();
+                reclaim();
+                if (_send_depth == _send_queue_length) {
+                    _backpressure++;
+                    return 0;
                 }
 
-                if (!_moving.empty()) {
-                    qp *dev = &_dev->queue_for_cpu(_cpu);
-                    auto cpu = this_shard_id();
-                    // FIXME: future is discarded
-                    (void)smp::submit_to(_cpu, [this, dev, cpu]() mutable {
-                        for (size_t i = 0; i < _moving.size(); i++) {
-                            dev->proxy_send(_moving[i].free_on_cpu(cpu, [this] { _send_depth--; }));
-                        }
-                    }).then([this] { _moving.clear(); });
+                auto n = std::min(p.size(), _send_queue_length - _send_depth);
+                if (!n) {
+                    return 0;
+                }
+                // Swap the deleters before publishing anything: once in the ring the
+                // packets belong to the master
+                std::vector<deleter> held;
+                held.reserve(n);
+                for (size_t i = 0; i < n; ++i) {
+                    held.push_back(p[i].exchange_deleter(deleter()));
+                }
+                auto batch = make_deleter(deleter(), [ch = _channel, held = std::move(held)]() mutable {
+                    auto pushed = ch->frees.push(std::move(held));
+                    // _send_queue_length bounds the batches in flight
+                    assert(pushed);
+                    (void)pushed;
+                });
+                // The master drops the references, so none may be left here
+                for (size_t i = 0; i < n; ++i) {
+                    p[i].exchange_deleter(i + 1 < n ? batch.share() : std::move(batch));
                 }
+                auto sent = _channel->packets.push(p, n);
+                assert(sent == n);
+                _send_depth += sent;
+                _forwarded += sent;
+                ring_doorbell();
 
-                return _moving.size();
+                return sent;
             }
 
             std::unique_ptr<qp> create_proxy_net_device(unsigned master_cpu, device *dev) {
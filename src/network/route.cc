@@ -0,0 +1,144 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <algorithm>
+
+#include <nil/actor/network/route.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            static uint32_t prefix_mask(uint8_t length) {
+                return length ? ~uint32_t(0) << (32 - length) : 0;
+            }
+
+            ipv4_route_table::ipv4_route_table() : _level1(size_t(1) << 16, 0) {
+            }
+
+            void ipv4_route_table::add(ipv4_route r) {
+                r.prefix &= prefix_mask(r.length);
+                auto i = std::find_if(_routes.begin(), _routes.end(), [&r](const ipv4_route &x) {
+                    return x.prefix == r.prefix && x.length == r.length;
+                });
+                if (i != _routes.end()) {
+                    *i = r;
+                } else {
+                    _routes.push_back(r);
+                }
+                rebuild();
+            }
+
+            bool ipv4_route_table::remove(uint32_t prefix, uint8_t length) {
+                prefix &= prefix_mask(length);
+                auto i = std::find_if(_routes.begin(), _routes.end(), [prefix, length](const ipv4_route &x) {
+                    return x.prefix == prefix && x.length == length;
+                });
+                if (i == _routes.end()) {
+                    return false;
+                }
+                _routes.erase(i);
+                rebuild();
+                return true;
+            }
+
+            void ipv4_route_table::assign(std::vector<ipv4_route> routes) {
+                for (auto &&r : routes) {
+                    r.prefix &= prefix_mask(r.length);
+                }
+                // Sorting keeps duplicates in their original order, the last one wins
+                std::stable_sort(routes.begin(), routes.end(), [](const ipv4_route &a, const ipv4_route &b) {
+                    return a.length < b.length || (a.length == b.length && a.prefix < b.prefix);
+                });
+                _routes.clear();
+                for (auto &&r : routes) {
+                    if (!_routes.empty() && _routes.back().length == r.length && _routes.back().prefix == r.prefix) {
+                        _routes.back() = r;
+                    } else {
+                        _routes.push_back(r);
+                    }
+                }
+                rebuild();
+            }
+
+            uint32_t ipv4_route_table::next_hop_entry(const ipv4_route &r) {
+                auto i = std::find_if(_next_hops.begin(), _next_hops.end(), [&r](const next_hop &nh) {
+                    return nh.gateway == r.gateway && nh.source == r.source;
+                });
+                if (i == _next_hops.end()) {
+                    i = _next_hops.insert(i, next_hop {r.gateway, r.source});
+                }
+                return uint32_t(i - _next_hops.begin()) + 1;
+            }
+
+            uint32_t ipv4_route_table::chunk_for(std::vector<std::array<uint32_t, 256>> &level, uint32_t &entry) {
+                if (entry & chunk_bit) {
+                    return entry & ~chunk_bit;
+                }
+                // The new chunk inherits the shorter prefix covering it
+                std::array<uint32_t, 256> chunk;
+                chunk.fill(entry);
+                level.push_back(chunk);
+                entry = uint32_t(level.size() - 1) | chunk_bit;
+                return uint32_t(level.size() - 1);
+            }
+
+            void ipv4_route_table::rebuild() {
+                std::fill(_level1.begin(), _level1.end(), 0);
+                _level2.clear();
+                _level3.clear();
+                _next_hops.clear();
+
+                // Shorter prefixes first, so that longer ones overwrite what they cover
+                auto routes = _routes;
+                std::stable_sort(routes.begin(), routes.end(),
+                                 [](const ipv4_route &a, const ipv4_route &b) { return a.length < b.length; });
+                for (auto &&r : routes) {
+                    auto nh = next_hop_entry(r);
+                    auto &l1 = _level1[r.prefix >> 16];
+                    if (r.length <= 16) {
+                        std::fill_n(&l1, size_t(1) << (16 - r.length), nh);
+                        continue;
+                    }
+                    auto &l2 = _level2[chunk_for(_level2, l1)];
+                    if (r.length <= 24) {
+                        std::fill_n(&l2[(r.prefix >> 8) & 0xff], size_t(1) << (24 - r.length), nh);
+                        continue;
+                    }
+                    auto &l3 = _level3[chunk_for(_level3, l2[(r.prefix >> 8) & 0xff])];
+                    std::fill_n(&l3[r.prefix & 0xff], size_t(1) << (32 - r.length), nh);
+                }
+
+                // Invalidates the lookup cache
+                if (++_generation == 0) {
+                    _cache = {};
+                    _generation = 1;
+                }
+            }
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,690 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/network/shm_socket.hh>
+#include <nil/actor/network/stack.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/posix.hh>
+#include <nil/actor/core/iostream.hh>
+#include <nil/actor/core/condition_variable.hh>
+#include <nil/actor/core/shared_ptr.hh>
+#include <nil/actor/detail/log.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <array>
+#include <deque>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            namespace shm {
+
+                static logger shm_log("shm_socket");
+
+                // Shared memory layout: a header holding the state of both rings,
+                // followed by the data of the ring of side 0 (the connecting side) and
+                // the data of the ring of side 1. Each side produces into its own ring
+                // and consumes from the other one.
+                struct ring_state {
+                    alignas(64) std::atomic<uint64_t> head;    // written by the producer only
+                    std::atomic<uint32_t> producer_waiting;
+                    std::atomic<uint32_t> producer_closed;
+                    alignas(64) std::atomic<uint64_t> tail;    // written by the consumer only
+                    std::atomic<uint32_t> consumer_waiting;
+                    std::atomic<uint32_t> consumer_closed;
+                };
+
+                struct channel_header {
+                    static constexpr uint32_t magic_value = 0x72706373;    // "rpcs"
+                    std::atomic<uint32_t> magic;
+                    uint64_t ring_size;
+                    ring_state rings[2];
+                };
+
+                static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                              "rings are shared between processes and need lock-free atomics");
+
+                static constexpr size_t header_size = 4096;
+                static_assert(sizeof(channel_header) <= header_size);
+
+                // Sent by the connecting side along with the memory file and the eventfds
+                struct hello {
+                    uint32_t magic;
+                    uint32_t fds;
+                    uint64_t ring_size;
+                };
+
+                static constexpr unsigned hello_fds = 3;    // memory file, eventfd of side 0, eventfd of side 1
+
+                static constexpr uint64_t min_ring_size = 4096;
+                static constexpr uint64_t max_ring_size = uint64_t(1) << 32;
+
+                static size_t mapping_size(uint64_t ring_size) {
+                    return header_size + 2 * ring_size;
+                }
+
+                struct mapping {
+                    void *area = MAP_FAILED;
+                    size_t size = 0;
+
+                    mapping(int fd, size_t size) : size(size) {
+                        area = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                        throw_system_error_on(area == MAP_FAILED, "mmap");
+                    }
+                    mapping(mapping &&x) noexcept : area(std::exchange(x.area, MAP_FAILED)), size(x.size) {
+                    }
+                    ~mapping() {
+                        if (area != MAP_FAILED) {
+                            ::munmap(area, size);
+                        }
+                    }
+                    channel_header &header() const {
+                        return *static_cast<channel_header *>(area);
+                    }
+                    char *data(unsigned side) const {
+                        return static_cast<char *>(area) + header_size + side * header().ring_size;
+                    }
+                };
+
+                // One end of a connection. Readers and writers of this end sleep on
+                // _cv, which is signalled whenever the peer rings our eventfd, the peer
+                // goes away or this end is shut down.
+                class channel : public enable_lw_shared_from_this<channel> {
+                    struct segment {
+                        uint64_t end;
+                        bool released;
+                    };
+
+                    mapping _map;
+                    unsigned _side;
+                    uint64_t _ring_size;
+                    pollable_fd _doorbell;
+                    file_desc _peer_doorbell;
+                    pollable_fd _bootstrap;
+                    condition_variable _cv;
+                    bool _peer_gone = false;
+                    bool _input_done = false;
+                    bool _output_done = false;
+                    uint64_t _write_pos = 0;
+                    // Bytes up to _read_pos were handed out, bytes up to _consumed were
+                    // handed out and released, in order, so that the peer may reuse them.
+                    uint64_t _read_pos = 0;
+                    uint64_t _consumed = 0;
+                    std::deque<segment> _segments;
+                    uint64_t _first_segment = 0;
+                    uint64_t _doorbell_value;
+                    char _bootstrap_byte;
+
+                private:
+                    ring_state &out_ring() {
+                        return _map.header().rings[_side];
+                    }
+                    ring_state &in_ring() {
+                        return _map.header().rings[1 - _side];
+                    }
+                    void kick_peer() {
+                        uint64_t one = 1;
+                        _peer_doorbell.write(&one, sizeof(one));
+                    }
+                    temporary_buffer<char> take(uint64_t head);
+                    void release(uint64_t seq);
+                    void copy_into_ring(const packet &p, size_t from, size_t n);
+                    void notify_closed() noexcept;
+                    void maybe_finish();
+
+                public:
+                    channel(mapping map, unsigned side, pollable_fd doorbell, file_desc peer_doorbell,
+                            pollable_fd bootstrap) :
+                        _map(std::move(map)),
+                        _side(side), _ring_size(_map.header().ring_size), _doorbell(std::move(doorbell)),
+                        _peer_doorbell(std::move(peer_doorbell)), _bootstrap(std::move(bootstrap)) {
+                    }
+                    void start();
+                    future<temporary_buffer<char>> read();
+                    future<> write(packet p);
+                    void close_input() noexcept;
+                    void close_output() noexcept;
+                    pollable_fd &bootstrap() {
+                        return _bootstrap;
+                    }
+                };
+
+                void channel::start() {
+                    // FIXME: futures are discarded, they keep the channel alive until both
+                    // directions are closed or the peer goes away
+                    (void)repeat([this, self = shared_from_this()] {
+                        return _doorbell.read_some(reinterpret_cast<char *>(&_doorbell_value), sizeof(_doorbell_value))
+                            .then([this](size_t) {
+                                _cv.broadcast();
+                                return stop_iteration(_input_done && _output_done);
+                            });
+                    }).handle_exception([this, self = shared_from_this()](std::exception_ptr) { _cv.broadcast(); });
+                    // Nothing is sent on the bootstrap connection after the handshake, so
+                    // it only becomes readable once the peer closes it or dies.
+                    (void)_bootstrap.read_some(&_bootstrap_byte, 1)
+                        .then_wrapped([this, self = shared_from_this()](future<size_t> f) {
+                            f.ignore_ready_future();
+                            _peer_gone = true;
+                            _cv.broadcast();
+                        });
+                }
+
+                temporary_buffer<char> channel::take(uint64_t head) {
+                    auto offset = _read_pos & (_ring_size - 1);
+                    auto len = std::min(head - _read_pos, _ring_size - offset);
+                    auto data = _map.data(1 - _side) + offset;
+                    // Buffers still held by the reader block the peer; once half the ring
+                    // is held, further data is copied out so that the peer keeps going.
+                    auto held = _read_pos - _consumed;
+                    _read_pos += len;
+                    if (held >= _ring_size / 2) {
+                        temporary_buffer<char> buf(data, len);
+                        _segments.push_back({_read_pos, false});
+                        release(_first_segment + _segments.size() - 1);
+                        return buf;
+                    }
+                    _segments.push_back({_read_pos, false});
+                    auto seq = _first_segment + _segments.size() - 1;
+                    return temporary_buffer<char>(
+                        data, len, make_deleter([self = shared_from_this(), seq] { self->release(seq); }));
+                }
+
+                void channel::release(uint64_t seq) {
+                    _segments[seq - _first_segment].released = true;
+                    if (!_segments.front().released) {
+                        return;
+                    }
+                    while (!_segments.empty() && _segments.front().released) {
+                        _consumed = _segments.front().end;
+                        _segments.pop_front();
+                        ++_first_segment;
+                    }
+                    auto &r = in_ring();
+                    r.tail.store(_consumed, std::memory_order_release);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (r.producer_waiting.load(std::memory_order_relaxed)) {
+                        kick_peer();
+                    }
+                }
+
+                future<temporary_buffer<char>> channel::read() {
+                    auto &r = in_ring();
+                    if (_input_done) {
+                        return make_ready_future<temporary_buffer<char>>();
+                    }
+                    auto head = r.head.load(std::memory_order_acquire);
+                    if (head != _read_pos) {
+                        return make_ready_future<temporary_buffer<char>>(take(head));
+                    }
+                    if (r.producer_closed.load(std::memory_order_acquire) || _peer_gone) {
+                        // The producer publishes its last data before closing
+                        head = r.head.load(std::memory_order_acquire);
+                        return make_ready_future<temporary_buffer<char>>(head != _read_pos ? take(head) :
+                                                                                             temporary_buffer<char>());
+                    }
+                    r.consumer_waiting.store(1, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (r.head.load(std::memory_order_acquire) != _read_pos ||
+                        r.producer_closed.load(std::memory_order_acquire)) {
+                        r.consumer_waiting.store(0, std::memory_order_relaxed);
+                        return read();
+                    }
+                    return _cv.wait().then([this, &r] {
+                        r.consumer_waiting.store(0, std::memory_order_relaxed);
+                        return read();
+                    });
+                }
+
+                void channel::copy_into_ring(const packet &p, size_t from, size_t n) {
+                    auto data = _map.data(_side);
+                    for (auto &&f : p.fragments()) {
+                        if (from >= f.size) {
+                            from -= f.size;
+                            continue;
+                        }
+                        auto src = f.base + from;
+                        auto len = std::min<size_t>(f.size - from, n);
+                        from = 0;
+                        n -= len;
+                        while (len) {
+                            auto offset = _write_pos & (_ring_size - 1);
+                            auto chunk = std::min<size_t>(len, _ring_size - offset);
+                            std::copy_n(src, chunk, data + offset);
+                            src += chunk;
+                            len -= chunk;
+                            _write_pos += chunk;
+                        }
+                        if (!n) {
+                            break;
+                        }
+                    }
+                }
+
+                future<> channel::write(packet p) {
+                    return do_with(std::move(p), size_t(0), [this](packet &p, size_t &done) {
+                        return repeat([this, &p, &done] {
+                            auto &r = out_ring();
+                            while (done != p.len()) {
+                                if (r.consumer_closed.load(std::memory_order_acquire) || _peer_gone) {
+                                    return make_exception_future<stop_iteration>(
+                                        std::system_error(EPIPE, std::system_category(), "shm socket"));
+                                }
+                                auto tail = r.tail.load(std::memory_order_acquire);
+                                auto space = _ring_size - (_write_pos - tail);
+                                if (space) {
+                                    auto n = std::min<size_t>(space, p.len() - done);
+                                    copy_into_ring(p, done, n);
+                                    done += n;
+                                    r.head.store(_write_pos, std::memory_order_release);
+                                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                                    if (r.consumer_waiting.load(std::memory_order_relaxed)) {
+                                        kick_peer();
+                                    }
+                                    continue;
+                                }
+                                r.producer_waiting.store(1, std::memory_order_relaxed);
+                                std::atomic_thread_fence(std::memory_order_seq_cst);
+                                if (r.tail.load(std::memory_order_acquire) != tail ||
+                                    r.consumer_closed.load(std::memory_order_acquire)) {
+                                    r.producer_waiting.store(0, std::memory_order_relaxed);
+                                    continue;
+                                }
+                                return _cv.wait().then([&r] {
+                                    r.producer_waiting.store(0, std::memory_order_relaxed);
+                                    return stop_iteration::no;
+                                });
+                            }
+                            return make_ready_future<stop_iteration>(stop_iteration::yes);
+                        });
+                    });
+                }
+
+                void channel::close_input() noexcept {
+                    if (_input_done) {
+                        return;
+                    }
+                    _input_done = true;
+                    in_ring().consumer_closed.store(1, std::memory_order_release);
+                    notify_closed();
+                }
+
+                void channel::close_output() noexcept {
+                    if (_output_done) {
+                        return;
+                    }
+                    _output_done = true;
+                    out_ring().producer_closed.store(1, std::memory_order_release);
+                    notify_closed();
+                }
+
+                void channel::notify_closed() noexcept {
+                    _cv.broadcast();
+                    // Called from destructors: the ring flags are set already, so a peer
+                    // that misses the kick still sees the close on its next wake-up.
+                    try {
+                        kick_peer();
+                        maybe_finish();
+                    } catch (...) {
+                        shm_log.warn("failed to close shm channel: {}", std::current_exception());
+                    }
+                }
+
+                void channel::maybe_finish() {
+                    if (!_input_done || !_output_done) {
+                        return;
+                    }
+                    _doorbell.abort_reader();
+                    try {
+                        _bootstrap.shutdown(SHUT_RDWR);
+                    } catch (std::system_error &e) {
+                        if (e.code().value() != ENOTCONN) {
+                            throw;
+                        }
+                    }
+                }
+
+                class shm_data_source_impl final : public data_source_impl {
+                    lw_shared_ptr<channel> _chan;
+
+                public:
+                    explicit shm_data_source_impl(lw_shared_ptr<channel> chan) : _chan(std::move(chan)) {
+                    }
+                    ~shm_data_source_impl() {
+                        _chan->close_input();
+                    }
+                    virtual future<temporary_buffer<char>> get() override {
+                        return _chan->read();
+                    }
+                    virtual future<> close() override {
+                        _chan->close_input();
+                        return make_ready_future<>();
+                    }
+                };
+
+                class shm_data_sink_impl final : public data_sink_impl {
+                    lw_shared_ptr<channel> _chan;
+
+                public:
+                    explicit shm_data_sink_impl(lw_shared_ptr<channel> chan) : _chan(std::move(chan)) {
+                    }
+                    ~shm_data_sink_impl() {
+                        _chan->close_output();
+                    }
+                    virtual future<> put(packet p) override {
+                        return _chan->write(std::move(p));
+                    }
+                    virtual future<> close() override {
+                        _chan->close_output();
+                        return make_ready_future<>();
+                    }
+                };
+
+                class shm_connected_socket_impl final : public connected_socket_impl {
+                    lw_shared_ptr<channel> _chan;
+                    bool _source_taken = false;
+                    bool _sink_taken = false;
+
+                public:
+                    explicit shm_connected_socket_impl(lw_shared_ptr<channel> chan) : _chan(std::move(chan)) {
+                    }
+                    ~shm_connected_socket_impl() {
+                        if (!_source_taken) {
+                            _chan->close_input();
+                        }
+                        if (!_sink_taken) {
+                            _chan->close_output();
+                        }
+                    }
+                    virtual data_source source() override {
+                        _source_taken = true;
+                        return data_source(std::make_unique<shm_data_source_impl>(_chan));
+                    }
+                    virtual data_sink sink() override {
+                        _sink_taken = true;
+                        return data_sink(std::make_unique<shm_data_sink_impl>(_chan));
+                    }
+                    virtual void shutdown_input() override {
+                        _chan->close_input();
+                    }
+                    virtual void shutdown_output() override {
+                        _chan->close_output();
+                    }
+                    // Frames are visible to the peer as soon as they are written
+                    virtual void set_nodelay(bool nodelay) override {
+                    }
+                    virtual bool get_nodelay() const override {
+                        return true;
+                    }
+                    void set_keepalive(bool keepalive) override {
+                    }
+                    bool get_keepalive() const override {
+                        return false;
+                    }
+                    void set_keepalive_parameters(const keepalive_params &p) override {
+                    }
+                    keepalive_params get_keepalive_parameters() const override {
+                        return keepalive_params {};
+                    }
+                    void set_sockopt(int level, int optname, const void *data, size_t len) override {
+                        _chan->bootstrap().get_file_desc().setsockopt(level, optname, data, socklen_t(len));
+                    }
+                    int get_sockopt(int level, int optname, void *data, size_t len) const override {
+                        return _chan->bootstrap().get_file_desc().getsockopt(level, optname,
+                                                                             reinterpret_cast<char *>(data),
+                                                                             socklen_t(len));
+                    }
+                };
+
+                static connected_socket make_connected_socket(mapping map, unsigned side, file_desc doorbell,
+                                                              file_desc peer_doorbell, pollable_fd bootstrap) {
+                    auto chan = make_lw_shared<channel>(std::move(map), side, pollable_fd(std::move(doorbell)),
+                                                        std::move(peer_doorbell), std::move(bootstrap));
+                    chan->start();
+                    return connected_socket(std::make_unique<shm_connected_socket_impl>(std::move(chan)));
+                }
+
+                struct handshake {
+                    hello payload;
+                    struct iovec iov;
+                    struct msghdr msg;
+                    union {
+                        struct cmsghdr align;
+                        char buf[CMSG_SPACE(sizeof(int) * hello_fds)];
+                    } control;
+                    char ack = 0;
+
+                    handshake() {
+                        std::memset(&msg, 0, sizeof(msg));
+                        std::memset(&control, 0, sizeof(control));
+                        iov.iov_base = &payload;
+                        iov.iov_len = sizeof(payload);
+                        msg.msg_iov = &iov;
+                        msg.msg_iovlen = 1;
+                        msg.msg_control = control.buf;
+                        msg.msg_controllen = sizeof(control.buf);
+                    }
+                    int *fds() {
+                        return reinterpret_cast<int *>(CMSG_DATA(CMSG_FIRSTHDR(&msg)));
+                    }
+                };
+
+                class shm_socket_impl final : public socket_impl {
+                    shm_socket_options _opts;
+                    pollable_fd _fd;
+
+                    future<connected_socket> do_connect(socket_address sa, socket_address local);
+
+                public:
+                    explicit shm_socket_impl(const shm_socket_options &opts) : _opts(opts) {
+                    }
+                    virtual future<connected_socket> connect(socket_address sa, socket_address local,
+                                                             transport proto = transport::TCP) override {
+                        return futurize_invoke([this, sa, local] { return do_connect(sa, local); });
+                    }
+                    void set_reuseaddr(bool reuseaddr) override {
+                    }
+                    bool get_reuseaddr() const override {
+                        return false;
+                    }
+                    virtual void shutdown() override {
+                        if (_fd) {
+                            try {
+                                _fd.shutdown(SHUT_RDWR);
+                            } catch (std::system_error &e) {
+                                if (e.code().value() != ENOTCONN) {
+                                    throw;
+                                }
+                            }
+                        }
+                    }
+                };
+
+                future<connected_socket> shm_socket_impl::do_connect(socket_address sa, socket_address local) {
+                    if (!sa.is_af_unix()) {
+                        throw std::invalid_argument("shm sockets connect to unix domain addresses");
+                    }
+                    if (local.is_unspecified()) {
+                        local = socket_address {unix_domain_addr {std::string {}}};
+                    }
+                    uint64_t ring_size = min_ring_size;
+                    while (ring_size < std::min<uint64_t>(_opts.ring_size, max_ring_size)) {
+                        ring_size <<= 1;
+                    }
+                    auto hs = std::make_unique<handshake>();
+                    auto memfd = ::memfd_create("actor-shm-socket", MFD_CLOEXEC);
+                    throw_system_error_on(memfd < 0, "memfd_create");
+                    auto memory = file_desc::from_fd(memfd);
+                    throw_system_error_on(::ftruncate(memory.get(), mapping_size(ring_size)) < 0, "ftruncate");
+                    mapping map(memory.get(), mapping_size(ring_size));
+                    map.header().ring_size = ring_size;
+                    map.header().magic.store(channel_header::magic_value, std::memory_order_release);
+                    auto doorbells = std::make_unique<std::array<file_desc, 2>>(
+                        std::array<file_desc, 2> {file_desc::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK),
+                                                  file_desc::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)});
+
+                    hs->payload = {channel_header::magic_value, hello_fds, ring_size};
+                    auto cmsg = CMSG_FIRSTHDR(&hs->msg);
+                    cmsg->cmsg_level = SOL_SOCKET;
+                    cmsg->cmsg_type = SCM_RIGHTS;
+                    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * hello_fds);
+                    hs->fds()[0] = memory.get();
+                    hs->fds()[1] = (*doorbells)[0].get();
+                    hs->fds()[2] = (*doorbells)[1].get();
+
+                    _fd = engine().make_pollable_fd(sa, 0);
+                    return engine()
+                        .posix_connect(_fd, sa, local)
+                        .then([fd = _fd, hs = hs.get()]() mutable { return fd.sendmsg(&hs->msg); })
+                        .then([fd = _fd, hs = hs.get()](size_t sent) mutable {
+                            if (sent != sizeof(hello)) {
+                                throw std::runtime_error("shm socket handshake was cut short");
+                            }
+                            return fd.read_some(&hs->ack, 1);
+                        })
+                        .then([fd = _fd, hs = std::move(hs), memory = std::move(memory), map = std::move(map),
+                               doorbells = std::move(doorbells)](size_t received) mutable {
+                            if (received != 1) {
+                                throw std::runtime_error("shm socket handshake was rejected by the peer");
+                            }
+                            // The peer mapped the memory file, our copy of it is not needed
+                            return make_connected_socket(std::move(map), 0, std::move((*doorbells)[0]),
+                                                         std::move((*doorbells)[1]), std::move(fd));
+                        });
+                }
+
+                class shm_server_socket_impl final : public server_socket_impl {
+                    pollable_fd _lfd;
+                    pollable_fd _handshaking;
+                    bool _aborted = false;
+
+                    future<connected_socket> receive_hello(pollable_fd fd);
+
+                public:
+                    explicit shm_server_socket_impl(pollable_fd lfd) : _lfd(std::move(lfd)) {
+                    }
+                    virtual future<accept_result> accept() override;
+                    virtual void abort_accept() override {
+                        _aborted = true;
+                        _lfd.abort_reader();
+                        if (_handshaking) {
+                            _handshaking.abort_reader();
+                        }
+                    }
+                    virtual socket_address local_address() const override {
+                        return _lfd.get_file_desc().get_address();
+                    }
+                };
+
+                future<accept_result> shm_server_socket_impl::accept() {
+                    return _lfd.accept().then([this](std::tuple<pollable_fd, socket_address> fd_sa) {
+                        auto &fd = std::get<0>(fd_sa);
+                        auto &sa = std::get<1>(fd_sa);
+                        _handshaking = fd;
+                        return receive_hello(std::move(fd)).then_wrapped([this, sa](future<connected_socket> f) {
+                            _handshaking = pollable_fd();
+                            if (f.failed() && !_aborted) {
+                                // A peer failing the handshake only loses its own connection
+                                f.ignore_ready_future();
+                                return accept();
+                            }
+                            return make_ready_future<accept_result>(accept_result {f.get0(), sa});
+                        });
+                    });
+                }
+
+                future<connected_socket> shm_server_socket_impl::receive_hello(pollable_fd fd) {
+                    auto hs = std::make_unique<handshake>();
+                    auto msg = &hs->msg;
+                    return fd.recvmsg(msg).then([fd, hs = std::move(hs)](size_t received) mutable {
+                        // Take ownership of whatever was passed before validating anything
+                        std::vector<file_desc> fds;
+                        for (auto cmsg = CMSG_FIRSTHDR(&hs->msg); cmsg; cmsg = CMSG_NXTHDR(&hs->msg, cmsg)) {
+                            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                                auto n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                                auto data = reinterpret_cast<int *>(CMSG_DATA(cmsg));
+                                for (size_t i = 0; i < n; ++i) {
+                                    fds.push_back(file_desc::from_fd(data[i]));
+                                    ::fcntl(data[i], F_SETFD, FD_CLOEXEC);
+                                }
+                            }
+                        }
+                        auto &h = hs->payload;
+                        if (received != sizeof(hello) || (hs->msg.msg_flags & MSG_CTRUNC) ||
+                            h.magic != channel_header::magic_value || h.fds != hello_fds || fds.size() != hello_fds ||
+                            h.ring_size < min_ring_size || h.ring_size > max_ring_size ||
+                            (h.ring_size & (h.ring_size - 1))) {
+                            throw std::runtime_error("malformed shm socket handshake");
+                        }
+                        // Do not trust the size announced by the peer: touching pages past the
+                        // end of the memory file would raise SIGBUS.
+                        struct stat st;
+                        throw_system_error_on(::fstat(fds[0].get(), &st) < 0, "fstat");
+                        if (uint64_t(st.st_size) < mapping_size(h.ring_size)) {
+                            throw std::runtime_error("shm socket memory file is too small");
+                        }
+                        mapping map(fds[0].get(), mapping_size(h.ring_size));
+                        if (map.header().magic.load(std::memory_order_acquire) != channel_header::magic_value ||
+                            map.header().ring_size != h.ring_size) {
+                            throw std::runtime_error("shm socket memory file does not match the handshake");
+                        }
+                        return fd.write_all(&hs->ack, 1).then(
+                            [fd, map = std::move(map), fds = std::move(fds), hs = std::move(hs)]() mutable {
+                                return make_connected_socket(std::move(map), 1, std::move(fds[2]), std::move(fds[1]),
+                                                             std::move(fd));
+                            });
+                    });
+                }
+
+            }    // namespace shm
+
+            ::nil::actor::socket shm_socket(const shm_socket_options &opts) {
+                return ::nil::actor::socket(std::make_unique<shm::shm_socket_impl>(opts));
+            }
+
+            server_socket shm_listen(socket_address sa, listen_options opts) {
+                if (!sa.is_af_unix()) {
+                    throw std::invalid_argument("shm sockets listen on unix domain addresses");
+                }
+                return server_socket(
+                    std::make_unique<shm::shm_server_socket_impl>(engine().posix_listen(sa, opts)));
+            }
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
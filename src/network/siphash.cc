@@ -0,0 +1,121 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/network/siphash.hh>
+
+#include <cstring>
+#include <random>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            namespace {
+
+                inline uint64_t rotl(uint64_t x, int b) {
+                    return (x << b) | (x >> (64 - b));
+                }
+
+                struct siphash_state {
+                    uint64_t v0;
+                    uint64_t v1;
+                    uint64_t v2;
+                    uint64_t v3;
+
+                    explicit siphash_state(const siphash_key &key) :
+                        v0(key.k0 ^ 0x736f6d6570736575ull), v1(key.k1 ^ 0x646f72616e646f6dull),
+                        v2(key.k0 ^ 0x6c7967656e657261ull), v3(key.k1 ^ 0x7465646279746573ull) {
+                    }
+
+                    void round() {
+                        v0 += v1;
+                        v1 = rotl(v1, 13);
+                        v1 ^= v0;
+                        v0 = rotl(v0, 32);
+                        v2 += v3;
+                        v3 = rotl(v3, 16);
+                        v3 ^= v2;
+                        v0 += v3;
+                        v3 = rotl(v3, 21);
+                        v3 ^= v0;
+                        v2 += v1;
+                        v1 = rotl(v1, 17);
+                        v1 ^= v2;
+                        v2 = rotl(v2, 32);
+                    }
+
+                    void compress(uint64_t m) {
+                        v3 ^= m;
+                        round();
+                        round();
+                        v0 ^= m;
+                    }
+
+                    uint64_t finalize() {
+                        v2 ^= 0xff;
+                        round();
+                        round();
+                        round();
+                        round();
+                        return v0 ^ v1 ^ v2 ^ v3;
+                    }
+                };
+
+                // Words are read little endian, as the reference implementation does
+                inline uint64_t read_le64(const uint8_t *p) {
+                    uint64_t v = 0;
+                    for (int i = 7; i >= 0; --i) {
+                        v = (v << 8) | p[i];
+                    }
+                    return v;
+                }
+
+            }    // namespace
+
+            siphash_key siphash_key::random() {
+                std::random_device rd;
+                std::uniform_int_distribution<uint64_t> dist;
+                return siphash_key {dist(rd), dist(rd)};
+            }
+
+            uint64_t siphash(const siphash_key &key, const void *data, size_t len) noexcept {
+                auto p = static_cast<const uint8_t *>(data);
+                siphash_state s(key);
+                auto end = p + (len & ~size_t(7));
+                for (; p != end; p += 8) {
+                    s.compress(read_le64(p));
+                }
+                uint64_t last = uint64_t(len) << 56;
+                for (size_t i = 0; i < (len & 7); ++i) {
+                    last |= uint64_t(p[i]) << (8 * i);
+                }
+                s.compress(last);
+                return s.finalize();
+            }
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
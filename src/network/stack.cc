@@ -25,6 +25,9 @@
 #include <nil/actor/network/stack.hh>
 #include <nil/actor/network/inet_address.hh>
 
+#include <algorithm>
+#include <stdexcept>
+
 namespace nil {
     namespace actor {
 
@@ -98,6 +101,10 @@ namespace nil {
             return input_stream<char>(_csi->source(csisc));
         }
 
+        stream_receiver connected_socket::receiver() {
+            return stream_receiver(_csi->packet_source());
+        }
+
         output_stream<char> connected_socket::output(size_t buffer_size) {
             // TODO: allow user to determine buffer size etc
             return output_stream<char>(_csi->sink(), buffer_size, false, true);
@@ -107,6 +114,10 @@ namespace nil {
             _csi->set_nodelay(nodelay);
         }
 
+        void connected_socket::set_read_size_hint(size_t size) {
+            _csi->set_read_size_hint(size);
+        }
+
         bool connected_socket::get_nodelay() const {
             return _csi->get_nodelay();
         }
@@ -142,6 +153,155 @@ namespace nil {
             return source();
         }
 
+        namespace net {
+
+            // Packets made of the buffers of the input data source, for stacks
+            // that do not have the received packets at hand
+            class data_source_packet_source final : public packet_source_impl {
+                data_source _src;
+
+            public:
+                explicit data_source_packet_source(data_source src) : _src(std::move(src)) {
+                }
+                virtual future<packet> get() override {
+                    return _src.get().then([](temporary_buffer<char> buf) {
+                        return buf.empty() ? packet() : packet(std::move(buf));
+                    });
+                }
+                virtual future<> close() override {
+                    return _src.close();
+                }
+            };
+
+        }    // namespace net
+
+        std::unique_ptr<net::packet_source_impl> net::connected_socket_impl::packet_source() {
+            return std::make_unique<data_source_packet_source>(source());
+        }
+
+        stream_receiver::stream_receiver(std::unique_ptr<net::packet_source_impl> src) noexcept :
+            _src(std::move(src)) {
+        }
+
+        stream_receiver::stream_receiver(stream_receiver &&) noexcept = default;
+        stream_receiver &stream_receiver::operator=(stream_receiver &&) noexcept = default;
+
+        stream_receiver::~stream_receiver() {
+        }
+
+        future<> stream_receiver::receive() {
+            return _src->get().then([this](net::packet p) {
+                if (!p.len()) {
+                    _eof = true;
+                } else {
+                    _buf.append(std::move(p));
+                }
+            });
+        }
+
+        future<> stream_receiver::fill(size_t size) {
+            if (_buf.len() >= size || _eof) {
+                return make_ready_future<>();
+            }
+            return receive().then([this, size] { return fill(size); });
+        }
+
+        temporary_buffer<char> stream_receiver::front(size_t size) {
+            temporary_buffer<char> ret;
+            if (size) {
+                _buf.share(0, size).release_into([&ret](temporary_buffer<char> &&frag) { ret = std::move(frag); });
+            }
+            return ret;
+        }
+
+        void stream_receiver::consume_into(char *dst, size_t size) {
+            auto left = size;
+            for (auto &&f : _buf.fragments()) {
+                if (!left) {
+                    break;
+                }
+                auto n = std::min<size_t>(left, f.size);
+                dst = std::copy_n(f.base, n, dst);
+                left -= n;
+            }
+            _buf.trim_front(size);
+        }
+
+        future<temporary_buffer<char>> stream_receiver::peek(size_t size) {
+            return fill(size).then([this, size]() mutable {
+                size = std::min<size_t>(size, _buf.len());
+                if (size) {
+                    // Copied once if it spans fragments, and kept that way for the
+                    // read that follows
+                    _buf.get_header(0, size);
+                }
+                return front(size);
+            });
+        }
+
+        future<temporary_buffer<char>> stream_receiver::read_exactly(size_t size) {
+            return read_into(size, [](size_t n) { return temporary_buffer<char>(n); });
+        }
+
+        future<size_t> stream_receiver::read_into(char *dst, size_t size) {
+            // Copies what has arrived right away, without waiting for the rest
+            auto n = std::min<size_t>(size, _buf.len());
+            consume_into(dst, n);
+            if (n == size || _eof) {
+                return make_ready_future<size_t>(n);
+            }
+            return receive().then([this, dst, size, n] {
+                return read_into(dst + n, size - n).then([n](size_t rest) { return n + rest; });
+            });
+        }
+
+        future<temporary_buffer<char>>
+            stream_receiver::read_into(size_t size, noncopyable_function<temporary_buffer<char>(size_t)> provider) {
+            return fill(size).then([this, size, provider = std::move(provider)]() mutable {
+                size = std::min<size_t>(size, _buf.len());
+                if (size && _buf.frag(0).size < size) {
+                    auto buf = provider(size);
+                    if (buf.size() < size) {
+                        // Nothing is consumed, the bytes can still be read another way
+                        return make_exception_future<temporary_buffer<char>>(
+                            std::invalid_argument("read_into provider returned a short buffer"));
+                    }
+                    consume_into(buf.get_write(), size);
+                    buf.trim(size);
+                    return make_ready_future<temporary_buffer<char>>(std::move(buf));
+                }
+                auto buf = front(size);
+                _buf.trim_front(size);
+                return make_ready_future<temporary_buffer<char>>(std::move(buf));
+            });
+        }
+
+        future<temporary_buffer<char>> stream_receiver::read() {
+            if (_buf.len()) {
+                auto size = _buf.frag(0).size;
+                auto buf = front(size);
+                _buf.trim_front(size);
+                return make_ready_future<temporary_buffer<char>>(std::move(buf));
+            }
+            if (_eof) {
+                return make_ready_future<temporary_buffer<char>>();
+            }
+            return receive().then([this] { return read(); });
+        }
+
+        future<> stream_receiver::skip(size_t size) {
+            auto n = std::min<size_t>(size, _buf.len());
+            _buf.trim_front(n);
+            if (n == size || _eof) {
+                return make_ready_future<>();
+            }
+            return receive().then([this, size = size - n] { return skip(size); });
+        }
+
+        future<> stream_receiver::close() {
+            return _src->close();
+        }
+
         socket::~socket() {
         }
 
@@ -25,10 +25,13 @@
 #include <nil/actor/network/tcp.hh>
 #include <nil/actor/network/tcp-stack.hh>
 #include <nil/actor/network/ip.hh>
+#include <nil/actor/network/ipv6.hh>
 #include <nil/actor/core/align.hh>
 #include <nil/actor/core/future.hh>
 #include <nil/actor/network/detail/native-stack-impl.hh>
 
+#include <iterator>
+
 namespace nil {
     namespace actor {
         namespace net {
@@ -101,6 +104,22 @@ namespace nil {
                         off += win_scale.len;
                         size += win_scale.len;
                     }
+                    if (_sack_received || !ack_on) {
+                        auto sack = tcp_option::sack();
+                        sack.write(off);
+                        off += sack.len;
+                        size += sack.len;
+                    }
+                } else if (ack_on && _nr_sack_blocks) {
+                    auto len = sack_blocks_size(_nr_sack_blocks);
+                    off[0] = uint8_t(option_kind::sack_blocks);
+                    off[1] = len;
+                    for (unsigned i = 0; i < _nr_sack_blocks; ++i) {
+                        write_be<uint32_t>(off + 2 + 8 * i, _sack_blocks[i].first);
+                        write_be<uint32_t>(off + 6 + 8 * i, _sack_blocks[i].second);
+                    }
+                    off += len;
+                    size += len;
                 }
                 if (size > 0) {
                     // Insert NOP option
@@ -129,6 +148,11 @@ namespace nil {
                     if (_win_scale_received || !ack_on) {
                         size += option_len::win_scale;
                     }
+                    if (_sack_received || !ack_on) {
+                        size += option_len::sack;
+                    }
+                } else if (ack_on) {
+                    size += sack_blocks_size(_nr_sack_blocks);
                 }
                 if (size > 0) {
                     size += option_len::eol;
@@ -138,6 +162,44 @@ namespace nil {
                 return size;
             }
 
+            namespace {
+
+                // MSS values a cookie can carry, the common ones for IPv4 and IPv6 paths
+                constexpr uint16_t syn_cookie_mss[] = {536, 1220, 1440, 1460};
+                constexpr uint32_t syn_cookie_no_win_scale = 15;
+
+            }    // namespace
+
+            boost::optional<uint32_t> syn_cookie::encode_options(const tcp_option &opt) {
+                uint32_t mss_index = 0;
+                if (opt._mss_received) {
+                    if (opt._remote_mss < syn_cookie_mss[0]) {
+                        return boost::none;
+                    }
+                    for (uint32_t i = 0; i < std::size(syn_cookie_mss); ++i) {
+                        if (syn_cookie_mss[i] <= opt._remote_mss) {
+                            mss_index = i;
+                        }
+                    }
+                }
+                uint32_t win_scale = opt._win_scale_received ? std::min<uint32_t>(opt._remote_win_scale, 14) :
+                                                               syn_cookie_no_win_scale;
+                return mss_index | (win_scale << 2) | (uint32_t(opt._sack_received) << 6);
+            }
+
+            void syn_cookie::decode_options(uint32_t bits, tcp_option &opt) {
+                opt._mss_received = true;
+                opt._remote_mss = syn_cookie_mss[bits & 3];
+                auto win_scale = (bits >> 2) & 15;
+                if (win_scale != syn_cookie_no_win_scale) {
+                    opt._win_scale_received = true;
+                    opt._remote_win_scale = win_scale;
+                    // What parse() picks when the SYN carries the option
+                    opt._local_win_scale = 7;
+                }
+                opt._sack_received = (bits >> 6) & 1;
+            }
+
             ipv4_tcp::ipv4_tcp(ipv4 &inet) : _inet_l4(inet), _tcp(std::make_unique<tcp<ipv4_traits>>(_inet_l4)) {
             }
 
@@ -160,6 +222,34 @@ namespace nil {
             ::nil::actor::socket tcpv4_socket(tcp<ipv4_traits> &tcpv4) {
                 return ::nil::actor::socket(std::make_unique<native_socket_impl<tcp<ipv4_traits>>>(tcpv4));
             }
+
+            ipv6_tcp::ipv6_tcp(ipv6 &inet) : _inet_l4(inet), _tcp(std::make_unique<tcp<ipv6_traits>>(_inet_l4)) {
+            }
+
+            ipv6_tcp::~ipv6_tcp() {
+            }
+
+            void ipv6_tcp::received(packet p, ipv6_address from, ipv6_address to) {
+                _tcp->received(std::move(p), from, to);
+            }
+
+            bool ipv6_tcp::forward(forward_hash &out_hash_data, packet &p, size_t off) {
+                return _tcp->forward(out_hash_data, p, off);
+            }
+
+            server_socket tcpv6_listen(tcp<ipv6_traits> &tcpv6, uint16_t port, listen_options opts) {
+                return server_socket(std::make_unique<native_server_socket_impl<tcp<ipv6_traits>>>(tcpv6, port, opts));
+            }
+
+            ::nil::actor::socket tcpv6_socket(tcp<ipv6_traits> &tcpv6) {
+                return ::nil::actor::socket(std::make_unique<native_socket_impl<tcp<ipv6_traits>>>(tcpv6));
+            }
+
+            ::nil::actor::socket tcp_dual_stack_socket(tcp<ipv4_traits> &tcpv4, tcp<ipv6_traits> &tcpv6) {
+                return ::nil::actor::socket(
+                    std::make_unique<native_dual_stack_socket_impl<tcp<ipv4_traits>, tcp<ipv6_traits>>>(tcpv4,
+                                                                                                         tcpv6));
+            }
         }    // namespace net
     }    // namespace actor
 }    // namespace nil
@@ -0,0 +1,188 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/network/timer_wheel.hh>
+
+#include <algorithm>
+
+namespace nil {
+    namespace actor {
+
+        namespace net {
+
+            constexpr std::chrono::milliseconds timer_wheel::tick;
+
+            wheel_timer::wheel_timer(timer_wheel &wheel) noexcept : _wheel(&wheel) {
+                wheel._timers.push_back(*this);
+            }
+
+            wheel_timer::wheel_timer(timer_wheel &wheel, noncopyable_function<void()> callback) noexcept :
+                _wheel(&wheel), _callback(std::move(callback)) {
+                wheel._timers.push_back(*this);
+            }
+
+            wheel_timer::~wheel_timer() {
+                // A detached timer is in no slot, and has no counter to update
+                if (_hook.is_linked()) {
+                    _hook.unlink();
+                    --_wheel->_linked;
+                }
+            }
+
+            void wheel_timer::rearm(clock_type::time_point until) {
+                _deadline = until;
+                if (!_wheel) {
+                    // Nothing is left to run the timer
+                    return;
+                }
+                _armed = true;
+                _wheel->schedule(*this);
+            }
+
+            timer_wheel::timer_wheel() : _start(clock_type::now()) {
+                _driver.set_callback([this] { advance(); });
+            }
+
+            timer_wheel::~timer_wheel() {
+                while (!_timers.empty()) {
+                    auto &t = _timers.front();
+                    _timers.pop_front();
+                    if (t._hook.is_linked()) {
+                        t._hook.unlink();
+                    }
+                    t._wheel = nullptr;
+                    t._armed = false;
+                }
+                _linked = 0;
+            }
+
+            uint64_t timer_wheel::current_tick() const noexcept {
+                auto now = clock_type::now();
+                return now > _start ? (now - _start) / tick : 0;
+            }
+
+            uint64_t timer_wheel::tick_of(clock_type::time_point tp) const noexcept {
+                // Rounded up, a timer never runs early
+                if (tp <= _start) {
+                    return 0;
+                }
+                return (tp - _start + tick - clock_type::duration(1)) / tick;
+            }
+
+            void timer_wheel::schedule(wheel_timer &t) {
+                ++_stats.rearms;
+                auto when = tick_of(t._deadline);
+                if (t._hook.is_linked()) {
+                    if (t._tick <= when) {
+                        // The slot comes first and puts the timer back, if still armed
+                        ++_stats.deferred;
+                        return;
+                    }
+                    t._hook.unlink();
+                    --_linked;
+                }
+                link(t, when);
+            }
+
+            void timer_wheel::link(wheel_timer &t, uint64_t when) {
+                if (!_linked++ && !_driver.armed()) {
+                    // The wheel stands still while empty, catch up with the clock
+                    _now = current_tick();
+                    _driver.arm_periodic(tick);
+                }
+                // The slot of the current tick has been processed already
+                place(t, std::max(when, _now + 1));
+            }
+
+            void timer_wheel::place(wheel_timer &t, uint64_t when) noexcept {
+                constexpr uint64_t horizon = (uint64_t(1) << (levels * level_bits)) - 1;
+                // Timers beyond the horizon wait at its end, and get put back from there
+                when = std::min(when, _now + horizon);
+                auto delta = when - _now;
+                unsigned level = 0;
+                while (level + 1 < levels && delta >= (uint64_t(1) << ((level + 1) * level_bits))) {
+                    ++level;
+                }
+                auto index = (when >> (level * level_bits)) & (slots_per_level - 1);
+                t._tick = when;
+                _slots[level * slots_per_level + index].push_back(t);
+            }
+
+            void timer_wheel::advance() {
+                auto target = current_tick();
+                list_type due;
+                while (_now < target) {
+                    ++_now;
+                    // Spread the slots of the higher levels we just entered, highest
+                    // first, so that nothing lands in a lower slot already passed
+                    unsigned top = 0;
+                    while (top + 1 < levels && !(_now & ((uint64_t(1) << ((top + 1) * level_bits)) - 1))) {
+                        ++top;
+                    }
+                    for (auto level = top; level > 0; --level) {
+                        auto index = (_now >> (level * level_bits)) & (slots_per_level - 1);
+                        auto &slot = _slots[level * slots_per_level + index];
+                        while (!slot.empty()) {
+                            auto &t = slot.front();
+                            slot.pop_front();
+                            ++_stats.cascaded;
+                            if (t._tick <= _now) {
+                                due.push_back(t);
+                            } else {
+                                place(t, t._tick);
+                            }
+                        }
+                    }
+                    due.splice(due.end(), _slots[_now & (slots_per_level - 1)]);
+                }
+
+                // Callbacks may arm, cancel or destroy any timer, those still in due
+                // included: the hooks unlink themselves.
+                while (!due.empty()) {
+                    auto &t = due.front();
+                    due.pop_front();
+                    --_linked;
+                    if (!t._armed) {
+                        continue;
+                    }
+                    auto when = tick_of(t._deadline);
+                    if (when > _now) {
+                        ++_stats.reinserted;
+                        ++_linked;
+                        place(t, when);
+                        continue;
+                    }
+                    t._armed = false;
+                    ++_stats.expired;
+                    t._callback();
+                }
+                if (!_linked) {
+                    _driver.cancel();
+                }
+            }
+
+        }    // namespace net
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,186 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/network/toeplitz.hh>
+
+#include <array>
+#include <memory>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace nil {
+    namespace actor {
+
+        // Bit p of the key, counting from the most significant bit of its first byte
+        static unsigned key_bit(rss_key_type key, size_t p) {
+            return p / 8 < key.size() ? (key[p / 8] >> (7 - p % 8)) & 1 : 0;
+        }
+
+        // The 32 bits of the key starting at bit p, which an input bit at position
+        // p contributes to the hash
+        static uint32_t key_window(rss_key_type key, size_t p) {
+            uint32_t v = 0;
+            for (unsigned b = 0; b < 32; ++b) {
+                v = (v << 1) | key_bit(key, p + b);
+            }
+            return v;
+        }
+
+        namespace {
+
+            struct toeplitz_tables {
+                const uint8_t *key;
+                size_t key_size;
+                // Contribution of every value of every input byte
+                std::vector<std::array<uint32_t, 256>> bytes;
+                // Bit-reflected 63-bit key windows of every 32-bit input word, for
+                // the carry-less multiplication kernel
+                std::vector<uint64_t> words;
+
+                explicit toeplitz_tables(rss_key_type k) :
+                    key(k.data()), key_size(k.size()), bytes(k.size()), words((k.size() + 3) / 4) {
+                    // Input bits beyond the key see a window of zeroes and do not
+                    // contribute, hence no more rows than key bytes.
+                    for (size_t i = 0; i < bytes.size(); ++i) {
+                        std::array<uint32_t, 8> bit_windows;
+                        for (unsigned b = 0; b < 8; ++b) {
+                            bit_windows[b] = key_window(k, 8 * i + b);
+                        }
+                        for (unsigned x = 0; x < 256; ++x) {
+                            uint32_t h = 0;
+                            for (unsigned b = 0; b < 8; ++b) {
+                                if (x & (0x80 >> b)) {
+                                    h ^= bit_windows[b];
+                                }
+                            }
+                            bytes[i][x] = h;
+                        }
+                    }
+                    for (size_t c = 0; c < words.size(); ++c) {
+                        uint64_t w = 0;
+                        for (unsigned m = 0; m < 63; ++m) {
+                            w |= uint64_t(key_bit(k, 32 * c + m)) << m;
+                        }
+                        words[c] = w;
+                    }
+                }
+            };
+
+        }    // namespace
+
+        static const toeplitz_tables &tables_for(rss_key_type key) {
+            // Processes see one or two keys, a short list beats a map
+            static thread_local std::vector<std::unique_ptr<toeplitz_tables>> cache;
+            for (auto &&t : cache) {
+                if (t->key == key.data() && t->key_size == key.size()) {
+                    return *t;
+                }
+            }
+            cache.push_back(std::make_unique<toeplitz_tables>(key));
+            return *cache.back();
+        }
+
+        static uint32_t toeplitz_hash_bitwise(rss_key_type key, const uint8_t *data, size_t len) {
+            uint32_t hash = 0, v;
+
+            v = (key[0] << 24) + (key[1] << 16) + (key[2] << 8) + key[3];
+            for (size_t i = 0; i < len; i++) {
+                for (unsigned b = 0; b < 8; b++) {
+                    if (data[i] & (1 << (7 - b)))
+                        hash ^= v;
+                    v <<= 1;
+                    if ((i + 4) < key.size() && (key[i + 4] & (1 << (7 - b))))
+                        v |= 1;
+                }
+            }
+            return hash;
+        }
+
+        static uint32_t toeplitz_hash_table(rss_key_type key, const uint8_t *data, size_t len) {
+            auto &t = tables_for(key);
+            len = std::min(len, t.bytes.size());
+            uint32_t hash = 0;
+            for (size_t i = 0; i < len; ++i) {
+                hash ^= t.bytes[i][data[i]];
+            }
+            return hash;
+        }
+
+#if defined(__x86_64__)
+        // Multiplying a 32-bit input word (first bit on top) by its reflected key
+        // window puts the bits of its contribution, lowest first, at 31..62 of the
+        // product; products are linear, so they are accumulated and the result is
+        // extracted and reflected once.
+        __attribute__((target("pclmul"))) static uint32_t toeplitz_hash_clmul(rss_key_type key,
+                                                                                const uint8_t *data, size_t len) {
+            auto &t = tables_for(key);
+            len = std::min(len, 4 * t.words.size());
+            auto acc = _mm_setzero_si128();
+            size_t c = 0;
+            for (; 4 * c + 4 <= len; ++c) {
+                uint32_t w = (uint32_t(data[4 * c]) << 24) | (uint32_t(data[4 * c + 1]) << 16) |
+                             (uint32_t(data[4 * c + 2]) << 8) | data[4 * c + 3];
+                auto p = _mm_clmulepi64_si128(_mm_cvtsi32_si128(int(w)), _mm_cvtsi64_si128(t.words[c]), 0x00);
+                acc = _mm_xor_si128(acc, p);
+            }
+            if (4 * c < len) {
+                uint32_t w = 0;
+                for (unsigned i = 0; i < 4; ++i) {
+                    w = (w << 8) | (4 * c + i < len ? data[4 * c + i] : 0);
+                }
+                auto p = _mm_clmulepi64_si128(_mm_cvtsi32_si128(int(w)), _mm_cvtsi64_si128(t.words[c]), 0x00);
+                acc = _mm_xor_si128(acc, p);
+            }
+            uint32_t r = uint64_t(_mm_cvtsi128_si64(acc)) >> 31;
+            // Reflect the 32 bits
+            r = ((r >> 1) & 0x55555555) | ((r & 0x55555555) << 1);
+            r = ((r >> 2) & 0x33333333) | ((r & 0x33333333) << 2);
+            r = ((r >> 4) & 0x0f0f0f0f) | ((r & 0x0f0f0f0f) << 4);
+            return __builtin_bswap32(r);
+        }
+#endif
+
+        const std::vector<toeplitz_implementation> &toeplitz_implementations() {
+            static const std::vector<toeplitz_implementation> impls = [] {
+                std::vector<toeplitz_implementation> v {{"bitwise", toeplitz_hash_bitwise},
+                                                        {"table", toeplitz_hash_table}};
+#if defined(__x86_64__)
+                if (__builtin_cpu_supports("pclmul")) {
+                    v.push_back({"clmul", toeplitz_hash_clmul});
+                }
+#endif
+                return v;
+            }();
+            return impls;
+        }
+
+        uint32_t toeplitz_hash(rss_key_type key, const uint8_t *data, size_t len) {
+            static const auto hash = toeplitz_implementations().back().hash;
+            return hash(key, data, len);
+        }
+
+    }    // namespace actor
+}    // namespace nil
@@ -25,6 +25,7 @@
 #include <cassert>
 
 #include <nil/actor/network/ip.hh>
+#include <nil/actor/network/ipv6.hh>
 #include <nil/actor/network/stack.hh>
 #include <nil/actor/network/inet_address.hh>
 
@@ -34,25 +35,41 @@ namespace nil {
         using namespace net;
 
         namespace net {
-            namespace ipv4_udp_impl {
+            namespace udp_impl {
 
-                static inline ipv4_addr to_ipv4_addr(ipv4_address a, uint16_t port) {
-                    return {a.ip, port};
-                }
+                // What the datagrams and channels of a network layer are made of
+                template<typename InetTraits>
+                struct udp_family;
+
+                template<>
+                struct udp_family<ipv4_traits> {
+                    using proto_type = ipv4_udp;
+                    using addr_type = ipv4_addr;
+                };
 
+                template<>
+                struct udp_family<ipv6_traits> {
+                    using proto_type = ipv6_udp;
+                    using addr_type = ipv6_addr;
+                };
+
+                template<typename InetTraits>
                 class native_datagram : public udp_datagram_impl {
                 private:
-                    ipv4_addr _src;
-                    ipv4_addr _dst;
+                    using address_type = typename InetTraits::address_type;
+                    using addr_type = typename udp_family<InetTraits>::addr_type;
+
+                    addr_type _src;
+                    addr_type _dst;
                     packet _p;
 
                 public:
-                    native_datagram(ipv4_address src, ipv4_address dst, packet p) : _p(std::move(p)) {
+                    native_datagram(address_type src, address_type dst, packet p) : _p(std::move(p)) {
                         udp_hdr *hdr = _p.get_header<udp_hdr>();
                         auto h = ntoh(*hdr);
                         _p.trim_front(sizeof(*hdr));
-                        _src = to_ipv4_addr(src, h.src_port);
-                        _dst = to_ipv4_addr(dst, h.dst_port);
+                        _src = addr_type(src.ip, h.src_port);
+                        _dst = addr_type(dst.ip, h.dst_port);
                     }
 
                     virtual socket_address get_src() override {
@@ -72,15 +89,18 @@ namespace nil {
                     }
                 };
 
+                template<typename InetTraits>
                 class native_channel : public udp_channel_impl {
                 private:
-                    ipv4_udp &_proto;
-                    ipv4_udp::registration _reg;
+                    using proto_type = typename udp_family<InetTraits>::proto_type;
+
+                    proto_type &_proto;
+                    typename proto_type::registration _reg;
                     bool _closed;
                     lw_shared_ptr<udp_channel_state> _state;
 
                 public:
-                    native_channel(ipv4_udp &proto, ipv4_udp::registration reg,
+                    native_channel(proto_type &proto, typename proto_type::registration reg,
                                    lw_shared_ptr<udp_channel_state> state) :
                         _proto(proto),
                         _reg(reg), _closed(false), _state(state) {
@@ -129,9 +149,54 @@ namespace nil {
                     }
                 };
 
-            } /* namespace ipv4_udp_impl */
+                template<typename InetTraits, typename Addr>
+                udp_channel make_channel(typename udp_family<InetTraits>::proto_type &proto,
+                                         udp_channel_table &channels, int queue_size, const Addr &addr) {
+                    if (!addr.is_ip_unspecified()) {
+                        throw std::runtime_error("Binding to specific IP not supported yet");
+                    }
+                    auto chan_state = make_lw_shared<udp_channel_state>(queue_size);
+                    auto bind_port = channels.bind(addr.port, chan_state);
+                    using proto_type = typename udp_family<InetTraits>::proto_type;
+                    return udp_channel(std::make_unique<native_channel<InetTraits>>(
+                        proto, typename proto_type::registration(proto, bind_port), std::move(chan_state)));
+                }
 
-            using namespace net::ipv4_udp_impl;
+                template<typename InetTraits>
+                void deliver(udp_channel_table &channels, packet p, typename InetTraits::address_type from,
+                             typename InetTraits::address_type to) {
+                    udp_datagram dgram(std::make_unique<native_datagram<InetTraits>>(from, to, std::move(p)));
+                    if (auto *chan = channels.find(dgram.get_dst_port())) {
+                        chan->_queue.push(std::move(dgram));
+                    }
+                }
+
+            } /* namespace udp_impl */
+
+            uint16_t udp_channel_table::bind(uint16_t port, lw_shared_ptr<udp_channel_state> state) {
+                auto next_port = [](uint16_t port) -> uint16_t {
+                    return (port + 1) == 0 ? min_anonymous_port : port + 1;
+                };
+
+                if (port) {
+                    if (_channels.count(port)) {
+                        throw std::runtime_error("Address already in use");
+                    }
+                } else {
+                    auto starting_port = _next_anonymous_port;
+                    while (_channels.count(_next_anonymous_port)) {
+                        _next_anonymous_port = next_port(_next_anonymous_port);
+                        if (starting_port == _next_anonymous_port) {
+                            throw std::runtime_error("No free port");
+                        }
+                    }
+
+                    port = _next_anonymous_port;
+                    _next_anonymous_port = next_port(_next_anonymous_port);
+                }
+                _channels[port] = std::move(state);
+                return port;
+            }
 
             const int ipv4_udp::default_queue_size = 1024;
 
@@ -157,17 +222,11 @@ namespace nil {
             }
 
             void ipv4_udp::received(packet p, ipv4_address from, ipv4_address to) {
-                udp_datagram dgram(std::make_unique<native_datagram>(from, to, std::move(p)));
-
-                auto chan_it = _channels.find(dgram.get_dst_port());
-                if (chan_it != _channels.end()) {
-                    auto chan = chan_it->second;
-                    chan->_queue.push(std::move(dgram));
-                }
+                udp_impl::deliver<ipv4_traits>(_channels, std::move(p), from, to);
             }
 
             void ipv4_udp::send(uint16_t src_port, ipv4_addr dst, packet &&p) {
-                auto src = _inet.host_address();
+                auto src = _inet.source_address(dst);
                 auto hdr = p.prepend_header<udp_hdr>();
                 hdr->src_port = src_port;
                 hdr->dst_port = dst.port;
@@ -190,43 +249,91 @@ namespace nil {
                 p.set_offload_info(oi);
 
                 // FIXME: future is discarded
-                (void)_inet.get_l2_dst_address(dst).then([this, dst, p = std::move(p)](ethernet_address e_dst) mutable {
-                    _packetq.emplace_back(ipv4_traits::l4packet {dst, std::move(p), e_dst, ip_protocol_num::udp});
+                (void)_inet.get_l2_dst_address(dst).then([this, dst, src,
+                                                          p = std::move(p)](ethernet_address e_dst) mutable {
+                    _packetq.emplace_back(ipv4_traits::l4packet {dst, std::move(p), e_dst, ip_protocol_num::udp, src});
                 });
             }
 
-            uint16_t ipv4_udp::next_port(uint16_t port) {
-                return (port + 1) == 0 ? min_anonymous_port : port + 1;
-            }
-
             udp_channel ipv4_udp::make_channel(ipv4_addr addr) {
-                if (!is_ip_unspecified(addr)) {
-                    throw std::runtime_error("Binding to specific IP not supported yet");
-                }
+                return udp_impl::make_channel<ipv4_traits>(*this, _channels, _queue_size, addr);
+            }
 
-                uint16_t bind_port;
+            const int ipv6_udp::default_queue_size = 1024;
 
-                if (!is_port_unspecified(addr)) {
-                    if (_channels.count(addr.port)) {
-                        throw std::runtime_error("Address already in use");
+            ipv6_udp::ipv6_udp(ipv6 &inet) : _inet(inet) {
+                _inet.register_packet_provider([this] {
+                    boost::optional<ipv6_traits::l4packet> l4p;
+                    if (!_packetq.empty()) {
+                        l4p = std::move(_packetq.front());
+                        _packetq.pop_front();
                     }
-                    bind_port = addr.port;
-                } else {
-                    auto starting_port = _next_anonymous_port;
-                    while (_channels.count(_next_anonymous_port)) {
-                        _next_anonymous_port = next_port(_next_anonymous_port);
-                        if (starting_port == _next_anonymous_port) {
-                            throw std::runtime_error("No free port");
-                        }
+                    return l4p;
+                });
+            }
+
+            bool ipv6_udp::forward(forward_hash &out_hash_data, packet &p, size_t off) {
+                auto uh = p.get_header<udp_hdr>(off);
+
+                if (uh) {
+                    out_hash_data.push_back(uh->src_port);
+                    out_hash_data.push_back(uh->dst_port);
+                }
+                return true;
+            }
+
+            void ipv6_udp::received(packet p, ipv6_address from, ipv6_address to) {
+                auto uh = p.get_header<udp_hdr>();
+                if (!uh) {
+                    return;
+                }
+                // Unlike IPv4, the checksum is mandatory for UDP over IPv6
+                if (!_inet.hw_features().rx_csum_offload) {
+                    checksummer csum;
+                    ipv6_traits::udp_pseudo_header_checksum(csum, from, to, p.len());
+                    csum.sum(p);
+                    if (uh->cksum == 0 || csum.get() != 0) {
+                        return;
                     }
+                }
 
-                    bind_port = _next_anonymous_port;
-                    _next_anonymous_port = next_port(_next_anonymous_port);
+                udp_impl::deliver<ipv6_traits>(_channels, std::move(p), from, to);
+            }
+
+            void ipv6_udp::send(uint16_t src_port, ipv6_addr dst, packet &&p) {
+                // IPv6 datagrams are not fragmented, see ipv6::send()
+                if (p.len() + sizeof(udp_hdr) + sizeof(ip6_hdr) > _inet.hw_features().mtu) {
+                    throw std::system_error(EMSGSIZE, std::system_category());
+                }
+                ipv6_address to(dst);
+                auto src = _inet.source_address(to);
+                auto hdr = p.prepend_header<udp_hdr>();
+                hdr->src_port = src_port;
+                hdr->dst_port = dst.port;
+                hdr->len = p.len();
+                *hdr = hton(*hdr);
+
+                offload_info oi;
+                checksummer csum;
+                ipv6_traits::udp_pseudo_header_checksum(csum, src, to, p.len());
+                csum.sum(p);
+                hdr->cksum = csum.get();
+                // A computed checksum of zero is transmitted as all ones
+                if (hdr->cksum == 0) {
+                    hdr->cksum = 0xffff;
                 }
+                oi.needs_csum = false;
+                oi.protocol = ip_protocol_num::udp;
+                p.set_offload_info(oi);
+
+                // FIXME: future is discarded
+                (void)_inet.get_l2_dst_address(to).then([this, to, p = std::move(p)](ethernet_address e_dst) mutable {
+                    _packetq.emplace_back(ipv6_traits::l4packet {to, std::move(p), e_dst, ip_protocol_num::udp});
+                });
+            }
 
-                auto chan_state = make_lw_shared<udp_channel_state>(_queue_size);
-                _channels[bind_port] = chan_state;
-                return udp_channel(std::make_unique<native_channel>(*this, registration(*this, bind_port), chan_state));
+            udp_channel ipv6_udp::make_channel(ipv6_addr addr) {
+                return udp_impl::make_channel<ipv6_traits>(*this, _channels, _queue_size, addr);
             }
 
         } /* namespace net */
@@ -0,0 +1,140 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/rpc/client_group.hh>
+#include <nil/actor/core/metrics.hh>
+
+#include <algorithm>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            namespace {
+
+                // Tells apart the metrics of groups sharing a name on one shard
+                thread_local uint64_t next_group_id = 0;
+
+            }    // namespace
+
+            client_group::client_group(std::vector<std::reference_wrapper<client>> replicas, hedging_options opts) :
+                _opts(std::move(opts)), _hedge_delay(_opts.initial_delay), _rng(std::random_device()()) {
+                if (replicas.empty()) {
+                    throw std::invalid_argument("rpc client group needs at least one replica");
+                }
+                _replicas.reserve(replicas.size());
+                for (client &c : replicas) {
+                    _replicas.push_back(replica {&c});
+                }
+                _samples.reserve(max_samples);
+
+                namespace sm = metrics;
+                std::vector<sm::label_instance> labels {sm::label_instance("group", _opts.name),
+                                                        sm::label_instance("id", next_group_id++)};
+                _metrics.add_group(
+                    "rpc_client_group",
+                    {
+                        sm::make_derive("calls", _stats.calls, sm::description("Counts calls made"), labels),
+                        sm::make_derive("hedged", _stats.hedged,
+                                        sm::description("Counts calls sent again to another replica. "
+                                                        "Divide by calls to get the hedge rate."),
+                                        labels),
+                        sm::make_derive("hedge_wins", _stats.hedge_wins,
+                                        sm::description("Counts hedged calls answered first by the second replica"),
+                                        labels),
+                        sm::make_derive("errors", _stats.errors,
+                                        sm::description("Counts calls failed on every replica tried"), labels),
+                        sm::make_gauge(
+                            "hedge_delay_us",
+                            [this] {
+                                return std::chrono::duration_cast<std::chrono::microseconds>(_hedge_delay).count();
+                            },
+                            sm::description("Holds the time after which a call is hedged"), labels),
+                    });
+            }
+
+            double client_group::load(unsigned i) const {
+                auto &r = _replicas[i];
+                return (r.outstanding + 1) * std::chrono::duration<double>(r.latency).count();
+            }
+
+            unsigned client_group::pick(int exclude) {
+                unsigned n = _replicas.size();
+                std::uniform_int_distribution<unsigned> dist(0, n - 1);
+                int first = -1;
+                int second = -1;
+                for (unsigned tries = 0; tries < 2 * n && second < 0; tries++) {
+                    int i = dist(_rng);
+                    if (i == exclude || i == first || _replicas[i].c->error()) {
+                        continue;
+                    }
+                    (first < 0 ? first : second) = i;
+                }
+                if (first < 0) {
+                    // Nothing healthy was found; the call fails on whichever replica it goes to
+                    return exclude < 0 ? 0 : (exclude + 1) % n;
+                }
+                if (second < 0) {
+                    return first;
+                }
+                return load(second) < load(first) ? second : first;
+            }
+
+            bool client_group::may_hedge() const {
+                return _stats.hedged < _opts.max_hedge_ratio * _stats.calls;
+            }
+
+            void client_group::update_latency(unsigned r, clock_type::duration latency) {
+                auto &rep = _replicas[r];
+                rep.latency = rep.sampled ? rep.latency + (latency - rep.latency) / 8 : latency;
+                rep.sampled = true;
+            }
+
+            void client_group::add_sample(unsigned r, clock_type::duration latency) {
+                update_latency(r, latency);
+                if (_samples.size() < max_samples) {
+                    _samples.push_back(latency);
+                } else {
+                    _samples[_next_sample] = latency;
+                    _next_sample = (_next_sample + 1) % max_samples;
+                }
+                if (_samples.size() < min_samples || ++_samples_since_update < update_interval) {
+                    return;
+                }
+                _samples_since_update = 0;
+                auto sorted = _samples;
+                auto nth = sorted.begin() + size_t(_opts.percentile * (sorted.size() - 1));
+                std::nth_element(sorted.begin(), nth, sorted.end());
+                _hedge_delay = std::max<clock_type::duration>(*nth, _opts.min_delay);
+            }
+
+            future<> client_group::close() {
+                return _gate.close();
+            }
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,113 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/rpc/deadline_semaphore.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            deadline_semaphore::deadline_semaphore(size_t count) : _count(count) {
+                _expiry.set_callback([this] { expire(); });
+            }
+
+            future<deadline_semaphore::units> deadline_semaphore::get_units(size_t n,
+                                                                            boost::optional<time_point> deadline,
+                                                                            unsigned priority_class) {
+                if (_ex) {
+                    return make_exception_future<units>(_ex);
+                }
+                if (_waiters.empty() && _count >= n) {
+                    _count -= n;
+                    return make_ready_future<units>(units(*this, n));
+                }
+                if (deadline && *deadline <= clock_type::now()) {
+                    return make_exception_future<units>(semaphore_timed_out());
+                }
+                auto when = deadline.value_or(time_point::max());
+                auto it =
+                    _waiters.emplace(key_type(priority_class, when, _arrivals++), waiter {promise<units>(), n}).first;
+                auto f = it->second.pr.get_future();
+                if (deadline && (!_expiry.armed() || when < _expiry.get_timeout())) {
+                    _expiry.rearm(when);
+                }
+                return f;
+            }
+
+            void deadline_semaphore::signal(size_t n) noexcept {
+                _count += n;
+                wake();
+            }
+
+            void deadline_semaphore::wake() noexcept {
+                while (!_waiters.empty()) {
+                    auto it = _waiters.begin();
+                    auto n = it->second.n;
+                    if (n > _count) {
+                        break;
+                    }
+                    _count -= n;
+                    it->second.pr.set_value(units(*this, n));
+                    _waiters.erase(it);
+                }
+            }
+
+            void deadline_semaphore::expire() noexcept {
+                auto now = clock_type::now();
+                auto next = time_point::max();
+                auto it = _waiters.begin();
+                while (it != _waiters.end()) {
+                    // it is the first waiter of its class, the one with the earliest deadline
+                    auto cls = std::get<0>(it->first);
+                    while (it != _waiters.end() && std::get<0>(it->first) == cls && std::get<1>(it->first) <= now) {
+                        it->second.pr.set_exception(semaphore_timed_out());
+                        it = _waiters.erase(it);
+                    }
+                    if (it != _waiters.end() && std::get<0>(it->first) == cls) {
+                        next = std::min(next, std::get<1>(it->first));
+                        it = _waiters.upper_bound(
+                            key_type(cls, time_point::max(), std::numeric_limits<uint64_t>::max()));
+                    }
+                }
+                if (next != time_point::max()) {
+                    _expiry.arm(next);
+                }
+                // The waiters that timed out may have held back smaller ones
+                wake();
+            }
+
+            void deadline_semaphore::broken() noexcept {
+                _ex = std::make_exception_ptr(broken_semaphore());
+                _expiry.cancel();
+                for (auto &&w : _waiters) {
+                    w.second.pr.set_exception(_ex);
+                }
+                _waiters.clear();
+            }
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,158 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/rpc/response_cache.hh>
+#include <nil/actor/core/metrics.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            // Replies up to that size are copied rather than pinning the chunks they were marshalled into
+            static constexpr size_t max_copied_reply = 4096;
+
+            response_cache::response_cache(response_cache_options opts, uint64_t verb) : _opts(std::move(opts)) {
+                namespace sm = metrics;
+                std::vector<sm::label_instance> labels {sm::label_instance("cache", _opts.name),
+                                                        sm::label_instance("verb", verb)};
+                _metrics.add_group(
+                    "rpc_response_cache",
+                    {
+                        sm::make_derive("hits", _stats.hits, sm::description("Counts requests answered from the cache"),
+                                        labels),
+                        sm::make_derive("misses", _stats.misses,
+                                        sm::description("Counts requests passed to the handler. "
+                                                        "The hit ratio is hits over hits and misses."),
+                                        labels),
+                        sm::make_derive("evictions", _stats.evictions,
+                                        sm::description("Counts replies dropped to stay within the memory budget"),
+                                        labels),
+                        sm::make_derive("invalidations", _stats.invalidations,
+                                        sm::description("Counts replies dropped on request"), labels),
+                        sm::make_gauge("memory", [this] { return _memory; },
+                                       sm::description("Holds the bytes of cached arguments and replies"), labels),
+                        sm::make_gauge("entries", [this] { return _lru.size(); },
+                                       sm::description("Holds the number of cached replies"), labels),
+                    });
+            }
+
+            boost::optional<snd_buf> response_cache::lookup(const sstring &key, size_t head_space) {
+                auto i = _index.find(std::string_view(key.data(), key.size()));
+                if (i == _index.end()) {
+                    _stats.misses++;
+                    return boost::none;
+                }
+                auto it = i->second;
+                if (it->expiry <= clock_type::now()) {
+                    erase(it);
+                    _stats.misses++;
+                    return boost::none;
+                }
+                _lru.splice(_lru.begin(), _lru, it);
+                _stats.hits++;
+                std::vector<temporary_buffer<char>> bufs;
+                bufs.reserve(it->reply.size() + 1);
+                bufs.emplace_back(head_space);
+                for (auto &b : it->reply) {
+                    bufs.push_back(b.share());
+                }
+                return snd_buf(std::move(bufs), head_space + it->size);
+            }
+
+            void response_cache::insert(miss m, snd_buf &reply, size_t head_space) {
+                if (m.generation != _generation) {
+                    return;
+                }
+                auto &key = m.key;
+                auto size = reply.size - head_space;
+                auto footprint = key.size() + size;
+                if (footprint > _opts.memory_budget) {
+                    return;
+                }
+                auto i = _index.find(std::string_view(key.data(), key.size()));
+                if (i != _index.end()) {
+                    erase(i->second);
+                }
+                std::vector<temporary_buffer<char>> bufs;
+                if (size <= max_copied_reply) {
+                    auto data = key_of(reply, head_space);
+                    bufs.emplace_back(data.data(), data.size());
+                } else {
+                    auto skip = head_space;
+                    auto left = size;
+                    auto add = [&](temporary_buffer<char> &b) {
+                        auto from = std::min(skip, b.size());
+                        skip -= from;
+                        auto n = std::min(b.size() - from, left);
+                        if (n) {
+                            bufs.push_back(b.share(from, n));
+                            left -= n;
+                        }
+                    };
+                    if (auto *one = std::get_if<temporary_buffer<char>>(&reply.bufs)) {
+                        add(*one);
+                    } else {
+                        for (auto &b : std::get<std::vector<temporary_buffer<char>>>(reply.bufs)) {
+                            add(b);
+                        }
+                    }
+                }
+                while (_memory + footprint > _opts.memory_budget) {
+                    erase(std::prev(_lru.end()));
+                    _stats.evictions++;
+                }
+                _lru.push_front(entry {std::move(key), std::move(bufs), size, clock_type::now() + _opts.ttl});
+                auto &e = _lru.front();
+                _index.emplace(std::string_view(e.key.data(), e.key.size()), _lru.begin());
+                _memory += footprint;
+            }
+
+            void response_cache::invalidate(const sstring &key) {
+                _generation++;
+                auto i = _index.find(std::string_view(key.data(), key.size()));
+                if (i != _index.end()) {
+                    erase(i->second);
+                    _stats.invalidations++;
+                }
+            }
+
+            void response_cache::clear() {
+                _generation++;
+                _stats.invalidations += _lru.size();
+                _index.clear();
+                _lru.clear();
+                _memory = 0;
+            }
+
+            void response_cache::erase(std::list<entry>::iterator it) {
+                _memory -= it->key.size() + it->size;
+                _index.erase(std::string_view(it->key.data(), it->key.size()));
+                _lru.erase(it);
+            }
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
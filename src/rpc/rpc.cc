@@ -31,6 +31,8 @@
 
 #include <boost/range/adaptor/map.hpp>
 
+#include <cstring>
+
 namespace nil {
     namespace actor {
 
@@ -93,6 +95,104 @@ namespace nil {
                 }
             }
 
+            namespace {
+
+                // Full-size chunks of messages sent from this shard, kept for the next ones
+                class snd_chunk_pool {
+                    static constexpr size_t max_free = 16;
+                    std::vector<std::unique_ptr<char[]>> _free;
+
+                public:
+                    static snd_chunk_pool &local() {
+                        // Never destroyed: chunks may come back while the shard shuts down
+                        static thread_local auto *pool = new snd_chunk_pool;
+                        return *pool;
+                    }
+                    temporary_buffer<char> get() {
+                        std::unique_ptr<char[]> chunk;
+                        if (!_free.empty()) {
+                            chunk = std::move(_free.back());
+                            _free.pop_back();
+                        } else {
+                            chunk.reset(new char[snd_buf::chunk_size]);
+                        }
+                        auto p = chunk.release();
+                        return temporary_buffer<char>(p, snd_buf::chunk_size,
+                                                      make_deleter([p, shard = this_shard_id()] {
+                                                          if (shard == this_shard_id()) {
+                                                              local().put(p);
+                                                          } else {
+                                                              delete[] p;
+                                                          }
+                                                      }));
+                    }
+                    void put(char *p) noexcept {
+                        if (_free.size() < max_free) {
+                            _free.emplace_back(p);
+                        } else {
+                            delete[] p;
+                        }
+                    }
+                };
+
+            }    // namespace
+
+            snd_buf_output_stream::snd_buf_output_stream(size_t head_space, size_t size_hint) {
+                static constexpr size_t min_chunk_size = 256;
+                next_chunk(std::max({head_space, size_hint, min_chunk_size}));
+                _pos += head_space;
+            }
+
+            void snd_buf_output_stream::next_chunk(size_t min_size) {
+                auto size = min_size;
+                if (!_chunks.empty()) {
+                    auto &last = _chunks.back();
+                    size = std::max(size, 2 * last.size());
+                    last.trim(_pos - last.get());
+                    _done += last.size();
+                }
+                size = std::min(size, snd_buf::chunk_size);
+                if (size == snd_buf::chunk_size) {
+                    _chunks.push_back(snd_chunk_pool::local().get());
+                } else {
+                    _chunks.emplace_back(size);
+                }
+                _pos = _chunks.back().get_write();
+                _end = _pos + _chunks.back().size();
+            }
+
+            void snd_buf_output_stream::write_slow(const char *p, size_t size) {
+                while (size) {
+                    if (_pos == _end) {
+                        next_chunk(size);
+                    }
+                    auto n = std::min(size, size_t(_end - _pos));
+                    _pos = std::copy_n(p, n, _pos);
+                    p += n;
+                    size -= n;
+                }
+            }
+
+            void snd_buf_output_stream::skip(size_t size) {
+                while (size) {
+                    if (_pos == _end) {
+                        next_chunk(size);
+                    }
+                    auto n = std::min(size, size_t(_end - _pos));
+                    _pos += n;
+                    size -= n;
+                }
+            }
+
+            snd_buf snd_buf_output_stream::release() && {
+                auto total = size();
+                _chunks.back().trim(_pos - _chunks.back().get());
+                if (_chunks.size() == 1) {
+                    return snd_buf(std::move(_chunks.front()));
+                }
+                return snd_buf(std::move(_chunks), total);
+            }
+
             // Make a copy of a remote buffer. No data is actually copied, only pointers and
             // a deleter of a new buffer takes care of deleting the original buffer
             template<typename T>    // T is either snd_buf or rcv_buf
@@ -123,6 +223,53 @@ namespace nil {
             template snd_buf make_shard_local_buffer_copy(foreign_ptr<std::unique_ptr<snd_buf>>);
             template rcv_buf make_shard_local_buffer_copy(foreign_ptr<std::unique_ptr<rcv_buf>>);
 
+            namespace {
+
+                // Tasks for other shards, at most one batch on its way to each of them at a time
+                class cross_shard_batches {
+                    struct destination {
+                        std::vector<noncopyable_function<void()>> pending;
+                        bool in_flight = false;
+                    };
+                    std::vector<destination> _destinations;
+
+                public:
+                    cross_shard_batches() : _destinations(smp::count) {
+                    }
+                    void submit(unsigned shard, noncopyable_function<void()> task) {
+                        auto &d = _destinations[shard];
+                        d.pending.push_back(std::move(task));
+                        if (!d.in_flight) {
+                            flush(shard);
+                        }
+                    }
+
+                private:
+                    void flush(unsigned shard) {
+                        auto &d = _destinations[shard];
+                        d.in_flight = true;
+                        (void)smp::submit_to(shard, [batch = std::exchange(d.pending, {})]() mutable {
+                            for (auto &task : batch) {
+                                task();
+                            }
+                        }).then_wrapped([this, shard](future<> f) {
+                            f.ignore_ready_future();
+                            auto &d = _destinations[shard];
+                            d.in_flight = false;
+                            if (!d.pending.empty()) {
+                                flush(shard);
+                            }
+                        });
+                    }
+                };
+
+            }    // namespace
+
+            void submit_batched(unsigned shard, noncopyable_function<void()> task) {
+                static thread_local cross_shard_batches batches;
+                batches.submit(shard, std::move(task));
+            }
+
             snd_buf connection::compress(snd_buf buf) {
                 if (_compressor) {
                     buf = _compressor->compress(4, std::move(buf));
@@ -147,48 +294,151 @@ namespace nil {
                 }
             }
 
+            // Chunk header: the tag of the message and the size of the chunk, its top bit set on the last chunk
+            static constexpr size_t frame_chunk_header_size = 8;
+            static constexpr uint32_t frame_chunk_last = uint32_t(1) << 31;
+
+            size_t connection::pending_messages() const {
+                size_t n = 0;
+                for (auto &c : _outgoing_classes) {
+                    n += c.second.entries.size();
+                }
+                return n;
+            }
+
+            size_t connection::next_write_size(const outgoing_entry &d) const {
+                // Not known exactly before the headers are trimmed and the buffer compressed
+                auto left = d.buf.size - d.sent;
+                return _continuation_negotiated ? std::min(left, send_quantum) : left;
+            }
+
+            connection::outgoing_class *connection::next_outgoing_class() {
+                while (!_active_classes.empty()) {
+                    auto *c = _active_classes.front();
+                    if (c->entries.empty()) {
+                        // Emptied by expired or cancelled messages, or by the last send
+                        c->active = false;
+                        c->has_turn = false;
+                        c->deficit = 0;
+                        _active_classes.pop_front();
+                        continue;
+                    }
+                    if (!c->has_turn) {
+                        c->deficit += send_quantum * c->weight;
+                        c->has_turn = true;
+                    }
+                    if (c->deficit >= next_write_size(c->entries.front())) {
+                        return c;
+                    }
+                    c->has_turn = false;
+                    _active_classes.pop_front();
+                    _active_classes.push_back(c);
+                }
+                return nullptr;
+            }
+
+            snd_buf connection::next_chunk(outgoing_entry &d, size_t size) {
+                bool last = d.sent + size == d.buf.size;
+                std::vector<temporary_buffer<char>> bufs;
+                temporary_buffer<char> header(frame_chunk_header_size);
+                write_le<uint32_t>(header.get_write(), d.chunk_tag);
+                write_le<uint32_t>(header.get_write() + 4, uint32_t(size) | (last ? frame_chunk_last : 0));
+                bufs.push_back(std::move(header));
+                auto skip = d.sent;
+                auto left = size;
+                auto add = [&](temporary_buffer<char> &b) {
+                    auto from = std::min(skip, b.size());
+                    skip -= from;
+                    auto n = std::min(b.size() - from, left);
+                    if (n) {
+                        bufs.push_back(b.share(from, n));
+                        left -= n;
+                    }
+                };
+                if (auto *one = std::get_if<temporary_buffer<char>>(&d.buf.bufs)) {
+                    add(*one);
+                } else {
+                    for (auto &b : std::get<std::vector<temporary_buffer<char>>>(d.buf.bufs)) {
+                        add(b);
+                    }
+                }
+                d.sent += size;
+                return snd_buf(std::move(bufs), frame_chunk_header_size + size);
+            }
+
+            template<connection::outgoing_queue_type QueueType>
+            void connection::prepare_outgoing(outgoing_entry &d) {
+                d.t.cancel();    // cancel timeout timer
+                if (d.pcancel) {
+                    d.pcancel->cancel_send = std::function<void()>();    // request is no longer cancellable
+                }
+                if (QueueType == outgoing_queue_type::request) {
+                    static_assert(snd_buf::chunk_size >= request_frame_headroom, "send buffer chunk size is too small");
+                    // The trace context comes first, then the expiration time, each of them
+                    // dropped if not negotiated
+                    auto &front = d.buf.front();
+                    if (!_tracing_negotiated) {
+                        front.trim_front(trace_context_size);
+                        d.buf.size -= trace_context_size;
+                    }
+                    auto expire_offset = _tracing_negotiated ? trace_context_size : 0;
+                    if (_timeout_negotiated) {
+                        auto expire = d.t.get_timeout();
+                        uint64_t left = 0;
+                        if (expire != typename timer<rpc_clock_type>::time_point()) {
+                            left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       expire - timer<rpc_clock_type>::clock::now())
+                                       .count();
+                        }
+                        write_le<uint64_t>(front.get_write() + expire_offset, left);
+                    } else {
+                        if (_tracing_negotiated) {
+                            std::memmove(front.get_write() + 8, front.get(), trace_context_size);
+                        }
+                        front.trim_front(8);
+                        d.buf.size -= 8;
+                    }
+                }
+                d.buf = compress(std::move(d.buf));
+                d.chunk_tag = _next_chunk_tag++;
+                d.prepared = true;
+            }
+
             template<connection::outgoing_queue_type QueueType>
             void connection::send_loop() {
                 _send_loop_stopped =
                     do_until(
                         [this] { return _error; },
                         [this] {
-                            return _outgoing_queue_cond.wait([this] { return !_outgoing_queue.empty(); }).then([this] {
-                                // despite using wait with predicated above _outgoing_queue can still be empty here if
-                                // there is only one entry on the list and its expire timer runs after wait() returned
-                                // ready future, but before this continuation runs.
-                                if (_outgoing_queue.empty()) {
+                            return _outgoing_queue_cond.wait([this] { return !_active_classes.empty(); }).then([this] {
+                                // despite using wait with predicated above the queues can still be empty here if
+                                // their last entries expired after wait() returned ready future, but before this
+                                // continuation runs.
+                                auto *c = next_outgoing_class();
+                                if (!c) {
                                     return make_ready_future();
                                 }
-                                auto d = std::move(_outgoing_queue.front());
-                                _outgoing_queue.pop_front();
-                                d.t.cancel();    // cancel timeout timer
-                                if (d.pcancel) {
-                                    d.pcancel->cancel_send =
-                                        std::function<void()>();    // request is no longer cancellable
+                                auto &d = c->entries.front();
+                                if (!d.prepared) {
+                                    prepare_outgoing<QueueType>(d);
                                 }
-                                if (QueueType == outgoing_queue_type::request) {
-                                    static_assert(snd_buf::chunk_size >= 8, "send buffer chunk size is too small");
-                                    if (_timeout_negotiated) {
-                                        auto expire = d.t.get_timeout();
-                                        uint64_t left = 0;
-                                        if (expire != typename timer<rpc_clock_type>::time_point()) {
-                                            left = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                                       expire - timer<rpc_clock_type>::clock::now())
-                                                       .count();
-                                        }
-                                        write_le<uint64_t>(d.buf.front().get_write(), left);
-                                    } else {
-                                        d.buf.front().trim_front(8);
-                                        d.buf.size -= 8;
-                                    }
+                                auto size = d.buf.size - d.sent;
+                                if (_continuation_negotiated) {
+                                    size = std::min(size, send_quantum);
+                                }
+                                c->deficit -= std::min(c->deficit, size);
+                                if (d.sent + size != d.buf.size) {
+                                    // The rest waits for the next turn of the class
+                                    return send_buffer(next_chunk(d, size)).then([this] { return _write_buf.flush(); });
                                 }
-                                d.buf = compress(std::move(d.buf));
-                                auto f = send_buffer(std::move(d.buf)).then([this] {
+                                auto done = std::move(d);
+                                c->entries.pop_front();
+                                auto buf = _continuation_negotiated ? next_chunk(done, size) : std::move(done.buf);
+                                auto f = send_buffer(std::move(buf)).then([this] {
                                     _stats.sent_messages++;
                                     return _write_buf.flush();
                                 });
-                                return f.finally([d = std::move(d)] {});
+                                return f.finally([d = std::move(done)] {});
                             });
                         })
                         .handle_exception([this](std::exception_ptr eptr) { _error = true; });
@@ -202,19 +452,20 @@ namespace nil {
                 }
                 return when_all(std::move(_send_loop_stopped), std::move(_sink_closed_future))
                     .then([this](std::tuple<future<>, future<bool>> res) {
-                        _outgoing_queue.clear();
+                        _active_classes.clear();
+                        _outgoing_classes.clear();
                         // both _send_loop_stopped and _sink_closed_future are never exceptional
                         bool sink_closed = std::get<1>(res).get0();
                         return _connected && !sink_closed ? _write_buf.close() : make_ready_future();
                     });
             }
 
-            void connection::set_socket(connected_socket &&fd) {
+            void connection::set_socket(connected_socket &&fd, connected_socket_input_stream_config input_config) {
                 if (_connected) {
                     throw std::runtime_error("already connected");
                 }
                 _fd = std::move(fd);
-                _read_buf = _fd.input();
+                _read_buf = _fd.input(input_config);
                 _write_buf = _fd.output();
                 _connected = true;
             }
@@ -249,20 +500,31 @@ namespace nil {
                     if (timeout && *timeout <= rpc_clock_type::now()) {
                         return make_ready_future<>();
                     }
-                    _outgoing_queue.emplace_back(std::move(buf));
-                    auto deleter = [this, it = std::prev(_outgoing_queue.cend())] { _outgoing_queue.erase(it); };
+                    auto sg = current_scheduling_group();
+                    auto it = _outgoing_classes.find(sg);
+                    if (it == _outgoing_classes.end()) {
+                        it = _outgoing_classes.emplace(sg, outgoing_class()).first;
+                        it->second.weight = std::max(send_weight(sg), 1u);
+                    }
+                    auto &c = it->second;
+                    c.entries.emplace_back(std::move(buf));
+                    auto deleter = [&c, it = std::prev(c.entries.cend())] { c.entries.erase(it); };
                     if (timeout) {
-                        auto &t = _outgoing_queue.back().t;
+                        auto &t = c.entries.back().t;
                         t.set_callback(deleter);
                         t.arm(timeout.value());
                     }
                     if (cancel) {
                         cancel->cancel_send = std::move(deleter);
-                        cancel->send_back_pointer = &_outgoing_queue.back().pcancel;
-                        _outgoing_queue.back().pcancel = cancel;
+                        cancel->send_back_pointer = &c.entries.back().pcancel;
+                        c.entries.back().pcancel = cancel;
+                    }
+                    if (!c.active) {
+                        c.active = true;
+                        _active_classes.push_back(&c);
                     }
                     _outgoing_queue_cond.signal();
-                    return _outgoing_queue.back().p->get_future();
+                    return c.entries.back().p->get_future();
                 } else {
                     return make_exception_future<>(closed_error());
                 }
@@ -335,12 +597,21 @@ namespace nil {
                 });
             }
 
-            inline future<rcv_buf> read_rcv_buf(input_stream<char> &in, uint32_t size) {
-                return in.read_up_to(size).then([&, size](temporary_buffer<char> data) mutable {
+            // Reads size bytes of a frame whose header was read. Given the socket in reads from, the bytes
+            // not buffered yet are read in one buffer of their size rather than in buffers sized after the
+            // previous reads
+            inline future<rcv_buf> read_rcv_buf(input_stream<char> &in, uint32_t size, connected_socket *fd = nullptr) {
+                if (fd) {
+                    fd->set_read_size_hint(size);
+                }
+                return in.read_up_to(size).then([&in, size, fd](temporary_buffer<char> data) mutable {
                     rcv_buf rb(size);
                     if (data.size() == 0) {
                         return make_ready_future<rcv_buf>(rcv_buf());
                     } else if (data.size() == size) {
+                        if (fd) {
+                            fd->set_read_size_hint(0);
+                        }
                         rb.bufs = std::move(data);
                         return make_ready_future<rcv_buf>(std::move(rb));
                     } else {
@@ -348,8 +619,11 @@ namespace nil {
                         std::vector<temporary_buffer<char>> v;
                         v.push_back(std::move(data));
                         rb.bufs = std::move(v);
-                        return do_with(std::move(rb), std::move(size), [&in](rcv_buf &rb, uint32_t &left) {
+                        return do_with(std::move(rb), std::move(size), [&in, fd](rcv_buf &rb, uint32_t &left) {
                             return repeat([&]() {
+                                       if (fd) {
+                                           fd->set_read_size_hint(left);
+                                       }
                                        return in.read_up_to(left).then([&](temporary_buffer<char> data) {
                                            if (!data.size()) {
                                                rb.size -= left;
@@ -362,7 +636,12 @@ namespace nil {
                                            }
                                        });
                                    })
-                                .then([&rb] { return std::move(rb); });
+                                .then([&rb, fd] {
+                                    if (fd) {
+                                        fd->set_read_size_hint(0);
+                                    }
+                                    return std::move(rb);
+                                });
                         });
                     }
                 });
@@ -387,7 +666,8 @@ namespace nil {
                     if (!size) {
                         return FrameType::make_value(h, rcv_buf());
                     } else {
-                        return read_rcv_buf(in, size).then([this, info, h = std::move(h), size](rcv_buf rb) {
+                        auto fd = socket_of(in);
+                        return read_rcv_buf(in, size, fd).then([this, info, h = std::move(h), size](rcv_buf rb) {
                             if (rb.size != size) {
                                 _logger(info,
                                         format("unexpected eof on a {} while reading data: expected {:d} got {:d}",
@@ -403,6 +683,19 @@ namespace nil {
                 });
             }
 
+            static void append_to_packet(net::packet &p, rcv_buf data) {
+                auto *one = std::get_if<temporary_buffer<char>>(&data.bufs);
+                if (one) {
+                    p = net::packet(std::move(p), std::move(*one));
+                } else {
+                    auto &&bufs = std::get<std::vector<temporary_buffer<char>>>(data.bufs);
+                    p.reserve(bufs.size());
+                    for (auto &&b : bufs) {
+                        p = net::packet(std::move(p), std::move(b));
+                    }
+                }
+            }
+
             template<typename FrameType>
             typename FrameType::return_type connection::read_frame_compressed(socket_address info,
                                                                               std::unique_ptr<compressor> &compressor,
@@ -423,7 +716,9 @@ namespace nil {
                         }
                         auto ptr = compress_header.get();
                         auto size = read_le<uint32_t>(ptr);
-                        return read_rcv_buf(in, size).then([this, size, &compressor, info](rcv_buf compressed_data) {
+                        auto fd = socket_of(in);
+                        return read_rcv_buf(in, size, fd).then([this, size, &compressor,
+                                                                info](rcv_buf compressed_data) {
                             if (compressed_data.size != size) {
                                 _logger(
                                     info,
@@ -436,16 +731,7 @@ namespace nil {
                             }
                             auto eb = compressor->decompress(std::move(compressed_data));
                             net::packet p;
-                            auto *one = std::get_if<temporary_buffer<char>>(&eb.bufs);
-                            if (one) {
-                                p = net::packet(std::move(p), std::move(*one));
-                            } else {
-                                auto &&bufs = std::get<std::vector<temporary_buffer<char>>>(eb.bufs);
-                                p.reserve(bufs.size());
-                                for (auto &&b : bufs) {
-                                    p = net::packet(std::move(p), std::move(b));
-                                }
-                            }
+                            append_to_packet(p, std::move(eb));
                             return do_with(as_input_stream(std::move(p)), [this, info](input_stream<char> &in) {
                                 return read_frame<FrameType>(info, in);
                             });
@@ -456,6 +742,86 @@ namespace nil {
                 }
             }
 
+            template<typename FrameType>
+            typename FrameType::return_type connection::read_frame_chunked(socket_address info,
+                                                                           std::unique_ptr<compressor> &compressor,
+                                                                           input_stream<char> &in) {
+                if (!_continuation_negotiated) {
+                    return read_frame_compressed<FrameType>(info, compressor, in);
+                }
+                return do_with(boost::optional<net::packet>(), [this, info, &compressor,
+                                                                &in](boost::optional<net::packet> &frame) {
+                    return repeat([this, info, &in, &frame] {
+                               return in.read_exactly(frame_chunk_header_size)
+                                   .then([this, info, &in, &frame](temporary_buffer<char> header) {
+                                       if (header.size() != frame_chunk_header_size) {
+                                           if (header.size() != 0) {
+                                               _logger(info, format("unexpected eof on a {} while reading chunk "
+                                                                    "header: expected {:d} got {:d}",
+                                                                    FrameType::role(), frame_chunk_header_size,
+                                                                    header.size()));
+                                           }
+                                           return make_ready_future<stop_iteration>(stop_iteration::yes);
+                                       }
+                                       auto tag = read_le<uint32_t>(header.get());
+                                       auto size = read_le<uint32_t>(header.get() + 4);
+                                       bool last = size & frame_chunk_last;
+                                       size &= ~frame_chunk_last;
+                                       // A peer holding more messages open than it has scheduling groups
+                                       // sending, or more bytes than we accept, is broken or hostile
+                                       if (!_partial_frames.count(tag) &&
+                                           _partial_frames.size() >= max_partial_frames) {
+                                           _logger(info, format("protocol error on a {}: more than {:d} messages "
+                                                                "in progress",
+                                                                FrameType::role(), max_partial_frames));
+                                           drop_partial_frames();
+                                           return make_ready_future<stop_iteration>(stop_iteration::yes);
+                                       }
+                                       if (_partial_frames_size + size > max_partial_frames_size()) {
+                                           _logger(info, format("protocol error on a {}: messages in progress "
+                                                                "exceed {:d} bytes",
+                                                                FrameType::role(), max_partial_frames_size()));
+                                           drop_partial_frames();
+                                           return make_ready_future<stop_iteration>(stop_iteration::yes);
+                                       }
+                                       return read_rcv_buf(in, size, socket_of(in)).then([this, info, &frame, tag, size,
+                                                                           last](rcv_buf data) {
+                                           if (data.size != size) {
+                                               _logger(info, format("unexpected eof on a {} while reading chunk: "
+                                                                    "expected {:d} got {:d}",
+                                                                    FrameType::role(), size, data.size));
+                                               return stop_iteration::yes;
+                                           }
+                                           auto &partial = _partial_frames[tag];
+                                           append_to_packet(partial, std::move(data));
+                                           _partial_frames_size += size;
+                                           if (!last) {
+                                               return stop_iteration::no;
+                                           }
+                                           _partial_frames_size -= partial.len();
+                                           frame = std::move(partial);
+                                           _partial_frames.erase(tag);
+                                           return stop_iteration::yes;
+                                       });
+                                   });
+                           })
+                        .then([this, info, &compressor, &frame] {
+                            if (!frame) {
+                                return FrameType::empty_value();
+                            }
+                            return do_with(as_input_stream(std::move(*frame)),
+                                           [this, info, &compressor](input_stream<char> &in) {
+                                               return read_frame_compressed<FrameType>(info, compressor, in);
+                                           });
+                        });
+                });
+            }
+
+            void connection::drop_partial_frames() {
+                _partial_frames.clear();
+                _partial_frames_size = 0;
+            }
+
             struct stream_frame {
                 using opt_buf_type = boost::optional<rcv_buf>;
                 using return_type = future<opt_buf_type>;
@@ -587,6 +953,12 @@ namespace nil {
                         case protocol_features::TIMEOUT:
                             _timeout_negotiated = true;
                             break;
+                        case protocol_features::TRACING:
+                            _tracing_negotiated = true;
+                            break;
+                        case protocol_features::FRAME_CONTINUATION:
+                            _continuation_negotiated = true;
+                            break;
                         case protocol_features::CONNECTION_ID: {
                             _id = deserialize_connection_id(e.second);
                             break;
@@ -598,6 +970,11 @@ namespace nil {
                 }
             }
 
+            unsigned client::send_weight(scheduling_group sg) const {
+                auto it = _options.send_weights.find(sg);
+                return it != _options.send_weights.end() ? it->second : 1;
+            }
+
             future<> client::negotiate_protocol(input_stream<char> &in) {
                 return receive_negotiation_frame(*this, in).then(
                     [this](feature_map features) { return negotiate(features); });
@@ -637,13 +1014,13 @@ namespace nil {
 
             future<response_frame::header_and_buffer_type>
                 client::read_response_frame_compressed(input_stream<char> &in) {
-                return read_frame_compressed<response_frame>(_server_addr, _compressor, in);
+                return read_frame_chunked<response_frame>(_server_addr, _compressor, in);
             }
 
             stats client::get_stats() const {
                 stats res = _stats;
                 res.wait_reply = _outstanding.size();
-                res.pending = _outgoing_queue.size();
+                res.pending = pending_messages();
                 return res;
             }
 
@@ -719,7 +1096,7 @@ namespace nil {
                             fd.set_keepalive(true);
                             fd.set_keepalive_parameters(ops.keepalive.value());
                         }
-                        set_socket(std::move(fd));
+                        set_socket(std::move(fd), _options.input_stream_config);
 
                         feature_map features;
                         if (_options.compressor_factory) {
@@ -735,6 +1112,12 @@ namespace nil {
                         if (!_options.isolation_cookie.empty()) {
                             features[protocol_features::ISOLATION] = _options.isolation_cookie;
                         }
+                        if (_options.send_trace_context) {
+                            features[protocol_features::TRACING] = "";
+                        }
+                        if (_options.send_in_chunks && !_options.stream_parent) {
+                            features[protocol_features::FRAME_CONTINUATION] = "";
+                        }
 
                         return send_negotiation_frame(std::move(features))
                             .then([this] { return negotiate_protocol(_read_buf); })
@@ -845,6 +1228,63 @@ namespace nil {
                 client(l, s, client_options {}, std::move(socket), addr, local) {
             }
 
+            striped_client::striped_client(striping_options options,
+                                           noncopyable_function<std::unique_ptr<client>()> connect) :
+                _options(options) {
+                auto n = std::max(options.stripes, 1u);
+                for (unsigned i = 0; i < n; ++i) {
+                    _stripes.push_back(connect());
+                    _stripes.back()->_message_id = i + 1;
+                    _stripes.back()->_message_id_step = n;
+                }
+            }
+
+            client &striped_client::pick(size_t size) {
+                // With a bulk threshold, the last connection only carries bulk requests
+                unsigned n = _stripes.size();
+                if (_options.bulk_threshold && n > 1) {
+                    if (size >= _options.bulk_threshold) {
+                        return *_stripes.back();
+                    }
+                    --n;
+                }
+                // Skip broken connections as long as there are healthy ones
+                for (unsigned i = 0; i < n; ++i) {
+                    auto &c = *_stripes[_next++ % n];
+                    if (!c.error()) {
+                        return c;
+                    }
+                }
+                return *_stripes[_next++ % n];
+            }
+
+            client *striped_client::stripe_of_stream(connection_id id) noexcept {
+                for (auto &&c : _stripes) {
+                    if (c->has_stream(id)) {
+                        return c.get();
+                    }
+                }
+                return nullptr;
+            }
+
+            stats striped_client::get_stats() const {
+                stats res;
+                for (auto &&c : _stripes) {
+                    auto s = c->get_stats();
+                    res.replied += s.replied;
+                    res.pending += s.pending;
+                    res.exception_received += s.exception_received;
+                    res.sent_messages += s.sent_messages;
+                    res.wait_reply += s.wait_reply;
+                    res.timeout += s.timeout;
+                }
+                return res;
+            }
+
+            future<> striped_client::stop() {
+                return parallel_for_each(_stripes, [](std::unique_ptr<client> &c) { return c->stop(); });
+            }
+
             future<feature_map> server::connection::negotiate(feature_map requested) {
                 feature_map ret;
                 future<> f = make_ready_future<>();
@@ -864,6 +1304,17 @@ namespace nil {
                             _timeout_negotiated = true;
                             ret[protocol_features::TIMEOUT] = "";
                             break;
+                        case protocol_features::TRACING:
+                            _tracing_negotiated = true;
+                            ret[protocol_features::TRACING] = "";
+                            break;
+                        case protocol_features::FRAME_CONTINUATION:
+                            // Stream frames are read as they come
+                            if (!_is_stream) {
+                                _continuation_negotiated = true;
+                                ret[protocol_features::FRAME_CONTINUATION] = "";
+                            }
+                            break;
                         case protocol_features::STREAM_PARENT: {
                             if (!_server._options.streaming_domain) {
                                 f = make_exception_future<>(
@@ -918,6 +1369,15 @@ namespace nil {
                 return f.then([ret = std::move(ret)] { return ret; });
             }
 
+            size_t server::connection::max_partial_frames_size() const {
+                return _server._limits.max_memory;
+            }
+
+            unsigned server::connection::send_weight(scheduling_group sg) const {
+                auto it = _server._options.send_weights.find(sg);
+                return it != _server._options.send_weights.end() ? it->second : 1;
+            }
+
             future<> server::connection::negotiate_protocol(input_stream<char> &in) {
                 return receive_negotiation_frame(*this, in).then([this](feature_map requested_features) {
                     return negotiate(std::move(requested_features)).then([this](feature_map returned_features) {
@@ -928,9 +1388,10 @@ namespace nil {
 
             struct request_frame {
                 using opt_buf_type = boost::optional<rcv_buf>;
-                using header_and_buffer_type = std::tuple<boost::optional<uint64_t>, uint64_t, int64_t, opt_buf_type>;
+                using header_and_buffer_type =
+                    std::tuple<boost::optional<uint64_t>, uint64_t, int64_t, opt_buf_type, trace_context>;
                 using return_type = future<header_and_buffer_type>;
-                using header_type = std::tuple<boost::optional<uint64_t>, uint64_t, int64_t, uint32_t>;
+                using header_type = std::tuple<boost::optional<uint64_t>, uint64_t, int64_t, uint32_t, trace_context>;
                 static size_t header_size() {
                     return 20;
                 }
@@ -939,20 +1400,20 @@ namespace nil {
                 }
                 static auto empty_value() {
                     return make_ready_future<header_and_buffer_type>(
-                        header_and_buffer_type(boost::none, uint64_t(0), 0, boost::none));
+                        header_and_buffer_type(boost::none, uint64_t(0), 0, boost::none, trace_context()));
                 }
                 static header_type decode_header(const char *ptr) {
                     auto type = read_le<uint64_t>(ptr);
                     auto msgid = read_le<int64_t>(ptr + 8);
                     auto size = read_le<uint32_t>(ptr + 16);
-                    return std::make_tuple(boost::none, type, msgid, size);
+                    return std::make_tuple(boost::none, type, msgid, size, trace_context());
                 }
                 static uint32_t get_size(const header_type &t) {
                     return std::get<3>(t);
                 }
                 static auto make_value(const header_type &t, rcv_buf data) {
-                    return make_ready_future<header_and_buffer_type>(
-                        header_and_buffer_type(std::get<0>(t), std::get<1>(t), std::get<2>(t), std::move(data)));
+                    return make_ready_future<header_and_buffer_type>(header_and_buffer_type(
+                        std::get<0>(t), std::get<1>(t), std::get<2>(t), std::move(data), std::get<4>(t)));
                 }
             };
 
@@ -968,12 +1429,33 @@ namespace nil {
                 }
             };
 
+            template<typename Frame>
+            struct request_frame_with_trace : Frame {
+                static size_t header_size() {
+                    return trace_context_size + Frame::header_size();
+                }
+                static typename Frame::header_type decode_header(const char *ptr) {
+                    auto h = Frame::decode_header(ptr + trace_context_size);
+                    std::get<4>(h) = read_trace_context(ptr);
+                    return h;
+                }
+            };
+
             future<request_frame::header_and_buffer_type>
                 server::connection::read_request_frame_compressed(input_stream<char> &in) {
+                if (_tracing_negotiated) {
+                    if (_timeout_negotiated) {
+                        return read_frame_chunked<request_frame_with_trace<request_frame_with_timeout>>(
+                            _info.addr, _compressor, in);
+                    } else {
+                        return read_frame_chunked<request_frame_with_trace<request_frame>>(_info.addr, _compressor,
+                                                                                           in);
+                    }
+                }
                 if (_timeout_negotiated) {
-                    return read_frame_compressed<request_frame_with_timeout>(_info.addr, _compressor, in);
+                    return read_frame_chunked<request_frame_with_timeout>(_info.addr, _compressor, in);
                 } else {
-                    return read_frame_compressed<request_frame>(_info.addr, _compressor, in);
+                    return read_frame_chunked<request_frame>(_info.addr, _compressor, in);
                 }
             }
 
@@ -1033,6 +1515,7 @@ namespace nil {
                                             auto &type = std::get<1>(header_and_buffer);
                                             auto &msg_id = std::get<2>(header_and_buffer);
                                             auto &data = std::get<3>(header_and_buffer);
+                                            auto &trace = std::get<4>(header_and_buffer);
                                             if (!data) {
                                                 _error = true;
                                                 return make_ready_future<>();
@@ -1050,15 +1533,21 @@ namespace nil {
                                                 // If the new method of per-connection scheduling group was used, honor
                                                 // it. Otherwise, use the old per-handler scheduling group.
                                                 auto sg = _isolation_config ? _isolation_config->sched_group : h->sg;
+                                                span_ptr s;
+                                                if (trace.sampled) {
+                                                    s = start_span(trace, type, msg_id);
+                                                }
                                                 return with_scheduling_group(
                                                     sg,
                                                     [this,
                                                      timeout,
                                                      msg_id,
                                                      h,
-                                                     data = std::move(data.value())]() mutable {
+                                                     data = std::move(data.value()),
+                                                     s = std::move(s)]() mutable {
                                                         return h
-                                                            ->func(shared_from_this(), timeout, msg_id, std::move(data))
+                                                            ->func(shared_from_this(), timeout, msg_id, std::move(data),
+                                                                   std::move(s))
                                                             .finally([this, h] {
                                                                 // If anything between get_handler() and here throws, we
                                                                 // leak put_handler
@@ -1102,7 +1591,7 @@ namespace nil {
                                            const logger &l,
                                            void *serializer,
                                            connection_id id) :
-                rpc::connection(std::move(fd), l, serializer, id),
+                rpc::connection(std::move(fd), l, serializer, id, s._options.input_stream_config),
                 _server(s) {
                 _info.addr = std::move(addr);
             }
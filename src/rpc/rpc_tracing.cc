@@ -0,0 +1,155 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/rpc/rpc_tracing.hh>
+#include <nil/actor/http/function_handlers.hh>
+#include <nil/actor/http/routes.hh>
+#include <nil/actor/core/future-util.hh>
+#include <nil/actor/core/print.hh>
+#include <nil/actor/core/smp.hh>
+
+#include <boost/range/irange.hpp>
+
+#include <random>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            static thread_local trace_context current_trace;
+
+            static uint64_t random_id() {
+                static thread_local std::mt19937_64 engine {std::random_device {}()};
+                uint64_t id;
+                do {
+                    id = engine();
+                } while (!id);
+                return id;
+            }
+
+            trace_context trace_context::start(bool sampled) {
+                return trace_context {random_id(), random_id(), sampled};
+            }
+
+            trace_scope::trace_scope(const trace_context &ctx) noexcept : _saved(current_trace) {
+                current_trace = ctx;
+            }
+
+            trace_scope::~trace_scope() {
+                current_trace = _saved;
+            }
+
+            const trace_context &current_trace_context() noexcept {
+                return current_trace;
+            }
+
+            span_ptr start_span(const trace_context &ctx, uint64_t verb, int64_t msg_id) {
+                auto s = make_lw_shared<span>();
+                s->trace_id = ctx.trace_id;
+                s->span_id = random_id();
+                s->parent_span_id = ctx.span_id;
+                s->verb = verb;
+                s->msg_id = msg_id;
+                s->received = std::chrono::steady_clock::now();
+                return s;
+            }
+
+            void finish_span(const span_ptr &s) {
+                s->replied = std::chrono::steady_clock::now();
+                local_spans().push(*s);
+            }
+
+            void span_ring::push(const span &s) {
+                if (_spans.size() < _capacity) {
+                    _spans.push_back(s);
+                } else {
+                    _spans[_next] = s;
+                    _next = (_next + 1) % _capacity;
+                }
+                _recorded++;
+            }
+
+            std::vector<span> span_ring::snapshot() const {
+                std::vector<span> ret;
+                ret.reserve(_spans.size());
+                ret.insert(ret.end(), _spans.begin() + _next, _spans.end());
+                ret.insert(ret.end(), _spans.begin(), _spans.begin() + _next);
+                return ret;
+            }
+
+            span_ring &local_spans() {
+                static thread_local span_ring ring(4096);
+                return ring;
+            }
+
+            future<std::vector<span>> collect_spans() {
+                return do_with(std::vector<span>(), [](std::vector<span> &all) {
+                    return parallel_for_each(boost::irange(0u, smp::count),
+                                             [&all](unsigned shard) {
+                                                 return smp::submit_to(shard, [] {
+                                                            return local_spans().snapshot();
+                                                        }).then([&all](std::vector<span> spans) {
+                                                     all.insert(all.end(), spans.begin(), spans.end());
+                                                 });
+                                             })
+                        .then([&all] { return std::move(all); });
+                });
+            }
+
+            sstring spans_to_json(const std::vector<span> &spans) {
+                auto us = [](span::time_point t) {
+                    return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+                };
+                sstring ret = "[";
+                for (auto &s : spans) {
+                    if (&s != &spans.front()) {
+                        ret += ",";
+                    }
+                    ret += format("{{\"trace_id\":\"{:016x}\",\"span_id\":\"{:016x}\",\"parent_span_id\":\"{:016x}\","
+                                  "\"verb\":{},\"msg_id\":{},\"received\":{},\"admitted\":{},\"handler_started\":{},"
+                                  "\"handler_finished\":{},\"replied\":{}}}",
+                                  s.trace_id, s.span_id, s.parent_span_id, s.verb, s.msg_id, us(s.received),
+                                  us(s.admitted), us(s.handler_started), us(s.handler_finished), us(s.replied));
+                }
+                ret += "]";
+                return ret;
+            }
+
+            void add_tracing_routes(httpd::routes &r, const sstring &path) {
+                httpd::future_handler_function handle = [](std::unique_ptr<httpd::request> req,
+                                                            std::unique_ptr<httpd::reply> rep) {
+                    return collect_spans().then([rep = std::move(rep)](std::vector<span> spans) mutable {
+                        rep->_content = spans_to_json(spans);
+                        rep->done("json");
+                        return std::move(rep);
+                    });
+                };
+                r.put(httpd::GET, path, new httpd::function_handler(handle, "json"));
+            }
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,140 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
+#include <nil/actor/network/arp.hh>
+#include <nil/actor/network/ip.hh>
+#include <nil/actor/network/loopback.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/thread.hh>
+#include <nil/actor/core/sleep.hh>
+
+using namespace nil::actor;
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+    // Queues keep raw pointers to their devices and live until the reactor exits,
+    // so neither devices nor the stacks on top of them are ever torn down.
+    template<typename T>
+    T &leak(T *p) {
+        return *p;
+    }
+
+    const ethernet_address stale_mac({0x02, 0x00, 0x00, 0x00, 0x00, 0x99});
+
+    arp_cache_config fast_config() {
+        arp_cache_config cfg;
+        cfg.reachable_time = 100ms;
+        cfg.gc_time = 1s;
+        cfg.retransmit_time = 20ms;
+        return cfg;
+    }
+
+    struct ipv4_node {
+        interface netif;
+        ipv4 inet;
+
+        static std::shared_ptr<device> start(std::shared_ptr<device> dev) {
+            dev->set_local_queue(dev->init_local_queue({}, this_shard_id()));
+            return dev;
+        }
+
+        ipv4_node(std::shared_ptr<device> dev, const char *addr) : netif(start(std::move(dev))), inet(&netif) {
+            inet.set_host_address(ipv4_address(addr));
+            inet.set_netmask_address(ipv4_address("255.255.255.0"));
+            inet.set_arp_learn_hook([this](ethernet_address l2, ipv4_address l3) { inet.learn(l2, l3); });
+            inet.neighbors().set_config(fast_config());
+        }
+    };
+
+    struct ipv4_link {
+        ipv4_node a;
+        ipv4_node b;
+
+        explicit ipv4_link(std::pair<std::shared_ptr<device>, std::shared_ptr<device>> devs) :
+            a(std::move(devs.first), "10.0.0.1"), b(std::move(devs.second), "10.0.0.2") {
+        }
+    };
+
+    // Looks the address up until it maps to the expected hardware address
+    bool wait_for_mapping(arp_for<ipv4> &arp, ipv4_address addr, ethernet_address expected) {
+        for (unsigned i = 0; i < 100; ++i) {
+            if (arp.lookup(addr).get0() == expected) {
+                return true;
+            }
+            sleep(10ms).get();
+        }
+        return false;
+    }
+
+}    // namespace
+
+ACTOR_THREAD_TEST_CASE(test_stale_entry_is_probed) {
+    auto &link = leak(new ipv4_link(create_loopback_device_pair()));
+    auto &arp = link.a.inet.neighbors();
+    auto peer = ipv4_address("10.0.0.2");
+    BOOST_REQUIRE(arp.lookup(peer).get0() == link.b.netif.hw_address());
+
+    // Pretend the peer used to have another hardware address. Once the mapping
+    // ages out, sending to it keeps using it and probes it in the background,
+    // and the answer brings the current address in.
+    arp.learn(stale_mac, peer);
+    BOOST_REQUIRE(arp.lookup(peer).get0() == stale_mac);
+    sleep(200ms).get();
+    BOOST_REQUIRE(arp.lookup(peer).get0() == stale_mac);
+    BOOST_REQUIRE(wait_for_mapping(arp, peer, link.b.netif.hw_address()));
+}
+
+ACTOR_THREAD_TEST_CASE(test_gratuitous_arp_updates_entry) {
+    auto &link = leak(new ipv4_link(create_loopback_device_pair()));
+    auto &arp = link.a.inet.neighbors();
+    auto peer = ipv4_address("10.0.0.2");
+    arp.learn(stale_mac, peer);
+
+    // Configuring an address announces it, which fixes the existing mapping
+    // well before it would be probed
+    link.b.inet.set_host_address(peer);
+    BOOST_REQUIRE(wait_for_mapping(arp, peer, link.b.netif.hw_address()));
+}
+
+ACTOR_THREAD_TEST_CASE(test_unresolved_queue_is_bounded) {
+    auto &link = leak(new ipv4_link(create_loopback_device_pair()));
+    auto &arp = link.a.inet.neighbors();
+    auto cfg = fast_config();
+    cfg.max_queued = 2;
+    arp.set_config(cfg);
+
+    auto nobody = ipv4_address("10.0.0.99");
+    auto f1 = arp.lookup(nobody);
+    auto f2 = arp.lookup(nobody);
+    auto f3 = arp.lookup(nobody);
+    // The oldest waiter makes room for the newest one
+    BOOST_REQUIRE(f1.available());
+    BOOST_REQUIRE_THROW(f1.get(), arp_queue_full_error);
+    BOOST_REQUIRE_THROW(f2.get(), arp_timeout_error);
+    BOOST_REQUIRE_THROW(f3.get(), arp_timeout_error);
+}
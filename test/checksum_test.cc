@@ -0,0 +1,135 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <nil/actor/network/ip_checksum.hh>
+#include <nil/actor/network/packet.hh>
+#include <nil/actor/network/byteorder.hh>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace nil::actor;
+using namespace net;
+
+namespace {
+
+    std::vector<char> random_bytes(std::mt19937 &rng, size_t size) {
+        std::vector<char> v(size);
+        std::uniform_int_distribution<int> dist(0, 255);
+        for (auto &c : v) {
+            c = char(dist(rng));
+        }
+        return v;
+    }
+
+}    // namespace
+
+BOOST_AUTO_TEST_CASE(test_rfc1071_example) {
+    // RFC 1071, section 3: the sum of these words is 0xddf2
+    const char data[] = {0x00, 0x01, char(0xf2), 0x03, char(0xf4), char(0xf5), char(0xf6), char(0xf7)};
+    BOOST_REQUIRE_EQUAL(ntoh(ip_checksum(data, sizeof(data))), uint16_t(~0xddf2));
+
+    // A buffer with its checksum in it sums to zero
+    std::vector<char> v(data, data + sizeof(data));
+    auto csum = ip_checksum(v.data(), v.size());
+    v.resize(v.size() + 2);
+    std::memcpy(v.data() + sizeof(data), &csum, sizeof(csum));
+    BOOST_REQUIRE_EQUAL(ip_checksum(v.data(), v.size()), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_kernels_match_scalar_reference) {
+    auto &impls = checksum_implementations();
+    BOOST_REQUIRE_EQUAL(impls.front().name, std::string("scalar"));
+    auto reference = impls.front().sum;
+
+    std::mt19937 rng(1071);
+    auto buf = random_bytes(rng, 65536 + 64);
+    std::uniform_int_distribution<size_t> offset_dist(0, 63);
+    std::uniform_int_distribution<size_t> short_len_dist(0, 2048);
+    std::uniform_int_distribution<size_t> long_len_dist(0, 65536);
+    for (unsigned i = 0; i < 20000; ++i) {
+        // Unaligned starts, and mostly lengths around a packet's size
+        auto off = offset_dist(rng);
+        auto len = i % 16 ? short_len_dist(rng) : long_len_dist(rng);
+        auto expected = reference(buf.data() + off, len);
+        for (auto &&impl : impls) {
+            BOOST_REQUIRE_MESSAGE(impl.sum(buf.data() + off, len) == expected,
+                                  impl.name << " differs at offset " << off << ", length " << len);
+        }
+    }
+
+    // Values that make the lanes carry
+    std::vector<char> ones(65536, char(0xff));
+    std::vector<char> zeroes(65536, 0);
+    for (auto &&impl : impls) {
+        BOOST_REQUIRE_EQUAL(impl.sum(ones.data(), ones.size()), reference(ones.data(), ones.size()));
+        BOOST_REQUIRE_EQUAL(impl.sum(zeroes.data(), zeroes.size()), 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_fragmented_packet) {
+    std::mt19937 rng(793);
+    std::uniform_int_distribution<size_t> frag_dist(1, 700);
+    for (unsigned i = 0; i < 500; ++i) {
+        auto data = random_bytes(rng, 9000);
+        // Fragments of odd and even sizes, so that words straddle fragment boundaries
+        packet p;
+        size_t off = 0;
+        while (off < data.size()) {
+            auto n = std::min(frag_dist(rng), data.size() - off);
+            temporary_buffer<char> frag(n);
+            std::copy_n(data.data() + off, n, frag.get_write());
+            p = packet(std::move(p), std::move(frag));
+            off += n;
+        }
+        checksummer csum;
+        csum.sum(p);
+        BOOST_REQUIRE_EQUAL(csum.get(), ip_checksum(data.data(), data.size()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_mixed_sums) {
+    // Header fields added as integers and payload added as bytes give the same
+    // result as summing the serialized bytes.
+    std::mt19937 rng(17);
+    auto payload = random_bytes(rng, 1499);
+    uint32_t a = 0x0a000001;
+    uint16_t b = 0x1234;
+
+    checksummer csum;
+    csum.sum_many(a, b);
+    csum.sum(payload.data(), payload.size());
+
+    std::vector<char> bytes(6);
+    auto na = hton(a);
+    auto nb = hton(b);
+    std::memcpy(bytes.data(), &na, 4);
+    std::memcpy(bytes.data() + 4, &nb, 2);
+    bytes.insert(bytes.end(), payload.begin(), payload.end());
+    BOOST_REQUIRE_EQUAL(csum.get(), ip_checksum(bytes.data(), bytes.size()));
+}
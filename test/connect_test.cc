@@ -24,9 +24,12 @@
 
 #include <nil/actor/core/reactor.hh>
 #include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
 #include <nil/actor/testing/test_runner.hh>
 #include <nil/actor/network/ip.hh>
 
+#include <algorithm>
+
 using namespace nil::actor;
 using namespace net;
 
@@ -96,3 +99,36 @@ ACTOR_TEST_CASE(test_accept_after_abort) {
         });
     });
 }
+
+ACTOR_THREAD_TEST_CASE(test_read_size_hint) {
+    std::default_random_engine &rnd = testing::local_random_engine;
+    auto distr = std::uniform_int_distribution<uint16_t>(12000, 65000);
+    auto sa = make_ipv4_address({"127.0.0.1", distr(rnd)});
+    auto listener = engine().net().listen(sa, listen_options());
+    auto accepted = listener.accept();
+    auto client = nil::actor::connect(sa).get0();
+    auto server = accepted.get0().connection;
+
+    // A header saying how much follows, then the body
+    constexpr size_t body_size = 64 * 1024;
+    auto out = client.output();
+    sstring frame = uninitialized_string(4 + body_size);
+    std::fill(frame.begin(), frame.end(), 'x');
+    out.write(frame).get();
+    out.flush().get();
+
+    connected_socket_input_stream_config config;
+    config.buffer_size = 1024;
+    config.max_buffer_size = 1024 * 1024;
+    auto in = server.input(config);
+    BOOST_REQUIRE_EQUAL(in.read_exactly(4).get0().size(), 4u);
+    server.set_read_size_hint(body_size);
+    size_t left = body_size;
+    left -= in.read_up_to(left).get0().size();
+    BOOST_REQUIRE_GT(left, 0u);
+    // What was not buffered comes in one read instead of reads growing from 1 KiB
+    BOOST_REQUIRE_EQUAL(in.read_up_to(left).get0().size(), left);
+
+    out.close().get();
+    in.close().get();
+}
@@ -0,0 +1,146 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <nil/actor/network/ephemeral_ports.hh>
+#include <nil/actor/network/toeplitz.hh>
+
+#include <array>
+#include <set>
+#include <system_error>
+
+using namespace nil::actor;
+using namespace nil::actor::net;
+
+namespace {
+
+    const unsigned nr_shards = 4;
+    const unsigned this_shard = 1;
+
+    // An IPv4 flow as the stack hashes it: foreign address, local address,
+    // foreign port and local port.
+    std::array<uint8_t, 12> flow(uint32_t foreign_ip, uint16_t foreign_port, uint16_t local_port) {
+        std::array<uint8_t, 12> data {};
+        for (unsigned i = 0; i < 4; ++i) {
+            data[i] = foreign_ip >> (24 - 8 * i);
+            data[4 + i] = 0x0a000001 >> (24 - 8 * i);
+        }
+        data[8] = foreign_port >> 8;
+        data[9] = foreign_port;
+        data[10] = local_port >> 8;
+        data[11] = local_port;
+        return data;
+    }
+
+    uint32_t hash(const std::array<uint8_t, 12> &data) {
+        return toeplitz_hash(default_rsskey_40bytes, data.data(), data.size());
+    }
+
+    bool steers_here(uint32_t h) {
+        return h % nr_shards == this_shard;
+    }
+
+    ephemeral_port_allocator make_allocator() {
+        return ephemeral_port_allocator(
+            [](uint16_t port) {
+                std::array<uint8_t, 12> data {};
+                data[10] = port >> 8;
+                data[11] = port;
+                return hash(data);
+            },
+            steers_here, nr_shards - 1, 0);
+    }
+
+}    // namespace
+
+BOOST_AUTO_TEST_CASE(test_ports_steer_to_this_shard) {
+    auto ports = make_allocator();
+    auto flow_hash = hash(flow(0xc0a80001, 80, 0));
+
+    unsigned expected = 0;
+    for (uint32_t port = ephemeral_port_allocator::first_port; port <= ephemeral_port_allocator::last_port; ++port) {
+        expected += steers_here(hash(flow(0xc0a80001, 80, port)));
+    }
+
+    std::set<uint16_t> allocated;
+    for (unsigned i = 0; i < expected; ++i) {
+        auto port = ports.allocate(flow_hash);
+        BOOST_REQUIRE(steers_here(hash(flow(0xc0a80001, 80, port))));
+        BOOST_REQUIRE(allocated.insert(port).second);
+    }
+    BOOST_REQUIRE_THROW(ports.allocate(flow_hash), std::system_error);
+
+    // Another destination has its own ports
+    BOOST_REQUIRE(steers_here(hash(flow(0xc0a80002, 80, ports.allocate(hash(flow(0xc0a80002, 80, 0)))))));
+}
+
+BOOST_AUTO_TEST_CASE(test_released_ports_are_reused_last) {
+    auto ports = make_allocator();
+    auto flow_hash = hash(flow(0xc0a80001, 443, 0));
+    auto first = ports.allocate(flow_hash);
+    ports.release(flow_hash, first);
+
+    std::set<uint16_t> allocated;
+    uint16_t port;
+    do {
+        port = ports.allocate(flow_hash);
+        BOOST_REQUIRE(allocated.insert(port).second);
+    } while (port != first);
+    BOOST_REQUIRE_THROW(ports.allocate(flow_hash), std::system_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_idle_pools_are_evicted) {
+    auto ports = make_allocator();
+    auto busy = hash(flow(0xc0a80001, 80, 0));
+    ports.allocate(busy);
+    for (uint32_t ip = 0; ip < 2 * ephemeral_port_allocator::max_idle_pools; ++ip) {
+        auto flow_hash = hash(flow(0xc0a90000 + ip, 80, 0));
+        ports.release(flow_hash, ports.allocate(flow_hash));
+    }
+    BOOST_REQUIRE_EQUAL(ports.pools(), ephemeral_port_allocator::max_idle_pools + 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_flows_share_the_ports_of_their_bucket) {
+    auto ports = make_allocator();
+    for (uint32_t ip = 0; ip < 256; ++ip) {
+        auto flow_hash = hash(flow(0xc0a90000 + ip, 80, 0));
+        BOOST_REQUIRE(steers_here(hash(flow(0xc0a90000 + ip, 80, ports.allocate(flow_hash)))));
+    }
+    // One list of ports per value of the bits steering depends on
+    BOOST_REQUIRE_LE(ports.buckets(), nr_shards);
+    BOOST_REQUIRE_EQUAL(ports.pools(), 256u);
+}
+
+BOOST_AUTO_TEST_CASE(test_single_queue_hashes_no_port) {
+    unsigned hashed = 0;
+    ephemeral_port_allocator ports([&hashed](uint16_t port) { return ++hashed; }, [](uint32_t) { return true; },
+                                   0, 0);
+    for (uint32_t flow_hash = 0; flow_hash < 16; ++flow_hash) {
+        BOOST_REQUIRE_GE(ports.allocate(flow_hash), ephemeral_port_allocator::first_port);
+    }
+    BOOST_REQUIRE_EQUAL(hashed, 0u);
+    BOOST_REQUIRE_EQUAL(ports.buckets(), 1u);
+}
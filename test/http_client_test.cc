@@ -0,0 +1,301 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/http/client.hh>
+#include <nil/actor/http/httpd.hh>
+#include <nil/actor/http/handlers.hh>
+#include <nil/actor/http/function_handlers.hh>
+#include <nil/actor/core/loop.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/sleep.hh>
+#include <nil/actor/core/thread.hh>
+#include <nil/actor/core/when_all.hh>
+#include <nil/actor/network/tls.hh>
+#include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
+
+#include <boost/dll.hpp>
+#include <boost/range/irange.hpp>
+
+using namespace nil::actor;
+
+static const auto cert_location = boost::dll::program_location().parent_path();
+
+static std::string certfile(const std::string &file) {
+    return (cert_location / file).string();
+}
+
+namespace {
+
+    sstring pattern(size_t size) {
+        sstring s(sstring::initialized_later(), size);
+        for (size_t i = 0; i < size; ++i) {
+            s[i] = 'a' + i % 26;
+        }
+        return s;
+    }
+
+    class stream_handler : public httpd::handler_base {
+        size_t _chunks;
+        size_t _chunk_size;
+
+    public:
+        stream_handler(size_t chunks, size_t chunk_size) : _chunks(chunks), _chunk_size(chunk_size) {
+        }
+        future<std::unique_ptr<httpd::reply>> handle(const sstring &path, std::unique_ptr<httpd::request> req,
+                                                     std::unique_ptr<httpd::reply> rep) override {
+            rep->write_body("txt", [chunks = _chunks, chunk = pattern(_chunk_size)](output_stream<char> &&o) {
+                return do_with(std::move(o), [chunks, chunk](output_stream<char> &out) {
+                    return do_for_each(boost::irange<size_t>(0, chunks),
+                                       [&out, &chunk](size_t) { return out.write(chunk); })
+                        .then([&out] { return out.close(); });
+                });
+            });
+            return make_ready_future<std::unique_ptr<httpd::reply>>(std::move(rep));
+        }
+    };
+
+    // An http_server on the current shard, listening on 127.0.0.1
+    struct test_server {
+        httpd::http_server server;
+        socket_address addr;
+
+        test_server(const sstring &name, uint16_t port) : server(name), addr(ipv4_addr("127.0.0.1", port)) {
+            server._routes.put(httpd::GET, "/hello",
+                               new httpd::function_handler([](httpd::const_req req) { return "hello"; }, "txt"));
+            server._routes.put(httpd::POST, "/echo",
+                               new httpd::function_handler([](httpd::const_req req) { return req.content; }, "txt"));
+            server._routes.put(
+                httpd::GET, "/slow",
+                new httpd::function_handler(
+                    [](std::unique_ptr<httpd::request> req, std::unique_ptr<httpd::reply> rep) {
+                        return sleep(std::chrono::milliseconds(500)).then([rep = std::move(rep)]() mutable {
+                            return std::move(rep);
+                        });
+                    },
+                    "txt"));
+            server._routes.put(httpd::GET, "/stream", new stream_handler(100, 1000));
+        }
+        void start() {
+            listen_options lo;
+            lo.reuse_address = true;
+            server.listen(addr, lo).get();
+        }
+        ~test_server() {
+            server.stop().get();
+        }
+    };
+
+}    // namespace
+
+ACTOR_THREAD_TEST_CASE(test_keep_alive_pool) {
+    test_server ts("http-client-test-pool", 10100);
+    ts.start();
+    http::client c;
+    http::endpoint ep {ts.addr, "localhost"};
+
+    for (int i = 0; i < 20; ++i) {
+        auto rsp = c.make_request(ep, http::request("GET", "/hello")).get0();
+        BOOST_REQUIRE_EQUAL(rsp.status(), 200);
+        BOOST_REQUIRE_EQUAL(rsp.version(), "1.1");
+        BOOST_REQUIRE_EQUAL(rsp.get_header("content-length"), "5");
+        BOOST_REQUIRE_EQUAL(rsp.read_body().get0(), "hello");
+    }
+    BOOST_REQUIRE_EQUAL(c.connections(), 1u);
+    BOOST_REQUIRE_EQUAL(ts.server.total_connections(), 1u);
+
+    auto rsp = c.make_request(ep, http::request("GET", "/missing")).get0();
+    BOOST_REQUIRE_EQUAL(rsp.status(), 404);
+    rsp.read_body().get();
+    c.close().get();
+}
+
+ACTOR_THREAD_TEST_CASE(test_request_bodies) {
+    test_server ts("http-client-test-bodies", 10101);
+    ts.start();
+    http::client c;
+    http::endpoint ep {ts.addr, "localhost"};
+
+    auto rsp = c.make_request(ep, http::request("POST", "/echo", "los lobos")).get0();
+    BOOST_REQUIRE_EQUAL(rsp.read_body().get0(), "los lobos");
+
+    // http_server reads bodies up to their Content-Length only
+    auto body = pattern(100000);
+    http::request req("POST", "/echo");
+    req.content_length = body.size();
+    req.body_writer = [body](output_stream<char> &&o) {
+        return do_with(std::move(o), [body](output_stream<char> &out) {
+            return do_for_each(boost::irange<size_t>(0, body.size(), 1000),
+                               [&out, &body](size_t off) { return out.write(body.data() + off, 1000); })
+                .then([&out] { return out.close(); });
+        });
+    };
+    BOOST_REQUIRE(!req.retryable());
+    rsp = c.make_request(ep, std::move(req)).get0();
+    BOOST_REQUIRE_EQUAL(rsp.read_body().get0(), body);
+    BOOST_REQUIRE_EQUAL(c.connections(), 1u);
+    c.close().get();
+}
+
+ACTOR_THREAD_TEST_CASE(test_chunked_response) {
+    test_server ts("http-client-test-chunked", 10102);
+    ts.start();
+    http::client c;
+    http::endpoint ep {ts.addr, "localhost"};
+
+    for (int i = 0; i < 2; ++i) {
+        auto rsp = c.make_request(ep, http::request("GET", "/stream")).get0();
+        BOOST_REQUIRE_EQUAL(rsp.get_header("Transfer-Encoding"), "chunked");
+        size_t received = 0;
+        while (auto buf = rsp.body().read().get0()) {
+            for (size_t j = 0; j < buf.size(); ++j) {
+                BOOST_REQUIRE_EQUAL(buf[j], char('a' + (received + j) % 1000 % 26));
+            }
+            received += buf.size();
+        }
+        BOOST_REQUIRE_EQUAL(received, 100000u);
+    }
+    // the connection survived both bodies
+    BOOST_REQUIRE_EQUAL(ts.server.total_connections(), 1u);
+    c.close().get();
+}
+
+ACTOR_THREAD_TEST_CASE(test_pipelining_within_connection_limit) {
+    test_server ts("http-client-test-pipelining", 10103);
+    ts.start();
+    http::client_options opts;
+    opts.max_connections_per_host = 2;
+    opts.max_pipeline_depth = 4;
+    http::client c(opts);
+    http::endpoint ep {ts.addr, "localhost"};
+
+    std::vector<future<sstring>> replies;
+    for (int i = 0; i < 40; ++i) {
+        replies.push_back(c.make_request(ep, http::request("GET", "/hello")).then([](http::response rsp) {
+            return do_with(std::move(rsp), [](http::response &rsp) { return rsp.read_body(); });
+        }));
+    }
+    for (auto &&r : when_all(replies.begin(), replies.end()).get0()) {
+        BOOST_REQUIRE_EQUAL(r.get0(), "hello");
+    }
+    BOOST_REQUIRE_LE(ts.server.total_connections(), 2u);
+    BOOST_REQUIRE_EQUAL(ts.server.requests_served(), 40u);
+    c.close().get();
+}
+
+ACTOR_THREAD_TEST_CASE(test_request_timeout) {
+    test_server ts("http-client-test-timeout", 10104);
+    ts.start();
+    http::client_options opts;
+    opts.request_timeout = std::chrono::milliseconds(100);
+    http::client c(opts);
+    http::endpoint ep {ts.addr, "localhost"};
+
+    BOOST_REQUIRE_THROW(c.make_request(ep, http::request("GET", "/slow")).get(), http::request_timeout_error);
+    // the timed out connection is not reused
+    auto rsp = c.make_request(ep, http::request("GET", "/hello")).get0();
+    BOOST_REQUIRE_EQUAL(rsp.read_body().get0(), "hello");
+    BOOST_REQUIRE_EQUAL(c.connections(), 1u);
+    c.close().get();
+}
+
+ACTOR_THREAD_TEST_CASE(test_retry_on_stale_connection) {
+    http::client c;
+    socket_address addr(ipv4_addr("127.0.0.1", 10105));
+    http::endpoint ep {addr, "localhost"};
+    {
+        test_server ts("http-client-test-stale-1", 10105);
+        ts.start();
+        auto rsp = c.make_request(ep, http::request("GET", "/hello")).get0();
+        BOOST_REQUIRE_EQUAL(rsp.read_body().get0(), "hello");
+    }
+    // the pooled connection was closed by the server meanwhile
+    test_server ts("http-client-test-stale-2", 10105);
+    ts.start();
+    auto rsp = c.make_request(ep, http::request("GET", "/hello")).get0();
+    BOOST_REQUIRE_EQUAL(rsp.read_body().get0(), "hello");
+    BOOST_REQUIRE_EQUAL(ts.server.total_connections(), 1u);
+    c.close().get();
+}
+
+ACTOR_THREAD_TEST_CASE(test_malformed_content_length) {
+    listen_options lo;
+    lo.reuse_address = true;
+    socket_address addr(ipv4_addr("127.0.0.1", 10107));
+    auto ss = server_socket(engine().net().listen(addr, lo));
+    http::client_options opts;
+    opts.max_retries = 0;
+    http::client c(opts);
+    http::endpoint ep {addr, "localhost"};
+
+    auto rsp = c.make_request(ep, http::request("GET", "/hello"));
+    auto conn = std::move(ss.accept().get0().connection);
+    auto in = conn.input();
+    auto out = conn.output();
+    in.read().get();
+    out.write("HTTP/1.1 200 OK\r\nContent-Length: 5x\r\n\r\nhello").get();
+    out.flush().get();
+    BOOST_REQUIRE_THROW(rsp.get(), http::client_error);
+    // where the next response starts is unknown, so the connection is not reused
+    BOOST_REQUIRE_EQUAL(c.connections(), 0u);
+    out.close().get();
+    c.close().get();
+}
+
+ACTOR_THREAD_TEST_CASE(test_close_waits_for_bodies) {
+    test_server ts("http-client-test-close", 10108);
+    ts.start();
+    http::client c;
+    http::endpoint ep {ts.addr, "localhost"};
+
+    auto rsp = c.make_request(ep, http::request("GET", "/stream")).get0();
+    auto closed = c.close();
+    BOOST_REQUIRE(!closed.available());
+    auto buf = rsp.body().read().get0();
+    BOOST_REQUIRE(!buf.empty());
+    BOOST_REQUIRE(!closed.available());
+    rsp.body().close().get();
+    closed.get();
+}
+
+ACTOR_THREAD_TEST_CASE(test_https) {
+    test_server ts("http-client-test-https", 10106);
+    auto server_creds = ::make_shared<tls::server_credentials>(::make_shared<tls::dh_params>());
+    server_creds->set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    ts.server.set_tls_credentials(server_creds);
+    ts.start();
+
+    http::client_options opts;
+    opts.credentials = ::make_shared<tls::certificate_credentials>();
+    opts.credentials->set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+    http::client c(opts);
+    http::endpoint ep {ts.addr, "test.nil.foundation", true};
+
+    for (int i = 0; i < 3; ++i) {
+        auto rsp = c.make_request(ep, http::request("GET", "/hello")).get0();
+        BOOST_REQUIRE_EQUAL(rsp.read_body().get0(), "hello");
+    }
+    BOOST_REQUIRE_EQUAL(ts.server.total_connections(), 1u);
+    c.close().get();
+}
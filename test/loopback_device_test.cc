@@ -0,0 +1,372 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
+#include <nil/actor/network/loopback.hh>
+#include <nil/actor/network/ethernet.hh>
+#include <nil/actor/network/ip.hh>
+#include <nil/actor/network/tcp.hh>
+#include <nil/actor/network/tcp-stack.hh>
+#include <nil/actor/network/udp.hh>
+#include <nil/actor/network/toeplitz.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/thread.hh>
+#include <nil/actor/core/sleep.hh>
+#include <nil/actor/core/byteorder.hh>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace nil::actor;
+using namespace net;
+
+namespace {
+
+    // Queues keep raw pointers to their devices and live until the reactor exits,
+    // so neither devices nor the stacks on top of them are ever torn down.
+    template<typename T>
+    T &leak(T *p) {
+        return *p;
+    }
+
+    thread_local std::vector<std::pair<uint16_t, uint32_t>> received_frames;
+
+    packet make_udp_frame(ethernet_address src_mac, ethernet_address dst_mac, uint16_t src_port,
+                          uint16_t dst_port) {
+        packet p(packet::from_static_data("payload", 7));
+        auto uh = p.prepend_header<udp_hdr>();
+        uh->src_port = src_port;
+        uh->dst_port = dst_port;
+        uh->len = p.len();
+        uh->cksum = 0;
+        *uh = hton(*uh);
+        auto iph = p.prepend_header<ip_hdr>();
+        iph->ihl = sizeof(ip_hdr) / 4;
+        iph->ver = 4;
+        iph->dscp = 0;
+        iph->ecn = 0;
+        iph->len = p.len();
+        iph->id = 0;
+        iph->frag = 0;
+        iph->ttl = 64;
+        iph->ip_proto = uint8_t(ip_protocol_num::udp);
+        iph->csum = 0;
+        iph->src_ip = ipv4_address("10.0.0.1");
+        iph->dst_ip = ipv4_address("10.0.0.2");
+        *iph = hton(*iph);
+        auto eh = p.prepend_header<eth_hdr>();
+        eh->dst_mac = dst_mac;
+        eh->src_mac = src_mac;
+        eh->eth_proto = uint16_t(eth_protocol_num::ipv4);
+        *eh = hton(*eh);
+        return p;
+    }
+
+    // What ipv4::forward() and ipv4_udp::forward() feed into the Toeplitz hash
+    uint32_t expected_hash(uint16_t src_port, uint16_t dst_port) {
+        forward_hash data;
+        data.push_back(hton(ipv4_address("10.0.0.1").ip));
+        data.push_back(hton(ipv4_address("10.0.0.2").ip));
+        data.push_back(hton(src_port));
+        data.push_back(hton(dst_port));
+        return toeplitz_hash(default_rsskey_40bytes, data);
+    }
+
+    // Sets up the queues of both devices on every shard and records what the
+    // second one receives.
+    void start_device_pair(std::shared_ptr<device> a, std::shared_ptr<device> b) {
+        smp::invoke_on_all([a, b] {
+            received_frames.clear();
+            auto qid = this_shard_id();
+            for (auto &&dev : {a, b}) {
+                if (qid < dev->hw_queues_count()) {
+                    dev->set_local_queue(dev->init_local_queue({}, qid));
+                }
+            }
+            if (qid < b->hw_queues_count()) {
+                (void)b->receive([](packet p) {
+                    auto uh = p.get_header<udp_hdr>(sizeof(eth_hdr) + sizeof(ip_hdr));
+                    received_frames.emplace_back(ntoh(uh->src_port), p.rss_hash().value_or(0));
+                    return make_ready_future<>();
+                });
+            }
+        }).get();
+    }
+
+    void send_frames(device &dev, circular_buffer<packet> frames) {
+        while (!frames.empty()) {
+            dev.local_queue().send(frames);
+            thread::yield();
+        }
+    }
+
+    size_t wait_for_frames(size_t expected) {
+        size_t total = 0;
+        for (unsigned i = 0; i < 1000 && total < expected; ++i) {
+            sleep(std::chrono::milliseconds(1)).get();
+            total = 0;
+            for (unsigned c = 0; c < smp::count; ++c) {
+                total += smp::submit_to(c, [] { return received_frames.size(); }).get0();
+            }
+        }
+        return total;
+    }
+
+    struct ipv4_node {
+        interface netif;
+        ipv4 inet;
+
+        ipv4_node(std::shared_ptr<device> dev, const char *addr) : netif(std::move(dev)), inet(&netif) {
+            inet.set_host_address(ipv4_address(addr));
+            inet.set_netmask_address(ipv4_address("255.255.255.0"));
+            inet.set_arp_learn_hook([this](ethernet_address l2, ipv4_address l3) { inet.learn(l2, l3); });
+        }
+    };
+
+    // Two single-queue stacks on the current shard, talking to each other
+    struct ipv4_link {
+        ipv4_node a;
+        ipv4_node b;
+
+        static std::shared_ptr<device> start(std::shared_ptr<device> dev) {
+            dev->set_local_queue(dev->init_local_queue({}, this_shard_id()));
+            return dev;
+        }
+
+        explicit ipv4_link(std::pair<std::shared_ptr<device>, std::shared_ptr<device>> devs) :
+            a(start(std::move(devs.first)), "10.0.0.1"), b(start(std::move(devs.second)), "10.0.0.2") {
+        }
+    };
+
+    void transfer(ipv4_link &link, uint16_t port, size_t size) {
+        auto ss = tcpv4_listen(link.b.inet.get_tcp(), port, listen_options());
+        auto accepted = ss.accept();
+        auto cs = tcpv4_socket(link.a.inet.get_tcp()).connect(socket_address(ipv4_addr("10.0.0.2", port))).get0();
+        auto ar = accepted.get0();
+        BOOST_REQUIRE_EQUAL(ar.remote_address, socket_address(ipv4_addr("10.0.0.1", ar.remote_address.port())));
+
+        auto out = cs.output();
+        auto in = ar.connection.input();
+        auto writer = async([&out, size] {
+            // A multiple of the pattern length, so that every chunk continues it
+            sstring chunk(sstring::initialized_later(), 26 * 100);
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                chunk[i] = 'a' + i % 26;
+            }
+            for (size_t off = 0; off < size; off += chunk.size()) {
+                out.write(chunk.data(), std::min(chunk.size(), size - off)).get();
+            }
+            out.flush().get();
+        });
+        size_t received = 0;
+        while (received < size) {
+            auto buf = in.read().get0();
+            BOOST_REQUIRE(!buf.empty());
+            for (size_t i = 0; i < buf.size(); ++i) {
+                BOOST_REQUIRE_EQUAL(buf[i], char('a' + (received + i) % 26));
+            }
+            received += buf.size();
+        }
+        writer.get();
+        out.close().get();
+        in.close().get();
+        ss.abort_accept();
+    }
+
+}    // namespace
+
+ACTOR_THREAD_TEST_CASE(test_rss_steering) {
+    loopback_device_config cfg;
+    cfg.queues = smp::count;
+    auto devs = create_loopback_device_pair(cfg);
+    auto &a = leak(new std::shared_ptr<device>(devs.first));
+    auto &b = leak(new std::shared_ptr<device>(devs.second));
+    BOOST_REQUIRE_EQUAL(b->hw_queues_count(), smp::count);
+    start_device_pair(a, b);
+
+    const unsigned nr_frames = 64;
+    circular_buffer<packet> frames;
+    for (unsigned i = 0; i < nr_frames; ++i) {
+        frames.push_back(make_udp_frame(a->hw_address(), b->hw_address(), 10000 + i, 80));
+    }
+    send_frames(*a, std::move(frames));
+    BOOST_REQUIRE_EQUAL(wait_for_frames(nr_frames), nr_frames);
+
+    // Every frame carries the hash the stack would compute for the flow, and
+    // landed on the queue hash2qid() picks for it.
+    for (unsigned c = 0; c < smp::count; ++c) {
+        auto ok = smp::submit_to(c, [b = b.get(), c] {
+            for (auto &&f : received_frames) {
+                if (f.second != expected_hash(f.first, 80) || b->hash2qid(f.second) != c) {
+                    return false;
+                }
+            }
+            return true;
+        }).get0();
+        BOOST_REQUIRE(ok);
+    }
+}
+
+ACTOR_THREAD_TEST_CASE(test_loss_emulation) {
+    loopback_device_config cfg;
+    cfg.loss = 0.5;
+    cfg.seed = 42;
+    auto devs = create_loopback_device_pair(cfg);
+    auto &a = leak(new std::shared_ptr<device>(devs.first));
+    auto &b = leak(new std::shared_ptr<device>(devs.second));
+    start_device_pair(a, b);
+
+    const unsigned nr_frames = 200;
+    circular_buffer<packet> frames;
+    for (unsigned i = 0; i < nr_frames; ++i) {
+        frames.push_back(make_udp_frame(a->hw_address(), b->hw_address(), 10000, 80));
+    }
+    send_frames(*a, std::move(frames));
+    sleep(std::chrono::milliseconds(50)).get();
+    auto received = received_frames.size();
+    BOOST_REQUIRE_GT(received, 0u);
+    BOOST_REQUIRE_LT(received, nr_frames);
+}
+
+ACTOR_THREAD_TEST_CASE(test_tcp_over_device_pair) {
+    auto &link = leak(new ipv4_link(create_loopback_device_pair()));
+    transfer(link, 10000, 1 << 20);
+}
+
+ACTOR_THREAD_TEST_CASE(test_tcp_with_latency_and_reordering) {
+    loopback_device_config cfg;
+    cfg.latency = std::chrono::microseconds(200);
+    cfg.reorder = 0.05;
+    cfg.seed = 7;
+    auto &link = leak(new ipv4_link(create_loopback_device_pair(cfg)));
+    transfer(link, 10001, 256 << 10);
+}
+
+ACTOR_THREAD_TEST_CASE(test_tcp_with_heavy_reordering) {
+    // Deep enough reordering to keep the out-of-order queue of the receiver busy
+    loopback_device_config cfg;
+    cfg.latency = std::chrono::microseconds(100);
+    cfg.reorder = 0.3;
+    cfg.seed = 11;
+    auto &link = leak(new ipv4_link(create_loopback_device_pair(cfg)));
+    transfer(link, 10003, 1 << 20);
+}
+
+ACTOR_THREAD_TEST_CASE(test_stream_receiver) {
+    // Length-prefixed frames, read by peeking at the length and then moving
+    // the body out of the received packets
+    auto &link = leak(new ipv4_link(create_loopback_device_pair()));
+    const uint16_t port = 10004;
+    auto ss = tcpv4_listen(link.b.inet.get_tcp(), port, listen_options());
+    auto accepted = ss.accept();
+    auto cs = tcpv4_socket(link.a.inet.get_tcp()).connect(socket_address(ipv4_addr("10.0.0.2", port))).get0();
+    auto ar = accepted.get0();
+
+    const std::vector<uint32_t> sizes = {10, 3000, 70000, 1, 200000, 1460};
+    auto out = cs.output();
+    auto writer = async([&out, &sizes] {
+        for (auto size : sizes) {
+            char len[sizeof(uint32_t)];
+            write_le<uint32_t>(len, size);
+            out.write(len, sizeof(len)).get();
+            sstring body(sstring::initialized_later(), size);
+            for (size_t i = 0; i < size; ++i) {
+                body[i] = 'a' + (size + i) % 26;
+            }
+            out.write(body).get();
+        }
+        out.close().get();
+    });
+
+    auto check = [](const char *body, uint32_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            BOOST_REQUIRE_EQUAL(body[i], char('a' + (size + i) % 26));
+        }
+    };
+    auto in = ar.connection.receiver();
+    for (unsigned i = 0; i < sizes.size(); ++i) {
+        auto header = in.peek(sizeof(uint32_t)).get0();
+        BOOST_REQUIRE_EQUAL(header.size(), sizeof(uint32_t));
+        auto size = read_le<uint32_t>(header.get());
+        BOOST_REQUIRE_EQUAL(size, sizes[i]);
+        in.skip(sizeof(uint32_t)).get();
+        if (i % 2) {
+            std::vector<char> body(size);
+            BOOST_REQUIRE_EQUAL(in.read_into(body.data(), size).get0(), size);
+            check(body.data(), size);
+        } else {
+            auto body = in.read_exactly(size).get0();
+            BOOST_REQUIRE_EQUAL(body.size(), size);
+            check(body.get(), size);
+        }
+    }
+    writer.get();
+    BOOST_REQUIRE(in.read().get0().empty());
+    BOOST_REQUIRE(in.eof());
+    in.close().get();
+    ss.abort_accept();
+}
+
+ACTOR_THREAD_TEST_CASE(test_stream_receiver_short_provider) {
+    auto &link = leak(new ipv4_link(create_loopback_device_pair()));
+    const uint16_t port = 10005;
+    auto ss = tcpv4_listen(link.b.inet.get_tcp(), port, listen_options());
+    auto accepted = ss.accept();
+    auto cs = tcpv4_socket(link.a.inet.get_tcp()).connect(socket_address(ipv4_addr("10.0.0.2", port))).get0();
+    auto ar = accepted.get0();
+
+    // Larger than one segment, so the provider is asked for memory
+    const size_t size = 5000;
+    auto out = cs.output();
+    out.write(sstring(size, 'x')).get();
+    out.close().get();
+
+    auto in = ar.connection.receiver();
+    BOOST_REQUIRE_THROW(in.read_into(size, [](size_t) { return temporary_buffer<char>(10); }).get(),
+                        std::invalid_argument);
+    auto body = in.read_exactly(size).get0();
+    BOOST_REQUIRE_EQUAL(body.size(), size);
+    BOOST_REQUIRE(std::all_of(body.begin(), body.end(), [](char c) { return c == 'x'; }));
+    in.close().get();
+    ss.abort_accept();
+}
+
+ACTOR_THREAD_TEST_CASE(test_udp_over_device_pair_with_csum_offload) {
+    loopback_device_config cfg;
+    cfg.csum_offload = true;
+    auto &link = leak(new ipv4_link(create_loopback_device_pair(cfg)));
+    auto server = link.b.inet.get_udp().make_channel(ipv4_addr(uint16_t(10002)));
+    auto client = link.a.inet.get_udp().make_channel(ipv4_addr());
+
+    client.send(ipv4_addr("10.0.0.2", 10002), "apa").get();
+    auto dgram = server.receive().get0();
+    BOOST_REQUIRE_EQUAL(dgram.get_src(), socket_address(ipv4_addr("10.0.0.1", dgram.get_src().port())));
+    auto &data = dgram.get_data();
+    data.linearize();
+    BOOST_REQUIRE_EQUAL(sstring(data.fragments()[0].base, data.len()), "apa");
+
+    client.close();
+    server.close();
+}
@@ -0,0 +1,210 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
+#include <nil/actor/network/ipv6.hh>
+#include <nil/actor/network/loopback.hh>
+#include <nil/actor/network/tcp.hh>
+#include <nil/actor/network/tcp-stack.hh>
+#include <nil/actor/network/udp.hh>
+#include <nil/actor/network/api.hh>
+#include <nil/actor/network/inet_address.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/thread.hh>
+#include <nil/actor/core/byteorder.hh>
+
+#include <algorithm>
+
+using namespace nil::actor;
+using namespace net;
+
+namespace {
+
+    struct ipv6_node {
+        interface netif;
+        ipv6 inet;
+
+        static std::shared_ptr<device> start(std::shared_ptr<device> dev) {
+            dev->set_local_queue(dev->init_local_queue({}, this_shard_id()));
+            return dev;
+        }
+
+        ipv6_node(std::shared_ptr<device> dev, const char *addr) : netif(start(std::move(dev))), inet(&netif) {
+            inet.set_host_address(ipv6_address(addr));
+        }
+    };
+
+    // Two stacks on the current shard, wired back-to-back: addresses are resolved
+    // with neighbor solicitations and advertisements crossing the link.
+    struct ipv6_link {
+        ipv6_node a;
+        ipv6_node b;
+
+        explicit ipv6_link(std::pair<std::shared_ptr<device>, std::shared_ptr<device>> devs) :
+            a(std::move(devs.first), "fd00::1"), b(std::move(devs.second), "fd00::2") {
+        }
+    };
+
+    // The device queues outlive the test cases (they are released on reactor exit)
+    // and keep polling the stacks, so the stacks are never torn down.
+    ipv6_link &local_link() {
+        static thread_local ipv6_link *link = new ipv6_link(create_loopback_device_pair());
+        return *link;
+    }
+
+    const ethernet_address spoofed_mac({0x02, 0x00, 0x00, 0x00, 0x00, 0x99});
+
+    // A neighbor advertisement for \c target at \c mac, as handed to ndp::received()
+    packet make_advertisement(ipv6_address target, ethernet_address mac, uint32_t flags) {
+        char buf[32] = {};
+        buf[0] = char(icmpv6_hdr::msg_type::neighbor_advertisement);
+        write_be<uint32_t>(buf + 4, flags);
+        std::copy(target.ip.begin(), target.ip.end(), buf + 8);
+        // Target link-layer address option, one 8-octet unit
+        buf[24] = 2;
+        buf[25] = 1;
+        std::copy(mac.mac.begin(), mac.mac.end(), buf + 26);
+        return packet(buf, sizeof(buf));
+    }
+
+    constexpr uint32_t override_flag = 1u << 29;
+
+}    // namespace
+
+ACTOR_TEST_CASE(test_link_local_address) {
+    auto ll = ipv6::make_link_local_address({0x52, 0x54, 0x00, 0x12, 0x34, 0x56});
+    BOOST_REQUIRE_EQUAL(ll, ipv6_address("fe80::5054:ff:fe12:3456"));
+    BOOST_REQUIRE(ipv6::is_link_local(ll));
+    BOOST_REQUIRE(!ipv6::is_link_local(ipv6_address("fd00::1")));
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_multicast_addresses) {
+    auto sn = ipv6::solicited_node_address(ipv6_address("2001:db8::aa:bbcc:ddee"));
+    BOOST_REQUIRE_EQUAL(sn, ipv6_address("ff02::1:ffcc:ddee"));
+    BOOST_REQUIRE(ipv6::is_multicast(sn));
+    auto mac = ipv6::multicast_ethernet_address(sn);
+    BOOST_REQUIRE(mac.mac == (std::array<uint8_t, 6> {0x33, 0x33, 0xff, 0xcc, 0xdd, 0xee}));
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_pseudo_header_checksum) {
+    // An UDP datagram carrying a checksum computed over the IPv6 pseudo header
+    // must sum up to zero when verified the same way.
+    auto src = ipv6_address("fd00::1");
+    auto dst = ipv6_address("fd00::2");
+    udp_hdr h;
+    h.src_port = 1234;
+    h.dst_port = 5678;
+    h.len = sizeof(h) + 3;
+    h.cksum = 0;
+    h = hton(h);
+    packet p(packet::from_static_data("abc", 3));
+    *p.prepend_header<udp_hdr>() = h;
+
+    checksummer csum;
+    ipv6_traits::udp_pseudo_header_checksum(csum, src, dst, p.len());
+    csum.sum(p);
+    p.get_header<udp_hdr>()->cksum = csum.get();
+
+    checksummer verify;
+    ipv6_traits::udp_pseudo_header_checksum(verify, src, dst, p.len());
+    verify.sum(p);
+    BOOST_REQUIRE_EQUAL(verify.get(), 0);
+    return make_ready_future<>();
+}
+
+ACTOR_THREAD_TEST_CASE(test_tcp_over_loopback) {
+    auto &link = local_link();
+    auto addr = socket_address(ipv6_addr("fd00::2", 10000));
+
+    auto ss = tcpv6_listen(link.b.inet.get_tcp(), addr.port(), listen_options());
+    BOOST_REQUIRE(ss.local_address().addr().is_ipv6());
+
+    auto accepted = ss.accept();
+    auto cs = tcpv6_socket(link.a.inet.get_tcp()).connect(addr).get0();
+    auto ar = accepted.get0();
+    BOOST_REQUIRE_EQUAL(ar.remote_address.addr(), net::inet_address(ipv6_address("fd00::1")));
+
+    auto out = cs.output();
+    out.write("los lobos").get();
+    out.flush().get();
+
+    auto in = ar.connection.input();
+    sstring received;
+    while (received.size() < 9) {
+        auto buf = in.read().get0();
+        BOOST_REQUIRE(!buf.empty());
+        received += sstring(buf.get(), buf.size());
+    }
+    BOOST_REQUIRE_EQUAL(received, "los lobos");
+
+    out.close().get();
+    in.close().get();
+    ss.abort_accept();
+}
+
+ACTOR_THREAD_TEST_CASE(test_udp_over_loopback) {
+    auto &link = local_link();
+    auto server = link.b.inet.get_udp().make_channel(ipv6_addr(uint16_t(10001)));
+    auto client = link.a.inet.get_udp().make_channel(ipv6_addr());
+
+    client.send(socket_address(ipv6_addr("fd00::2", 10001)), "apa").get();
+    auto dgram = server.receive().get0();
+
+    BOOST_REQUIRE(dgram.get_src().addr().is_ipv6());
+    BOOST_REQUIRE_EQUAL(dgram.get_src().addr(), net::inet_address(ipv6_address("fd00::1")));
+    auto &data = dgram.get_data();
+    data.linearize();
+    BOOST_REQUIRE_EQUAL(sstring(data.fragments()[0].base, data.len()), "apa");
+
+    client.close();
+    server.close();
+}
+
+ACTOR_THREAD_TEST_CASE(test_unsolicited_advertisements) {
+    auto &link = *new ipv6_link(create_loopback_device_pair());
+    auto &nd = link.a.inet.neighbors();
+    auto peer = ipv6_address("fd00::2");
+    auto from = ipv6_address("fd00::3");
+
+    // Nothing is learned from advertisements nobody asked for
+    nd.received(make_advertisement(peer, spoofed_mac, override_flag), from, link.a.inet.host_address(), 255,
+                spoofed_mac);
+    BOOST_REQUIRE(nd.lookup(peer).get0() == link.b.netif.hw_address());
+
+    // Without the override flag the known mapping stays, and messages that may
+    // come from off the link are ignored altogether
+    nd.received(make_advertisement(peer, spoofed_mac, 0), from, link.a.inet.host_address(), 255, spoofed_mac);
+    BOOST_REQUIRE(nd.lookup(peer).get0() == link.b.netif.hw_address());
+    nd.received(make_advertisement(peer, spoofed_mac, override_flag), from, link.a.inet.host_address(), 64,
+                spoofed_mac);
+    BOOST_REQUIRE(nd.lookup(peer).get0() == link.b.netif.hw_address());
+
+    // An on-link neighbor may correct a known mapping
+    nd.received(make_advertisement(peer, spoofed_mac, override_flag), from, link.a.inet.host_address(), 255,
+                spoofed_mac);
+    BOOST_REQUIRE(nd.lookup(peer).get0() == spoofed_mac);
+}
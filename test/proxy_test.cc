@@ -0,0 +1,159 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
+#include <nil/actor/network/detail/proxy.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/thread.hh>
+#include <nil/actor/core/sleep.hh>
+#include <nil/actor/core/smp.hh>
+
+using namespace nil::actor;
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+    // Master queue freeing whatever it is handed right away
+    class sink_qp : public qp {
+    public:
+        virtual future<> send(packet p) override {
+            return make_ready_future<>();
+        }
+        virtual uint32_t send(circular_buffer<packet> &p) override {
+            uint32_t n = p.size();
+            p.clear();
+            return n;
+        }
+    };
+
+    class sink_device : public device {
+    public:
+        virtual ethernet_address hw_address() override {
+            return {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+        }
+        virtual net::hw_features hw_features() override {
+            return net::hw_features();
+        }
+        virtual std::unique_ptr<qp> init_local_queue(boost::program_options::variables_map opts,
+                                                     uint16_t qid) override {
+            return std::make_unique<sink_qp>();
+        }
+    };
+
+}    // namespace
+
+ACTOR_TEST_CASE(test_spsc_ring_empty_and_full) {
+    spsc_ring<int, 4> ring;
+    BOOST_REQUIRE(!ring.pop());
+    for (int i = 0; i < 4; ++i) {
+        BOOST_REQUIRE(ring.push(int(i)));
+    }
+    BOOST_REQUIRE(!ring.push(4));
+    BOOST_REQUIRE_EQUAL(ring.size(), 4u);
+    for (int i = 0; i < 4; ++i) {
+        BOOST_REQUIRE_EQUAL(*ring.pop(), i);
+    }
+    BOOST_REQUIRE(!ring.pop());
+    BOOST_REQUIRE_EQUAL(ring.size(), 0u);
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_spsc_ring_wraps_around) {
+    spsc_ring<int, 4> ring;
+    int next_in = 0;
+    int next_out = 0;
+    // Three at a time, so the indices cross the end of the slots at every offset
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < 3; ++i) {
+            BOOST_REQUIRE(ring.push(int(next_in++)));
+        }
+        for (int i = 0; i < 3; ++i) {
+            BOOST_REQUIRE_EQUAL(*ring.pop(), next_out++);
+        }
+    }
+    BOOST_REQUIRE(!ring.pop());
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_spsc_ring_batch_push) {
+    spsc_ring<int, 4> ring;
+    circular_buffer<int> q;
+    for (int i = 0; i < 6; ++i) {
+        q.push_back(i);
+    }
+    // Limited by the caller, then by the free slots, leaving the rest queued
+    BOOST_REQUIRE_EQUAL(ring.push(q, 1), 1u);
+    BOOST_REQUIRE_EQUAL(ring.push(q, 10), 3u);
+    BOOST_REQUIRE_EQUAL(q.size(), 2u);
+    BOOST_REQUIRE_EQUAL(q.front(), 4);
+    BOOST_REQUIRE_EQUAL(ring.push(q, 10), 0u);
+
+    BOOST_REQUIRE_EQUAL(*ring.pop(), 0);
+    BOOST_REQUIRE_EQUAL(*ring.pop(), 1);
+    BOOST_REQUIRE_EQUAL(ring.push(q, 10), 2u);
+    BOOST_REQUIRE(q.empty());
+    for (int i = 2; i < 6; ++i) {
+        BOOST_REQUIRE_EQUAL(*ring.pop(), i);
+    }
+    BOOST_REQUIRE(!ring.pop());
+    return make_ready_future<>();
+}
+
+ACTOR_THREAD_TEST_CASE(test_proxy_frees_packets_on_their_shard) {
+    if (smp::count < 2) {
+        return;
+    }
+    // Queues keep raw pointers to their devices, and the master keeps the proxy's
+    // provider registered, so neither is ever torn down.
+    auto dev = new sink_device();
+    dev->set_local_queue(dev->init_local_queue({}, 0));
+
+    smp::submit_to(1, [dev] {
+        return async([dev] {
+            auto &proxy = *new proxy_net_device(0, dev);
+            const unsigned total = 8 * proxy_net_device::max_in_flight() + 3;
+            unsigned freed = 0;
+            unsigned foreign = 0;
+            circular_buffer<packet> q;
+            for (unsigned i = 0; i < total; ++i) {
+                q.push_back(packet(packet::from_static_data("los lobos", 9), make_deleter([&] {
+                                       ++freed;
+                                       foreign += this_shard_id() != 1;
+                                   })));
+            }
+            while (!q.empty()) {
+                proxy.send(q);
+                BOOST_REQUIRE_LE(proxy.in_flight(), proxy_net_device::max_in_flight());
+                sleep(1ms).get();
+            }
+            while (freed < total) {
+                sleep(1ms).get();
+            }
+            BOOST_REQUIRE_EQUAL(foreign, 0u);
+            BOOST_REQUIRE_EQUAL(proxy.in_flight(), 0u);
+        });
+    }).get();
+}
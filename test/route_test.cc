@@ -0,0 +1,146 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <nil/actor/network/route.hh>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace nil::actor;
+using namespace net;
+
+namespace {
+
+    uint32_t mask(uint8_t length) {
+        return length ? ~0u << (32 - length) : 0;
+    }
+
+    // Linear scan over the routes, the obviously correct longest prefix match
+    const ipv4_route *reference_lookup(const std::vector<ipv4_route> &routes, uint32_t dst) {
+        const ipv4_route *best = nullptr;
+        for (auto &&r : routes) {
+            if ((dst & mask(r.length)) == r.prefix && (!best || r.length > best->length)) {
+                best = &r;
+            }
+        }
+        return best;
+    }
+
+    ipv4_route make_route(uint32_t prefix, uint8_t length, uint32_t gateway, uint32_t source = 0) {
+        ipv4_route r;
+        r.prefix = prefix & mask(length);
+        r.length = length;
+        r.gateway = gateway;
+        r.source = source;
+        return r;
+    }
+
+}    // namespace
+
+BOOST_AUTO_TEST_CASE(test_longest_prefix_wins) {
+    ipv4_route_table t;
+    BOOST_REQUIRE(!t.lookup(0x0a000001));
+
+    t.add(make_route(0, 0, 1));
+    t.add(make_route(0x0a000000, 8, 2));
+    t.add(make_route(0x0a010000, 16, 3));
+    t.add(make_route(0x0a010200, 24, 4));
+    t.add(make_route(0x0a010203, 32, 5));
+
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0b000001)->gateway, 1u);
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0a020001)->gateway, 2u);
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0a010301)->gateway, 3u);
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0a010201)->gateway, 4u);
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0a010203)->gateway, 5u);
+    BOOST_REQUIRE_EQUAL(t.routes().size(), 5u);
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_follows_updates) {
+    ipv4_route_table t;
+    t.add(make_route(0x0a000000, 8, 1, 7));
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0a010203)->gateway, 1u);
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0a010203)->source, 7u);
+
+    // A more specific route must take over a destination that is already cached
+    t.add(make_route(0x0a010200, 24, 2));
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0a010203)->gateway, 2u);
+
+    // Same prefix and length replaces the route
+    t.add(make_route(0x0a010200, 24, 3));
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0a010203)->gateway, 3u);
+    BOOST_REQUIRE_EQUAL(t.routes().size(), 2u);
+
+    BOOST_REQUIRE(t.remove(0x0a010200, 24));
+    BOOST_REQUIRE(!t.remove(0x0a010200, 24));
+    BOOST_REQUIRE_EQUAL(t.lookup(0x0a010203)->gateway, 1u);
+
+    t.assign({});
+    BOOST_REQUIRE(!t.lookup(0x0a010203));
+}
+
+BOOST_AUTO_TEST_CASE(test_random_tables_match_linear_scan) {
+    std::mt19937 rng(1);
+    for (unsigned iter = 0; iter < 20; ++iter) {
+        ipv4_route_table t;
+        std::vector<ipv4_route> ref;
+        auto nr_routes = rng() % 300;
+        for (unsigned i = 0; i < nr_routes; ++i) {
+            // Few distinct first octets, so that prefixes nest
+            auto r = make_route((rng() % 4) << 24 | (rng() & 0xffffff), rng() % 33, rng() % 5, rng() % 2);
+            t.add(r);
+            auto it = std::find_if(ref.begin(), ref.end(),
+                                   [&](auto &&x) { return x.prefix == r.prefix && x.length == r.length; });
+            if (it != ref.end()) {
+                *it = r;
+            } else {
+                ref.push_back(r);
+            }
+        }
+        for (unsigned i = 0; i < 20 && !ref.empty(); ++i) {
+            auto idx = rng() % ref.size();
+            BOOST_REQUIRE(t.remove(ref[idx].prefix, ref[idx].length));
+            ref.erase(ref.begin() + idx);
+        }
+        for (unsigned i = 0; i < 20000; ++i) {
+            uint32_t dst = (rng() % 4) << 24 | (rng() & 0xffffff);
+            if (i % 2 && !ref.empty()) {
+                // Half of the destinations fall within a route, to hit the deep levels
+                auto &r = ref[rng() % ref.size()];
+                dst = r.prefix | (rng() & ~mask(r.length));
+            }
+            auto expected = reference_lookup(ref, dst);
+            auto nh = t.lookup(dst);
+            BOOST_REQUIRE_EQUAL(bool(expected), bool(nh));
+            BOOST_REQUIRE_EQUAL(nh, t.lookup_uncached(dst));
+            if (expected) {
+                BOOST_REQUIRE_EQUAL(nh->gateway, expected->gateway);
+                BOOST_REQUIRE_EQUAL(nh->source, expected->source);
+            }
+        }
+    }
+}
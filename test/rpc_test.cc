@@ -25,9 +25,11 @@
 #include "loopback_socket.hh"
 #include <nil/actor/rpc/rpc.hh>
 #include <nil/actor/rpc/rpc_types.hh>
+#include <nil/actor/rpc/client_group.hh>
 #include <nil/actor/rpc/lz4_compressor.hh>
 #include <nil/actor/rpc/lz4_fragmented_compressor.hh>
 #include <nil/actor/rpc/multi_algo_compressor_factory.hh>
+#include <nil/actor/network/shm_socket.hh>
 #include <nil/actor/testing/test_case.hh>
 #include <nil/actor/testing/thread_test_case.hh>
 #include <nil/actor/testing/test_runner.hh>
@@ -38,6 +40,10 @@
 #include <nil/actor/detail/defer.hh>
 #include <nil/actor/detail/log.hh>
 
+#include <atomic>
+#include <numeric>
+#include <unordered_set>
+
 using namespace nil::actor;
 
 struct serializer { };
@@ -187,6 +193,18 @@ class rpc_test_env {
             return proto().register_handler(t, sg, std::move(func));
         }
 
+        template<typename ShardOf, typename Func>
+        auto register_sharded_handler(MsgType t, ShardOf shard_of, Func func) {
+            _handlers.emplace_back(t);
+            return proto().register_sharded_handler(t, std::move(shard_of), std::move(func));
+        }
+
+        template<typename Func>
+        auto register_cacheable_handler(MsgType t, rpc::response_cache_options opts, Func func) {
+            _handlers.emplace_back(t);
+            return proto().register_cacheable_handler(t, std::move(opts), std::move(func));
+        }
+
         future<> unregister_handler(MsgType t) {
             auto it = std::find(_handlers.begin(), _handlers.end(), t);
             assert(it != _handlers.end());
@@ -256,10 +274,39 @@ public:
         return register_handler(t, scheduling_group(), std::move(func));
     }
 
+    template<typename ShardOf, typename Func>
+    future<> register_sharded_handler(MsgType t, ShardOf shard_of, Func func) {
+        return _service->invoke_on_all(
+            [t, shard_of = std::move(shard_of), func = std::move(func)](rpc_test_service &s) mutable {
+                s.register_sharded_handler(t, std::move(shard_of), std::move(func));
+            });
+    }
+
+    // Registers the handler make_func returns on every shard, for handlers of shard-local state
+    template<typename ShardOf, typename MakeFunc>
+    future<> register_sharded_handler_per_shard(MsgType t, ShardOf shard_of, MakeFunc make_func) {
+        return _service->invoke_on_all([t, shard_of, make_func](rpc_test_service &s) mutable {
+            s.register_sharded_handler(t, shard_of, make_func());
+        });
+    }
+
+    template<typename Func>
+    future<> register_cacheable_handler(MsgType t, rpc::response_cache_options opts, Func func) {
+        return _service->invoke_on_all([t, opts = std::move(opts), func = std::move(func)](rpc_test_service &s) {
+            s.register_cacheable_handler(t, opts, func);
+        });
+    }
+
     future<> unregister_handler(MsgType t) {
         return _service->invoke_on_all([t](rpc_test_service &s) mutable { return s.unregister_handler(t); });
     }
 
+    // Calls func with the protocol of every shard
+    template<typename Func>
+    future<> invoke_on_all(Func func) {
+        return _service->invoke_on_all([func = std::move(func)](rpc_test_service &s) { func(s.proto()); });
+    }
+
 private:
     rpc_test_service &local_service() {
         return _service->local();
@@ -612,6 +659,61 @@ ACTOR_TEST_CASE(test_rpc_scheduling) {
     });
 }
 
+ACTOR_THREAD_TEST_CASE(test_rpc_weighted_chunked_send) {
+    auto bulk = create_scheduling_group("bulk", 100).get0();
+    auto bulk_kill = defer([&] { destroy_scheduling_group(bulk).get(); });
+    auto fast = create_scheduling_group("fast", 100).get0();
+    auto fast_kill = defer([&] { destroy_scheduling_group(fast).get(); });
+    for (auto compress : {false, true}) {
+        auto factory = std::make_unique<cfactory>();
+        rpc_test_config cfg;
+        cfg.server_options.send_weights[fast] = 4;
+        rpc::client_options co;
+        co.send_in_chunks = true;
+        co.send_weights[fast] = 4;
+        if (compress) {
+            cfg.server_options.compressor_factory = factory.get();
+            co.compressor_factory = factory.get();
+        }
+        rpc_test_env<>::do_with_thread(cfg, co, [bulk, fast](rpc_test_env<> &env, test_rpc_proto::client &c) {
+            env.register_handler(1, bulk, [](sstring payload) { return payload; }).get();
+            env.register_handler(2, fast, [](int x) { return x + 1; }).get();
+            auto echo = env.proto().make_client<sstring(sstring)>(1);
+            auto inc = env.proto().make_client<int(int)>(2);
+
+            // Larger than several chunks, requests and replies alike
+            auto big = sstring(sstring::initialized_later(), 4 * rpc::send_quantum + 123);
+            std::iota(big.begin(), big.end(), 0);
+            // Replies of the fast verb received by the time each echo completes
+            unsigned fast_done = 0;
+            std::vector<unsigned> fast_done_before_echo;
+            std::vector<future<sstring>> echoed;
+            for (int i = 0; i < 3; i++) {
+                echoed.push_back(with_scheduling_group(bulk, [&] { return echo(c, big); }).then([&](sstring s) {
+                    fast_done_before_echo.push_back(fast_done);
+                    return s;
+                }));
+            }
+            std::vector<future<int>> incremented;
+            for (int i = 0; i < 10; i++) {
+                incremented.push_back(with_scheduling_group(fast, [&, i] { return inc(c, i); }).then([&](int x) {
+                    fast_done++;
+                    return x;
+                }));
+            }
+            for (int i = 0; i < 10; i++) {
+                BOOST_REQUIRE_EQUAL(incremented[i].get0(), i + 1);
+            }
+            for (auto &f : echoed) {
+                BOOST_REQUIRE(f.get0() == big);
+            }
+            // Small messages of the heavier class overtake the chunks of large ones
+            BOOST_REQUIRE(fast_done_before_echo == std::vector<unsigned>(3, 10));
+            BOOST_REQUIRE_EQUAL(c.get_stats().pending, 0u);
+        }).get();
+    }
+}
+
 ACTOR_THREAD_TEST_CASE(test_rpc_scheduling_connection_based) {
     auto sg1 = create_scheduling_group("sg1", 100).get0();
     auto sg1_kill = defer([&] { destroy_scheduling_group(sg1).get(); });
@@ -1201,5 +1303,516 @@ ACTOR_TEST_CASE(test_loggers) {
     });
 }
 
+ACTOR_THREAD_TEST_CASE(test_deadline_semaphore_order) {
+    using namespace std::chrono_literals;
+    rpc::deadline_semaphore sem(0);
+    auto now = rpc::rpc_clock_type::now();
+    std::vector<int> order;
+    std::vector<future<>> waits;
+    auto wait = [&](int id, boost::optional<rpc::rpc_clock_type::time_point> deadline, unsigned priority_class) {
+        waits.push_back(
+            sem.get_units(1, deadline, priority_class).then([&order, id](auto units) { order.push_back(id); }));
+    };
+    wait(0, {}, 0);
+    wait(1, now + 30s, 0);
+    wait(2, now + 10s, 1);
+    wait(3, now + 10s, 0);
+    wait(4, now + 20s, 0);
+    wait(5, {}, 0);
+    BOOST_REQUIRE_EQUAL(sem.waiters(), 6u);
+    for (unsigned i = 0; i < waits.size(); ++i) {
+        sem.signal(1);
+        thread::yield();
+    }
+    when_all_succeed(waits.begin(), waits.end()).get();
+    // Earliest deadline first within a class, the ones without a deadline last
+    BOOST_REQUIRE(order == std::vector<int>({3, 4, 1, 0, 5, 2}));
+    BOOST_REQUIRE_EQUAL(sem.available_units(), waits.size());
+}
+
+ACTOR_THREAD_TEST_CASE(test_deadline_semaphore_expiry) {
+    using namespace std::chrono_literals;
+    rpc::deadline_semaphore sem(1);
+    auto held = sem.get_units(1).get0();
+    // A large waiter holds back a small one until it times out
+    auto large = sem.get_units(2, rpc::rpc_clock_type::now() + 20ms);
+    auto small = sem.get_units(1, rpc::rpc_clock_type::now() + 10s);
+    held.return_all();
+    BOOST_REQUIRE(!small.available());
+    BOOST_REQUIRE_THROW(large.get(), semaphore_timed_out);
+    auto units = small.get0();
+    BOOST_REQUIRE_EQUAL(units.count(), 1u);
+    BOOST_REQUIRE_EQUAL(sem.waiters(), 0u);
+
+    auto late = sem.get_units(1, rpc::rpc_clock_type::now() + 10s);
+    sem.broken();
+    BOOST_REQUIRE_THROW(late.get(), broken_semaphore);
+}
+
+ACTOR_TEST_CASE(test_rpc_deadline_shedding) {
+    using namespace std::chrono_literals;
+    rpc_test_config cfg;
+    // One request at a time
+    cfg.resource_limits.basic_request_size = 1000;
+    cfg.resource_limits.max_memory = 1000;
+    return rpc_test_env<>::do_with_thread(cfg, [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        int executed = 0;
+        auto delay = 100ms;
+        env.register_handler(1, [&executed, &delay] {
+               executed++;
+               return sleep(delay);
+           }).get();
+        promise<> unblock;
+        env.register_handler(2, [&unblock] { return unblock.get_future(); }).get();
+        auto call = env.proto().make_client<void()>(1);
+        auto block = env.proto().make_client<void()>(2);
+        // Sends a request to the verb while another holds the resources for 10ms
+        auto contended_call = [&](rpc::rpc_clock_type::duration timeout) {
+            unblock = promise<>();
+            auto blocked = block(c1);
+            auto f = call(c1, timeout);
+            sleep(10ms).get();
+            unblock.set_value();
+            blocked.get();
+            return f;
+        };
+        // Teaches the server how long the verb takes
+        for (unsigned i = 0; i < rpc::verb_admission::seed_samples; i++) {
+            call(c1, 10s).get();
+        }
+        auto &stats = env.server().get_admission_stats();
+        BOOST_REQUIRE_EQUAL(executed, 4);
+
+        // The verb got faster, but the estimate still says it takes 100ms
+        delay = 1ms;
+        // Too little time left for the handler to finish once resources are freed: it never runs
+        BOOST_REQUIRE_THROW(contended_call(60ms).get(), rpc::timeout_error);
+        BOOST_REQUIRE_EQUAL(executed, 4);
+        BOOST_REQUIRE_EQUAL(stats.shed, 1u);
+
+        // Without contention the verb is served, and its estimate recovers
+        for (unsigned i = 0; i < 32; i++) {
+            call(c1, 60ms).get();
+        }
+        BOOST_REQUIRE_EQUAL(executed, 36);
+        contended_call(60ms).get();
+        BOOST_REQUIRE_EQUAL(executed, 37);
+        BOOST_REQUIRE_EQUAL(stats.shed, 1u);
+
+        // Requests without a deadline are always served
+        call(c1).get();
+        BOOST_REQUIRE_EQUAL(executed, 38);
+        BOOST_REQUIRE_EQUAL(stats.served, 38u + 2u);
+
+        env.proto().set_priority_class(1, 1);
+        BOOST_REQUIRE_THROW(env.proto().set_priority_class(2, 1), std::runtime_error);
+    });
+}
+
+struct measuring_serializer : serializer {
+    static constexpr bool measure_before_marshalling = true;
+};
+
+static sstring flatten(const rpc::snd_buf &buf) {
+    sstring ret;
+    if (auto *one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+        ret = sstring(one->get(), one->size());
+    } else {
+        for (auto &&b : std::get<std::vector<temporary_buffer<char>>>(buf.bufs)) {
+            ret += sstring(b.get(), b.size());
+        }
+    }
+    return ret;
+}
+
+ACTOR_TEST_CASE(test_single_pass_marshalling) {
+    serializer single_pass;
+    measuring_serializer two_pass;
+    const size_t head_space = 28;
+    for (auto len : {0, 1, 200, 4096, 300000}) {
+        auto str = sstring(sstring::initialized_later(), len);
+        std::fill(str.begin(), str.end(), 'x');
+        auto a = rpc::marshall(single_pass, head_space, uint64_t(len), str, int32_t(-1));
+        auto b = rpc::marshall(two_pass, head_space, uint64_t(len), str, int32_t(-1));
+        BOOST_REQUIRE_EQUAL(a.size, b.size);
+        BOOST_REQUIRE(flatten(a).substr(head_space) == flatten(b).substr(head_space));
+        // The header is backfilled into the first buffer
+        BOOST_REQUIRE_GE(a.front().size(), head_space);
+        if (a.size > rpc::snd_buf::chunk_size) {
+            BOOST_REQUIRE(std::holds_alternative<std::vector<temporary_buffer<char>>>(a.bufs));
+        }
+    }
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_striped_client) {
+    using namespace std::chrono_literals;
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env) {
+        env.register_handler(1, [](int a, int b) { return a + b; }).get();
+        env.register_handler(2, [](sstring s) { return s.size(); }).get();
+        env.register_handler(3, [] { return sleep(1s); }).get();
+        rpc::striping_options so;
+        so.stripes = 3;
+        so.bulk_threshold = 1024;
+        test_rpc_proto::striped_client c(env.proto(), so, {}, [&env] { return env.make_socket(); }, ipv4_addr());
+        auto stop = defer([&] { c.stop().get(); });
+
+        // Small requests go round-robin over all but the last connection
+        auto sum = env.proto().make_client<int(int, int)>(1);
+        for (int i = 0; i < 10; i++) {
+            BOOST_REQUIRE_EQUAL(sum(c, i, 1).get0(), i + 1);
+        }
+        BOOST_REQUIRE_EQUAL(c.stripe(0).get_stats().sent_messages, 5u);
+        BOOST_REQUIRE_EQUAL(c.stripe(1).get_stats().sent_messages, 5u);
+        BOOST_REQUIRE_EQUAL(c.stripe(2).get_stats().sent_messages, 0u);
+
+        // Bulk requests use the last one
+        auto size = env.proto().make_client<size_t(sstring)>(2);
+        BOOST_REQUIRE_EQUAL(size(c, sstring(sstring::initialized_later(), 4096)).get0(), 4096u);
+        BOOST_REQUIRE_EQUAL(c.stripe(2).get_stats().sent_messages, 1u);
+        BOOST_REQUIRE_EQUAL(c.get_stats().sent_messages, 11u);
+
+        // Message ids do not collide across connections
+        std::unordered_set<rpc::id_type> ids;
+        for (unsigned i = 0; i < c.stripes(); i++) {
+            for (int j = 0; j < 10; j++) {
+                BOOST_REQUIRE(ids.insert(c.stripe(i).next_message_id()).second);
+            }
+        }
+
+        auto slow = env.proto().make_client<void()>(3);
+        BOOST_REQUIRE_THROW(slow(c, 10ms).get(), rpc::timeout_error);
+        rpc::cancellable cancel;
+        auto f = slow(c, cancel);
+        cancel.cancel();
+        BOOST_REQUIRE_THROW(f.get(), rpc::canceled_error);
+    });
+}
+
+ACTOR_TEST_CASE(test_striped_client_streaming) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env) {
+        std::vector<future<>> server_done;
+        int server_sum = 0;
+        env.register_handler(1, [&](rpc::source<int> source) {
+               server_done.push_back(nil::actor::async([source, &server_sum]() mutable {
+                   while (auto data = source().get0()) {
+                       server_sum += std::get<0>(*data);
+                   }
+               }));
+           }).get();
+        rpc::striping_options so;
+        so.stripes = 3;
+        test_rpc_proto::striped_client c(env.proto(), so, {}, [&env] { return env.make_socket(); }, ipv4_addr());
+        auto stop = defer([&] { c.stop().get(); });
+
+        // Every call has to follow its sink, whichever connection comes next in turn
+        auto call = env.proto().make_client<void(rpc::sink<int>)>(1);
+        for (int i = 0; i < 5; i++) {
+            auto sink = c.make_stream_sink<serializer, int>(env.make_socket()).get0();
+            call(c, sink).get();
+            sink(i).get();
+            sink.flush().get();
+            sink.close().get();
+        }
+        when_all_succeed(server_done.begin(), server_done.end()).get();
+        BOOST_REQUIRE_EQUAL(server_sum, 0 + 1 + 2 + 3 + 4);
+    });
+}
+
+ACTOR_THREAD_TEST_CASE(test_rpc_over_shm_socket) {
+    auto addr = socket_address(unix_domain_addr(std::string("\0actor-rpc-shm-test", 19)));
+    test_rpc_proto proto(serializer {});
+    proto.register_handler(1, [](sstring s) { return s + s; });
+    test_rpc_proto::server server(proto, rpc::server_options(), net::shm_listen(addr));
+    test_rpc_proto::client client(proto, rpc::client_options(), net::shm_socket(), addr);
+    auto twice = proto.make_client<sstring(sstring)>(1);
+    BOOST_REQUIRE_EQUAL(twice(client, "ab").get0(), "abab");
+
+    // Messages larger than the rings are passed through in pieces
+    auto big = sstring(sstring::initialized_later(), 3 << 20);
+    std::iota(big.begin(), big.end(), 0);
+    BOOST_REQUIRE(twice(client, big).get0() == big + big);
+
+    client.stop().get();
+    server.stop().get();
+}
+
+ACTOR_TEST_CASE(test_rpc_sharded_handler) {
+    using namespace std::chrono_literals;
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env, test_rpc_proto::client &c) {
+        auto shard_of = [](int key) { return unsigned(key); };
+        env.register_sharded_handler(1, shard_of, [](int key, sstring payload) {
+               if (key < 0) {
+                   throw std::runtime_error("negative key");
+               }
+               return to_sstring(this_shard_id()) + ":" + payload;
+           }).get();
+        env.register_sharded_handler(2, shard_of, [](rpc::opt_time_point timeout, int key) {
+               return sleep(10ms).then([] { return this_shard_id(); });
+           }).get();
+
+        auto call = env.proto().make_client<sstring(int, sstring)>(1);
+        auto big = sstring(sstring::initialized_later(), 1 << 20);
+        std::iota(big.begin(), big.end(), 0);
+        for (unsigned key = 0; key < 2 * smp::count; key++) {
+            auto payload = key % 2 ? big : sstring("x");
+            BOOST_REQUIRE(call(c, key, payload).get0() == to_sstring(key % smp::count) + ":" + payload);
+        }
+        BOOST_REQUIRE_THROW(call(c, -1, "x").get(), std::runtime_error);
+
+        // Requests in flight to the same shard at once
+        auto where = env.proto().make_client<unsigned(int)>(2);
+        std::vector<future<unsigned>> replies;
+        for (unsigned i = 0; i < 100; i++) {
+            replies.push_back(where(c, 1s, i));
+        }
+        for (unsigned i = 0; i < 100; i++) {
+            BOOST_REQUIRE_EQUAL(replies[i].get0(), i % smp::count);
+        }
+    });
+}
+
+ACTOR_THREAD_TEST_CASE(test_rpc_sharded_handler_of_shard) {
+    // Each shard counts the requests its own handler ran
+    struct shard_state {
+        unsigned shard = this_shard_id();
+        std::vector<int> keys;
+    };
+    sharded<shard_state> states;
+    states.start().get();
+    auto stop = defer([&] { states.stop().get(); });
+
+    rpc_test_env<>::do_with_thread(rpc_test_config(), [&states](rpc_test_env<> &env, test_rpc_proto::client &c) {
+        auto shard_of = [](int key) { return unsigned(key); };
+        env.register_sharded_handler_per_shard(1, shard_of, [&states] {
+               auto *state = &states.local();
+               return [state](int key) {
+                   state->keys.push_back(key);
+                   return state->shard;
+               };
+           }).get();
+
+        auto call = env.proto().make_client<unsigned(int)>(1);
+        for (int key = 0; key < int(4 * smp::count); key++) {
+            BOOST_REQUIRE_EQUAL(call(c, key).get0(), key % smp::count);
+        }
+    }).get();
+
+    states
+        .invoke_on_all([](shard_state &s) {
+            BOOST_REQUIRE_EQUAL(s.keys.size(), 4u);
+            for (auto key : s.keys) {
+                BOOST_REQUIRE_EQUAL(key % smp::count, s.shard);
+            }
+        })
+        .get();
+}
+
+ACTOR_TEST_CASE(test_rpc_tracing) {
+    using namespace std::chrono_literals;
+    rpc::client_options co;
+    co.send_trace_context = true;
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), co, [](rpc_test_env<> &env, test_rpc_proto::client &c) {
+        env.register_handler(1, [](int x) { return sleep(1ms).then([x] { return x; }); }).get();
+        env.register_handler(2, [] { return rpc::current_trace_context().trace_id; }).get();
+        auto call = env.proto().make_client<int(int)>(1);
+        auto trace_of_handler = env.proto().make_client<uint64_t()>(2);
+        auto traced = [](const rpc::trace_context &ctx, auto &&make_call) {
+            rpc::trace_scope scope(ctx);
+            return make_call();
+        };
+
+        auto unsampled = rpc::trace_context::start(false);
+        BOOST_REQUIRE_EQUAL(traced(unsampled, [&] { return call(c, 1); }).get0(), 1);
+        auto ctx = rpc::trace_context::start();
+        BOOST_REQUIRE_EQUAL(traced(ctx, [&] { return call(c, 2); }).get0(), 2);
+        // Handlers run with the trace of their request
+        BOOST_REQUIRE_EQUAL(traced(ctx, [&] { return trace_of_handler(c); }).get0(), ctx.trace_id);
+
+        // Spans are recorded once replies are written, which may be after the client got them
+        auto spans_of = [](uint64_t trace_id) {
+            auto spans = rpc::collect_spans().get0();
+            spans.erase(std::remove_if(spans.begin(), spans.end(),
+                                       [trace_id](const rpc::span &s) { return s.trace_id != trace_id; }),
+                        spans.end());
+            return spans;
+        };
+        auto spans = spans_of(ctx.trace_id);
+        for (int i = 0; i < 100 && spans.size() < 2; i++) {
+            sleep(1ms).get();
+            spans = spans_of(ctx.trace_id);
+        }
+        BOOST_REQUIRE_EQUAL(spans.size(), 2u);
+        BOOST_REQUIRE(spans_of(unsampled.trace_id).empty());
+
+        auto &s = spans[0].verb == 1 ? spans[0] : spans[1];
+        BOOST_REQUIRE_EQUAL(s.verb, 1u);
+        BOOST_REQUIRE_EQUAL(s.parent_span_id, ctx.span_id);
+        BOOST_REQUIRE_NE(s.span_id, ctx.span_id);
+        BOOST_REQUIRE(s.received <= s.admitted);
+        BOOST_REQUIRE(s.admitted <= s.handler_started);
+        BOOST_REQUIRE(s.handler_started + 1ms <= s.handler_finished);
+        BOOST_REQUIRE(s.handler_finished <= s.replied);
+        auto json = rpc::spans_to_json({s});
+        BOOST_REQUIRE(json.find(format("\"trace_id\":\"{:016x}\"", ctx.trace_id)) != sstring::npos);
+    });
+}
+
+ACTOR_TEST_CASE(test_rpc_response_cache) {
+    using namespace std::chrono_literals;
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env, test_rpc_proto::client &c) {
+        std::atomic<unsigned> calls {0};
+        rpc::response_cache_options opts;
+        opts.ttl = 1s;
+        env.register_cacheable_handler(1, opts, [&calls](int x, sstring s) {
+               calls++;
+               if (x < 0) {
+                   throw std::runtime_error("negative");
+               }
+               return s + to_sstring(x);
+           }).get();
+        auto call = env.proto().make_client<sstring(int, sstring)>(1);
+        auto hits = [&env] {
+            std::atomic<uint64_t> n {0};
+            env.invoke_on_all([&n](test_rpc_proto &p) { n += p.cache_of(1).get_stats().hits; }).get();
+            return n.load();
+        };
+
+        BOOST_REQUIRE_EQUAL(call(c, 1, "a").get0(), "a1");
+        BOOST_REQUIRE_EQUAL(call(c, 1, "a").get0(), "a1");
+        BOOST_REQUIRE_EQUAL(calls.load(), 1u);
+        BOOST_REQUIRE_EQUAL(call(c, 2, "a").get0(), "a2");
+        BOOST_REQUIRE_EQUAL(calls.load(), 2u);
+        // Large replies share the buffers they were marshalled into
+        auto big = sstring(sstring::initialized_later(), 64 * 1024);
+        std::iota(big.begin(), big.end(), 0);
+        BOOST_REQUIRE(call(c, 3, big).get0() == big + "3");
+        BOOST_REQUIRE(call(c, 3, big).get0() == big + "3");
+        BOOST_REQUIRE_EQUAL(calls.load(), 3u);
+        // Errors are not cached
+        BOOST_REQUIRE_THROW(call(c, -1, "a").get(), std::runtime_error);
+        BOOST_REQUIRE_THROW(call(c, -1, "a").get(), std::runtime_error);
+        BOOST_REQUIRE_EQUAL(calls.load(), 5u);
+        BOOST_REQUIRE_EQUAL(hits(), 2u);
+
+        env.invoke_on_all([](test_rpc_proto &p) { p.invalidate_cached(1, 1, sstring("a")); }).get();
+        BOOST_REQUIRE_EQUAL(call(c, 1, "a").get0(), "a1");
+        BOOST_REQUIRE_EQUAL(calls.load(), 6u);
+        BOOST_REQUIRE_EQUAL(call(c, 2, "a").get0(), "a2");
+        BOOST_REQUIRE_EQUAL(calls.load(), 6u);
+        env.invoke_on_all([](test_rpc_proto &p) { p.invalidate_cached(1); }).get();
+        BOOST_REQUIRE_EQUAL(call(c, 2, "a").get0(), "a2");
+        BOOST_REQUIRE_EQUAL(calls.load(), 7u);
+
+        // Expired replies are computed again
+        sleep(1100ms).get();
+        BOOST_REQUIRE_EQUAL(call(c, 2, "a").get0(), "a2");
+        BOOST_REQUIRE_EQUAL(calls.load(), 8u);
+    });
+}
+
+ACTOR_TEST_CASE(test_rpc_response_cache_invalidated_while_computing) {
+    using namespace std::chrono_literals;
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env, test_rpc_proto::client &c) {
+        std::atomic<int> version {1};
+        std::atomic<bool> started {false};
+        std::atomic<bool> released {false};
+        // The handler reads the state, then blocks until released
+        env.register_cacheable_handler(1, rpc::response_cache_options(), [&](int x) {
+               auto v = version.load();
+               started = true;
+               return do_until([&released] { return released.load(); }, [] { return sleep(1ms); }).then([v] {
+                   return v;
+               });
+           }).get();
+        auto call = env.proto().make_client<int(int)>(1);
+
+        auto stale = call(c, 1);
+        while (!started) {
+            sleep(1ms).get();
+        }
+        // The state changes while the handler computes the old reply
+        version = 2;
+        env.invoke_on_all([](test_rpc_proto &p) { p.invalidate_cached(1); }).get();
+        released = true;
+        BOOST_REQUIRE_EQUAL(stale.get0(), 1);
+        // The old reply was not cached
+        BOOST_REQUIRE_EQUAL(call(c, 1).get0(), 2);
+        BOOST_REQUIRE_EQUAL(call(c, 1).get0(), 2);
+    });
+}
+
+ACTOR_THREAD_TEST_CASE(test_client_group_hedging) {
+    using namespace std::chrono_literals;
+    struct replica_server {
+        loopback_connection_factory lcf;
+        test_rpc_proto proto {serializer {}};
+        test_rpc_proto::server server;
+        test_rpc_proto::client client;
+
+        explicit replica_server(std::chrono::milliseconds delay) :
+            server(proto, rpc::server_options(), lcf.get_server_socket()),
+            client(proto, rpc::client_options(),
+                   nil::actor::socket(std::make_unique<rpc_socket_impl>(lcf, true, false)), ipv4_addr()) {
+            proto.register_handler(1, [delay](int x) { return sleep(delay).then([x] { return x; }); });
+        }
+        future<> stop() {
+            return client.stop().then([this] { return server.stop(); });
+        }
+    };
+
+    // The last replica stalls
+    std::vector<std::unique_ptr<replica_server>> replicas;
+    for (auto delay : {0ms, 0ms, 1000ms}) {
+        replicas.push_back(std::make_unique<replica_server>(delay));
+    }
+    auto stop = defer([&] {
+        for (auto &r : replicas) {
+            r->stop().get();
+        }
+    });
+
+    rpc::hedging_options ho;
+    ho.initial_delay = 20ms;
+    ho.max_hedge_ratio = 1;
+    rpc::client_group g({replicas[0]->client, replicas[1]->client, replicas[2]->client}, ho);
+    auto close = defer([&] { g.close().get(); });
+
+    auto echo = replicas[0]->proto.make_client<int(int)>(1);
+    for (int i = 0; i < 50; i++) {
+        auto start = steady_clock_type::now();
+        BOOST_REQUIRE_EQUAL(g.call(echo, i).get0(), i);
+        BOOST_REQUIRE(steady_clock_type::now() - start < 500ms);
+    }
+
+    // The stalled replica only got calls before anything was known about it, which were hedged
+    BOOST_REQUIRE_GE(replicas[2]->client.get_stats().sent_messages, 1u);
+    BOOST_REQUIRE_LE(replicas[2]->client.get_stats().sent_messages, 2u);
+    BOOST_REQUIRE_GE(g.get_stats().hedged, 1u);
+    BOOST_REQUIRE_GE(g.get_stats().hedge_wins, 1u);
+    BOOST_REQUIRE_EQUAL(g.get_stats().calls, 50u);
+    BOOST_REQUIRE_EQUAL(g.get_stats().errors, 0u);
+    // Fast replies bring the hedging delay down from the initial one
+    BOOST_REQUIRE(g.hedge_delay() < 20ms);
+}
+
+ACTOR_THREAD_TEST_CASE(test_client_groups_with_the_same_name) {
+    loopback_connection_factory lcf;
+    test_rpc_proto proto {serializer {}};
+    test_rpc_proto::server server(proto, rpc::server_options(), lcf.get_server_socket());
+    test_rpc_proto::client client(proto, rpc::client_options(),
+                                  nil::actor::socket(std::make_unique<rpc_socket_impl>(lcf, true, false)), ipv4_addr());
+    auto stop = defer([&] {
+        client.stop().get();
+        server.stop().get();
+    });
+
+    // Their metrics are told apart by the id label instead of colliding
+    rpc::client_group first({client});
+    rpc::client_group second({client});
+    first.close().get();
+    second.close().get();
+}
+
 static_assert(std::is_same_v<decltype(rpc::tuple(1U, 1L)), rpc::tuple<unsigned, long>>,
               "rpc::tuple deduction guid not working");
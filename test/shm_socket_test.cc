@@ -0,0 +1,123 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
+#include <nil/actor/network/shm_socket.hh>
+#include <nil/actor/network/api.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/thread.hh>
+
+using namespace nil::actor;
+
+namespace {
+
+    socket_address abstract_address(const char *name) {
+        return socket_address(unix_domain_addr(std::string(1, '\0') + name));
+    }
+
+    sstring read_all(input_stream<char> &in) {
+        sstring ret;
+        for (;;) {
+            auto buf = in.read().get0();
+            if (buf.empty()) {
+                return ret;
+            }
+            ret += sstring(buf.get(), buf.size());
+        }
+    }
+
+}    // namespace
+
+ACTOR_THREAD_TEST_CASE(test_shm_socket_stream) {
+    auto addr = abstract_address("actor-shm-socket-stream");
+    auto ss = net::shm_listen(addr);
+    auto accepted = ss.accept();
+    auto cs = net::shm_socket().connect(addr).get0();
+    auto ar = accepted.get0();
+
+    auto out = cs.output();
+    auto in = ar.connection.input();
+    out.write("los lobos").get();
+    out.flush().get();
+    auto buf = in.read_exactly(9).get0();
+    BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "los lobos");
+
+    // Closing the output is seen as the end of the stream by the peer
+    out.close().get();
+    BOOST_REQUIRE(in.read().get0().empty());
+
+    // The other direction still works
+    auto reply = ar.connection.output();
+    auto reply_in = cs.input();
+    reply.write("la bamba").get();
+    reply.close().get();
+    BOOST_REQUIRE_EQUAL(read_all(reply_in), "la bamba");
+
+    in.close().get();
+    reply_in.close().get();
+    ss.abort_accept();
+}
+
+ACTOR_THREAD_TEST_CASE(test_shm_socket_wraps_around) {
+    // With the smallest ring, the writer has to wait for the reader all along
+    auto addr = abstract_address("actor-shm-socket-wrap");
+    net::shm_socket_options opts;
+    opts.ring_size = 4096;
+    auto ss = net::shm_listen(addr);
+    auto accepted = ss.accept();
+    auto cs = net::shm_socket(opts).connect(addr).get0();
+    auto ar = accepted.get0();
+
+    sstring data(sstring::initialized_later(), 1 << 20);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = 'a' + i % 23;
+    }
+    auto out = cs.output();
+    auto written = out.write(data).then([&out] { return out.close(); });
+    auto in = ar.connection.input();
+    BOOST_REQUIRE(read_all(in) == data);
+    written.get();
+    in.close().get();
+    ss.abort_accept();
+}
+
+ACTOR_THREAD_TEST_CASE(test_shm_socket_peer_gone) {
+    auto addr = abstract_address("actor-shm-socket-gone");
+    auto ss = net::shm_listen(addr);
+    auto accepted = ss.accept();
+    auto cs = net::shm_socket().connect(addr).get0();
+    auto in = cs.input();
+    auto out = cs.output();
+    {
+        // The peer shuts both directions down
+        auto ar = accepted.get0();
+        ar.connection.shutdown_input();
+        ar.connection.shutdown_output();
+    }
+    BOOST_REQUIRE(in.read().get0().empty());
+    BOOST_REQUIRE_THROW(out.write("late").then([&out] { return out.flush(); }).get(), std::system_error);
+    in.close().get();
+    ss.abort_accept();
+}
@@ -0,0 +1,265 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
+#include <nil/actor/network/loopback.hh>
+#include <nil/actor/network/offload.hh>
+#include <nil/actor/network/ethernet.hh>
+#include <nil/actor/network/ip.hh>
+#include <nil/actor/network/tcp.hh>
+#include <nil/actor/network/tcp-stack.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/thread.hh>
+
+using namespace nil::actor;
+using namespace net;
+
+namespace {
+
+    const ipv4_address src_ip("10.0.0.1");
+    const ipv4_address dst_ip("10.0.0.2");
+
+    sstring make_payload(size_t len, size_t off = 0) {
+        sstring s(sstring::initialized_later(), len);
+        for (size_t i = 0; i < len; ++i) {
+            s[i] = 'a' + (off + i) % 26;
+        }
+        return s;
+    }
+
+    packet prepend_ip_header(packet p) {
+        auto iph = p.prepend_header<ip_hdr>();
+        iph->ihl = sizeof(ip_hdr) / 4;
+        iph->ver = 4;
+        iph->dscp = 0;
+        iph->ecn = 0;
+        iph->len = p.len();
+        iph->id = 0;
+        iph->frag = 0;
+        iph->ttl = 64;
+        iph->ip_proto = uint8_t(ip_protocol_num::tcp);
+        iph->csum = 0;
+        iph->src_ip = src_ip;
+        iph->dst_ip = dst_ip;
+        *iph = hton(*iph);
+        iph->csum = ip_checksum(iph, sizeof(*iph));
+        return p;
+    }
+
+    // A TCP/IPv4 datagram with a complete checksum
+    packet make_segment(uint32_t seq, const sstring &payload, bool psh = false) {
+        packet p(payload.data(), payload.size());
+        auto th = p.prepend_uninitialized_header(tcp_hdr::len);
+        tcp_hdr h {};
+        h.src_port = 10000;
+        h.dst_port = 80;
+        h.seq = tcp_seq {seq};
+        h.ack = tcp_seq {1};
+        h.data_offset = tcp_hdr::len / 4;
+        h.f_ack = true;
+        h.f_psh = psh;
+        h.window = 1000;
+        h.checksum = 0;
+        h.write(th);
+        checksummer csum;
+        ipv4_traits::tcp_pseudo_header_checksum(csum, src_ip, dst_ip, p.len());
+        csum.sum(p);
+        tcp_hdr::write_nbo_checksum(th, csum.get());
+        return prepend_ip_header(std::move(p));
+    }
+
+    bool tcp_checksum_ok(packet &p, size_t tcp_off) {
+        auto tcp = p.share(tcp_off, p.len() - tcp_off);
+        checksummer csum;
+        ipv4_traits::tcp_pseudo_header_checksum(csum, src_ip, dst_ip, tcp.len());
+        csum.sum(tcp);
+        return csum.get() == 0;
+    }
+
+    sstring to_sstring(packet p) {
+        p.linearize();
+        return sstring(p.fragments()[0].base, p.len());
+    }
+
+    struct ipv4_node {
+        interface netif;
+        ipv4 inet;
+
+        static std::shared_ptr<device> start(std::shared_ptr<device> dev) {
+            dev->set_local_queue(dev->init_local_queue({}, this_shard_id()));
+            return dev;
+        }
+
+        ipv4_node(std::shared_ptr<device> dev, const char *addr) : netif(start(std::move(dev))), inet(&netif) {
+            inet.set_host_address(ipv4_address(addr));
+            inet.set_netmask_address(ipv4_address("255.255.255.0"));
+            inet.set_arp_learn_hook([this](ethernet_address l2, ipv4_address l3) { inet.learn(l2, l3); });
+            netif.enable_sw_gso();
+            inet.enable_gro();
+        }
+    };
+
+}    // namespace
+
+ACTOR_TEST_CASE(test_gso_segment) {
+    // A super-segment the way tcb::output_one() builds it for TSO: the TCP
+    // checksum covers the pseudo header with a zero length only.
+    const size_t mss = 1460;
+    auto payload = make_payload(3 * mss + 100);
+    packet p(payload.data(), payload.size());
+    auto th = p.prepend_uninitialized_header(tcp_hdr::len);
+    tcp_hdr h {};
+    h.src_port = 10000;
+    h.dst_port = 80;
+    h.seq = tcp_seq {1000};
+    h.data_offset = tcp_hdr::len / 4;
+    h.f_ack = true;
+    h.f_psh = true;
+    h.f_fin = true;
+    h.write(th);
+    checksummer pseudo;
+    ipv4_traits::tcp_pseudo_header_checksum(pseudo, src_ip, dst_ip, 0);
+    tcp_hdr::write_nbo_checksum(th, ~pseudo.get());
+    p = prepend_ip_header(std::move(p));
+    auto eh = p.prepend_header<eth_hdr>();
+    eh->eth_proto = uint16_t(eth_protocol_num::ipv4);
+    *eh = hton(*eh);
+    offload_info oi;
+    oi.protocol = ip_protocol_num::tcp;
+    oi.needs_csum = true;
+    oi.tso_seg_size = mss;
+    p.set_offload_info(oi);
+
+    circular_buffer<packet> out;
+    BOOST_REQUIRE_EQUAL(tcp_gso_segment(std::move(p), hw_features(), out), 4u);
+    BOOST_REQUIRE_EQUAL(out.size(), 4u);
+    sstring received;
+    for (size_t i = 0; i < out.size(); ++i) {
+        auto &s = out[i];
+        bool last = i == out.size() - 1;
+        BOOST_REQUIRE(!s.offload_info().needs_csum);
+        BOOST_REQUIRE_EQUAL(s.offload_info().tso_seg_size, 0);
+        auto iph = s.get_header<ip_hdr>(sizeof(eth_hdr));
+        BOOST_REQUIRE_EQUAL(ip_checksum(iph, sizeof(*iph)), 0);
+        BOOST_REQUIRE_EQUAL(size_t(ntoh(*iph).len), s.len() - sizeof(eth_hdr));
+        BOOST_REQUIRE(tcp_checksum_ok(s, sizeof(eth_hdr) + sizeof(ip_hdr)));
+        auto sh = tcp_hdr::read(s.get_header(sizeof(eth_hdr) + sizeof(ip_hdr), tcp_hdr::len));
+        BOOST_REQUIRE_EQUAL(sh.seq.raw, 1000 + i * mss);
+        BOOST_REQUIRE_EQUAL(bool(sh.f_fin), last);
+        BOOST_REQUIRE_EQUAL(bool(sh.f_psh), last);
+        BOOST_REQUIRE(sh.f_ack);
+        auto hdr_len = sizeof(eth_hdr) + sizeof(ip_hdr) + tcp_hdr::len;
+        BOOST_REQUIRE_EQUAL(s.len() - hdr_len, last ? 100u : mss);
+        received += to_sstring(s.share(hdr_len, s.len() - hdr_len));
+    }
+    BOOST_REQUIRE_EQUAL(received, payload);
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_gro_coalesces_in_order_segments) {
+    std::vector<std::pair<packet, unsigned>> delivered;
+    tcp_gro gro(true, [&delivered](packet p, unsigned segments) { delivered.emplace_back(std::move(p), segments); });
+
+    const size_t mss = 1000;
+    for (unsigned i = 0; i < 4; ++i) {
+        gro.receive(make_segment(1 + i * mss, make_payload(mss, i * mss)));
+    }
+    BOOST_REQUIRE(delivered.empty());
+    // A short segment with PSH ends the burst
+    gro.receive(make_segment(1 + 4 * mss, make_payload(10, 4 * mss), true));
+    BOOST_REQUIRE_EQUAL(delivered.size(), 1u);
+    BOOST_REQUIRE_EQUAL(delivered[0].second, 5u);
+    auto &p = delivered[0].first;
+    BOOST_REQUIRE(p.offload_info().rx_csum_verified);
+    BOOST_REQUIRE_EQUAL(size_t(ntoh(*p.get_header<ip_hdr>(0)).len), p.len());
+    auto h = tcp_hdr::read(p.get_header(sizeof(ip_hdr), tcp_hdr::len));
+    BOOST_REQUIRE_EQUAL(h.seq.raw, 1u);
+    BOOST_REQUIRE(h.f_psh);
+    auto hdr_len = sizeof(ip_hdr) + tcp_hdr::len;
+    BOOST_REQUIRE_EQUAL(to_sstring(p.share(hdr_len, p.len() - hdr_len)), make_payload(4 * mss + 10));
+    BOOST_REQUIRE(!gro.flush());
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_gro_flushes_out_of_order_and_corrupted_segments) {
+    std::vector<std::pair<packet, unsigned>> delivered;
+    tcp_gro gro(true, [&delivered](packet p, unsigned segments) { delivered.emplace_back(std::move(p), segments); });
+
+    gro.receive(make_segment(1, make_payload(100)));
+    gro.receive(make_segment(101, make_payload(100)));
+    // A hole: what was held goes first, the new segment is held instead
+    gro.receive(make_segment(1001, make_payload(100)));
+    BOOST_REQUIRE_EQUAL(delivered.size(), 1u);
+    BOOST_REQUIRE_EQUAL(delivered[0].second, 2u);
+
+    auto bad = make_segment(1101, make_payload(100));
+    bad.get_header(sizeof(ip_hdr) + tcp_hdr::len, 1)[0] ^= 1;
+    gro.receive(std::move(bad));
+    BOOST_REQUIRE_EQUAL(delivered.size(), 2u);
+    BOOST_REQUIRE_EQUAL(delivered[1].second, 1u);
+    BOOST_REQUIRE(!delivered[1].first.offload_info().rx_csum_verified);
+
+    BOOST_REQUIRE(gro.flush());
+    BOOST_REQUIRE_EQUAL(delivered.size(), 3u);
+    BOOST_REQUIRE_EQUAL(tcp_hdr::read(delivered[2].first.get_header(sizeof(ip_hdr), tcp_hdr::len)).seq.raw, 1001u);
+    return make_ready_future<>();
+}
+
+ACTOR_THREAD_TEST_CASE(test_tcp_with_software_offloads) {
+    // The stacks are leaked: device queues keep polling them until the reactor exits
+    auto devs = create_loopback_device_pair();
+    auto &a = *new ipv4_node(devs.first, "10.0.0.1");
+    auto &b = *new ipv4_node(devs.second, "10.0.0.2");
+    BOOST_REQUIRE(a.netif.hw_features().tx_tso);
+
+    auto ss = tcpv4_listen(b.inet.get_tcp(), 10000, listen_options());
+    auto accepted = ss.accept();
+    auto cs = tcpv4_socket(a.inet.get_tcp()).connect(socket_address(ipv4_addr("10.0.0.2", 10000))).get0();
+    auto ar = accepted.get0();
+
+    const size_t size = 4 << 20;
+    auto out = cs.output();
+    auto in = ar.connection.input();
+    auto writer = async([&out] {
+        auto chunk = make_payload(26 * 1000);
+        for (size_t off = 0; off < size; off += chunk.size()) {
+            out.write(chunk.data(), std::min(chunk.size(), size - off)).get();
+        }
+        out.flush().get();
+    });
+    size_t received = 0;
+    while (received < size) {
+        auto buf = in.read().get0();
+        BOOST_REQUIRE(!buf.empty());
+        for (size_t i = 0; i < buf.size(); ++i) {
+            BOOST_REQUIRE_EQUAL(buf[i], char('a' + (received + i) % 26));
+        }
+        received += buf.size();
+    }
+    writer.get();
+    out.close().get();
+    in.close().get();
+    ss.abort_accept();
+}
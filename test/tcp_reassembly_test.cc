@@ -0,0 +1,158 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <nil/actor/network/packet-util.hh>
+#include <nil/actor/network/tcp.hh>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace nil::actor;
+using namespace net;
+
+namespace {
+
+    std::string contents(const packet &p) {
+        std::string s;
+        for (auto &&f : p.fragments()) {
+            s.append(f.base, f.size);
+        }
+        return s;
+    }
+
+    std::string random_stream(std::mt19937 &rng, size_t len) {
+        std::string s(len, 0);
+        for (auto &c : s) {
+            c = char('a' + rng() % 26);
+        }
+        return s;
+    }
+
+}    // namespace
+
+BOOST_AUTO_TEST_CASE(test_adjacent_segments_coalesce) {
+    packet_reassembly_queue<uint32_t> q;
+    BOOST_REQUIRE_EQUAL(q.insert(10, packet("cd", 2)), 2u);
+    BOOST_REQUIRE_EQUAL(q.insert(14, packet("gh", 2)), 2u);
+    BOOST_REQUIRE_EQUAL(q.size(), 2u);
+    // Fills the hole, touching both neighbours
+    BOOST_REQUIRE_EQUAL(q.insert(12, packet("ef", 2)), 2u);
+    BOOST_REQUIRE_EQUAL(q.size(), 1u);
+    // Duplicates and overlaps only count what is new
+    BOOST_REQUIRE_EQUAL(q.insert(11, packet("de", 2)), 0u);
+    BOOST_REQUIRE_EQUAL(q.insert(15, packet("hij", 3)), 2u);
+    BOOST_REQUIRE_EQUAL(q.bytes(), 8u);
+
+    std::string out;
+    auto next = q.pop_front(8, [&](packet p) { out += contents(p); });
+    BOOST_REQUIRE_EQUAL(next, 8u);
+    BOOST_REQUIRE(out.empty());
+    next = q.pop_front(11, [&](packet p) { out += contents(p); });
+    BOOST_REQUIRE_EQUAL(next, 18u);
+    BOOST_REQUIRE_EQUAL(out, "defghij");
+    BOOST_REQUIRE(q.empty());
+    BOOST_REQUIRE_EQUAL(q.bytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_limit) {
+    packet_reassembly_queue<uint32_t> q;
+    BOOST_REQUIRE_EQUAL(q.insert(100, packet("0123456789", 10), 16), 10u);
+    BOOST_REQUIRE_EQUAL(q.insert(200, packet("0123456789", 10), 16), 6u);
+    BOOST_REQUIRE_EQUAL(q.insert(300, packet("0123456789", 10), 16), 0u);
+    BOOST_REQUIRE_EQUAL(q.bytes(), 16u);
+    BOOST_REQUIRE_EQUAL(q.size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(test_sack_blocks_report_latest_first) {
+    packet_reassembly_queue<uint32_t> q;
+    q.insert(100, packet("a", 1));
+    q.insert(300, packet("b", 1));
+    q.insert(200, packet("c", 1));
+    std::pair<uint32_t, uint32_t> blocks[4];
+    BOOST_REQUIRE_EQUAL(q.ranges(blocks, 4), 3u);
+    BOOST_REQUIRE_EQUAL(blocks[0].first, 200u);
+    BOOST_REQUIRE_EQUAL(blocks[1].first, 100u);
+    BOOST_REQUIRE_EQUAL(blocks[2].first, 300u);
+    BOOST_REQUIRE_EQUAL(q.ranges(blocks, 2), 2u);
+
+    // The block grows with the segment that extends it
+    q.insert(101, packet("d", 1));
+    BOOST_REQUIRE_EQUAL(q.ranges(blocks, 1), 1u);
+    BOOST_REQUIRE_EQUAL(blocks[0].first, 100u);
+    BOOST_REQUIRE_EQUAL(blocks[0].second, 102u);
+}
+
+BOOST_AUTO_TEST_CASE(test_reordered_stream_across_sequence_wrap) {
+    std::mt19937 rng(7);
+    for (unsigned iter = 0; iter < 200; ++iter) {
+        auto stream = random_stream(rng, 1 + rng() % 20000);
+        // Segments of the stream, plus overlapping retransmissions
+        std::vector<std::pair<size_t, size_t>> segs;
+        for (size_t pos = 0; pos < stream.size();) {
+            auto len = std::min<size_t>(1 + rng() % 1460, stream.size() - pos);
+            segs.emplace_back(pos, len);
+            pos += len;
+        }
+        for (unsigned i = 0; i < 20; ++i) {
+            auto pos = rng() % stream.size();
+            segs.emplace_back(pos, std::min<size_t>(1 + rng() % 3000, stream.size() - pos));
+        }
+        std::shuffle(segs.begin(), segs.end(), rng);
+
+        // Start close to the end of the sequence space
+        auto base = make_seq(uint32_t(-1) - rng() % 10000);
+        auto next = base;
+        packet_reassembly_queue<tcp_seq> q;
+        std::string out;
+        for (auto &&s : segs) {
+            auto seq = base + int32_t(s.first);
+            auto len = s.second;
+            auto off = s.first;
+            if (seq < next) {
+                // What the tcb trims before queueing
+                auto dup = size_t(next - seq);
+                if (dup >= len) {
+                    continue;
+                }
+                seq = next;
+                off += dup;
+                len -= dup;
+            }
+            if (seq == next) {
+                out.append(stream, off, len);
+                next = q.pop_front(next + int32_t(len), [&](packet p) { out += contents(p); });
+            } else {
+                q.insert(seq, packet(stream.data() + off, len));
+            }
+        }
+        BOOST_REQUIRE(q.empty());
+        BOOST_REQUIRE_EQUAL(q.bytes(), 0u);
+        BOOST_REQUIRE(out == stream);
+    }
+}
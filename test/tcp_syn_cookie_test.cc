@@ -0,0 +1,177 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
+#include <nil/actor/network/loopback.hh>
+#include <nil/actor/network/ip.hh>
+#include <nil/actor/network/tcp.hh>
+#include <nil/actor/network/tcp-stack.hh>
+#include <nil/actor/network/siphash.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/thread.hh>
+
+using namespace nil::actor;
+using namespace net;
+
+namespace {
+
+    struct ipv4_node {
+        interface netif;
+        ipv4 inet;
+
+        static std::shared_ptr<device> start(std::shared_ptr<device> dev) {
+            dev->set_local_queue(dev->init_local_queue({}, this_shard_id()));
+            return dev;
+        }
+
+        ipv4_node(std::shared_ptr<device> dev, const char *addr) : netif(start(std::move(dev))), inet(&netif) {
+            inet.set_host_address(ipv4_address(addr));
+            inet.set_netmask_address(ipv4_address("255.255.255.0"));
+            inet.set_arp_learn_hook([this](ethernet_address l2, ipv4_address l3) { inet.learn(l2, l3); });
+        }
+    };
+
+    // Two stacks on the current shard, talking to each other. The device queues
+    // outlive the test cases, so the stacks are never torn down.
+    struct ipv4_link {
+        ipv4_node client;
+        ipv4_node server;
+
+        explicit ipv4_link(std::pair<std::shared_ptr<device>, std::shared_ptr<device>> devs) :
+            client(std::move(devs.first), "10.0.0.1"), server(std::move(devs.second), "10.0.0.2") {
+        }
+    };
+
+    ipv4_link &local_link() {
+        static thread_local ipv4_link *link = new ipv4_link(create_loopback_device_pair());
+        return *link;
+    }
+
+    connected_socket connect_to(ipv4_link &link, uint16_t port) {
+        return tcpv4_socket(link.client.inet.get_tcp()).connect(socket_address(ipv4_addr("10.0.0.2", port))).get0();
+    }
+
+}    // namespace
+
+ACTOR_TEST_CASE(test_siphash_reference_vectors) {
+    // From the SipHash paper: key 00 01 .. 0f, messages 00 01 .. of growing length
+    siphash_key key {0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull};
+    uint8_t msg[15];
+    for (unsigned i = 0; i < sizeof(msg); ++i) {
+        msg[i] = i;
+    }
+    BOOST_REQUIRE_EQUAL(siphash(key, msg, 0), 0x726fdb47dd0e0e31ull);
+    BOOST_REQUIRE_EQUAL(siphash(key, msg, 8), 0x93f5f5799a932462ull);
+    BOOST_REQUIRE_EQUAL(siphash(key, msg, 15), 0xa129ca6149be45e5ull);
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_syn_cookie_options) {
+    tcp_option syn;
+    syn._mss_received = true;
+    syn._remote_mss = 1400;
+    syn._win_scale_received = true;
+    syn._remote_win_scale = 9;
+    syn._sack_received = true;
+    auto bits = syn_cookie::encode_options(syn);
+    BOOST_REQUIRE(bits);
+    BOOST_REQUIRE_LT(*bits, 1u << syn_cookie::option_bits);
+
+    tcp_option restored;
+    syn_cookie::decode_options(*bits, restored);
+    // The MSS is rounded down to a value the cookie can carry
+    BOOST_REQUIRE_EQUAL(restored._remote_mss, 1220);
+    BOOST_REQUIRE(restored._win_scale_received);
+    BOOST_REQUIRE_EQUAL(restored._remote_win_scale, 9);
+    BOOST_REQUIRE(restored._sack_received);
+
+    tcp_option bare;
+    syn_cookie::decode_options(*syn_cookie::encode_options(tcp_option()), bare);
+    BOOST_REQUIRE_EQUAL(bare._remote_mss, 536);
+    BOOST_REQUIRE(!bare._win_scale_received);
+    BOOST_REQUIRE(!bare._sack_received);
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_syn_cookie_small_mss) {
+    // A cookie cannot carry an MSS below 536, so such SYNs get no cookie at all
+    tcp_option syn;
+    syn._mss_received = true;
+    syn._remote_mss = 100;
+    BOOST_REQUIRE(!syn_cookie::encode_options(syn));
+
+    syn._remote_mss = 536;
+    auto bits = syn_cookie::encode_options(syn);
+    BOOST_REQUIRE(bits);
+    tcp_option restored;
+    syn_cookie::decode_options(*bits, restored);
+    BOOST_REQUIRE_EQUAL(restored._remote_mss, 536);
+    return make_ready_future<>();
+}
+
+ACTOR_THREAD_TEST_CASE(test_syn_cookie_when_backlog_full) {
+    auto &link = local_link();
+    listen_options lo;
+    lo.listen_backlog = 1;
+    auto ss = tcpv4_listen(link.server.inet.get_tcp(), 10000, lo);
+
+    auto first = connect_to(link, 10000);
+    // The backlog is full until the first connection is accepted: the second
+    // handshake completes with a cookie, and its final ACK is dropped.
+    auto second = connect_to(link, 10000);
+    auto a1 = ss.accept().get0();
+
+    // Data from the second client carries the cookie again, now with room for it
+    auto out = second.output();
+    out.write("cookie").get();
+    out.flush().get();
+    auto a2 = ss.accept().get0();
+    auto in = a2.connection.input();
+    sstring received;
+    while (received.size() < 6) {
+        auto buf = in.read().get0();
+        BOOST_REQUIRE(!buf.empty());
+        received += sstring(buf.get(), buf.size());
+    }
+    BOOST_REQUIRE_EQUAL(received, "cookie");
+
+    out.close().get();
+    in.close().get();
+    ss.abort_accept();
+}
+
+ACTOR_THREAD_TEST_CASE(test_full_backlog_without_syn_cookies) {
+    auto &link = local_link();
+    link.server.inet.get_tcp().set_syn_cookies(false);
+    listen_options lo;
+    lo.listen_backlog = 1;
+    auto ss = tcpv4_listen(link.server.inet.get_tcp(), 10001, lo);
+
+    auto first = connect_to(link, 10001);
+    BOOST_REQUIRE_THROW(connect_to(link, 10001), std::exception);
+
+    link.server.inet.get_tcp().set_syn_cookies(true);
+    ss.abort_accept();
+}
@@ -0,0 +1,189 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <nil/actor/testing/test_case.hh>
+#include <nil/actor/testing/thread_test_case.hh>
+#include <nil/actor/network/timer_wheel.hh>
+#include <nil/actor/core/sleep.hh>
+#include <nil/actor/core/thread.hh>
+
+#include <random>
+#include <vector>
+
+using namespace nil::actor;
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+    using clock_type = timer_wheel::clock_type;
+
+    // lowres_clock is only updated by the reactor, so a timer may fire up to a
+    // tick of the clock and a tick of the wheel after its deadline.
+    constexpr auto slack = 100ms;
+
+    void wait_until(const bool &done, clock_type::duration limit) {
+        auto end = clock_type::now() + limit;
+        while (!done && clock_type::now() < end) {
+            sleep(1ms).get();
+        }
+    }
+
+}    // namespace
+
+ACTOR_THREAD_TEST_CASE(test_fires_after_deadline) {
+    timer_wheel wheel;
+    bool fired = false;
+    clock_type::time_point fired_at;
+    wheel_timer t(wheel, [&] {
+        fired = true;
+        fired_at = clock_type::now();
+    });
+    auto deadline = clock_type::now() + 50ms;
+    t.arm(deadline);
+    BOOST_REQUIRE(t.armed());
+    wait_until(fired, 1s);
+    BOOST_REQUIRE(fired);
+    BOOST_REQUIRE(fired_at >= deadline);
+    BOOST_REQUIRE(fired_at <= deadline + slack);
+    BOOST_REQUIRE(!t.armed());
+    BOOST_REQUIRE_EQUAL(wheel.size(), 0u);
+}
+
+ACTOR_THREAD_TEST_CASE(test_rearm_later_is_deferred) {
+    timer_wheel wheel;
+    bool fired = false;
+    clock_type::time_point fired_at;
+    wheel_timer t(wheel, [&] {
+        fired = true;
+        fired_at = clock_type::now();
+    });
+    t.arm(30ms);
+    // Pushing the deadline back repeatedly, the way every ACK pushes back the
+    // retransmission timeout, does not touch the wheel.
+    clock_type::time_point deadline;
+    for (unsigned i = 0; i < 10; ++i) {
+        deadline = clock_type::now() + 100ms;
+        t.rearm(deadline);
+    }
+    BOOST_REQUIRE_EQUAL(wheel.get_stats().rearms, 11u);
+    BOOST_REQUIRE_EQUAL(wheel.get_stats().deferred, 10u);
+    wait_until(fired, 1s);
+    BOOST_REQUIRE(fired);
+    BOOST_REQUIRE(fired_at >= deadline);
+    BOOST_REQUIRE_GE(wheel.get_stats().reinserted, 1u);
+    BOOST_REQUIRE_EQUAL(wheel.get_stats().expired, 1u);
+}
+
+ACTOR_THREAD_TEST_CASE(test_rearm_earlier) {
+    timer_wheel wheel;
+    bool fired = false;
+    clock_type::time_point fired_at;
+    wheel_timer t(wheel, [&] {
+        fired = true;
+        fired_at = clock_type::now();
+    });
+    t.arm(10s);
+    auto deadline = clock_type::now() + 30ms;
+    t.rearm(deadline);
+    wait_until(fired, 1s);
+    BOOST_REQUIRE(fired);
+    BOOST_REQUIRE(fired_at >= deadline);
+    BOOST_REQUIRE(fired_at <= deadline + slack);
+    BOOST_REQUIRE_EQUAL(wheel.size(), 0u);
+}
+
+ACTOR_THREAD_TEST_CASE(test_cancel) {
+    timer_wheel wheel;
+    unsigned fired = 0;
+    wheel_timer cancelled(wheel, [&] { ++fired; });
+    cancelled.arm(20ms);
+    BOOST_REQUIRE(cancelled.cancel());
+    BOOST_REQUIRE(!cancelled.cancel());
+    {
+        wheel_timer t(wheel, [&] { ++fired; });
+        t.arm(20ms);
+        BOOST_REQUIRE_EQUAL(wheel.size(), 2u);
+    }
+    BOOST_REQUIRE_EQUAL(wheel.size(), 1u);
+    sleep(100ms).get();
+    BOOST_REQUIRE_EQUAL(fired, 0u);
+    // A cancelled timer leaves the wheel when its slot comes
+    BOOST_REQUIRE_EQUAL(wheel.size(), 0u);
+    BOOST_REQUIRE_EQUAL(wheel.get_stats().expired, 0u);
+}
+
+ACTOR_THREAD_TEST_CASE(test_many_timers) {
+    // Deadlines up to 3s, beyond the first level of the wheel, so that timers
+    // are cascaded down before they fire
+    timer_wheel wheel;
+    const unsigned count = 1000;
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> delay(0, 3000);
+    std::vector<std::unique_ptr<wheel_timer>> timers;
+    std::vector<clock_type::time_point> deadlines(count);
+    std::vector<clock_type::time_point> fired_at(count);
+    unsigned fired = 0;
+    auto start = clock_type::now();
+    for (unsigned i = 0; i < count; ++i) {
+        timers.push_back(std::make_unique<wheel_timer>(wheel, [&, i] {
+            fired_at[i] = clock_type::now();
+            ++fired;
+        }));
+        deadlines[i] = start + std::chrono::milliseconds(delay(rng));
+        timers[i]->arm(deadlines[i]);
+    }
+    while (fired < count && clock_type::now() < start + 10s) {
+        sleep(10ms).get();
+    }
+    BOOST_REQUIRE_EQUAL(fired, count);
+    for (unsigned i = 0; i < count; ++i) {
+        BOOST_REQUIRE(fired_at[i] >= deadlines[i]);
+        BOOST_REQUIRE(fired_at[i] <= deadlines[i] + slack);
+    }
+    BOOST_REQUIRE_GT(wheel.get_stats().cascaded, 0u);
+    BOOST_REQUIRE_EQUAL(wheel.get_stats().expired, count);
+    BOOST_REQUIRE_EQUAL(wheel.size(), 0u);
+}
+
+ACTOR_THREAD_TEST_CASE(test_timers_outlive_wheel) {
+    auto wheel = std::make_unique<timer_wheel>();
+    unsigned fired = 0;
+    wheel_timer armed(*wheel, [&] { ++fired; });
+    wheel_timer idle(*wheel, [&] { ++fired; });
+    auto scheduled = std::make_unique<wheel_timer>(*wheel, [&] { ++fired; });
+    armed.arm(20ms);
+    scheduled->arm(20ms);
+    BOOST_REQUIRE_EQUAL(wheel->size(), 2u);
+    wheel.reset();
+    BOOST_REQUIRE(!armed.armed());
+    // Detached timers can still be armed and destroyed, and never fire
+    scheduled.reset();
+    idle.arm(10ms);
+    armed.rearm(clock_type::now() + 10ms);
+    BOOST_REQUIRE(!idle.armed());
+    BOOST_REQUIRE(!armed.cancel());
+    sleep(100ms).get();
+    BOOST_REQUIRE_EQUAL(fired, 0u);
+}
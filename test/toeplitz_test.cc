@@ -0,0 +1,96 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <nil/actor/network/toeplitz.hh>
+#include <nil/actor/network/net.hh>
+
+#include <random>
+#include <vector>
+
+using namespace nil::actor;
+
+namespace {
+
+    // The key of the Microsoft RSS verification suite
+    const uint8_t verification_key_v[] = {0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+                                          0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+                                          0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+                                          0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa};
+    const rss_key_type verification_key {verification_key_v, sizeof(verification_key_v)};
+
+}    // namespace
+
+BOOST_AUTO_TEST_CASE(test_verification_suite) {
+    // 66.9.149.187:2794 -> 161.142.100.80:1766
+    const std::vector<uint8_t> v4 = {66, 9, 149, 187, 161, 142, 100, 80, 0x0a, 0xea, 0x06, 0xe6};
+    // [3ffe:2501:200:1fff::7]:2794 -> [3ffe:2501:200:3::1]:1766
+    const std::vector<uint8_t> v6 = {0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x1f, 0xff, 0, 0, 0, 0, 0, 0, 0, 7,
+                                     0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x00, 0x03, 0, 0, 0, 0, 0, 0, 0, 1,
+                                     0x0a, 0xea, 0x06, 0xe6};
+    for (auto &&impl : toeplitz_implementations()) {
+        BOOST_TEST_CONTEXT(impl.name) {
+            BOOST_CHECK_EQUAL(impl.hash(verification_key, v4.data(), 8), 0x323e8fc2u);
+            BOOST_CHECK_EQUAL(impl.hash(verification_key, v4.data(), v4.size()), 0x51ccc178u);
+            BOOST_CHECK_EQUAL(impl.hash(verification_key, v6.data(), 32), 0x2cc18cd5u);
+            BOOST_CHECK_EQUAL(impl.hash(verification_key, v6.data(), v6.size()), 0x40207d3du);
+        }
+    }
+    BOOST_CHECK_EQUAL(toeplitz_hash(verification_key, v4), 0x51ccc178u);
+}
+
+BOOST_AUTO_TEST_CASE(test_implementations_match_reference) {
+    auto &impls = toeplitz_implementations();
+    BOOST_REQUIRE_EQUAL(impls.front().name, std::string("bitwise"));
+    auto reference = impls.front().hash;
+
+    std::mt19937 rng(40);
+    std::uniform_int_distribution<int> byte_dist(0, 255);
+    // Up to the size of forward_hash, which is longer than either key
+    std::uniform_int_distribution<size_t> len_dist(0, 64);
+    for (auto key : {default_rsskey_40bytes, default_rsskey_52bytes}) {
+        for (unsigned i = 0; i < 100000; ++i) {
+            uint8_t data[64];
+            for (auto &b : data) {
+                b = byte_dist(rng);
+            }
+            auto len = len_dist(rng);
+            auto expected = reference(key, data, len);
+            for (auto &&impl : impls) {
+                BOOST_REQUIRE_MESSAGE(impl.hash(key, data, len) == expected,
+                                      impl.name << " differs for a " << len << " bytes input");
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_forward_hash) {
+    net::forward_hash data;
+    for (uint8_t b : {66, 9, 149, 187, 161, 142, 100, 80}) {
+        data.push_back(b);
+    }
+    BOOST_CHECK_EQUAL(toeplitz_hash(verification_key, data), 0x323e8fc2u);
+}